@@ -0,0 +1,108 @@
+#version 450
+
+// has to match BLOOM_MODE_* in Renderer.h
+#define BLOOM_MODE_PREFILTER 0u
+#define BLOOM_MODE_DOWNSAMPLE 1u
+#define BLOOM_MODE_UPSAMPLE 2u
+
+#define BLOOM_THRESHOLD 1.0
+#define BLOOM_KNEE 0.5
+
+layout(set=0, binding=0) uniform sampler2D s_source;
+layout(set=0, binding=1, rgba16f) uniform image2D u_target;
+
+// has to match BloomConstants in Renderer.h
+layout(push_constant, std430) uniform BloomPC {
+    // the part of the source the scene was rendered into
+    vec2 uv_scale;
+    vec2 uv_max;
+    uint mode;
+};
+
+layout(local_size_x=8, local_size_y=8, local_size_z=1) in;
+
+// soft knee around the threshold so bright areas don't pop in
+vec3 Threshold(vec3 col) {
+    float brightness = max(col.r, max(col.g, col.b));
+    float soft = clamp(brightness - BLOOM_THRESHOLD + BLOOM_KNEE, 0.0, 2.0 * BLOOM_KNEE);
+    soft = soft * soft / (4.0 * BLOOM_KNEE + 0.00001);
+    float contribution = max(soft, brightness - BLOOM_THRESHOLD) / max(brightness, 0.00001);
+    return col * contribution;
+}
+
+// 4x4 box out of four bilinear taps, each thresholded on its own and
+// weighted down by its brightness so single hot pixels don't flicker.
+// Reads the render target, which only holds the scene in its scaled part.
+vec3 Prefilter(vec2 uv, vec2 texel) {
+    uv *= uv_scale;
+
+    vec3 result = vec3(0.0);
+    float total = 0.0;
+    for (int y = -1; y <= 1; y += 2) {
+        for (int x = -1; x <= 1; x += 2) {
+            vec2 tap = min(uv + texel * vec2(x, y), uv_max);
+            vec3 col = Threshold(textureLod(s_source, tap, 0.0).rgb);
+            float weight = 1.0 / (1.0 + max(col.r, max(col.g, col.b)));
+            result += col * weight;
+            total += weight;
+        }
+    }
+
+    return result / total;
+}
+
+// 13 taps as five overlapping 4x4 boxes, the center one weighted the most
+vec3 Downsample(vec2 uv, vec2 texel) {
+    vec3 a = textureLod(s_source, uv + texel * vec2(-2.0, 2.0), 0.0).rgb;
+    vec3 b = textureLod(s_source, uv + texel * vec2(0.0, 2.0), 0.0).rgb;
+    vec3 c = textureLod(s_source, uv + texel * vec2(2.0, 2.0), 0.0).rgb;
+    vec3 d = textureLod(s_source, uv + texel * vec2(-2.0, 0.0), 0.0).rgb;
+    vec3 e = textureLod(s_source, uv, 0.0).rgb;
+    vec3 f = textureLod(s_source, uv + texel * vec2(2.0, 0.0), 0.0).rgb;
+    vec3 g = textureLod(s_source, uv + texel * vec2(-2.0, -2.0), 0.0).rgb;
+    vec3 h = textureLod(s_source, uv + texel * vec2(0.0, -2.0), 0.0).rgb;
+    vec3 i = textureLod(s_source, uv + texel * vec2(2.0, -2.0), 0.0).rgb;
+    vec3 j = textureLod(s_source, uv + texel * vec2(-1.0, 1.0), 0.0).rgb;
+    vec3 k = textureLod(s_source, uv + texel * vec2(1.0, 1.0), 0.0).rgb;
+    vec3 l = textureLod(s_source, uv + texel * vec2(-1.0, -1.0), 0.0).rgb;
+    vec3 m = textureLod(s_source, uv + texel * vec2(1.0, -1.0), 0.0).rgb;
+
+    return e * 0.125 + (a + c + g + i) * 0.03125 + (b + d + f + h) * 0.0625 + (j + k + l + m) * 0.125;
+}
+
+// 3x3 tent over the smaller mip
+vec3 UpsampleTent(vec2 uv, vec2 texel) {
+    vec3 result = textureLod(s_source, uv, 0.0).rgb * 4.0;
+    result += textureLod(s_source, uv + texel * vec2(-1.0, 0.0), 0.0).rgb * 2.0;
+    result += textureLod(s_source, uv + texel * vec2(1.0, 0.0), 0.0).rgb * 2.0;
+    result += textureLod(s_source, uv + texel * vec2(0.0, -1.0), 0.0).rgb * 2.0;
+    result += textureLod(s_source, uv + texel * vec2(0.0, 1.0), 0.0).rgb * 2.0;
+    result += textureLod(s_source, uv + texel * vec2(-1.0, -1.0), 0.0).rgb;
+    result += textureLod(s_source, uv + texel * vec2(1.0, -1.0), 0.0).rgb;
+    result += textureLod(s_source, uv + texel * vec2(-1.0, 1.0), 0.0).rgb;
+    result += textureLod(s_source, uv + texel * vec2(1.0, 1.0), 0.0).rgb;
+    return result / 16.0;
+}
+
+void main() {
+    ivec2 size = imageSize(u_target);
+    ivec2 p = ivec2(gl_GlobalInvocationID.xy);
+    if (p.x >= size.x || p.y >= size.y) {
+        return;
+    }
+
+    vec2 uv = (vec2(p) + 0.5) / vec2(size);
+    vec2 texel = 1.0 / vec2(textureSize(s_source, 0));
+
+    vec3 result;
+    if (mode == BLOOM_MODE_PREFILTER) {
+        result = Prefilter(uv, texel);
+    } else if (mode == BLOOM_MODE_DOWNSAMPLE) {
+        result = Downsample(uv, texel);
+    } else {
+        // adds onto what the way down left in this mip
+        result = imageLoad(u_target, p).rgb + UpsampleTent(uv, texel);
+    }
+
+    imageStore(u_target, p, vec4(result, 1.0));
+}
@@ -2,6 +2,16 @@
 
 #define GAMMA 2.2
 
+// has to match SHADOW_CASCADE_COUNT in Renderer.h
+#define SHADOW_CASCADE_COUNT 4u
+
+// has to match ShadowMode in Renderer.h
+#define SHADOW_MODE_PCF 0u
+#define SHADOW_MODE_EVSM 1u
+
+// cuts the tail of the Chebyshev bound off where light leaks through
+const float evsm_light_bleed_reduction = 0.25;
+
 struct DirectionalLight {
 	vec3 color;
 	vec3 direction;
@@ -33,10 +43,9 @@ vec3 SampleLinear(sampler2D tex, vec2 uv) {
     return pow(sampled.rgb, vec3(GAMMA));
 }
 
-vec2 DistortShadow(vec2 position) {
-    float cd = length(position);
-    float factor = mix(1.0f, cd, 0.9f);
-    return position / factor;
+vec3 SampleLinear(sampler2DArray tex, vec3 uv) {
+    vec4 sampled = texture(tex, uv);
+    return pow(sampled.rgb, vec3(GAMMA));
 }
 
 vec3 CalculateDiffuse(vec3 normal, vec3 color) {
@@ -54,9 +63,26 @@ vec3 CalculateSpecular(vec3 normal, vec3 view_dir, float shininess) {
     return spec * sun_light.color;
 }
 
-float ShadowCalculation(vec4 shadow_pos, vec3 normal, sampler2D shadow_map, sampler2D noise_tex) {
+// first cascade whose split is past view_depth, SHADOW_CASCADE_COUNT when
+// it's further than all of them
+uint SelectShadowCascade(float view_depth, vec4 cascade_splits) {
+    for (uint i = 0; i < SHADOW_CASCADE_COUNT; ++i) {
+        if (view_depth < cascade_splits[i]) {
+            return i;
+        }
+    }
+
+    return SHADOW_CASCADE_COUNT;
+}
+
+// The windows wrap around their layers, window_offset is where this one
+// starts; the sampler repeats.
+float ShadowCalculation(vec4 shadow_pos, uint cascade, vec2 window_offset, vec3 normal, sampler2DArray shadow_map, sampler2D noise_tex) {
+    if (cascade >= SHADOW_CASCADE_COUNT) {
+        return 0.0;
+    }
+
     vec3 shadow_coords = shadow_pos.xyz / shadow_pos.w;
-    shadow_coords.xy = DistortShadow(shadow_coords.xy);
     shadow_coords.xy = shadow_coords.xy * 0.5 + 0.5;
 
     if (shadow_coords.z >= 1.0 || shadow_coords.z < 0.0) {
@@ -70,17 +96,71 @@ float ShadowCalculation(vec4 shadow_pos, vec3 normal, sampler2D shadow_map, samp
 
     // vec2 texel_size = vec2(1.0) / textureSize(shadow_map, 0);
     float shadow = 0.0;
-    float bias = max(0.001 * (1.0 - dot(normal, sun_light.direction)), 0.0001);
+    // texels of the further cascades cover more ground
+    float bias = max(0.001 * (1.0 - dot(normal, sun_light.direction)), 0.0001) * float(cascade + 1);
     for (int i = 0; i < 9; i++) {
         // vec2 shadow_offset = shadow_offsets[i] * texel_size;
         vec2 shadow_offset = rot * shadow_offsets[i];
-        float depth = texture(shadow_map, shadow_coords.xy + shadow_offset).r;
+        float depth = texture(shadow_map, vec3(shadow_coords.xy + window_offset + shadow_offset, float(cascade))).r;
         shadow += (shadow_coords.z - bias > depth) ? 1.0 : 0.0;
     }
 
     return shadow / 9.0;
 }
 
+// depth in [0, 1] to the positive and negative exponential. The exponents
+// come from the renderer, as high as the moments' format allows.
+vec2 WarpShadowDepth(float depth, vec2 exponents) {
+    depth = 2.0 * depth - 1.0;
+    return vec2(exp(exponents.x * depth), -exp(-exponents.y * depth));
+}
+
+// x, y: warped depth and its square, z, w: the same for the negative exponent
+vec4 ShadowMoments(float depth, vec2 exponents) {
+    vec2 warped = WarpShadowDepth(depth, exponents);
+    return vec4(warped.x, warped.x * warped.x, warped.y, warped.y * warped.y);
+}
+
+// upper bound of the lit fraction
+float ChebyshevUpperBound(vec2 moments, float mean, float min_variance) {
+    float variance = max(moments.y - moments.x * moments.x, min_variance);
+    float d = mean - moments.x;
+    float p_max = variance / (variance + d * d);
+    p_max = clamp((p_max - evsm_light_bleed_reduction) / (1.0 - evsm_light_bleed_reduction), 0.0, 1.0);
+    return mean <= moments.x ? 1.0 : p_max;
+}
+
+// Same contract as ShadowCalculation, from the blurred moments of the
+// cascade with a single filtered fetch.
+float ShadowCalculationEVSM(vec4 shadow_pos, uint cascade, vec2 window_offset, vec3 normal, sampler2DArray moments_map,
+    vec2 exponents) {
+    if (cascade >= SHADOW_CASCADE_COUNT) {
+        return 0.0;
+    }
+
+    vec3 shadow_coords = shadow_pos.xyz / shadow_pos.w;
+    shadow_coords.xy = shadow_coords.xy * 0.5 + 0.5;
+
+    if (shadow_coords.z >= 1.0 || shadow_coords.z < 0.0) {
+        return 0.0;
+    }
+
+    vec4 moments = texture(moments_map, vec3(shadow_coords.xy + window_offset, float(cascade)));
+
+    // a much smaller bias than PCF needs, the variance floor does the rest
+    float bias = 0.0002 * float(cascade + 1);
+    vec2 warped = WarpShadowDepth(shadow_coords.z - bias, exponents);
+
+    // floor scaled by the warp's slope so both exponents get the same one in depth
+    vec2 depth_scale = 0.0001 * exponents * warped;
+    vec2 min_variance = depth_scale * depth_scale;
+
+    float lit_positive = ChebyshevUpperBound(moments.xy, warped.x, min_variance.x);
+    float lit_negative = ChebyshevUpperBound(moments.zw, warped.y, min_variance.y);
+
+    return 1.0 - min(lit_positive, lit_negative);
+}
+
 float FresnelSchlick(float cosTheta, float F0) {
     return F0 + (1.0 - F0) * pow(clamp(1.0 - cosTheta, 0.0, 1.0), 5.0);
 }
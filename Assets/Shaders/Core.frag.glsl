@@ -1,6 +1,5 @@
 #version 450
 
-#extension GL_EXT_nonuniform_qualifier: require
 #extension GL_GOOGLE_include_directive: require
 
 #include "Common.h"
@@ -8,24 +7,28 @@
 layout(set=0, binding=0) uniform GlobalsUniform {
     mat4 proj_matrix;
     mat4 view_matrix;
-    mat4 light_space_matrix;
+    mat4 light_space_matrices[SHADOW_CASCADE_COUNT];
+    vec4 cascade_splits;
+    vec4 shadow_window_offsets[SHADOW_CASCADE_COUNT];
     vec3 camera_pos;
+    uint shadow_mode;
+    vec2 evsm_exponents;
 };
 
-layout(set=0, binding=2) uniform sampler2D s_textures[];
-layout(set=0, binding=3) uniform sampler2D s_shadow;
+layout(set=0, binding=2) uniform sampler2DArray s_textures;
+layout(set=0, binding=3) uniform sampler2DArray s_shadow;
 layout(set=0, binding=4) uniform sampler2D s_noise;
+layout(set=0, binding=5) uniform sampler2DArray s_shadow_moments;
 
 layout(location=0) in vec3 p_world_pos;
 layout(location=1) in vec3 p_normal;
 layout(location=2) in vec2 p_uv;
-layout(location=3) in vec4 p_shadow_pos;
 layout(location=4) flat in uint p_texture;
 
 layout(location=0) out vec4 color;
 
 void main() {
-    vec3 albedo = SampleLinear(s_textures[p_texture], p_uv);
+    vec3 albedo = SampleLinear(s_textures, vec3(p_uv, float(p_texture)));
 
     vec3 N = normalize(p_normal);
     vec3 V = normalize(camera_pos - p_world_pos);
@@ -36,7 +39,14 @@ void main() {
     float metallic = 0;
     float F0 = 0.04;
 
-    float shadow = ShadowCalculation(p_shadow_pos, N, s_shadow, s_noise);
+    float view_depth = -(view_matrix * vec4(p_world_pos, 1.0)).z;
+    uint cascade = SelectShadowCascade(view_depth, cascade_splits);
+    uint clamped_cascade = min(cascade, SHADOW_CASCADE_COUNT - 1);
+    vec4 shadow_pos = light_space_matrices[clamped_cascade] * vec4(p_world_pos, 1.0);
+    vec2 window_offset = shadow_window_offsets[clamped_cascade].xy;
+    float shadow = shadow_mode == SHADOW_MODE_EVSM ?
+        ShadowCalculationEVSM(shadow_pos, cascade, window_offset, N, s_shadow_moments, evsm_exponents) :
+        ShadowCalculation(shadow_pos, cascade, window_offset, N, s_shadow, s_noise);
     vec3 lighting = CalculatePBR(N, V, L, H, roughness, metallic, F0, albedo, shadow);
     float fresnel = mix(0.3, 1.0, FresnelSchlick(max(dot(N, V), 0.0), F0));
 
@@ -1,5 +1,9 @@
 #version 450
 
+#extension GL_GOOGLE_include_directive: require
+
+#include "Common.h"
+
 struct InstanceData {
     float px, py, pz;
     uint side;
@@ -9,8 +13,12 @@ struct InstanceData {
 layout(set=0, binding=0) uniform GlobalsUniform {
     mat4 proj_matrix;
     mat4 view_matrix;
-    mat4 light_space_matrix;
+    mat4 light_space_matrices[SHADOW_CASCADE_COUNT];
+    vec4 cascade_splits;
+    vec4 shadow_window_offsets[SHADOW_CASCADE_COUNT];
     vec3 camera_pos;
+    uint shadow_mode;
+    vec2 evsm_exponents;
 };
 
 layout(set=0, binding=1) readonly buffer InstanceBuffer {
@@ -77,10 +85,12 @@ const uint indices[] = {
     0, 2, 3
 };
 
+// the depth prepass and the solid pass have to land on the same depth
+invariant gl_Position;
+
 layout(location=0) out vec3 p_world_pos;
 layout(location=1) out vec3 p_normal;
 layout(location=2) out vec2 p_uv;
-layout(location=3) out vec4 p_shadow_pos;
 layout(location=4) flat out uint p_texture;
 
 void main() {
@@ -102,6 +112,5 @@ void main() {
     p_world_pos = pos.xyz;
     p_normal = normal;
     p_uv = uv;
-    p_shadow_pos = light_space_matrix * pos;
     p_texture = instance.texture;
 }
@@ -0,0 +1,159 @@
+#version 450
+
+#extension GL_GOOGLE_include_directive: require
+
+#include "Common.h"
+
+layout(location=0) in vec2 p_uv;
+
+layout(location=0) out vec4 color;
+
+// gamma encoded color, luma in alpha
+layout(set=0, binding=0) uniform sampler2D s_ldr;
+
+// below this contrast, relative to the brightest neighbour, it's no edge
+#define FXAA_EDGE_THRESHOLD 0.125
+// and nothing this dark is
+#define FXAA_EDGE_THRESHOLD_MIN 0.0312
+#define FXAA_SUBPIXEL_QUALITY 0.75
+#define FXAA_SEARCH_STEPS 12
+
+// walked along the edge, longer strides further out
+const float fxaa_search_strides[FXAA_SEARCH_STEPS] = {
+    1.0, 1.0, 1.0, 1.0, 1.0, 1.5, 2.0, 2.0, 2.0, 2.0, 4.0, 8.0
+};
+
+float LumaAt(vec2 uv) {
+    return textureLod(s_ldr, uv, 0.0).a;
+}
+
+float LumaAt(vec2 uv, ivec2 offset) {
+    return textureLodOffset(s_ldr, uv, 0.0, offset).a;
+}
+
+// Finds the edge through the pixel, walks along it to both ends and blends
+// with the neighbour across it by how close the nearer end is.
+vec3 ApplyFXAA(vec2 uv) {
+    vec2 inv_size = 1.0 / vec2(textureSize(s_ldr, 0));
+
+    vec4 center = textureLod(s_ldr, uv, 0.0);
+    float luma_center = center.a;
+    float luma_down = LumaAt(uv, ivec2(0, -1));
+    float luma_up = LumaAt(uv, ivec2(0, 1));
+    float luma_left = LumaAt(uv, ivec2(-1, 0));
+    float luma_right = LumaAt(uv, ivec2(1, 0));
+
+    float luma_min = min(luma_center, min(min(luma_down, luma_up), min(luma_left, luma_right)));
+    float luma_max = max(luma_center, max(max(luma_down, luma_up), max(luma_left, luma_right)));
+    float luma_range = luma_max - luma_min;
+
+    // most pixels leave here after five taps
+    if (luma_range < max(FXAA_EDGE_THRESHOLD_MIN, luma_max * FXAA_EDGE_THRESHOLD)) {
+        return center.rgb;
+    }
+
+    float luma_down_left = LumaAt(uv, ivec2(-1, -1));
+    float luma_up_right = LumaAt(uv, ivec2(1, 1));
+    float luma_up_left = LumaAt(uv, ivec2(-1, 1));
+    float luma_down_right = LumaAt(uv, ivec2(1, -1));
+
+    float luma_down_up = luma_down + luma_up;
+    float luma_left_right = luma_left + luma_right;
+    float luma_left_corners = luma_down_left + luma_up_left;
+    float luma_down_corners = luma_down_left + luma_down_right;
+    float luma_right_corners = luma_down_right + luma_up_right;
+    float luma_up_corners = luma_up_right + luma_up_left;
+
+    float edge_horizontal = abs(-2.0 * luma_left + luma_left_corners) + abs(-2.0 * luma_center + luma_down_up) * 2.0 +
+        abs(-2.0 * luma_right + luma_right_corners);
+    float edge_vertical = abs(-2.0 * luma_up + luma_up_corners) + abs(-2.0 * luma_center + luma_left_right) * 2.0 +
+        abs(-2.0 * luma_down + luma_down_corners);
+    bool is_horizontal = edge_horizontal >= edge_vertical;
+
+    // which side of the pixel the edge is on
+    float luma1 = is_horizontal ? luma_down : luma_left;
+    float luma2 = is_horizontal ? luma_up : luma_right;
+    float gradient1 = luma1 - luma_center;
+    float gradient2 = luma2 - luma_center;
+    bool is1_steepest = abs(gradient1) >= abs(gradient2);
+    float gradient_scaled = 0.25 * max(abs(gradient1), abs(gradient2));
+
+    float step_length = is_horizontal ? inv_size.y : inv_size.x;
+    float luma_local_average;
+    if (is1_steepest) {
+        step_length = -step_length;
+        luma_local_average = 0.5 * (luma1 + luma_center);
+    } else {
+        luma_local_average = 0.5 * (luma2 + luma_center);
+    }
+
+    // onto the edge itself, half a pixel over
+    vec2 edge_uv = uv;
+    if (is_horizontal) {
+        edge_uv.y += step_length * 0.5;
+    } else {
+        edge_uv.x += step_length * 0.5;
+    }
+
+    vec2 offset = is_horizontal ? vec2(inv_size.x, 0.0) : vec2(0.0, inv_size.y);
+    vec2 uv1 = edge_uv - offset;
+    vec2 uv2 = edge_uv + offset;
+    float luma_end1 = 0.0;
+    float luma_end2 = 0.0;
+    bool reached1 = false;
+    bool reached2 = false;
+
+    for (int i = 0; i < FXAA_SEARCH_STEPS; ++i) {
+        if (!reached1) {
+            luma_end1 = LumaAt(uv1) - luma_local_average;
+            reached1 = abs(luma_end1) >= gradient_scaled;
+        }
+        if (!reached2) {
+            luma_end2 = LumaAt(uv2) - luma_local_average;
+            reached2 = abs(luma_end2) >= gradient_scaled;
+        }
+        if (reached1 && reached2) {
+            break;
+        }
+
+        float stride = i + 1 < FXAA_SEARCH_STEPS ? fxaa_search_strides[i + 1] : 0.0;
+        if (!reached1) {
+            uv1 -= offset * stride;
+        }
+        if (!reached2) {
+            uv2 += offset * stride;
+        }
+    }
+
+    float distance1 = is_horizontal ? uv.x - uv1.x : uv.y - uv1.y;
+    float distance2 = is_horizontal ? uv2.x - uv.x : uv2.y - uv.y;
+    bool is_direction1 = distance1 < distance2;
+    float distance_final = min(distance1, distance2);
+    float edge_length = distance1 + distance2;
+
+    // only blend when the luma at the nearer end goes the other way than
+    // the center does, otherwise it's the far side of a corner
+    bool is_luma_center_smaller = luma_center < luma_local_average;
+    bool correct_variation = ((is_direction1 ? luma_end1 : luma_end2) < 0.0) != is_luma_center_smaller;
+    float pixel_offset = correct_variation ? -distance_final / edge_length + 0.5 : 0.0;
+
+    // single pixel features the edge walk can't see
+    float luma_average = (1.0 / 12.0) * (2.0 * (luma_down_up + luma_left_right) + luma_left_corners + luma_right_corners);
+    float subpixel = clamp(abs(luma_average - luma_center) / luma_range, 0.0, 1.0);
+    subpixel = (-2.0 * subpixel + 3.0) * subpixel * subpixel;
+    pixel_offset = max(pixel_offset, subpixel * subpixel * FXAA_SUBPIXEL_QUALITY);
+
+    vec2 final_uv = uv;
+    if (is_horizontal) {
+        final_uv.y += pixel_offset * step_length;
+    } else {
+        final_uv.x += pixel_offset * step_length;
+    }
+
+    return textureLod(s_ldr, final_uv, 0.0).rgb;
+}
+
+void main() {
+    vec3 aa = ApplyFXAA(p_uv);
+    color = vec4(pow(aa, vec3(GAMMA)), 1.0);
+}
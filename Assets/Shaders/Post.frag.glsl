@@ -9,10 +9,18 @@ layout(location=0) in vec2 p_uv;
 layout(location=0) out vec4 color;
 
 layout(set=0, binding=0) uniform sampler2D s_tex;
+layout(set=0, binding=1) uniform sampler2D s_bloom;
+
+// has to match RenderScaleConstants in Renderer.h
+layout(push_constant, std430) uniform PostPC {
+    // the part of s_tex the scene was rendered into
+    vec2 uv_scale;
+    vec2 uv_max;
+};
 
 #define EXPOSURE 1
-#define BLOOM_THRESHOLD 1.0
-#define BLOOM_INTENSITY 0.2
+// the bloom chain's top mip holds the sum of all of them
+#define BLOOM_INTENSITY 0.04
 #define VIGNETTE_INTENSITY 0.5
 #define BRIGHTNESS 0.9
 #define CONTRAST 1.0
@@ -24,22 +32,45 @@ vec3 ToneMapACES(vec3 col) {
     return col;
 }
 
+vec3 SampleScene(vec2 uv) {
+    return textureLod(s_tex, clamp(uv, vec2(0.0), uv_max), 0.0).rgb;
+}
+
+// Catmull-Rom out of nine bilinear taps, the lower the render scale the more
+// it beats plain bilinear. Can ring below zero around bright edges.
+vec3 UpscaleCatmullRom(vec2 uv) {
+    vec2 size = vec2(textureSize(s_tex, 0));
+    vec2 pos = uv * size;
+    vec2 center = floor(pos - 0.5) + 0.5;
+    vec2 f = pos - center;
+
+    vec2 w0 = f * (-0.5 + f * (1.0 - 0.5 * f));
+    vec2 w1 = 1.0 + f * f * (-2.5 + 1.5 * f);
+    vec2 w2 = f * (0.5 + f * (2.0 - 1.5 * f));
+    vec2 w3 = f * f * (-0.5 + 0.5 * f);
+
+    // the middle two texels per axis come out of one bilinear tap
+    vec2 w12 = w1 + w2;
+    vec2 uv0 = (center - 1.0) / size;
+    vec2 uv12 = (center + w2 / w12) / size;
+    vec2 uv3 = (center + 2.0) / size;
+
+    vec3 result = vec3(0.0);
+    result += SampleScene(vec2(uv0.x, uv0.y)) * w0.x * w0.y;
+    result += SampleScene(vec2(uv12.x, uv0.y)) * w12.x * w0.y;
+    result += SampleScene(vec2(uv3.x, uv0.y)) * w3.x * w0.y;
+    result += SampleScene(vec2(uv0.x, uv12.y)) * w0.x * w12.y;
+    result += SampleScene(vec2(uv12.x, uv12.y)) * w12.x * w12.y;
+    result += SampleScene(vec2(uv3.x, uv12.y)) * w3.x * w12.y;
+    result += SampleScene(vec2(uv0.x, uv3.y)) * w0.x * w3.y;
+    result += SampleScene(vec2(uv12.x, uv3.y)) * w12.x * w3.y;
+    result += SampleScene(vec2(uv3.x, uv3.y)) * w3.x * w3.y;
+
+    return max(result, vec3(0.0));
+}
+
 vec3 ApplyBloom(vec2 uv) {
-    vec3 bloom = vec3(0.0);
-    float count = 0.0;
-    for (int x = -1; x <= 1; x++) {
-        for (int y = -1; y <= 1; y++) {
-            vec2 offset = vec2(float(x), float(y)) / textureSize(s_tex, 0);
-            vec3 sampled = texture(s_tex, uv + offset).rgb;
-            if (length(sampled) > BLOOM_THRESHOLD) {
-                bloom += sampled;
-                count += 1.0;
-            }
-        }
-    }
-    if (count > 0.0)
-        bloom = (bloom / count) * BLOOM_INTENSITY;
-    return bloom;
+    return textureLod(s_bloom, uv, 0.0).rgb * BLOOM_INTENSITY;
 }
 
 vec3 Vignette(vec3 col, vec2 uv) {
@@ -56,18 +87,14 @@ vec3 ColorCorrect(vec3 col) {
     return col;
 }
 
-vec3 ApplyFXAA(vec2 uv) {
-    vec2 inv_res = 1.0 / textureSize(s_tex, 0);
-    vec3 col = texture(s_tex, uv).rgb;
-    vec3 n = texture(s_tex, uv + vec2(0.0, inv_res.y)).rgb;
-    vec3 s = texture(s_tex, uv - vec2(0.0, inv_res.y)).rgb;
-    vec3 e = texture(s_tex, uv + vec2(inv_res.x, 0.0)).rgb;
-    vec3 w = texture(s_tex, uv - vec2(inv_res.x, 0.0)).rgb;
-    return (col + n + s + e + w) / 5.0;
-}
-
 void main() {
-    vec3 tex = texture(s_tex, p_uv).rgb;
+    // at full scale every pixel lands on its texel, nothing to filter
+    vec3 tex;
+    if (uv_scale.x < 1.0) {
+        tex = UpscaleCatmullRom(p_uv * uv_scale);
+    } else {
+        tex = SampleScene(p_uv);
+    }
 
     vec3 ldr = tex;
     ldr = ToneMapACES(ldr);
@@ -79,10 +106,9 @@ void main() {
     ldr = ColorCorrect(ldr);
     ldr *= EXPOSURE;
 
-    vec3 aa = ApplyFXAA(p_uv);
-    ldr = mix(ldr, aa, 0.5);
-
     ldr = clamp(ldr, 0.0, 1.0);
 
-    color = vec4(ldr, 1.0);
+    // FXAA runs on gamma encoded color and wants the luma next to it
+    vec3 encoded = pow(ldr, vec3(1.0 / GAMMA));
+    color = vec4(encoded, dot(encoded, vec3(0.299, 0.587, 0.114)));
 }
@@ -10,11 +10,11 @@ struct InstanceData {
     uint texture;
 };
 
-layout(set=0, binding=0) uniform LightSpaceBuffer {
+layout(push_constant, std430) uniform LightSpacePC {
     mat4 light_space_matrix;
 };
 
-layout(set=0, binding=1) readonly buffer InstanceBuffer {
+layout(set=0, binding=0) readonly buffer InstanceBuffer {
     InstanceData instances[];
 };
 
@@ -92,5 +92,4 @@ void main() {
     vec4 pos = vec4(vert_pos + instance_pos, 1.0);
 
     gl_Position = light_space_matrix * pos;
-    gl_Position.xy = DistortShadow(gl_Position.xy);
 }
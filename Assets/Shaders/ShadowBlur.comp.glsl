@@ -0,0 +1,9 @@
+#version 450
+
+#extension GL_GOOGLE_include_directive: require
+
+#include "Common.h"
+
+#define MOMENTS_FORMAT rgba32f
+
+#include "ShadowBlur.h"
@@ -0,0 +1,59 @@
+// The moments filter of ShadowBlur.comp.glsl and ShadowBlurHalf.comp.glsl,
+// which only differ in the format of the images it writes, MOMENTS_FORMAT.
+
+layout(set=0, binding=0) uniform sampler2DArray s_shadow;
+layout(set=0, binding=1, MOMENTS_FORMAT) uniform image2D u_blur;
+layout(set=0, binding=2, MOMENTS_FORMAT) uniform image2DArray u_moments;
+
+layout(push_constant, std430) uniform BlurPC {
+    uint layer;
+    uint vertical;
+    vec2 evsm_exponents;
+};
+
+layout(local_size_x=8, local_size_y=8, local_size_z=1) in;
+
+#define BLUR_RADIUS 3
+
+// gaussian with sigma 1.5, center first
+const float blur_weights[BLUR_RADIUS + 1] = { 0.2707, 0.2167, 0.1113, 0.0366 };
+
+// The windows wrap around their layers, so does the blur.
+vec4 LoadMoments(ivec2 p, ivec2 size) {
+    p = (p + size) % size;
+
+    if (vertical == 0u) {
+        // 2x2 depth texels per moments texel, averaged as a box prefilter
+        vec4 result = vec4(0.0);
+        for (int y = 0; y < 2; ++y) {
+            for (int x = 0; x < 2; ++x) {
+                float depth = texelFetch(s_shadow, ivec3(p * 2 + ivec2(x, y), layer), 0).r;
+                result += ShadowMoments(depth, evsm_exponents);
+            }
+        }
+        return result * 0.25;
+    }
+
+    return imageLoad(u_blur, p);
+}
+
+void main() {
+    ivec2 size = imageSize(u_blur);
+    ivec2 p = ivec2(gl_GlobalInvocationID.xy);
+    if (p.x >= size.x || p.y >= size.y) {
+        return;
+    }
+
+    ivec2 dir = vertical == 0u ? ivec2(1, 0) : ivec2(0, 1);
+
+    vec4 sum = LoadMoments(p, size) * blur_weights[0];
+    for (int i = 1; i <= BLUR_RADIUS; ++i) {
+        sum += (LoadMoments(p + dir * i, size) + LoadMoments(p - dir * i, size)) * blur_weights[i];
+    }
+
+    if (vertical == 0u) {
+        imageStore(u_blur, p, sum);
+    } else {
+        imageStore(u_moments, ivec3(p, layer), sum);
+    }
+}
@@ -0,0 +1,9 @@
+#version 450
+
+#extension GL_GOOGLE_include_directive: require
+
+#include "Common.h"
+
+#define MOMENTS_FORMAT rgba16f
+
+#include "ShadowBlur.h"
@@ -1,6 +1,5 @@
 #version 450
 
-#extension GL_EXT_nonuniform_qualifier: require
 #extension GL_GOOGLE_include_directive: require
 
 #include "Common.h"
@@ -8,14 +7,19 @@
 layout(set=0, binding=0) uniform GlobalsUniform {
     mat4 proj_matrix;
     mat4 view_matrix;
-    mat4 light_space_matrix;
+    mat4 light_space_matrices[SHADOW_CASCADE_COUNT];
+    vec4 cascade_splits;
+    vec4 shadow_window_offsets[SHADOW_CASCADE_COUNT];
     vec3 camera_pos;
+    uint shadow_mode;
+    vec2 evsm_exponents;
 };
 
-layout(set=0, binding=2) uniform sampler2D s_shadow;
+layout(set=0, binding=2) uniform sampler2DArray s_shadow;
 layout(set=0, binding=3) uniform sampler2D s_noise;
 layout(set=0, binding=4) uniform sampler2D s_water1;
 layout(set=0, binding=5) uniform sampler2D s_water2;
+layout(set=0, binding=6) uniform sampler2DArray s_shadow_moments;
 
 layout(push_constant, std430) uniform time_pc {
     float time;
@@ -26,7 +30,6 @@ layout(location=1) in vec3 p_normal;
 layout(location=2) in vec3 p_tangent;
 layout(location=3) in vec3 p_bitangent;
 layout(location=4) in vec2 p_uv;
-layout(location=5) in vec4 p_shadow_pos;
 
 layout(location=0) out vec4 color;
 
@@ -63,7 +66,14 @@ void main() {
     float fresnel = FresnelSchlick(max(dot(V, N), 0.0), F0);
     vec3 water_color = mix(vec3(0.07, 0.3, 0.7), vec3(0.009, 0.15, 0.8), fresnel);
 
-    float shadow = ShadowCalculation(p_shadow_pos, N, s_shadow, s_noise);
+    float view_depth = -(view_matrix * vec4(p_world_pos, 1.0)).z;
+    uint cascade = SelectShadowCascade(view_depth, cascade_splits);
+    uint clamped_cascade = min(cascade, SHADOW_CASCADE_COUNT - 1);
+    vec4 shadow_pos = light_space_matrices[clamped_cascade] * vec4(p_world_pos, 1.0);
+    vec2 window_offset = shadow_window_offsets[clamped_cascade].xy;
+    float shadow = shadow_mode == SHADOW_MODE_EVSM ?
+        ShadowCalculationEVSM(shadow_pos, cascade, window_offset, N, s_shadow_moments, evsm_exponents) :
+        ShadowCalculation(shadow_pos, cascade, window_offset, N, s_shadow, s_noise);
     vec3 lighting = CalculatePBR(N, V, L, H, roughness, metallic, F0, water_color, shadow);
 
     float transparency = 0.9 + fresnel * 0.1;
@@ -1,5 +1,9 @@
 #version 450
 
+#extension GL_GOOGLE_include_directive: require
+
+#include "Common.h"
+
 struct InstanceData {
     float px, py, pz;
     uint side;
@@ -9,8 +13,12 @@ struct InstanceData {
 layout(set=0, binding=0) uniform GlobalsUniform {
     mat4 proj_matrix;
     mat4 view_matrix;
-    mat4 light_space_matrix;
+    mat4 light_space_matrices[SHADOW_CASCADE_COUNT];
+    vec4 cascade_splits;
+    vec4 shadow_window_offsets[SHADOW_CASCADE_COUNT];
     vec3 camera_pos;
+    uint shadow_mode;
+    vec2 evsm_exponents;
 };
 
 layout(set=0, binding=1) readonly buffer InstanceBuffer {
@@ -96,7 +104,6 @@ layout(location=2) out vec3 p_tangent;
 layout(location=3) out vec3 p_bitangent;
 
 layout(location=4) out vec2 p_uv;
-layout(location=5) out vec4 p_shadow_pos;
 
 void main() {
     uint vertexID = gl_VertexIndex;
@@ -121,5 +128,4 @@ void main() {
     p_tangent = tangent;
     p_bitangent = bitangent;
     p_uv = uv;
-    p_shadow_pos = light_space_matrix * pos;
 }
@@ -0,0 +1,514 @@
+#include "General.h"
+#include "World.h"
+#include "MapGen.h"
+#include "Mesher.h"
+#include "Collision.h"
+#include "Entities.h"
+#include "Math/NMath.h"
+#include "Math/SIMD.h"
+#include "Math/Mat.h"
+#include "DataStructures/Arena.h"
+#include "Platform/Platform.h"
+#include "Platform/Jobs.h"
+
+// Hot CPU paths of the engine core on their own, no window or GPU. Every
+// benchmark runs a fixed amount of work from fixed seeds so numbers from
+// different commits can be compared directly. Prints one csv row per
+// benchmark:
+// benchmark,workers,reps,ops,min_ms,median_ms,mean_ms,max_ms,ns_per_op
+
+enum {
+	BENCH_MAX_REPS = 1000,
+
+	BENCH_RANDOM_LOOKUPS = 1 << 20,
+	BENCH_NEIGHBOR_LOOKUPS = 1 << 18,
+	BENCH_RAYS = 1 << 16,
+	BENCH_ARENA_PUSHES = 1 << 20,
+	BENCH_ARENA_SIZE = 256 * 1024 * 1024,
+	BENCH_JOB_WAVES = 64,
+	BENCH_JOBS_PER_WAVE = 1024,
+	BENCH_PARALLEL_FOR_COUNT = 1 << 22,
+	BENCH_F32X4_COUNT = 4096,
+	BENCH_F32X4_PASSES = 256,
+	BENCH_MAT4_COUNT = 1 << 20,
+	BENCH_ENTITIES = 50000,
+	BENCH_ENTITY_TICKS = 10,
+};
+
+global const u32 bench_world_seed = 1337;
+global const u64 bench_rng_seed = 0x9E3779B97F4A7C15ull;
+
+// each benchmark folds its result in here so the work can't be optimized away
+global volatile u64 bench_sink;
+
+// Runs one repetition, returns how many operations it did.
+typedef u64 (*BenchFunc)();
+
+struct Benchmark {
+	const char *name;
+	BenchFunc run;
+};
+
+struct BenchState {
+	u64 rng;
+
+	int *random_coords;
+	vec3 *ray_origins;
+	vec3 *ray_dirs;
+	u32 *arena_sizes;
+	Arena arena;
+
+	InstanceData *solid_instances;
+	InstanceData *water_instances;
+
+	float *f32x4_a;
+	float *f32x4_b;
+	float *f32x4_c;
+	mat4 *matrices;
+
+	EntityStore entities;
+	SpatialHash entity_hash;
+
+	volatile u32 job_total;
+};
+
+global BenchState bench;
+
+internal u64 NextRandom() {
+	// xorshift64*
+	bench.rng ^= bench.rng >> 12;
+	bench.rng ^= bench.rng << 25;
+	bench.rng ^= bench.rng >> 27;
+	return bench.rng * 0x2545F4914F6CDD1Dull;
+}
+
+internal float NextRandomFloat() {
+	return float(NextRandom() >> 40) / float(1 << 24);
+}
+
+internal int WorldBlocksX() { return CHUNK_X * WORLD_CHUNK_COUNT_X; }
+internal int WorldBlocksY() { return CHUNK_Y * WORLD_CHUNK_COUNT_Y; }
+internal int WorldBlocksZ() { return CHUNK_Z * WORLD_CHUNK_COUNT_Z; }
+
+internal u64 BenchGenerateMap() {
+	GenerateMap();
+	return WORLD_CHUNK_COUNT_X * WORLD_CHUNK_COUNT_Y * WORLD_CHUNK_COUNT_Z;
+}
+
+internal u64 BenchMeshChunks() {
+	u64 faces = 0;
+
+	for (int cx = 0; cx < WORLD_CHUNK_COUNT_X; ++cx) {
+		for (int cz = 0; cz < WORLD_CHUNK_COUNT_Z; ++cz) {
+			for (int cy = 0; cy < WORLD_CHUNK_COUNT_Y; ++cy) {
+				Chunk *c = GetChunk(cx, cy, cz);
+				MeshChunk(c);
+				CommitChunkMesh(c);
+				faces += c->instance_count + c->water_instance_count;
+			}
+		}
+	}
+
+	bench_sink += faces;
+	return WORLD_CHUNK_COUNT_X * WORLD_CHUNK_COUNT_Y * WORLD_CHUNK_COUNT_Z;
+}
+
+internal u64 BenchGatherInstances() {
+	BlockInstanceCounts counts = GatherChunkInstances(bench.solid_instances, bench.water_instances);
+	bench_sink += counts.solid + counts.water;
+	return counts.solid + counts.water;
+}
+
+internal u64 BenchGetBlockLinear() {
+	u64 sum = 0;
+
+	// x, z, y is the order the blocks are stored in
+	for (int x = 0; x < WorldBlocksX(); ++x) {
+		for (int z = 0; z < WorldBlocksZ(); ++z) {
+			for (int y = 0; y < WorldBlocksY(); ++y) {
+				sum += GetBlock(x, y, z);
+			}
+		}
+	}
+
+	bench_sink += sum;
+	return u64(WorldBlocksX()) * WorldBlocksY() * WorldBlocksZ();
+}
+
+internal u64 BenchGetBlockRandom() {
+	u64 sum = 0;
+
+	int *coords = bench.random_coords;
+	for (u32 i = 0; i < BENCH_RANDOM_LOOKUPS; ++i) {
+		sum += GetBlock(coords[i * 3 + 0], coords[i * 3 + 1], coords[i * 3 + 2]);
+	}
+
+	bench_sink += sum;
+	return BENCH_RANDOM_LOOKUPS;
+}
+
+// the six neighbours of a block, what meshing and collision look at
+internal u64 BenchGetBlockNeighbors() {
+	u64 sum = 0;
+
+	int *coords = bench.random_coords;
+	for (u32 i = 0; i < BENCH_NEIGHBOR_LOOKUPS; ++i) {
+		int x = coords[i * 3 + 0];
+		int y = coords[i * 3 + 1];
+		int z = coords[i * 3 + 2];
+
+		sum += GetBlock(x, y + 1, z);
+		sum += GetBlock(x, y - 1, z);
+		sum += GetBlock(x - 1, y, z);
+		sum += GetBlock(x + 1, y, z);
+		sum += GetBlock(x, y, z + 1);
+		sum += GetBlock(x, y, z - 1);
+	}
+
+	bench_sink += sum;
+	return BENCH_NEIGHBOR_LOOKUPS * 6;
+}
+
+internal u64 BenchCastRay() {
+	float sum = 0.0f;
+
+	for (u32 i = 0; i < BENCH_RAYS; ++i) {
+		RayIntersection hit = CastRay(bench.ray_origins[i], bench.ray_dirs[i]);
+		sum += hit.pos.y;
+	}
+
+	bench_sink += u64(sum);
+	return BENCH_RAYS;
+}
+
+internal u64 BenchArenaPush() {
+	ResetArena(&bench.arena);
+
+	u64 sum = 0;
+	for (u32 i = 0; i < BENCH_ARENA_PUSHES; ++i) {
+		u32 size = bench.arena_sizes[i];
+		u8 *ptr = PushSize(&bench.arena, size, 4 << (size & 3));
+		sum += u64(ptr - bench.arena.ptr);
+	}
+
+	bench_sink += sum;
+	return BENCH_ARENA_PUSHES;
+}
+
+internal void CountJob(void *data, u32 begin, u32 end) {
+	AtomicIncrement(&bench.job_total);
+}
+
+internal u64 BenchRunJob() {
+	for (u32 wave = 0; wave < BENCH_JOB_WAVES; ++wave) {
+		JobCounter counter = {};
+		for (u32 i = 0; i < BENCH_JOBS_PER_WAVE; ++i) {
+			RunJob(CountJob, 0, &counter);
+		}
+		WaitForCounter(&counter);
+	}
+
+	return BENCH_JOB_WAVES * BENCH_JOBS_PER_WAVE;
+}
+
+internal void SumRangeJob(void *data, u32 begin, u32 end) {
+	u32 sum = 0;
+	for (u32 i = begin; i < end; ++i) {
+		sum += i * 2654435761u;
+	}
+	AtomicAdd(&bench.job_total, sum);
+}
+
+internal u64 BenchParallelFor() {
+	ParallelFor(BENCH_PARALLEL_FOR_COUNT, 4096, SumRangeJob, 0);
+	return BENCH_PARALLEL_FOR_COUNT;
+}
+
+internal u64 BenchF32x4() {
+	f32x4 acc = f32x4(0.0f);
+
+	for (u32 pass = 0; pass < BENCH_F32X4_PASSES; ++pass) {
+		for (u32 i = 0; i < BENCH_F32X4_COUNT; i += 4) {
+			f32x4 a = f32x4(bench.f32x4_a + i);
+			f32x4 b = f32x4(bench.f32x4_b + i);
+			f32x4 c = f32x4(bench.f32x4_c + i);
+
+			f32x4 v = a * b + c;
+			acc += Minimum(Maximum(v, f32x4(-4.0f)), f32x4(4.0f));
+		}
+	}
+
+	bench_sink += u64(HorizontalAdd(acc));
+	return BENCH_F32X4_PASSES * (BENCH_F32X4_COUNT / 4);
+}
+
+internal u64 BenchMat4Multiply() {
+	float sum = 0.0f;
+
+	// independent products, a long chain drifts into denormals
+	for (u32 i = 0; i < BENCH_MAT4_COUNT; ++i) {
+		mat4 m = bench.matrices[i & 1023] * bench.matrices[(i * 7 + 1) & 1023];
+		sum += m.M[3][0];
+	}
+
+	bench_sink += u64(sum != 0.0f);
+	return BENCH_MAT4_COUNT;
+}
+
+internal u64 BenchMat4Inverse() {
+	float sum = 0.0f;
+
+	for (u32 i = 0; i < BENCH_MAT4_COUNT / 4; ++i) {
+		mat4 inv = Inverse(bench.matrices[i & 1023]);
+		sum += inv.M[3][0];
+	}
+
+	bench_sink += u64(sum != 0.0f);
+	return BENCH_MAT4_COUNT / 4;
+}
+
+// mobs walking around on the terrain, collision and the spatial hash included
+internal u64 BenchUpdateEntities() {
+	for (u32 i = 0; i < BENCH_ENTITY_TICKS; ++i) {
+		UpdateEntities(&bench.entities, 1);
+		BuildSpatialHash(&bench.entity_hash, &bench.entities);
+	}
+
+	bench_sink += u64(bench.entities.py[0]);
+	return u64(bench.entities.count) * BENCH_ENTITY_TICKS;
+}
+
+global Benchmark benchmarks[] = {
+	{ "generate_map", BenchGenerateMap },
+	{ "mesh_chunks", BenchMeshChunks },
+	{ "gather_instances", BenchGatherInstances },
+	{ "get_block_linear", BenchGetBlockLinear },
+	{ "get_block_random", BenchGetBlockRandom },
+	{ "get_block_neighbors", BenchGetBlockNeighbors },
+	{ "cast_ray", BenchCastRay },
+	{ "arena_push", BenchArenaPush },
+	{ "run_job", BenchRunJob },
+	{ "parallel_for", BenchParallelFor },
+	{ "f32x4_madd", BenchF32x4 },
+	{ "mat4_multiply", BenchMat4Multiply },
+	{ "mat4_inverse", BenchMat4Inverse },
+	{ "update_entities", BenchUpdateEntities },
+};
+
+internal void InitBench() {
+	bench.rng = bench_rng_seed;
+
+	// the world every benchmark after generate_map works on
+	SetWorldSeed(bench_world_seed);
+	GenerateMap();
+
+	u32 solid_count = 0;
+	u32 water_count = 0;
+	for (int cx = 0; cx < WORLD_CHUNK_COUNT_X; ++cx) {
+		for (int cz = 0; cz < WORLD_CHUNK_COUNT_Z; ++cz) {
+			for (int cy = 0; cy < WORLD_CHUNK_COUNT_Y; ++cy) {
+				Chunk *c = GetChunk(cx, cy, cz);
+				MeshChunk(c);
+				CommitChunkMesh(c);
+				solid_count += c->instance_count;
+				water_count += c->water_instance_count;
+			}
+		}
+	}
+	bench.solid_instances = (InstanceData *) HeapAlloc(Max(solid_count, 1u) * sizeof(InstanceData));
+	bench.water_instances = (InstanceData *) HeapAlloc(Max(water_count, 1u) * sizeof(InstanceData));
+
+	bench.random_coords = (int *) HeapAlloc(BENCH_RANDOM_LOOKUPS * 3 * sizeof(int));
+	for (u32 i = 0; i < BENCH_RANDOM_LOOKUPS; ++i) {
+		bench.random_coords[i * 3 + 0] = int(NextRandom() % WorldBlocksX());
+		bench.random_coords[i * 3 + 1] = int(NextRandom() % WorldBlocksY());
+		bench.random_coords[i * 3 + 2] = int(NextRandom() % WorldBlocksZ());
+	}
+
+	// rays start somewhere around the terrain and look in any direction
+	bench.ray_origins = (vec3 *) HeapAlloc(BENCH_RAYS * sizeof(vec3));
+	bench.ray_dirs = (vec3 *) HeapAlloc(BENCH_RAYS * sizeof(vec3));
+	for (u32 i = 0; i < BENCH_RAYS; ++i) {
+		bench.ray_origins[i] = vec3(NextRandomFloat() * WorldBlocksX(), 10.0f + NextRandomFloat() * 50.0f,
+			NextRandomFloat() * WorldBlocksZ());
+
+		float yaw = NextRandomFloat() * 2.0f * PI32;
+		float pitch = (NextRandomFloat() - 0.5f) * PI32;
+		bench.ray_dirs[i] = vec3(Cos(yaw) * Cos(pitch), Sin(pitch), Sin(yaw) * Cos(pitch));
+	}
+
+	bench.arena = CreateArena(BENCH_ARENA_SIZE);
+	bench.arena_sizes = (u32 *) HeapAlloc(BENCH_ARENA_PUSHES * sizeof(u32));
+	for (u32 i = 0; i < BENCH_ARENA_PUSHES; ++i) {
+		bench.arena_sizes[i] = 8 + u32(NextRandom() % 120);
+	}
+
+	bench.f32x4_a = (float *) HeapAlloc(BENCH_F32X4_COUNT * sizeof(float));
+	bench.f32x4_b = (float *) HeapAlloc(BENCH_F32X4_COUNT * sizeof(float));
+	bench.f32x4_c = (float *) HeapAlloc(BENCH_F32X4_COUNT * sizeof(float));
+	for (u32 i = 0; i < BENCH_F32X4_COUNT; ++i) {
+		bench.f32x4_a[i] = NextRandomFloat() * 2.0f - 1.0f;
+		bench.f32x4_b[i] = NextRandomFloat() * 2.0f - 1.0f;
+		bench.f32x4_c[i] = NextRandomFloat() * 2.0f - 1.0f;
+	}
+
+	// rigid transforms, always invertible
+	bench.matrices = (mat4 *) HeapAlloc(1024 * sizeof(mat4));
+	for (u32 i = 0; i < 1024; ++i) {
+		vec3 axis = Normalize(vec3(NextRandomFloat() + 0.1f, NextRandomFloat(), NextRandomFloat()));
+		mat4 m = Rotate(mat4(1.0f), NextRandomFloat() * 2.0f * PI32, axis);
+		bench.matrices[i] = Translate(m, vec3(NextRandomFloat(), NextRandomFloat(), NextRandomFloat()));
+	}
+
+	// dropped just above the highest terrain and left to land first, so the
+	// timed ticks measure mobs walking, not falling
+	vec3 center = vec3(WorldBlocksX() * 0.5f, 52.0f, WorldBlocksZ() * 0.5f);
+	bench.entities = CreateEntityStore(BENCH_ENTITIES);
+	bench.entity_hash = CreateSpatialHash(&bench.entities, 4.0f);
+	SpawnEntitiesAround(&bench.entities, center, 64.0f, BENCH_ENTITIES, 12345);
+	for (u32 i = 0; i < 60; ++i) {
+		UpdateEntities(&bench.entities, 1);
+	}
+}
+
+internal b32 ContainsString(const char *haystack, String needle) {
+	u64 length = CStringLength(haystack);
+	for (u64 i = 0; i + needle.len <= length; ++i) {
+		if (String((u8 *) haystack + i, needle.len) == needle) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+internal void SortDoubles(double *values, u32 count) {
+	for (u32 i = 1; i < count; ++i) {
+		double v = values[i];
+		u32 j = i;
+		while (j > 0 && values[j - 1] > v) {
+			values[j] = values[j - 1];
+			j--;
+		}
+		values[j] = v;
+	}
+}
+
+internal void PrintUsage() {
+	PrintLiteral(
+		"usage: nmc_bench [options]\n"
+		"  --filter TEXT   only run benchmarks whose name contains TEXT\n"
+		"  --reps N        timed repetitions per benchmark (default 10)\n"
+		"  --warmup N      untimed repetitions before those (default 2)\n"
+		"  --workers N     job system threads, 0 is one per core (default 0)\n"
+		"  --out PATH      write the csv to PATH instead of stdout\n"
+		"  --list          print the benchmark names and exit\n");
+}
+
+void NKMain() {
+	String filter;
+	String out_path;
+	u32 reps = 10;
+	u32 warmup = 2;
+	u32 workers = 0;
+
+	u32 count = GetCommandLineArgCount();
+	for (u32 i = 1; i < count; ++i) {
+		String arg = GetCommandLineArg(i);
+		String value = i + 1 < count ? GetCommandLineArg(i + 1) : String();
+
+		b32 ok = 1;
+		if (arg == "--filter") {
+			ok = value.len > 0;
+			filter = value;
+			i++;
+		} else if (arg == "--reps") {
+			ok = ParseU32(value, &reps) && reps > 0 && reps <= BENCH_MAX_REPS;
+			i++;
+		} else if (arg == "--warmup") {
+			ok = ParseU32(value, &warmup);
+			i++;
+		} else if (arg == "--workers") {
+			ok = ParseU32(value, &workers);
+			i++;
+		} else if (arg == "--out") {
+			ok = value.len > 0;
+			out_path = value;
+			i++;
+		} else if (arg == "--list") {
+			for (u32 b = 0; b < ArrayCount(benchmarks); ++b) {
+				Print("%s\n", benchmarks[b].name);
+			}
+			return;
+		} else {
+			ok = 0;
+		}
+
+		if (!ok) {
+			Print("invalid argument: %.*s\n", int(arg.len), arg.ptr);
+			PrintUsage();
+			Exit(1);
+		}
+	}
+
+	InitJobs(workers);
+	InitBench();
+
+	FileWriter *writer = 0;
+	if (out_path.len) {
+		writer = (FileWriter *) HeapAlloc(sizeof(FileWriter));
+		if (!OpenFileWriter(writer, out_path)) {
+			Print("Failed to create %.*s\n", int(out_path.len), out_path.ptr);
+			Exit(1);
+		}
+		WriteFormat(writer, "benchmark,workers,reps,ops,min_ms,median_ms,mean_ms,max_ms,ns_per_op\n");
+	} else {
+		Print("benchmark,workers,reps,ops,min_ms,median_ms,mean_ms,max_ms,ns_per_op\n");
+	}
+
+	double times[BENCH_MAX_REPS];
+
+	for (u32 b = 0; b < ArrayCount(benchmarks); ++b) {
+		Benchmark *benchmark = &benchmarks[b];
+		if (filter.len && !ContainsString(benchmark->name, filter)) {
+			continue;
+		}
+
+		for (u32 i = 0; i < warmup; ++i) {
+			benchmark->run();
+		}
+
+		u64 ops = 0;
+		double total = 0.0;
+		for (u32 i = 0; i < reps; ++i) {
+			u64 begin = GetTimeNowUs();
+			ops = benchmark->run();
+			u64 end = GetTimeNowUs();
+
+			times[i] = double(end - begin) / 1000.0;
+			total += times[i];
+		}
+
+		SortDoubles(times, reps);
+		double median = reps & 1 ? times[reps / 2] : (times[reps / 2 - 1] + times[reps / 2]) * 0.5;
+		double ns_per_op = ops ? median * 1e6 / double(ops) : 0.0;
+
+		const char *row = "%s,%u,%u,%llu,%.4f,%.4f,%.4f,%.4f,%.3f\n";
+		if (writer) {
+			WriteFormat(writer, row, benchmark->name, GetJobWorkerCount(), reps, ops,
+				times[0], median, total / reps, times[reps - 1], ns_per_op);
+		} else {
+			Print(row, benchmark->name, GetJobWorkerCount(), reps, ops,
+				times[0], median, total / reps, times[reps - 1], ns_per_op);
+		}
+	}
+
+	if (writer) {
+		if (!CloseFileWriter(writer)) {
+			Print("Failed to write %.*s\n", int(out_path.len), out_path.ptr);
+		}
+		HeapFree(writer);
+	}
+
+	ShutdownJobs();
+}
@@ -0,0 +1,222 @@
+#include <stdio.h>
+
+#include "General.h"
+#include "AssetPack.h"
+#include "Platform/Platform.h"
+
+#include "ThirdParty/stb_image.h"
+
+// Bakes shaders and textures into the asset pack nmc maps at startup. Every
+// file after a --root is read from that directory and stored under the path
+// it was given as, .png files are decoded to RGBA8 with their full mip chain,
+// everything else is stored as is.
+
+enum {
+	PACK_MAX_INPUTS = 256,
+};
+
+struct PackInput {
+	String root;
+	String name;
+
+	u32 kind;
+	u32 width;
+	u32 height;
+	u32 mip_levels;
+	u8 *data;
+	u64 size;
+};
+
+internal u64 AlignPack(u64 offset) {
+	return (offset + ASSET_PACK_ALIGNMENT - 1) & ~u64(ASSET_PACK_ALIGNMENT - 1);
+}
+
+// 2x2 box filter, odd edges reuse their last row/column, which is what a
+// linear blit ends up doing as well
+internal void DownsampleRgba(u8 *src, u32 src_width, u32 src_height, u8 *dst, u32 dst_width, u32 dst_height) {
+	for (u32 y = 0; y < dst_height; ++y) {
+		u32 y0 = Min(y * 2, src_height - 1);
+		u32 y1 = Min(y * 2 + 1, src_height - 1);
+
+		for (u32 x = 0; x < dst_width; ++x) {
+			u32 x0 = Min(x * 2, src_width - 1);
+			u32 x1 = Min(x * 2 + 1, src_width - 1);
+
+			u8 *a = src + (y0 * src_width + x0) * 4;
+			u8 *b = src + (y0 * src_width + x1) * 4;
+			u8 *c = src + (y1 * src_width + x0) * 4;
+			u8 *d = src + (y1 * src_width + x1) * 4;
+
+			u8 *out = dst + (y * dst_width + x) * 4;
+			for (u32 i = 0; i < 4; ++i) {
+				out[i] = u8((u32(a[i]) + b[i] + c[i] + d[i] + 2) / 4);
+			}
+		}
+	}
+}
+
+internal b32 EndsWith(String str, const char *suffix) {
+	u64 len = CStringLength(suffix);
+	return str.len >= len && String(str.ptr + str.len - len, len) == suffix;
+}
+
+internal b32 LoadInput(PackInput *input) {
+	char path[512];
+	snprintf(path, sizeof(path), "%.*s/%.*s", int(input->root.len), (char *) input->root.ptr,
+		int(input->name.len), (char *) input->name.ptr);
+
+	if (!EndsWith(input->name, ".png")) {
+		String data = ReadFile(String(path));
+		if (!data.ptr) {
+			Print("Failed to read %s\n", path);
+			return 0;
+		}
+
+		input->kind = ASSET_BLOB;
+		input->data = data.ptr;
+		input->size = data.len;
+
+		return 1;
+	}
+
+	int width, height, channels;
+	u8 *pixels = stbi_load(path, &width, &height, &channels, STBI_rgb_alpha);
+	if (!pixels) {
+		Print("Failed to decode %s\n", path);
+		return 0;
+	}
+
+	input->kind = ASSET_TEXTURE;
+	input->width = u32(width);
+	input->height = u32(height);
+	input->mip_levels = 1;
+	while (Max(input->width, input->height) >> input->mip_levels) {
+		input->mip_levels++;
+	}
+	input->size = GetMipChainSize(input->width, input->height, input->mip_levels);
+	input->data = (u8 *) HeapAlloc(input->size);
+
+	CopyMemory(input->data, pixels, u64(width) * height * 4);
+	stbi_image_free(pixels);
+
+	u8 *level = input->data;
+	for (u32 i = 1; i < input->mip_levels; ++i) {
+		u32 src_width = Max(input->width >> (i - 1), 1u);
+		u32 src_height = Max(input->height >> (i - 1), 1u);
+		u8 *next = level + u64(src_width) * src_height * 4;
+
+		DownsampleRgba(level, src_width, src_height, next, Max(src_width >> 1, 1u), Max(src_height >> 1, 1u));
+		level = next;
+	}
+
+	return 1;
+}
+
+internal void PrintUsage() {
+	PrintLiteral(
+		"usage: nmc_pack --out PATH [--root DIR] FILE...\n"
+		"  --out PATH   pack to write\n"
+		"  --root DIR   directory the following files are read from (default .)\n");
+}
+
+void NKMain() {
+	String out_path;
+	String root = String(".");
+
+	PackInput *inputs = (PackInput *) HeapAlloc(PACK_MAX_INPUTS * sizeof(PackInput));
+	u32 input_count = 0;
+
+	u32 count = GetCommandLineArgCount();
+	for (u32 i = 1; i < count; ++i) {
+		String arg = GetCommandLineArg(i);
+		String value = i + 1 < count ? GetCommandLineArg(i + 1) : String();
+
+		b32 ok = 1;
+		if (arg == "--out") {
+			ok = value.len > 0;
+			out_path = value;
+			i++;
+		} else if (arg == "--root") {
+			ok = value.len > 0;
+			root = value;
+			i++;
+		} else if (arg.len && arg[0] != '-' && arg.len < ASSET_NAME_SIZE && input_count < PACK_MAX_INPUTS) {
+			PackInput *input = &inputs[input_count++];
+			*input = {};
+			input->root = root;
+			input->name = arg;
+		} else {
+			ok = 0;
+		}
+
+		if (!ok) {
+			Print("invalid argument: %.*s\n", int(arg.len), arg.ptr);
+			PrintUsage();
+			Exit(1);
+		}
+	}
+
+	if (!out_path.len || !input_count) {
+		PrintUsage();
+		Exit(1);
+	}
+
+	u64 data_offset = AlignPack(sizeof(AssetPackHeader) + input_count * sizeof(AssetEntry));
+	u64 pack_size = data_offset;
+	for (u32 i = 0; i < input_count; ++i) {
+		if (!LoadInput(&inputs[i])) {
+			Exit(1);
+		}
+
+		pack_size = AlignPack(pack_size) + inputs[i].size;
+	}
+
+	u8 *pack = (u8 *) HeapAlloc(pack_size);
+	ZeroMemory(pack, pack_size);
+
+	AssetPackHeader *header = (AssetPackHeader *) pack;
+	header->magic = ASSET_PACK_MAGIC;
+	header->version = ASSET_PACK_VERSION;
+	header->entry_count = input_count;
+
+	AssetEntry *entries = (AssetEntry *) (pack + sizeof(AssetPackHeader));
+	u64 offset = data_offset;
+	for (u32 i = 0; i < input_count; ++i) {
+		PackInput *input = &inputs[i];
+		AssetEntry *entry = &entries[i];
+
+		offset = AlignPack(offset);
+
+		CopyMemory(entry->name, input->name.ptr, input->name.len);
+		entry->kind = input->kind;
+		entry->width = input->width;
+		entry->height = input->height;
+		entry->mip_levels = input->mip_levels;
+		entry->offset = offset;
+		entry->size = input->size;
+
+		CopyMemory(pack + offset, input->data, input->size);
+		offset += input->size;
+
+		HeapFree(input->data);
+	}
+
+	OS_Handle file = OpenFile(out_path, OS_WRITE | OS_CREATE);
+	if (!IsValidFile(file)) {
+		Print("Failed to create %.*s\n", int(out_path.len), out_path.ptr);
+		Exit(1);
+	}
+
+	u64 written = WriteHandle(file, pack, pack_size);
+	CloseFile(file);
+
+	if (written != pack_size) {
+		Print("Failed to write %.*s\n", int(out_path.len), out_path.ptr);
+		Exit(1);
+	}
+
+	Print("Packed %u assets into %.*s (%llu bytes)\n", input_count, int(out_path.len), out_path.ptr, pack_size);
+
+	HeapFree(pack);
+	HeapFree(inputs);
+}
@@ -0,0 +1,99 @@
+#include "AssetPack.h"
+
+#include "Platform/Platform.h"
+
+struct AssetPack {
+	u8 *data;
+	u64 size;
+	AssetEntry *entries;
+	u32 entry_count;
+};
+
+global AssetPack asset_pack;
+
+u64 GetMipChainSize(u32 width, u32 height, u32 mip_levels) {
+	u64 result = 0;
+
+	for (u32 level = 0; level < mip_levels; ++level) {
+		result += u64(Max(width >> level, 1u)) * Max(height >> level, 1u) * 4;
+	}
+
+	return result;
+}
+
+internal b32 IsValidAssetPack(u8 *data, u64 size) {
+	AssetPackHeader *header = (AssetPackHeader *) data;
+	if (size < sizeof(AssetPackHeader) || header->magic != ASSET_PACK_MAGIC || header->version != ASSET_PACK_VERSION) {
+		return 0;
+	}
+
+	if ((size - sizeof(AssetPackHeader)) / sizeof(AssetEntry) < header->entry_count) {
+		return 0;
+	}
+
+	AssetEntry *entries = (AssetEntry *) (data + sizeof(AssetPackHeader));
+	for (u32 i = 0; i < header->entry_count; ++i) {
+		AssetEntry *entry = &entries[i];
+		if (entry->offset > size || entry->size > size - entry->offset || entry->name[ASSET_NAME_SIZE - 1] != 0) {
+			return 0;
+		}
+
+		if (entry->kind == ASSET_TEXTURE && entry->size != GetMipChainSize(entry->width, entry->height, entry->mip_levels)) {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+b32 OpenAssetPack(String path) {
+	OS_Handle file = OpenFile(path, OS_READ);
+	if (!IsValidFile(file)) {
+		return 0;
+	}
+
+	u64 size = GetFileInfo(file).size;
+	u8 *data = size ? (u8 *) MapFile(file, size) : 0;
+	CloseFile(file);
+
+	if (!data) {
+		return 0;
+	}
+
+	if (!IsValidAssetPack(data, size)) {
+		Print("%.*s is not an asset pack\n", int(path.len), path.ptr);
+		UnmapFile(data, size);
+		return 0;
+	}
+
+	asset_pack.data = data;
+	asset_pack.size = size;
+	asset_pack.entries = (AssetEntry *) (data + sizeof(AssetPackHeader));
+	asset_pack.entry_count = ((AssetPackHeader *) data)->entry_count;
+
+	return 1;
+}
+
+void CloseAssetPack() {
+	if (asset_pack.data) {
+		UnmapFile(asset_pack.data, asset_pack.size);
+	}
+
+	asset_pack = {};
+}
+
+AssetEntry *FindAsset(const char *name) {
+	// a few dozen entries, looked up once each at startup
+	for (u32 i = 0; i < asset_pack.entry_count; ++i) {
+		AssetEntry *entry = &asset_pack.entries[i];
+		if (String(entry->name) == name) {
+			return entry;
+		}
+	}
+
+	return 0;
+}
+
+u8 *GetAssetData(AssetEntry *entry) {
+	return asset_pack.data + entry->offset;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "General.h"
+#include "DataStructures/String.h"
+
+// One file with every shader and texture the game loads, baked by nmc_pack:
+// the header, then the table of contents, then each asset's data at an
+// ASSET_PACK_ALIGNMENT aligned offset. Assets are found by the path they
+// would otherwise be loaded from.
+
+#define ASSET_PACK_MAGIC 0x4B50434E // "NCPK"
+#define ASSET_PACK_VERSION 1
+
+enum {
+	ASSET_PACK_ALIGNMENT = 256,
+	ASSET_NAME_SIZE = 64,
+};
+
+enum {
+	// bytes as they were, SPIR-V
+	ASSET_BLOB,
+	// RGBA8, all mip_levels back to back starting with the full size one,
+	// level n is Max(width >> n, 1) by Max(height >> n, 1)
+	ASSET_TEXTURE,
+};
+
+struct AssetPackHeader {
+	u32 magic;
+	u32 version;
+	u32 entry_count;
+	u32 reserved;
+};
+
+struct AssetEntry {
+	char name[ASSET_NAME_SIZE];
+	u32 kind;
+	u32 width;
+	u32 height;
+	u32 mip_levels;
+	u64 offset;
+	u64 size;
+};
+
+// Byte size of the first mip_levels levels of an RGBA8 texture.
+u64 GetMipChainSize(u32 width, u32 height, u32 mip_levels);
+
+// Maps the pack for FindAsset, returns 0 (and leaves every lookup failing)
+// when there is no valid pack at path.
+b32 OpenAssetPack(String path);
+void CloseAssetPack();
+
+// Safe to call from any thread while the pack is open.
+AssetEntry *FindAsset(const char *name);
+u8 *GetAssetData(AssetEntry *entry);
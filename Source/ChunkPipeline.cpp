@@ -0,0 +1,401 @@
+#include "ChunkPipeline.h"
+
+#include "World.h"
+#include "MapGen.h"
+#include "Mesher.h"
+#include "Math/NMath.h"
+#include "Platform/Platform.h"
+#include "Platform/Jobs.h"
+#include "Platform/Profiler.h"
+
+enum {
+	PIPELINE_CHUNK_COUNT = WORLD_CHUNK_COUNT_X * WORLD_CHUNK_COUNT_Y * WORLD_CHUNK_COUNT_Z,
+
+	// generation works on whole columns, the rest on single chunks
+	PIPELINE_MAX_GENERATE_IN_FLIGHT = 8,
+	PIPELINE_MAX_DECORATE_IN_FLIGHT = 64,
+	PIPELINE_MAX_MESH_IN_FLIGHT = 64,
+	PIPELINE_MAX_UPLOADS_PER_FRAME = 64,
+
+	// backpressure: a stage takes no new work while this many chunks are
+	// waiting for the next stage
+	PIPELINE_MAX_WAITING = 256,
+};
+
+struct ChunkSlot {
+	// written by jobs when they finish a stage
+	volatile u32 state;
+
+	// render thread only
+	u32 seen_state;
+	u64 queued_us;
+};
+
+struct ChunkOffset {
+	s8 x;
+	s8 y;
+	s8 z;
+};
+
+struct ChunkPipeline {
+	ChunkSlot slots[PIPELINE_CHUNK_COUNT];
+
+	// every offset a chunk can have from the focus chunk, nearest first
+	ChunkOffset *order;
+	u32 order_count;
+
+	ChunkPipelineStats stats;
+
+	vec3 changed_chunks[CHANGED_CHUNKS_MAX];
+	u32 changed_count;
+
+	// held while jobs are started and while edits are applied, only ever
+	// tried so the render and simulation threads never wait for each other
+	OS_Handle edit_mutex;
+};
+
+global ChunkPipeline pipeline;
+
+global const char *chunk_stage_names[CHUNK_STAGE_COUNT] = {
+	"generate",
+	"decorate",
+	"mesh",
+	"upload",
+};
+
+internal u32 GetChunkIndex(int cx, int cy, int cz) {
+	return u32((cx * WORLD_CHUNK_COUNT_Z + cz) * WORLD_CHUNK_COUNT_Y + cy);
+}
+
+internal b32 IsChunkInWorld(int cx, int cy, int cz) {
+	return cx >= 0 && cy >= 0 && cz >= 0 &&
+		cx < WORLD_CHUNK_COUNT_X && cy < WORLD_CHUNK_COUNT_Y && cz < WORLD_CHUNK_COUNT_Z;
+}
+
+// Chunks outside the world count as done so border chunks don't wait forever.
+internal u32 GetChunkState(int cx, int cy, int cz) {
+	if (!IsChunkInWorld(cx, cy, cz)) {
+		return CHUNK_STATE_UPLOADED;
+	}
+
+	return AtomicLoad(&pipeline.slots[GetChunkIndex(cx, cy, cz)].state);
+}
+
+internal void GenerateColumnJob(void *data, u32 begin, u32 end) {
+	u32 column = u32(u64(data));
+	int cx = int(column) / WORLD_CHUNK_COUNT_Z;
+	int cz = int(column) % WORLD_CHUNK_COUNT_Z;
+
+	GenerateChunkColumn(cx, cz);
+
+	for (int cy = 0; cy < WORLD_CHUNK_COUNT_Y; ++cy) {
+		AtomicStore(&pipeline.slots[GetChunkIndex(cx, cy, cz)].state, CHUNK_STATE_GENERATED);
+	}
+}
+
+internal void DecorateChunkJob(void *data, u32 begin, u32 end) {
+	u32 index = u32(u64(data));
+	int cy = int(index) % WORLD_CHUNK_COUNT_Y;
+	int cz = (int(index) / WORLD_CHUNK_COUNT_Y) % WORLD_CHUNK_COUNT_Z;
+	int cx = int(index) / (WORLD_CHUNK_COUNT_Y * WORLD_CHUNK_COUNT_Z);
+
+	DecorateChunk(GetChunk(cx, cy, cz));
+
+	AtomicStore(&pipeline.slots[index].state, CHUNK_STATE_DECORATED);
+}
+
+internal void MeshChunkJob(void *data, u32 begin, u32 end) {
+	u32 index = u32(u64(data));
+	int cy = int(index) % WORLD_CHUNK_COUNT_Y;
+	int cz = (int(index) / WORLD_CHUNK_COUNT_Y) % WORLD_CHUNK_COUNT_Z;
+	int cx = int(index) / (WORLD_CHUNK_COUNT_Y * WORLD_CHUNK_COUNT_Z);
+
+	MeshChunk(GetChunk(cx, cy, cz));
+
+	AtomicStore(&pipeline.slots[index].state, CHUNK_STATE_MESHED);
+}
+
+internal void RecordStageDone(u32 stage, ChunkSlot *slot, u64 now) {
+	ChunkStageStats *stats = &pipeline.stats.stages[stage];
+
+	float latency = float(now - slot->queued_us) / 1000.0f;
+	stats->latency_avg = stats->completed ? stats->latency_avg * 0.95f + latency * 0.05f : latency;
+	stats->latency_max = Max(stats->latency_max * 0.99f, latency);
+	stats->completed++;
+
+	slot->queued_us = now;
+}
+
+void InitChunkPipeline() {
+	int rx = WORLD_CHUNK_COUNT_X - 1;
+	int ry = WORLD_CHUNK_COUNT_Y - 1;
+	int rz = WORLD_CHUNK_COUNT_Z - 1;
+	u32 max_distance = u32(rx * rx + ry * ry + rz * rz);
+
+	pipeline.order_count = u32((2 * rx + 1) * (2 * ry + 1) * (2 * rz + 1));
+	pipeline.order = (ChunkOffset *) HeapAlloc(pipeline.order_count * sizeof(ChunkOffset));
+
+	// counting sort by squared distance
+	u32 *bucket_start = (u32 *) HeapAlloc((max_distance + 2) * sizeof(u32));
+	SetMemory(bucket_start, 0, (max_distance + 2) * sizeof(u32));
+
+	for (int x = -rx; x <= rx; ++x) {
+		for (int y = -ry; y <= ry; ++y) {
+			for (int z = -rz; z <= rz; ++z) {
+				bucket_start[x * x + y * y + z * z + 1]++;
+			}
+		}
+	}
+	for (u32 d = 0; d <= max_distance; ++d) {
+		bucket_start[d + 1] += bucket_start[d];
+	}
+	for (int x = -rx; x <= rx; ++x) {
+		for (int y = -ry; y <= ry; ++y) {
+			for (int z = -rz; z <= rz; ++z) {
+				ChunkOffset *offset = &pipeline.order[bucket_start[x * x + y * y + z * z]++];
+				offset->x = s8(x);
+				offset->y = s8(y);
+				offset->z = s8(z);
+			}
+		}
+	}
+
+	HeapFree(bucket_start);
+
+	pipeline.edit_mutex = CreateMutex();
+
+	u64 now = GetTimeNowUs();
+	for (u32 i = 0; i < PIPELINE_CHUNK_COUNT; ++i) {
+		pipeline.slots[i].state = CHUNK_STATE_EMPTY;
+		pipeline.slots[i].seen_state = CHUNK_STATE_EMPTY;
+		pipeline.slots[i].queued_us = now;
+	}
+}
+
+b32 UpdateChunkPipeline(vec3 focus) {
+	PROFILE_FUNCTION();
+
+	b32 result = 0;
+	u64 now = GetTimeNowUs();
+
+	// pick up what the jobs finished since last frame
+	for (u32 i = 0; i < PIPELINE_CHUNK_COUNT; ++i) {
+		ChunkSlot *slot = &pipeline.slots[i];
+		u32 state = AtomicLoad(&slot->state);
+
+		if (state != slot->seen_state) {
+			u32 stage = CHUNK_STAGE_GENERATE;
+			if (state == CHUNK_STATE_DECORATED) {
+				stage = CHUNK_STAGE_DECORATE;
+			} else if (state == CHUNK_STATE_MESHED) {
+				stage = CHUNK_STAGE_MESH;
+			}
+
+			pipeline.stats.stages[stage].in_flight--;
+			RecordStageDone(stage, slot, now);
+			slot->seen_state = state;
+		}
+	}
+
+	// the simulation is applying edits, start jobs next frame instead of
+	// waiting for it
+	if (!TryAcquireMutex(pipeline.edit_mutex)) {
+		return result;
+	}
+
+	ChunkStageStats *stages = pipeline.stats.stages;
+	u32 decorate_backlog = stages[CHUNK_STAGE_DECORATE].waiting;
+	u32 mesh_backlog = stages[CHUNK_STAGE_MESH].waiting;
+	u32 upload_backlog = stages[CHUNK_STAGE_UPLOAD].waiting;
+
+	for (u32 s = 0; s < CHUNK_STAGE_COUNT; ++s) {
+		stages[s].waiting = 0;
+	}
+
+	u32 uploads = 0;
+
+	int fx = IFloor(focus.x / CHUNK_X);
+	int fy = IFloor(focus.y / CHUNK_Y);
+	int fz = IFloor(focus.z / CHUNK_Z);
+
+	for (u32 o = 0; o < pipeline.order_count; ++o) {
+		ChunkOffset offset = pipeline.order[o];
+		int cx = fx + offset.x;
+		int cy = fy + offset.y;
+		int cz = fz + offset.z;
+
+		if (!IsChunkInWorld(cx, cy, cz)) continue;
+
+		u32 index = GetChunkIndex(cx, cy, cz);
+		ChunkSlot *slot = &pipeline.slots[index];
+		Chunk *c = GetChunk(cx, cy, cz);
+
+		switch (slot->seen_state) {
+			case CHUNK_STATE_EMPTY: {
+				stages[CHUNK_STAGE_GENERATE].waiting++;
+
+				if (stages[CHUNK_STAGE_GENERATE].in_flight < PIPELINE_MAX_GENERATE_IN_FLIGHT * WORLD_CHUNK_COUNT_Y &&
+					decorate_backlog < PIPELINE_MAX_WAITING) {
+					for (int y = 0; y < WORLD_CHUNK_COUNT_Y; ++y) {
+						ChunkSlot *column_slot = &pipeline.slots[GetChunkIndex(cx, y, cz)];
+						column_slot->state = CHUNK_STATE_GENERATING;
+						column_slot->seen_state = CHUNK_STATE_GENERATING;
+					}
+					stages[CHUNK_STAGE_GENERATE].in_flight += WORLD_CHUNK_COUNT_Y;
+
+					RunJob(GenerateColumnJob, (void *) u64(cx * WORLD_CHUNK_COUNT_Z + cz), 0);
+				}
+			} break;
+
+			case CHUNK_STATE_GENERATED: {
+				if (GetChunkState(cx, cy + 1, cz) < CHUNK_STATE_GENERATED) break;
+
+				stages[CHUNK_STAGE_DECORATE].waiting++;
+
+				if (stages[CHUNK_STAGE_DECORATE].in_flight < PIPELINE_MAX_DECORATE_IN_FLIGHT &&
+					mesh_backlog < PIPELINE_MAX_WAITING) {
+					slot->state = CHUNK_STATE_DECORATING;
+					slot->seen_state = CHUNK_STATE_DECORATING;
+					stages[CHUNK_STAGE_DECORATE].in_flight++;
+
+					RunJob(DecorateChunkJob, (void *) u64(index), 0);
+				}
+			} break;
+
+			case CHUNK_STATE_DECORATED: {
+				// faces on the border need the neighbours' final blocks
+				if (GetChunkState(cx - 1, cy, cz) < CHUNK_STATE_DECORATED) break;
+				if (GetChunkState(cx + 1, cy, cz) < CHUNK_STATE_DECORATED) break;
+				if (GetChunkState(cx, cy - 1, cz) < CHUNK_STATE_DECORATED) break;
+				if (GetChunkState(cx, cy + 1, cz) < CHUNK_STATE_DECORATED) break;
+				if (GetChunkState(cx, cy, cz - 1) < CHUNK_STATE_DECORATED) break;
+				if (GetChunkState(cx, cy, cz + 1) < CHUNK_STATE_DECORATED) break;
+
+				stages[CHUNK_STAGE_MESH].waiting++;
+
+				if (stages[CHUNK_STAGE_MESH].in_flight < PIPELINE_MAX_MESH_IN_FLIGHT &&
+					upload_backlog < PIPELINE_MAX_WAITING) {
+					AtomicStore(&c->dirty, 0);
+					slot->state = CHUNK_STATE_MESHING;
+					slot->seen_state = CHUNK_STATE_MESHING;
+					stages[CHUNK_STAGE_MESH].in_flight++;
+
+					RunJob(MeshChunkJob, (void *) u64(index), 0);
+				}
+			} break;
+
+			case CHUNK_STATE_MESHED: {
+				stages[CHUNK_STAGE_UPLOAD].waiting++;
+
+				if (uploads < PIPELINE_MAX_UPLOADS_PER_FRAME) {
+					CommitChunkMesh(c);
+					if (pipeline.changed_count < CHANGED_CHUNKS_MAX) {
+						pipeline.changed_chunks[pipeline.changed_count] = c->world_pos;
+					}
+					pipeline.changed_count++;
+
+					slot->state = CHUNK_STATE_UPLOADED;
+					slot->seen_state = CHUNK_STATE_UPLOADED;
+					stages[CHUNK_STAGE_UPLOAD].waiting--;
+					RecordStageDone(CHUNK_STAGE_UPLOAD, slot, now);
+
+					uploads++;
+					result = 1;
+				}
+			} break;
+
+			case CHUNK_STATE_UPLOADED: {
+				// edited since it was meshed, mesh it again
+				if (AtomicLoad(&c->dirty)) {
+					slot->state = CHUNK_STATE_DECORATED;
+					slot->seen_state = CHUNK_STATE_DECORATED;
+					slot->queued_us = now;
+				}
+			} break;
+		}
+	}
+
+	ReleaseMutex(pipeline.edit_mutex);
+
+	pipeline.stats.uploaded_chunks += uploads;
+
+	return result;
+}
+
+b32 FlushChunkPipeline(vec3 focus) {
+	b32 result = 0;
+
+	for (;;) {
+		result |= UpdateChunkPipeline(focus);
+
+		b32 done = 1;
+		for (u32 i = 0; i < PIPELINE_CHUNK_COUNT; ++i) {
+			if (pipeline.slots[i].seen_state != CHUNK_STATE_UPLOADED) {
+				done = 0;
+				break;
+			}
+		}
+
+		if (done) {
+			break;
+		}
+
+		SleepMs(1);
+	}
+
+	return result;
+}
+
+u32 TakeChangedChunks(vec3 *positions, u32 max_count) {
+	Assert(max_count <= CHANGED_CHUNKS_MAX);
+
+	u32 result = pipeline.changed_count;
+	CopyMemory(positions, pipeline.changed_chunks, Min(result, max_count) * sizeof(vec3));
+	pipeline.changed_count = 0;
+
+	return result;
+}
+
+void LockChunkEdits() {
+	AcquireMutex(pipeline.edit_mutex);
+}
+
+b32 TryLockChunkEdits() {
+	return TryAcquireMutex(pipeline.edit_mutex);
+}
+
+void UnlockChunkEdits() {
+	ReleaseMutex(pipeline.edit_mutex);
+}
+
+b32 IsChunkEditable(Chunk *c) {
+	u32 index = u32(c - GetChunk(0, 0, 0));
+	int cy = int(index) % WORLD_CHUNK_COUNT_Y;
+	int cz = (int(index) / WORLD_CHUNK_COUNT_Y) % WORLD_CHUNK_COUNT_Z;
+	int cx = int(index) / (WORLD_CHUNK_COUNT_Y * WORLD_CHUNK_COUNT_Z);
+
+	u32 state = GetChunkState(cx, cy, cz);
+	// a meshed chunk's mesh was built before the edit and it goes back to
+	// decorated once uploaded, like an uploaded one
+	if (state != CHUNK_STATE_DECORATED && state != CHUNK_STATE_MESHED && state != CHUNK_STATE_UPLOADED) return 0;
+
+	// meshes read the border blocks of their neighbours, decoration the
+	// bottom of the chunk above
+	if (GetChunkState(cx - 1, cy, cz) == CHUNK_STATE_MESHING) return 0;
+	if (GetChunkState(cx + 1, cy, cz) == CHUNK_STATE_MESHING) return 0;
+	if (GetChunkState(cx, cy - 1, cz) == CHUNK_STATE_MESHING) return 0;
+	if (GetChunkState(cx, cy + 1, cz) == CHUNK_STATE_MESHING) return 0;
+	if (GetChunkState(cx, cy, cz - 1) == CHUNK_STATE_MESHING) return 0;
+	if (GetChunkState(cx, cy, cz + 1) == CHUNK_STATE_MESHING) return 0;
+	if (GetChunkState(cx, cy - 1, cz) == CHUNK_STATE_DECORATING) return 0;
+
+	return 1;
+}
+
+ChunkPipelineStats GetChunkPipelineStats() {
+	return pipeline.stats;
+}
+
+const char *GetChunkStageName(u32 stage) {
+	return chunk_stage_names[stage];
+}
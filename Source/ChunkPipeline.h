@@ -0,0 +1,79 @@
+#pragma once
+
+#include "General.h"
+#include "Math/Vec.h"
+#include "World.h"
+
+enum {
+	CHUNK_STAGE_GENERATE,
+	CHUNK_STAGE_DECORATE,
+	CHUNK_STAGE_MESH,
+	CHUNK_STAGE_UPLOAD,
+
+	CHUNK_STAGE_COUNT
+};
+
+// A chunk only ever moves forward through these, except that an edit sends an
+// uploaded chunk back to CHUNK_STATE_DECORATED to be meshed again.
+enum {
+	CHUNK_STATE_EMPTY,
+	CHUNK_STATE_GENERATING,
+	CHUNK_STATE_GENERATED,
+	CHUNK_STATE_DECORATING,
+	CHUNK_STATE_DECORATED,
+	CHUNK_STATE_MESHING,
+	CHUNK_STATE_MESHED,
+	CHUNK_STATE_UPLOADED,
+};
+
+enum {
+	// changed chunks remembered between TakeChangedChunks calls
+	CHANGED_CHUNKS_MAX = 256,
+};
+
+struct ChunkStageStats {
+	// chunks whose dependencies are met but that the stage has not started
+	u32 waiting;
+	u32 in_flight;
+	u32 completed;
+
+	// from entering the stage's queue until the result was seen, in ms
+	float latency_avg;
+	float latency_max;
+};
+
+struct ChunkPipelineStats {
+	ChunkStageStats stages[CHUNK_STAGE_COUNT];
+	u32 uploaded_chunks;
+};
+
+void InitChunkPipeline();
+
+// Called once per frame on the render thread. Schedules work nearest to focus
+// first and commits finished meshes; returns whether any mesh changed.
+b32 UpdateChunkPipeline(vec3 focus);
+
+// Keeps updating until every chunk is uploaded, for runs that need the whole
+// world from the first frame. Returns whether any mesh changed.
+b32 FlushChunkPipeline(vec3 focus);
+
+// World positions of the chunks whose mesh was committed since the last call,
+// for caches built from the world geometry. Returns how many there were; past
+// max_count (at most CHANGED_CHUNKS_MAX) the rest are dropped and the caller
+// has to assume everything changed.
+u32 TakeChangedChunks(vec3 *positions, u32 max_count);
+
+// Edits from outside the jobs go between these, no job starts while they're
+// locked. UpdateChunkPipeline skips starting jobs for the frame if it finds
+// them locked, TryLockChunkEdits fails while it is starting them.
+void LockChunkEdits();
+b32 TryLockChunkEdits();
+void UnlockChunkEdits();
+// Whether no job writes the chunk or reads it, its own mesh or a neighbour's
+// included, until UnlockChunkEdits. Only meshed or uploaded chunks and
+// decorated ones waiting for their neighbours are, and only while none of the
+// neighbours is meshing and the chunk below isn't decorating.
+b32 IsChunkEditable(Chunk *c);
+
+ChunkPipelineStats GetChunkPipelineStats();
+const char *GetChunkStageName(u32 stage);
@@ -0,0 +1,158 @@
+#include "Collision.h"
+
+#include "World.h"
+#include "Math/NMath.h"
+
+// Faces closer than this count as touching rather than overlapping, so an
+// entity resting on a block can still slide along it.
+global const float collision_epsilon = 0.0001f;
+
+AABB CreateEntityAABB(vec3 feet_pos, float width, float height) {
+	AABB result = {};
+
+	float hw = width * 0.5f;
+	result.min = vec3(feet_pos.x - hw, feet_pos.y, feet_pos.z - hw);
+	result.max = vec3(feet_pos.x + hw, feet_pos.y + height, feet_pos.z + hw);
+
+	return result;
+}
+
+AABB OffsetAABB(AABB box, vec3 offset) {
+	AABB result = {};
+
+	result.min = box.min + offset;
+	result.max = box.max + offset;
+
+	return result;
+}
+
+internal b32 IsSolidAt(int x, int y, int z) {
+	// treat everything below the world as solid so nothing falls forever
+	if (y < 0) {
+		return 1;
+	}
+
+	// same for chunks that are still being generated, nothing falls into
+	// them and their blocks are left to the jobs writing them
+	if (!IsBlockDecorated(x, y, z)) {
+		return 1;
+	}
+
+	return IsSolidBlock(GetBlock(x, y, z));
+}
+
+internal b32 AnySolidInSlice(int axis, int slice, int min1, int max1, int min2, int max2) {
+	int a1 = (axis + 1) % 3;
+	int a2 = (axis + 2) % 3;
+
+	int p[3];
+	p[axis] = slice;
+
+	for (int i = min1; i <= max1; ++i) {
+		p[a1] = i;
+		for (int j = min2; j <= max2; ++j) {
+			p[a2] = j;
+			if (IsSolidAt(p[0], p[1], p[2])) {
+				return 1;
+			}
+		}
+	}
+
+	return 0;
+}
+
+// Returns the part of delta along axis that box can travel. Only the block
+// slices between the box face and its destination are visited, nearest first,
+// so the common case of free movement touches a handful of blocks.
+internal float ClipAxis(AABB box, float delta, int axis) {
+	if (delta == 0.0f) {
+		return 0.0f;
+	}
+
+	int a1 = (axis + 1) % 3;
+	int a2 = (axis + 2) % 3;
+
+	int min1 = IFloor(box.min.E[a1] + collision_epsilon);
+	int max1 = IFloor(box.max.E[a1] - collision_epsilon);
+	int min2 = IFloor(box.min.E[a2] + collision_epsilon);
+	int max2 = IFloor(box.max.E[a2] - collision_epsilon);
+
+	if (delta > 0.0f) {
+		float face = box.max.E[axis];
+		int first = ICeil(face - collision_epsilon);
+		int last = IFloor(face + delta - collision_epsilon);
+
+		for (int s = first; s <= last; ++s) {
+			if (AnySolidInSlice(axis, s, min1, max1, min2, max2)) {
+				return Max(float(s) - face, 0.0f);
+			}
+		}
+	} else {
+		float face = box.min.E[axis];
+		int first = IFloor(face + collision_epsilon) - 1;
+		int last = IFloor(face + delta + collision_epsilon);
+
+		for (int s = first; s >= last; --s) {
+			if (AnySolidInSlice(axis, s, min1, max1, min2, max2)) {
+				return Min(float(s + 1) - face, 0.0f);
+			}
+		}
+	}
+
+	return delta;
+}
+
+CollisionResult MoveAndCollide(AABB box, vec3 delta) {
+	CollisionResult result = {};
+
+	// y first so horizontal movement slides along the ground instead of catching on it
+	float dy = ClipAxis(box, delta.y, 1);
+	box = OffsetAABB(box, vec3(0, dy, 0));
+
+	float dx = ClipAxis(box, delta.x, 0);
+	box = OffsetAABB(box, vec3(dx, 0, 0));
+
+	float dz = ClipAxis(box, delta.z, 2);
+
+	result.delta = vec3(dx, dy, dz);
+	result.hit_x = dx != delta.x;
+	result.hit_y = dy != delta.y;
+	result.hit_z = dz != delta.z;
+
+	return result;
+}
+
+RayIntersection CastRay(vec3 origin, vec3 dir) {
+	RayIntersection result = {};
+
+	const float RAY_MAX_DISTANCE = 6;
+	const float RAY_STEP = 0.5f;
+
+	float dist = RAY_STEP;
+
+	result.pos = origin;
+	result.prev_pos = origin;
+
+	while (dist < RAY_MAX_DISTANCE) {
+		vec3 cp = origin + dir * dist;
+
+		result.prev_pos = result.pos;
+		result.pos = cp;
+
+		BlockRef ref = GetBlockRef(cp);
+		if (ref.c) {
+			if (!IsChunkDecorated(ref.c)) {
+				break;
+			}
+
+			Block b = GetBlock(ref);
+			if (b != BLOCK_AIR) {
+				break;
+			}
+		}
+
+		dist += RAY_STEP;
+	}
+
+	return result;
+}
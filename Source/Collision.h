@@ -0,0 +1,35 @@
+#pragma once
+
+#include "General.h"
+#include "Math/Vec.h"
+
+struct AABB {
+	vec3 min;
+	vec3 max;
+};
+
+struct CollisionResult {
+	vec3 delta;
+
+	b8 hit_x;
+	b8 hit_y;
+	b8 hit_z;
+};
+
+AABB CreateEntityAABB(vec3 feet_pos, float width, float height);
+AABB OffsetAABB(AABB box, vec3 offset);
+
+// Sweeps box by delta through the block grid, one axis at a time (y, x, z),
+// and returns the displacement that can be applied without entering a solid block.
+// Chunks that aren't decorated yet are solid.
+CollisionResult MoveAndCollide(AABB box, vec3 delta);
+
+struct RayIntersection {
+	vec3 pos;
+	vec3 prev_pos;
+};
+
+// Marches from origin along dir in half block steps until it is inside a
+// non-air block, a chunk that isn't decorated yet or 6 blocks away. prev_pos
+// is the step before that.
+RayIntersection CastRay(vec3 origin, vec3 dir);
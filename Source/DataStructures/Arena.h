@@ -22,6 +22,6 @@ void ResetArena(Arena *a);
 TempArena BeginTempArena(Arena *owning);
 void EndTempArena(TempArena ta);
 
-#define PushArray(a, ty, n, ...) (ty *) PushSize(a, n * sizeof(ty), ##__VA_ARGS__)
+#define PushArray(a, ty, n, ...) (ty *) PushSize(a, (n) * sizeof(ty), ##__VA_ARGS__)
 #define PushStruct(a, ty, ...) (ty *) PushSize(a, sizeof(ty), ##__VA_ARGS__)
 u8 *PushSize(Arena *a, u64 size, u64 align = 4);
@@ -1,5 +1,7 @@
 #include "Array.h"
 
+#include "../Platform/Platform.h"
+
 template<typename T>
 void Reserve(Array<T> &a, u64 count) {
     if (count == 0) {
@@ -98,7 +98,7 @@ typedef wchar_t * NativeString;
 #define MakeNativeString(literal) ((wchar_t *) L##literal)
 #else
 typedef char * NativeString;
-typedef MakeNativeString(literal) ((char *) literal)
+#define MakeNativeString(literal) ((char *) literal)
 #endif
 
 inline b32 IsDigit(char ch) {
@@ -109,3 +109,25 @@ inline b32 IsAlpha(char ch) {
     return ('A' <= ch && ch <= 'Z')
         || ('a' <= ch && ch <= 'z');
 }
+
+// Decimal digits only, fails on anything else and on overflow.
+inline b32 ParseU32(String str, u32 *value) {
+    if (str.len == 0) {
+        return 0;
+    }
+
+    u64 result = 0;
+    for (u64 i = 0; i < str.len; ++i) {
+        if (!IsDigit(char(str.ptr[i]))) {
+            return 0;
+        }
+
+        result = result * 10 + u64(str.ptr[i] - '0');
+        if (result > max_u32) {
+            return 0;
+        }
+    }
+
+    *value = u32(result);
+    return 1;
+}
@@ -0,0 +1,320 @@
+#include "Entities.h"
+
+#include "Collision.h"
+#include "Math/SIMD.h"
+#include "Math/NMath.h"
+#include "Platform/Platform.h"
+#include "Platform/Profiler.h"
+
+// per tick, same units as the player
+global const float entity_gravity = -0.01f;
+global const float entity_drag = 0.9f;
+
+EntityStore CreateEntityStore(u32 capacity) {
+	EntityStore result = {};
+
+	capacity = AlignPow2(capacity, 4);
+
+	// 15 per-entity arrays plus room for a spatial hash
+	u64 array_size = AlignPow2(capacity * sizeof(float), 64);
+	result.arena = CreateArena(array_size * 18 + ENTITY_HASH_BUCKET_COUNT * 3 * sizeof(u32) + KiloBytes(4));
+	result.capacity = capacity;
+
+	Arena *a = &result.arena;
+	result.px = PushArray(a, float, capacity, 64);
+	result.py = PushArray(a, float, capacity, 64);
+	result.pz = PushArray(a, float, capacity, 64);
+	result.vx = PushArray(a, float, capacity, 64);
+	result.vy = PushArray(a, float, capacity, 64);
+	result.vz = PushArray(a, float, capacity, 64);
+	result.width = PushArray(a, float, capacity, 64);
+	result.height = PushArray(a, float, capacity, 64);
+	result.dx = PushArray(a, float, capacity, 64);
+	result.dy = PushArray(a, float, capacity, 64);
+	result.dz = PushArray(a, float, capacity, 64);
+	result.keep_x = PushArray(a, float, capacity, 64);
+	result.keep_y = PushArray(a, float, capacity, 64);
+	result.keep_z = PushArray(a, float, capacity, 64);
+	result.on_ground = PushArray(a, b8, capacity, 64);
+
+	SetMemory(result.arena.ptr, 0, result.arena.top);
+
+	return result;
+}
+
+void DestroyEntityStore(EntityStore *store) {
+	FreeArena(&store->arena);
+	*store = {};
+}
+
+u32 SpawnEntity(EntityStore *store, vec3 pos, float width, float height) {
+	if (store->count >= store->capacity) {
+		return u32(-1);
+	}
+
+	u32 i = store->count++;
+
+	store->px[i] = pos.x;
+	store->py[i] = pos.y;
+	store->pz[i] = pos.z;
+	store->vx[i] = 0;
+	store->vy[i] = 0;
+	store->vz[i] = 0;
+	store->width[i] = width;
+	store->height[i] = height;
+	store->on_ground[i] = 0;
+
+	return i;
+}
+
+internal u32 NextRandom(u32 *state) {
+	u32 x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*state = x;
+
+	return x;
+}
+
+internal float RandomBilateral(u32 *state) {
+	return float(NextRandom(state) & 0xFFFFFF) / float(0xFFFFFF) * 2.0f - 1.0f;
+}
+
+void SpawnEntitiesAround(EntityStore *store, vec3 center, float radius, u32 count, u32 seed) {
+	u32 state = seed ? seed : 1;
+
+	for (u32 i = 0; i < count; ++i) {
+		vec3 pos = center;
+		pos.x += RandomBilateral(&state) * radius;
+		pos.z += RandomBilateral(&state) * radius;
+		pos.y += RandomBilateral(&state) * 2.0f + 4.0f;
+
+		u32 index = SpawnEntity(store, pos, 0.6f, 1.8f);
+		if (index == u32(-1)) {
+			break;
+		}
+
+		store->vx[index] = RandomBilateral(&state) * 0.2f;
+		store->vz[index] = RandomBilateral(&state) * 0.2f;
+	}
+}
+
+// Every array, the scratch ones too, so a lane past count adds nothing to
+// its position and keeps no velocity.
+internal void ClearEntityLane(EntityStore *store, u32 index) {
+	store->px[index] = 0;
+	store->py[index] = 0;
+	store->pz[index] = 0;
+	store->vx[index] = 0;
+	store->vy[index] = 0;
+	store->vz[index] = 0;
+	store->width[index] = 0;
+	store->height[index] = 0;
+	store->dx[index] = 0;
+	store->dy[index] = 0;
+	store->dz[index] = 0;
+	store->keep_x[index] = 0;
+	store->keep_y[index] = 0;
+	store->keep_z[index] = 0;
+	store->on_ground[index] = 0;
+}
+
+void RemoveEntity(EntityStore *store, u32 index) {
+	Assert(index < store->count);
+
+	u32 last = --store->count;
+
+	store->px[index] = store->px[last];
+	store->py[index] = store->py[last];
+	store->pz[index] = store->pz[last];
+	store->vx[index] = store->vx[last];
+	store->vy[index] = store->vy[last];
+	store->vz[index] = store->vz[last];
+	store->width[index] = store->width[last];
+	store->height[index] = store->height[last];
+	store->on_ground[index] = store->on_ground[last];
+
+	// keep the padding lanes zero so the SIMD passes never see stale data
+	ClearEntityLane(store, last);
+}
+
+internal void ApplyForces(EntityStore *store, u32 lane_count) {
+	f32x4 gravity = f32x4(entity_gravity);
+	f32x4 drag = f32x4(entity_drag);
+
+	for (u32 i = 0; i < lane_count; i += 4) {
+		f32x4 vx = f32x4(store->vx + i);
+		f32x4 vy = f32x4(store->vy + i);
+		f32x4 vz = f32x4(store->vz + i);
+
+		vy += gravity;
+
+		Store(vx * drag, store->vx + i);
+		Store(vy * drag, store->vy + i);
+		Store(vz * drag, store->vz + i);
+	}
+}
+
+// The only scalar pass: block lookups don't vectorize, but it reads the
+// positions and velocities straight out of the arrays the SIMD passes write.
+internal void ResolveCollisions(EntityStore *store) {
+	for (u32 i = 0; i < store->count; ++i) {
+		AABB box = CreateEntityAABB(vec3(store->px[i], store->py[i], store->pz[i]), store->width[i], store->height[i]);
+		vec3 velocity = vec3(store->vx[i], store->vy[i], store->vz[i]);
+
+		CollisionResult collision = MoveAndCollide(box, velocity);
+
+		store->dx[i] = collision.delta.x;
+		store->dy[i] = collision.delta.y;
+		store->dz[i] = collision.delta.z;
+		store->keep_x[i] = collision.hit_x ? 0.0f : 1.0f;
+		store->keep_y[i] = collision.hit_y ? 0.0f : 1.0f;
+		store->keep_z[i] = collision.hit_z ? 0.0f : 1.0f;
+		store->on_ground[i] = collision.hit_y && velocity.y < 0;
+	}
+}
+
+internal void ApplyDisplacement(EntityStore *store, u32 lane_count) {
+	for (u32 i = 0; i < lane_count; i += 4) {
+		Store(f32x4(store->px + i) + f32x4(store->dx + i), store->px + i);
+		Store(f32x4(store->py + i) + f32x4(store->dy + i), store->py + i);
+		Store(f32x4(store->pz + i) + f32x4(store->dz + i), store->pz + i);
+
+		Store(f32x4(store->vx + i) * f32x4(store->keep_x + i), store->vx + i);
+		Store(f32x4(store->vy + i) * f32x4(store->keep_y + i), store->vy + i);
+		Store(f32x4(store->vz + i) * f32x4(store->keep_z + i), store->vz + i);
+	}
+}
+
+void UpdateEntities(EntityStore *store, b32 collide) {
+	PROFILE_FUNCTION();
+
+	u32 lane_count = AlignPow2(store->count, 4);
+
+	ApplyForces(store, lane_count);
+
+	if (collide) {
+		ResolveCollisions(store);
+	} else {
+		u64 size = lane_count * sizeof(float);
+		CopyMemory(store->dx, store->vx, size);
+		CopyMemory(store->dy, store->vy, size);
+		CopyMemory(store->dz, store->vz, size);
+
+		for (u32 i = 0; i < lane_count; ++i) {
+			store->keep_x[i] = 1.0f;
+			store->keep_y[i] = 1.0f;
+			store->keep_z[i] = 1.0f;
+		}
+	}
+
+	ApplyDisplacement(store, lane_count);
+
+	// the SIMD passes ran over the padding lanes as well, gravity alone
+	// leaves them moving
+	for (u32 i = store->count; i < lane_count; ++i) {
+		ClearEntityLane(store, i);
+	}
+}
+
+SpatialHash CreateSpatialHash(EntityStore *store, float cell_size) {
+	SpatialHash result = {};
+
+	result.cell_size = cell_size;
+	result.inv_cell_size = 1.0f / cell_size;
+
+	Arena *a = &store->arena;
+	result.bucket_start = PushArray(a, u32, ENTITY_HASH_BUCKET_COUNT + 1, 64);
+	result.bucket_cursor = PushArray(a, u32, ENTITY_HASH_BUCKET_COUNT, 64);
+	result.entity_bucket = PushArray(a, u32, store->capacity, 64);
+	result.entity_index = PushArray(a, u32, store->capacity, 64);
+	result.bucket_stamp = PushArray(a, u32, ENTITY_HASH_BUCKET_COUNT, 64);
+	ZeroMemory(result.bucket_stamp, ENTITY_HASH_BUCKET_COUNT * sizeof(u32));
+
+	return result;
+}
+
+internal u32 HashCell(int x, int y, int z) {
+	u32 h = u32(x) * 73856093u ^ u32(y) * 19349663u ^ u32(z) * 83492791u;
+
+	return h & (ENTITY_HASH_BUCKET_COUNT - 1);
+}
+
+void BuildSpatialHash(SpatialHash *hash, EntityStore *store) {
+	PROFILE_FUNCTION();
+
+	SetMemory(hash->bucket_start, 0, (ENTITY_HASH_BUCKET_COUNT + 1) * sizeof(u32));
+
+	for (u32 i = 0; i < store->count; ++i) {
+		int cx = IFloor(store->px[i] * hash->inv_cell_size);
+		int cy = IFloor(store->py[i] * hash->inv_cell_size);
+		int cz = IFloor(store->pz[i] * hash->inv_cell_size);
+
+		u32 bucket = HashCell(cx, cy, cz);
+		hash->entity_bucket[i] = bucket;
+		hash->bucket_start[bucket + 1]++;
+	}
+
+	for (u32 b = 0; b < ENTITY_HASH_BUCKET_COUNT; ++b) {
+		hash->bucket_start[b + 1] += hash->bucket_start[b];
+	}
+
+	CopyMemory(hash->bucket_cursor, hash->bucket_start, ENTITY_HASH_BUCKET_COUNT * sizeof(u32));
+
+	for (u32 i = 0; i < store->count; ++i) {
+		u32 bucket = hash->entity_bucket[i];
+		hash->entity_index[hash->bucket_cursor[bucket]++] = i;
+	}
+}
+
+u32 QueryEntitiesInRadius(SpatialHash *hash, EntityStore *store, vec3 center, float radius, u32 *result, u32 max_results) {
+	u32 result_count = 0;
+
+	int min_x = IFloor((center.x - radius) * hash->inv_cell_size);
+	int min_y = IFloor((center.y - radius) * hash->inv_cell_size);
+	int min_z = IFloor((center.z - radius) * hash->inv_cell_size);
+	int max_x = IFloor((center.x + radius) * hash->inv_cell_size);
+	int max_y = IFloor((center.y + radius) * hash->inv_cell_size);
+	int max_z = IFloor((center.z + radius) * hash->inv_cell_size);
+
+	// different cells can land in the same bucket, only walk each bucket once
+	u32 stamp = ++hash->query_stamp;
+	if (stamp == 0) {
+		ZeroMemory(hash->bucket_stamp, ENTITY_HASH_BUCKET_COUNT * sizeof(u32));
+		stamp = hash->query_stamp = 1;
+	}
+
+	float radius_sq = radius * radius;
+
+	for (int x = min_x; x <= max_x; ++x) {
+		for (int y = min_y; y <= max_y; ++y) {
+			for (int z = min_z; z <= max_z; ++z) {
+				u32 bucket = HashCell(x, y, z);
+
+				if (hash->bucket_stamp[bucket] == stamp) {
+					continue;
+				}
+				hash->bucket_stamp[bucket] = stamp;
+
+				for (u32 k = hash->bucket_start[bucket]; k < hash->bucket_start[bucket + 1]; ++k) {
+					u32 i = hash->entity_index[k];
+
+					float dx = store->px[i] - center.x;
+					float dy = store->py[i] - center.y;
+					float dz = store->pz[i] - center.z;
+					if (dx * dx + dy * dy + dz * dz > radius_sq) {
+						continue;
+					}
+
+					if (result_count == max_results) {
+						return result_count;
+					}
+					result[result_count++] = i;
+				}
+			}
+		}
+	}
+
+	return result_count;
+}
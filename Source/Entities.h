@@ -0,0 +1,68 @@
+#pragma once
+
+#include "General.h"
+#include "DataStructures/Arena.h"
+#include "Math/Vec.h"
+
+enum {
+	ENTITY_HASH_BUCKET_COUNT = 4096,
+};
+
+// Structure-of-arrays store so the integrator can process four entities per
+// f32x4. Capacity is padded to a multiple of 4, the padding lanes in every
+// array are zero between updates.
+struct EntityStore {
+	Arena arena;
+	u32 count;
+	u32 capacity;
+
+	float *px;
+	float *py;
+	float *pz;
+
+	float *vx;
+	float *vy;
+	float *vz;
+
+	float *width;
+	float *height;
+
+	// scratch filled by the collision pass: displacement and which velocity components survive
+	float *dx;
+	float *dy;
+	float *dz;
+	float *keep_x;
+	float *keep_y;
+	float *keep_z;
+
+	b8 *on_ground;
+};
+
+// Uniform grid hashed into a fixed bucket table, rebuilt with a counting sort
+// each tick so entities in one bucket are contiguous in entity_index.
+struct SpatialHash {
+	float cell_size;
+	float inv_cell_size;
+
+	u32 *bucket_start;
+	u32 *bucket_cursor;
+	u32 *entity_bucket;
+	u32 *entity_index;
+
+	// a bucket was already walked by the current query when its stamp matches
+	u32 *bucket_stamp;
+	u32 query_stamp;
+};
+
+EntityStore CreateEntityStore(u32 capacity);
+void DestroyEntityStore(EntityStore *store);
+
+u32 SpawnEntity(EntityStore *store, vec3 pos, float width, float height);
+void SpawnEntitiesAround(EntityStore *store, vec3 center, float radius, u32 count, u32 seed);
+void RemoveEntity(EntityStore *store, u32 index);
+
+void UpdateEntities(EntityStore *store, b32 collide);
+
+SpatialHash CreateSpatialHash(EntityStore *store, float cell_size);
+void BuildSpatialHash(SpatialHash *hash, EntityStore *store);
+u32 QueryEntitiesInRadius(SpatialHash *hash, EntityStore *store, vec3 center, float radius, u32 *result, u32 max_results);
@@ -0,0 +1,215 @@
+#include "FrameStats.h"
+
+#include "Platform/Platform.h"
+
+// needs this many frames in the window before the median means anything
+global const u32 auto_hitch_min_frames = 60;
+
+struct FrameHistogram {
+	u32 counts[FRAME_STATS_BUCKET_COUNT];
+	u32 total;
+};
+
+struct FrameHitch {
+	u32 frame;
+	float cpu_ms;
+	float gpu_ms;
+	FrameTags tags;
+};
+
+struct FrameStats {
+	float hitch_ms;
+	u32 frame_count;
+
+	float window_cpu[FRAME_STATS_WINDOW];
+	float window_gpu[FRAME_STATS_WINDOW];
+	b8 window_hitch[FRAME_STATS_WINDOW];
+	u32 window_hitches;
+
+	FrameHistogram rolling_cpu;
+	FrameHistogram rolling_gpu;
+	FrameHistogram total_cpu;
+	FrameHistogram total_gpu;
+	float total_cpu_max;
+	float total_gpu_max;
+
+	u32 hitch_count;
+	FrameHitch *hitches;
+};
+
+global FrameStats frame_stats;
+
+internal u32 GetFrameBucket(float ms) {
+	u32 bucket = u32(Max(ms, 0.0f) / FRAME_STATS_BUCKET_MS);
+	return Min(bucket, u32(FRAME_STATS_BUCKET_COUNT - 1));
+}
+
+internal void AddFrameTime(FrameHistogram *h, float ms) {
+	h->counts[GetFrameBucket(ms)]++;
+	h->total++;
+}
+
+internal void RemoveFrameTime(FrameHistogram *h, float ms) {
+	h->counts[GetFrameBucket(ms)]--;
+	h->total--;
+}
+
+// upper edge of the bucket the percentile falls into, never above the max
+internal float GetPercentile(FrameHistogram *h, float p, float max) {
+	if (h->total == 0) {
+		return 0.0f;
+	}
+
+	u32 target = Max(u32(p * float(h->total) + 0.999f), 1u);
+	u32 seen = 0;
+	for (u32 i = 0; i < FRAME_STATS_BUCKET_COUNT; ++i) {
+		seen += h->counts[i];
+		if (seen >= target) {
+			return Min(float(i + 1) * FRAME_STATS_BUCKET_MS, max);
+		}
+	}
+
+	return max;
+}
+
+internal FrameTimePercentiles GetPercentiles(FrameHistogram *h, float max) {
+	FrameTimePercentiles result = {};
+
+	result.p50 = GetPercentile(h, 0.50f, max);
+	result.p95 = GetPercentile(h, 0.95f, max);
+	result.p99 = GetPercentile(h, 0.99f, max);
+	result.max = max;
+
+	return result;
+}
+
+void InitFrameStats(float hitch_ms) {
+	frame_stats = {};
+	frame_stats.hitch_ms = hitch_ms;
+	frame_stats.hitches = (FrameHitch *) HeapAlloc(FRAME_STATS_MAX_HITCHES * sizeof(FrameHitch));
+}
+
+void DestroyFrameStats() {
+	HeapFree(frame_stats.hitches);
+	frame_stats.hitches = 0;
+}
+
+internal b32 IsHitch(float cpu_ms, float gpu_ms) {
+	if (frame_stats.hitch_ms > 0.0f) {
+		return cpu_ms > frame_stats.hitch_ms || gpu_ms > frame_stats.hitch_ms;
+	}
+
+	if (frame_stats.rolling_cpu.total < auto_hitch_min_frames) {
+		return 0;
+	}
+
+	// twice the median, and a couple of ms at least so jitter on very
+	// short frames doesn't count
+	float cap = FRAME_STATS_BUCKET_COUNT * FRAME_STATS_BUCKET_MS;
+	float cpu_median = GetPercentile(&frame_stats.rolling_cpu, 0.5f, cap);
+	float gpu_median = GetPercentile(&frame_stats.rolling_gpu, 0.5f, cap);
+
+	return cpu_ms > Max(cpu_median * 2.0f, cpu_median + 2.0f) ||
+		gpu_ms > Max(gpu_median * 2.0f, gpu_median + 2.0f);
+}
+
+b32 RecordFrameStats(double cpu_ms, double gpu_ms, FrameTags tags) {
+	float cpu = float(cpu_ms);
+	float gpu = float(gpu_ms);
+
+	u32 slot = frame_stats.frame_count % FRAME_STATS_WINDOW;
+	if (frame_stats.frame_count >= FRAME_STATS_WINDOW) {
+		RemoveFrameTime(&frame_stats.rolling_cpu, frame_stats.window_cpu[slot]);
+		RemoveFrameTime(&frame_stats.rolling_gpu, frame_stats.window_gpu[slot]);
+		frame_stats.window_hitches -= frame_stats.window_hitch[slot];
+	}
+
+	// judged against the frames before it
+	b32 hitch = IsHitch(cpu, gpu);
+
+	frame_stats.window_cpu[slot] = cpu;
+	frame_stats.window_gpu[slot] = gpu;
+	frame_stats.window_hitch[slot] = b8(hitch);
+	frame_stats.window_hitches += hitch;
+
+	AddFrameTime(&frame_stats.rolling_cpu, cpu);
+	AddFrameTime(&frame_stats.rolling_gpu, gpu);
+	AddFrameTime(&frame_stats.total_cpu, cpu);
+	AddFrameTime(&frame_stats.total_gpu, gpu);
+	frame_stats.total_cpu_max = Max(frame_stats.total_cpu_max, cpu);
+	frame_stats.total_gpu_max = Max(frame_stats.total_gpu_max, gpu);
+
+	if (hitch) {
+		if (frame_stats.hitch_count < FRAME_STATS_MAX_HITCHES) {
+			FrameHitch *h = &frame_stats.hitches[frame_stats.hitch_count];
+			h->frame = frame_stats.frame_count;
+			h->cpu_ms = cpu;
+			h->gpu_ms = gpu;
+			h->tags = tags;
+		}
+		frame_stats.hitch_count++;
+	}
+
+	frame_stats.frame_count++;
+
+	return hitch;
+}
+
+FrameStatsSummary GetRollingFrameStats() {
+	FrameStatsSummary result = {};
+
+	u32 count = Min(frame_stats.frame_count, u32(FRAME_STATS_WINDOW));
+
+	float cpu_max = 0.0f;
+	float gpu_max = 0.0f;
+	for (u32 i = 0; i < count; ++i) {
+		cpu_max = Max(cpu_max, frame_stats.window_cpu[i]);
+		gpu_max = Max(gpu_max, frame_stats.window_gpu[i]);
+	}
+
+	result.frames = count;
+	result.hitches = frame_stats.window_hitches;
+	result.cpu = GetPercentiles(&frame_stats.rolling_cpu, cpu_max);
+	result.gpu = GetPercentiles(&frame_stats.rolling_gpu, gpu_max);
+
+	return result;
+}
+
+FrameStatsSummary GetTotalFrameStats() {
+	FrameStatsSummary result = {};
+
+	result.frames = frame_stats.frame_count;
+	result.hitches = frame_stats.hitch_count;
+	result.cpu = GetPercentiles(&frame_stats.total_cpu, frame_stats.total_cpu_max);
+	result.gpu = GetPercentiles(&frame_stats.total_gpu, frame_stats.total_gpu_max);
+
+	return result;
+}
+
+b32 WriteFrameStatsCsv(String path) {
+	FileWriter *writer = (FileWriter *) HeapAlloc(sizeof(FileWriter));
+	if (!OpenFileWriter(writer, path)) {
+		HeapFree(writer);
+		return 0;
+	}
+
+	FrameStatsSummary total = GetTotalFrameStats();
+
+	WriteFormat(writer, "kind,frame,cpu_ms,gpu_ms,chunks_uploaded,chunks_pending,block_edits,upload_bytes,render_scale\n");
+	WriteFormat(writer, "p50,,%.3f,%.3f,,,,,\n", total.cpu.p50, total.gpu.p50);
+	WriteFormat(writer, "p95,,%.3f,%.3f,,,,,\n", total.cpu.p95, total.gpu.p95);
+	WriteFormat(writer, "p99,,%.3f,%.3f,,,,,\n", total.cpu.p99, total.gpu.p99);
+	WriteFormat(writer, "max,,%.3f,%.3f,,,,,\n", total.cpu.max, total.gpu.max);
+
+	u32 stored = Min(frame_stats.hitch_count, u32(FRAME_STATS_MAX_HITCHES));
+	for (u32 i = 0; i < stored; ++i) {
+		FrameHitch *h = &frame_stats.hitches[i];
+		WriteFormat(writer, "hitch,%u,%.3f,%.3f,%u,%u,%u,%llu,%.2f\n", h->frame, h->cpu_ms, h->gpu_ms,
+			h->tags.chunks_uploaded, h->tags.chunks_pending, h->tags.block_edits, h->tags.upload_bytes, h->tags.render_scale);
+	}
+
+	b32 result = CloseFileWriter(writer);
+	HeapFree(writer);
+
+	return result;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "General.h"
+#include "DataStructures/String.h"
+
+enum {
+	// frames the rolling percentiles cover
+	FRAME_STATS_WINDOW = 600,
+	// histogram buckets of FRAME_STATS_BUCKET_MS, the last one collects everything above
+	FRAME_STATS_BUCKET_COUNT = 2000,
+	FRAME_STATS_MAX_HITCHES = 4096,
+};
+
+#define FRAME_STATS_BUCKET_MS 0.05f
+
+// What happened during a frame, kept with it when it turns out to be a hitch.
+struct FrameTags {
+	u32 chunks_uploaded;
+	u32 chunks_pending;
+	u32 block_edits;
+	u64 upload_bytes;
+	// of the output size, what the 3D passes rendered at
+	float render_scale;
+};
+
+struct FrameTimePercentiles {
+	float p50;
+	float p95;
+	float p99;
+	float max;
+};
+
+struct FrameStatsSummary {
+	u32 frames;
+	u32 hitches;
+	FrameTimePercentiles cpu;
+	FrameTimePercentiles gpu;
+};
+
+// hitch_ms 0 counts frames above twice the rolling median (and at least 2ms
+// above it) as hitches.
+void InitFrameStats(float hitch_ms);
+void DestroyFrameStats();
+
+// Returns whether the frame was a hitch.
+b32 RecordFrameStats(double cpu_ms, double gpu_ms, FrameTags tags);
+
+FrameStatsSummary GetRollingFrameStats();
+FrameStatsSummary GetTotalFrameStats();
+
+// Rows of kind,frame,cpu_ms,gpu_ms,chunks_uploaded,chunks_pending,block_edits,upload_bytes,render_scale:
+// p50/p95/p99/max over the whole run first, then one per hitch.
+b32 WriteFrameStatsCsv(String path);
@@ -112,6 +112,10 @@ typedef unsigned int uint;
 #define AlignPow2(x, b) (((x) + (b) - 1) & (~((b) - 1)))
 #define IsPow2(x) ((x) != 0 && ((x) & ((x) - 1)) == 0)
 
+#ifndef __has_feature
+#define __has_feature(x) 0
+#endif
+
 #if __has_feature(address_sanitizer) || defined(__SANITIZE_ADDRESS__)
 #define ASAN_POISON_MEMORY_REGION(addr, size) __asan_poison_memory_region((addr), (size))
 #define ASAN_UNPOISON_MEMORY_REGION(addr, size) __asan_unpoison_memory_region((addr), (size))
@@ -0,0 +1,294 @@
+#include "GpuProfiler.h"
+
+#include "../Platform/Platform.h"
+
+struct GpuFrameZone {
+    const char *name;
+    u32 depth;
+};
+
+struct GpuProfilerFrame {
+    VkQueryPool pool;
+    u64 frame_index;
+    b32 pending;
+
+    u32 zone_count;
+    u32 depth;
+    GpuFrameZone zones[GPU_PROFILER_MAX_ZONES];
+};
+
+struct GpuZoneHistory {
+    const char *name;
+    u32 depth;
+    u32 count;
+    float ms[GPU_PROFILER_WINDOW];
+};
+
+struct GpuTraceEvent {
+    const char *name;
+    u64 frame_index;
+    u32 depth;
+    double begin_us;
+    double duration_us;
+};
+
+struct GpuProfiler {
+    double timestamp_period_ns;
+
+    u64 frame_index;
+    GpuProfilerFrame *current;
+    GpuProfilerFrame frames[GPU_PROFILER_FRAMES];
+
+    u32 resolved_frames;
+    u32 zone_count;
+    GpuZoneHistory zones[GPU_PROFILER_MAX_ZONES];
+
+    b32 has_origin;
+    u64 origin_timestamp;
+    u64 event_count;
+    GpuTraceEvent *events;
+};
+
+global GpuProfiler gpu_profiler;
+
+void InitGpuProfiler() {
+    VkPhysicalDeviceProperties props;
+    vkGetPhysicalDeviceProperties(GetPhysicalDevice(), &props);
+    gpu_profiler.timestamp_period_ns = double(props.limits.timestampPeriod);
+
+    for (u32 i = 0; i < GPU_PROFILER_FRAMES; ++i) {
+        gpu_profiler.frames[i].pool = CreateQueryPool(GPU_PROFILER_MAX_ZONES * 2, VK_QUERY_TYPE_TIMESTAMP);
+    }
+
+    gpu_profiler.events = (GpuTraceEvent *) HeapAlloc(GPU_PROFILER_HISTORY * sizeof(GpuTraceEvent));
+}
+
+void DestroyGpuProfiler() {
+    for (u32 i = 0; i < GPU_PROFILER_FRAMES; ++i) {
+        DestroyQueryPool(gpu_profiler.frames[i].pool);
+    }
+
+    HeapFree(gpu_profiler.events);
+    gpu_profiler = {};
+}
+
+internal GpuZoneHistory *FindZoneHistory(const char *name, u32 depth) {
+    for (u32 i = 0; i < gpu_profiler.zone_count; ++i) {
+        GpuZoneHistory *zone = &gpu_profiler.zones[i];
+        if (zone->depth == depth && String(zone->name) == name) {
+            return zone;
+        }
+    }
+
+    if (gpu_profiler.zone_count == GPU_PROFILER_MAX_ZONES) {
+        return 0;
+    }
+
+    GpuZoneHistory *zone = &gpu_profiler.zones[gpu_profiler.zone_count++];
+    zone->name = name;
+    zone->depth = depth;
+    zone->count = 0;
+
+    return zone;
+}
+
+internal void ResolveGpuFrame(GpuProfilerFrame *frame) {
+    if (!frame->pending || frame->zone_count == 0) {
+        return;
+    }
+
+    frame->pending = 0;
+
+    // value and availability per query
+    u64 results[GPU_PROFILER_MAX_ZONES * 2][2];
+    VkResult res = vkGetQueryPoolResults(GetLogicalDevice(), frame->pool, 0, frame->zone_count * 2, sizeof(results), results,
+        sizeof(results[0]), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+    if (res != VK_SUCCESS) {
+        return;
+    }
+
+    double ns_to_us = gpu_profiler.timestamp_period_ns * 1e-3;
+
+    if (!gpu_profiler.has_origin) {
+        gpu_profiler.origin_timestamp = results[0][0];
+        gpu_profiler.has_origin = 1;
+    }
+
+    u32 slot = gpu_profiler.resolved_frames % GPU_PROFILER_WINDOW;
+
+    for (u32 i = 0; i < frame->zone_count; ++i) {
+        GpuFrameZone *frame_zone = &frame->zones[i];
+        u64 begin = results[i * 2][0];
+        u64 end = results[i * 2 + 1][0];
+
+        // a zone that was never closed has no end timestamp
+        if (!results[i * 2][1] || !results[i * 2 + 1][1] || end < begin) {
+            continue;
+        }
+
+        double duration_us = double(end - begin) * ns_to_us;
+
+        GpuZoneHistory *zone = FindZoneHistory(frame_zone->name, frame_zone->depth);
+        if (zone) {
+            // zones that didn't run in a frame count as 0 there
+            for (; zone->count < gpu_profiler.resolved_frames; ++zone->count) {
+                zone->ms[zone->count % GPU_PROFILER_WINDOW] = 0.0f;
+            }
+            zone->ms[slot] = float(duration_us * 1e-3);
+            zone->count = gpu_profiler.resolved_frames + 1;
+        }
+
+        GpuTraceEvent *event = &gpu_profiler.events[gpu_profiler.event_count++ % GPU_PROFILER_HISTORY];
+        event->name = frame_zone->name;
+        event->frame_index = frame->frame_index;
+        event->depth = frame_zone->depth;
+        event->begin_us = double(s64(begin - gpu_profiler.origin_timestamp)) * ns_to_us;
+        event->duration_us = duration_us;
+    }
+
+    gpu_profiler.resolved_frames++;
+}
+
+void BeginGpuProfilerFrame(VkCommandBuffer cmdbuf) {
+    GpuProfilerFrame *frame = &gpu_profiler.frames[gpu_profiler.frame_index % GPU_PROFILER_FRAMES];
+
+    // the slot about to be reused is the oldest frame in the ring
+    ResolveGpuFrame(frame);
+
+    vkCmdResetQueryPool(cmdbuf, frame->pool, 0, GPU_PROFILER_MAX_ZONES * 2);
+    frame->frame_index = gpu_profiler.frame_index;
+    frame->pending = 1;
+    frame->zone_count = 0;
+    frame->depth = 0;
+
+    gpu_profiler.current = frame;
+    gpu_profiler.frame_index++;
+}
+
+void ResolveGpuProfiler() {
+    for (u32 i = 0; i < GPU_PROFILER_FRAMES; ++i) {
+        ResolveGpuFrame(&gpu_profiler.frames[(gpu_profiler.frame_index + i) % GPU_PROFILER_FRAMES]);
+    }
+
+    gpu_profiler.current = 0;
+}
+
+u32 BeginGpuZone(VkCommandBuffer cmdbuf, const char *name) {
+    GpuProfilerFrame *frame = gpu_profiler.current;
+    if (!frame || frame->zone_count == GPU_PROFILER_MAX_ZONES) {
+        return max_u32;
+    }
+
+    u32 zone = frame->zone_count++;
+    frame->zones[zone].name = name;
+    frame->zones[zone].depth = frame->depth++;
+
+    vkCmdWriteTimestamp(cmdbuf, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, frame->pool, zone * 2);
+
+    return zone;
+}
+
+void EndGpuZone(VkCommandBuffer cmdbuf, u32 zone) {
+    GpuProfilerFrame *frame = gpu_profiler.current;
+    if (!frame || zone == max_u32) {
+        return;
+    }
+
+    frame->depth--;
+
+    vkCmdWriteTimestamp(cmdbuf, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, frame->pool, zone * 2 + 1);
+}
+
+u32 GetGpuZoneStats(GpuZoneStats *stats, u32 max_count) {
+    u32 resolved = gpu_profiler.resolved_frames;
+    u32 window = Min(resolved, u32(GPU_PROFILER_WINDOW));
+    u32 count = Min(gpu_profiler.zone_count, max_count);
+
+    for (u32 i = 0; i < count; ++i) {
+        GpuZoneHistory *zone = &gpu_profiler.zones[i];
+        GpuZoneStats *result = &stats[i];
+
+        *result = {};
+        result->name = zone->name;
+        result->depth = zone->depth;
+
+        float total = 0.0f;
+        for (u32 f = resolved - window; f < resolved; ++f) {
+            // frames after the zone last ran count as 0
+            float ms = f < zone->count ? zone->ms[f % GPU_PROFILER_WINDOW] : 0.0f;
+            total += ms;
+            result->max_ms = Max(result->max_ms, ms);
+        }
+
+        if (window) {
+            result->avg_ms = total / float(window);
+        }
+        if (zone->count == resolved && resolved) {
+            result->last_ms = zone->ms[(resolved - 1) % GPU_PROFILER_WINDOW];
+        }
+    }
+
+    return count;
+}
+
+void PrintGpuProfile() {
+    GpuZoneStats stats[GPU_PROFILER_MAX_ZONES];
+    u32 count = GetGpuZoneStats(stats, GPU_PROFILER_MAX_ZONES);
+
+    Print("gpu zone              last      avg      max  (%u frames)\n", Min(gpu_profiler.resolved_frames, u32(GPU_PROFILER_WINDOW)));
+    for (u32 i = 0; i < count; ++i) {
+        GpuZoneStats *zone = &stats[i];
+        Print("%*s%-*s %7.3fms %7.3fms %7.3fms\n", int(zone->depth * 2), "", int(18 - Min(zone->depth * 2, 16u)), zone->name,
+            zone->last_ms, zone->avg_ms, zone->max_ms);
+    }
+}
+
+// events still in the history, oldest first
+internal u64 GetFirstGpuEvent() {
+    return gpu_profiler.event_count > GPU_PROFILER_HISTORY ? gpu_profiler.event_count - GPU_PROFILER_HISTORY : 0;
+}
+
+b32 WriteGpuTrace(String path) {
+    FileWriter *writer = (FileWriter *) HeapAlloc(sizeof(FileWriter));
+    if (!OpenFileWriter(writer, path)) {
+        HeapFree(writer);
+        return 0;
+    }
+
+    WriteFormat(writer, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    WriteFormat(writer, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"gpu\"}}");
+
+    for (u64 i = GetFirstGpuEvent(); i < gpu_profiler.event_count; ++i) {
+        GpuTraceEvent *event = &gpu_profiler.events[i % GPU_PROFILER_HISTORY];
+        WriteFormat(writer, ",\n{\"name\":\"%s\",\"cat\":\"gpu\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"frame\":%llu}}",
+            event->name, event->begin_us, event->duration_us, event->frame_index);
+    }
+
+    WriteFormat(writer, "\n]}\n");
+
+    b32 result = CloseFileWriter(writer);
+    HeapFree(writer);
+
+    return result;
+}
+
+b32 WriteGpuProfileCsv(String path) {
+    FileWriter *writer = (FileWriter *) HeapAlloc(sizeof(FileWriter));
+    if (!OpenFileWriter(writer, path)) {
+        HeapFree(writer);
+        return 0;
+    }
+
+    WriteFormat(writer, "frame,zone,depth,begin_ms,duration_ms\n");
+
+    for (u64 i = GetFirstGpuEvent(); i < gpu_profiler.event_count; ++i) {
+        GpuTraceEvent *event = &gpu_profiler.events[i % GPU_PROFILER_HISTORY];
+        WriteFormat(writer, "%llu,%s,%u,%.4f,%.4f\n", event->frame_index, event->name, event->depth,
+            event->begin_us * 1e-3, event->duration_us * 1e-3);
+    }
+
+    b32 result = CloseFileWriter(writer);
+    HeapFree(writer);
+
+    return result;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "../General.h"
+#include "../DataStructures/String.h"
+#include "NVulkan.h"
+
+enum {
+    // frames that can be in flight before their queries are read back
+    GPU_PROFILER_FRAMES = 3,
+    GPU_PROFILER_MAX_ZONES = 32,
+    // frames the rolling table covers
+    GPU_PROFILER_WINDOW = 128,
+    // resolved zones kept around for WriteGpuTrace/WriteGpuProfileCsv
+    GPU_PROFILER_HISTORY = 16384,
+};
+
+struct GpuZoneStats {
+    const char *name;
+    u32 depth;
+    float last_ms;
+    float avg_ms;
+    float max_ms;
+};
+
+void InitGpuProfiler();
+void DestroyGpuProfiler();
+
+// Call once per frame right after AcquireSwapchain, outside of rendering.
+// Reads back the oldest frame in the ring if the GPU is done with it, it
+// never waits; a frame whose queries aren't ready yet is dropped.
+void BeginGpuProfilerFrame(VkCommandBuffer cmdbuf);
+// Reads back every frame still in the ring, after WaitForDeviceIdle.
+void ResolveGpuProfiler();
+
+// Zones nest, name has to outlive the profiler (string literals).
+u32 BeginGpuZone(VkCommandBuffer cmdbuf, const char *name);
+void EndGpuZone(VkCommandBuffer cmdbuf, u32 zone);
+
+struct GpuZoneScope {
+    VkCommandBuffer cmdbuf;
+    u32 zone;
+
+    GpuZoneScope(VkCommandBuffer _cmdbuf, const char *name) {
+        cmdbuf = _cmdbuf;
+        zone = BeginGpuZone(cmdbuf, name);
+    }
+
+    ~GpuZoneScope() {
+        EndGpuZone(cmdbuf, zone);
+    }
+};
+
+#define GPU_ZONE(cmdbuf, name) GpuZoneScope NK_LINENUMBER(gpu_zone_)(cmdbuf, name)
+
+// Per zone over the last GPU_PROFILER_WINDOW resolved frames, in the order
+// the zones were first seen.
+u32 GetGpuZoneStats(GpuZoneStats *stats, u32 max_count);
+void PrintGpuProfile();
+
+// Chrome trace json, opens in chrome://tracing and ui.perfetto.dev
+b32 WriteGpuTrace(String path);
+// frame,zone,depth,begin_ms,duration_ms
+b32 WriteGpuProfileCsv(String path);
@@ -2,6 +2,9 @@
 
 #include "../DataStructures/Arena.h"
 #include "../Platform/Platform.h"
+#include "../Platform/Jobs.h"
+#include "../Platform/Profiler.h"
+#include "../AssetPack.h"
 
 #define VOLK_IMPLEMENTATION
 #include <Volk/volk.h>
@@ -36,6 +39,19 @@ VkSurfaceKHR GetSurfaceForWindow(Window *win) {
 
     return result;
 }
+#elif OS_LINUX
+VkSurfaceKHR GetSurfaceForWindow(Window *win) {
+    VkSurfaceKHR result = 0;
+
+    VkXcbSurfaceCreateInfoKHR surface_info = {};
+    surface_info.sType = VK_STRUCTURE_TYPE_XCB_SURFACE_CREATE_INFO_KHR;
+    surface_info.connection = (xcb_connection_t *) win->connection;
+    surface_info.window = xcb_window_t(win->handle);
+
+    VK_CHECK(vkCreateXcbSurfaceKHR(vulkan_state.instance, &surface_info, 0, &result));
+
+    return result;
+}
 #endif
 
 internal void InitPhysicalDevice(const char **device_extensions, u32 device_extensions_count) {
@@ -47,16 +63,14 @@ internal void InitPhysicalDevice(const char **device_extensions, u32 device_exte
     VkPhysicalDevice *devices = (VkPhysicalDevice *) HeapAlloc(dcount * sizeof(VkPhysicalDevice));
     VK_CHECK(vkEnumeratePhysicalDevices(instance, &dcount, devices));
 
+    VkPhysicalDevice fallback = 0;
+
     for (u32 i = 0; i < dcount; ++i) {
         VkPhysicalDevice pdevice = devices[i];
 
         VkPhysicalDeviceProperties properties;
         vkGetPhysicalDeviceProperties(pdevice, &properties);
 
-        if (properties.deviceType != VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU) {
-            continue;
-        }
-
         u32 dextcnt;
         VK_CHECK(vkEnumerateDeviceExtensionProperties(pdevice, 0, &dextcnt, 0));
 
@@ -88,10 +102,23 @@ internal void InitPhysicalDevice(const char **device_extensions, u32 device_exte
             continue;
         }
 
+        // integrated and software devices (lavapipe) only when there's no
+        // discrete one
+        if (properties.deviceType != VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU) {
+            if (!fallback) {
+                fallback = pdevice;
+            }
+            continue;
+        }
+
         vulkan_state.pdevice = pdevice;
         break;
     }
 
+    if (!vulkan_state.pdevice) {
+        vulkan_state.pdevice = fallback;
+    }
+
     if (!vulkan_state.pdevice) {
         Print("Failed to find compatible device.");
         Exit(1);
@@ -119,8 +146,10 @@ internal void InitLogicalDevice(const char **device_extensions, u32 device_exten
         VkQueueFamilyProperties props = quefmlyprops[i];
 
         if ((props.queueFlags & VK_QUEUE_GRAPHICS_BIT)) {
-            VkBool32 present_supports = VK_FALSE;
-            vkGetPhysicalDeviceSurfaceSupportKHR(pdev, i, vulkan_state.surface, &present_supports);
+            VkBool32 present_supports = VK_TRUE;
+            if (vulkan_state.surface) {
+                vkGetPhysicalDeviceSurfaceSupportKHR(pdev, i, vulkan_state.surface, &present_supports);
+            }
 
             if (!present_supports) {
                 continue;
@@ -150,7 +179,6 @@ internal void InitLogicalDevice(const char **device_extensions, u32 device_exten
 
     VkPhysicalDeviceVulkan12Features features12 = {};
     features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
-    features12.runtimeDescriptorArray = true;
 
     VkPhysicalDeviceVulkan13Features features13 = {};
     features13.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
@@ -189,19 +217,44 @@ void InitVulkan(Window *win) {
     app_info.pEngineName = "Engine";
     app_info.apiVersion = VK_API_VERSION_1_3;
 
+#if OS_WINDOWS
     const char *extensions[] = { VK_KHR_SURFACE_EXTENSION_NAME, VK_KHR_WIN32_SURFACE_EXTENSION_NAME };
+#elif OS_LINUX
+    const char *extensions[] = { VK_KHR_SURFACE_EXTENSION_NAME, VK_KHR_XCB_SURFACE_EXTENSION_NAME };
+#endif
     const char *layers[] = { "VK_LAYER_KHRONOS_validation" };
 
     const char *device_extensions[] = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
 
-    // @Todo: check if extensions and layers are available
+    // headless runs need neither surface nor swapchain extensions
+    u32 extensions_count = win ? ArrayCount(extensions) : 0;
+    u32 device_extensions_count = win ? ArrayCount(device_extensions) : 0;
+
+    // batch machines usually don't have the SDK layers installed
+    u32 layers_count = 0;
+    u32 available_layers_count = 0;
+    VK_CHECK(vkEnumerateInstanceLayerProperties(&available_layers_count, 0));
+
+    VkLayerProperties *available_layers = (VkLayerProperties *) HeapAlloc(available_layers_count * sizeof(VkLayerProperties));
+    VK_CHECK(vkEnumerateInstanceLayerProperties(&available_layers_count, available_layers));
+
+    for (u32 i = 0; i < available_layers_count; ++i) {
+        if (strcmp(available_layers[i].layerName, layers[0]) == 0) {
+            layers_count = 1;
+            break;
+        }
+    }
+
+    HeapFree(available_layers);
+
+    // @Todo: check if extensions are available
 
     VkInstanceCreateInfo instance_info = {};
     instance_info.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
     instance_info.pApplicationInfo = &app_info;
-    instance_info.enabledExtensionCount = ArrayCount(extensions);
+    instance_info.enabledExtensionCount = extensions_count;
     instance_info.ppEnabledExtensionNames = extensions;
-    instance_info.enabledLayerCount = ArrayCount(layers);
+    instance_info.enabledLayerCount = layers_count;
     instance_info.ppEnabledLayerNames = layers;
 
     VkInstance instance;
@@ -210,10 +263,12 @@ void InitVulkan(Window *win) {
     volkLoadInstance(instance);
 
     vulkan_state.instance = instance;
-    vulkan_state.surface = GetSurfaceForWindow(win);
+    if (win) {
+        vulkan_state.surface = GetSurfaceForWindow(win);
+    }
 
-    InitPhysicalDevice(device_extensions, ArrayCount(device_extensions));
-    InitLogicalDevice(device_extensions, ArrayCount(device_extensions));
+    InitPhysicalDevice(device_extensions, device_extensions_count);
+    InitLogicalDevice(device_extensions, device_extensions_count);
     volkLoadDevice(vulkan_state.ldevice);
 
     VmaVulkanFunctions vma_vulkan_func{};
@@ -250,7 +305,9 @@ void InitVulkan(Window *win) {
 void ReleaseVulkan() {
     vmaDestroyAllocator(vulkan_state.allocator);
     vkDestroyDevice(vulkan_state.ldevice, 0);
-    vkDestroySurfaceKHR(vulkan_state.instance, vulkan_state.surface, 0);
+    if (vulkan_state.surface) {
+        vkDestroySurfaceKHR(vulkan_state.instance, vulkan_state.surface, 0);
+    }
     vkDestroyInstance(vulkan_state.instance, 0);
     FreeArena(&vulkan_state.arena);
 }
@@ -342,14 +399,22 @@ void CreateSwapchain(Swapchain *swapchain, VkCommandPool cmdpool) {
     VkSurfaceFormatKHR *formats = (VkSurfaceFormatKHR *) HeapAlloc(formats_count * sizeof(VkSurfaceFormatKHR));
     vkGetPhysicalDeviceSurfaceFormatsKHR(pdev, surface, &formats_count, formats);
 
+    // the post pass writes linear color and relies on the target encoding it
+    b32 found_format = 0;
     for (u32 i = 0; i < formats_count; ++i) {
         VkSurfaceFormatKHR format = formats[i];
-        if (format.format == VK_FORMAT_R8G8B8A8_SRGB) {
+        if (format.format == VK_FORMAT_R8G8B8A8_SRGB || format.format == VK_FORMAT_B8G8R8A8_SRGB) {
             sc->format = format;
+            found_format = 1;
             break;
         }
     }
 
+    if (!found_format) {
+        Print("Surface doesn't support an sRGB format.\n");
+        Exit(1);
+    }
+
     VkSemaphoreCreateInfo semaphore_info = {};
     semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
@@ -368,6 +433,54 @@ void CreateSwapchain(Swapchain *swapchain, VkCommandPool cmdpool) {
     HeapFree(formats);
 }
 
+void CreateHeadlessSwapchain(Swapchain *swapchain, u32 width, u32 height) {
+    VkDevice ldev = vulkan_state.ldevice;
+    Swapchain *sc = swapchain;
+
+    sc->headless = 1;
+    sc->width = width;
+    sc->height = height;
+    sc->format.format = VK_FORMAT_R8G8B8A8_SRGB;
+    sc->format.colorSpace = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR;
+
+    VkFenceCreateInfo fence_info = {};
+    fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+    VK_CHECK(vkCreateFence(ldev, &fence_info, 0, &sc->frame_fence));
+
+    sc->query_pool = CreateQueryPool(2, VK_QUERY_TYPE_TIMESTAMP);
+
+    sc->copy_target = CreateImage(width, height, sc->format.format, 1, VK_IMAGE_ASPECT_COLOR_BIT,
+        VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT);
+
+    VkBufferCreateInfo info = {};
+    info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    info.size = VkDeviceSize(width) * height * 4;
+    info.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    VmaAllocationCreateInfo alloc_create_info = {};
+    alloc_create_info.usage = VMA_MEMORY_USAGE_AUTO;
+    alloc_create_info.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT;
+
+    VK_CHECK(vmaCreateBuffer(vulkan_state.allocator, &info, &alloc_create_info, &sc->readback.handle,
+        &sc->readback.allocation, &sc->readback.allocation_info));
+}
+
+void RequestSwapchainReadback(Swapchain *swapchain) {
+    Assert(swapchain->headless);
+
+    swapchain->readback_requested = 1;
+}
+
+u8 *GetSwapchainReadback(Swapchain *swapchain) {
+    Swapchain *sc = swapchain;
+
+    VK_CHECK(vmaInvalidateAllocation(vulkan_state.allocator, sc->readback.allocation, 0, VK_WHOLE_SIZE));
+
+    return (u8 *) sc->readback.allocation_info.pMappedData;
+}
+
 void DestroySwapchain(Swapchain *swapchain) {
     Swapchain *sc = swapchain;
     VkDevice ldev = vulkan_state.ldevice;
@@ -375,6 +488,22 @@ void DestroySwapchain(Swapchain *swapchain) {
     DestroyQueryPool(sc->query_pool);
 
     vkDestroyFence(ldev, sc->frame_fence, 0);
+
+    if (sc->copy_target.handle) {
+        DestroyImage(sc->copy_target);
+    }
+
+    if (sc->headless) {
+        DestroyStagingBuffer(sc->readback);
+        return;
+    }
+
+    for (u32 i = 0; i < SWAPCHAIN_IMAGE_COUNT; ++i) {
+        if (sc->views[i]) {
+            DestroyImageView(sc->views[i]);
+        }
+    }
+
     vkDestroySemaphore(ldev, sc->acquire_semaphore, 0);
     vkDestroySemaphore(ldev, sc->release_semaphore, 0);
 
@@ -422,6 +551,10 @@ void UpdateSwapchain(Swapchain *swapchain, VkCommandPool cmdpool, b8 vsync) {
         transform = caps.currentTransform;
     }
 
+    // drawing into the swapchain images saves a full screen copy each frame,
+    // not every surface allows it though
+    sc->direct = (caps.supportedUsageFlags & VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT) != 0;
+
     VkSwapchainCreateInfoKHR create_info = {};
     create_info.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
     create_info.surface = vulkan_state.surface;
@@ -430,7 +563,7 @@ void UpdateSwapchain(Swapchain *swapchain, VkCommandPool cmdpool, b8 vsync) {
     create_info.imageColorSpace = sc->format.colorSpace;
     create_info.imageExtent = extent;
     create_info.imageArrayLayers = 1;
-    create_info.imageUsage = VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    create_info.imageUsage = sc->direct ? VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT : VK_IMAGE_USAGE_TRANSFER_DST_BIT;
     create_info.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
     create_info.queueFamilyIndexCount = 1;
     create_info.pQueueFamilyIndices = &vulkan_state.graphics_queue_index;
@@ -456,19 +589,62 @@ void UpdateSwapchain(Swapchain *swapchain, VkCommandPool cmdpool, b8 vsync) {
         VK_CHECK(vkDeviceWaitIdle(ldev));
         vkDestroySwapchainKHR(ldev, old_swapchain, 0);
     }
+
+    for (u32 i = 0; i < SWAPCHAIN_IMAGE_COUNT; ++i) {
+        if (sc->views[i]) {
+            DestroyImageView(sc->views[i]);
+            sc->views[i] = 0;
+        }
+    }
+
+    if (sc->copy_target.handle) {
+        DestroyImage(sc->copy_target);
+        sc->copy_target = {};
+    }
+
+    if (sc->direct) {
+        for (u32 i = 0; i < SWAPCHAIN_IMAGE_COUNT; ++i) {
+            Image image = {};
+            image.handle = sc->images[i];
+            image.format = sc->format.format;
+
+            sc->views[i] = CreateImageLayerView(image, 0, VK_IMAGE_ASPECT_COLOR_BIT);
+        }
+    } else {
+        sc->copy_target = CreateImage(sc->width, sc->height, sc->format.format, 1, VK_IMAGE_ASPECT_COLOR_BIT,
+            VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT);
+    }
 }
 
-b32 AcquireSwapchain(Swapchain *swapchain, VkCommandPool cmdpool, VkCommandBuffer cmdbuf, Image color_target, Image depth_target) {
+Image GetSwapchainTarget(Swapchain *swapchain) {
+    Swapchain *sc = swapchain;
+
+    if (!sc->direct) {
+        return sc->copy_target;
+    }
+
+    Image result = {};
+
+    result.handle = sc->images[sc->current_image];
+    result.view = sc->views[sc->current_image];
+    result.format = sc->format.format;
+
+    return result;
+}
+
+b32 AcquireSwapchain(Swapchain *swapchain, VkCommandPool cmdpool, VkCommandBuffer cmdbuf) {
     Swapchain *sc = swapchain;
     VkDevice ldev = vulkan_state.ldevice;
 
-    VkResult result = vkAcquireNextImageKHR(ldev, sc->handle, 1000000, sc->acquire_semaphore, 0, &sc->current_image);
+    if (!sc->headless) {
+        VkResult result = vkAcquireNextImageKHR(ldev, sc->handle, 1000000, sc->acquire_semaphore, 0, &sc->current_image);
 
-    if (result == VK_ERROR_OUT_OF_DATE_KHR) {
-        return 0;
-    }
+        if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+            return 0;
+        }
 
-    VK_CHECK_SWAPCHAIN(result);
+        VK_CHECK_SWAPCHAIN(result);
+    }
 
     VK_CHECK(vkResetCommandPool(ldev, cmdpool, 0));
 
@@ -477,21 +653,57 @@ b32 AcquireSwapchain(Swapchain *swapchain, VkCommandPool cmdpool, VkCommandBuffe
     vkCmdResetQueryPool(cmdbuf, sc->query_pool, 0, 2);
     vkCmdWriteTimestamp(cmdbuf, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, sc->query_pool, 0);
 
-    VkImageMemoryBarrier2 barriers[] = {
-        CreateImageBarrier(color_target.handle, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, VK_IMAGE_LAYOUT_UNDEFINED,
-            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_ATTACHMENT_OPTIMAL, VK_IMAGE_ASPECT_COLOR_BIT),
-        CreateImageBarrier(depth_target.handle, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, VK_IMAGE_LAYOUT_UNDEFINED,
-            VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_ATTACHMENT_OPTIMAL, VK_IMAGE_ASPECT_DEPTH_BIT),
-    };
-
-    PipelineImageBarriers(cmdbuf, VK_DEPENDENCY_BY_REGION_BIT, barriers, ArrayCount(barriers));
-
     return 1;
 }
 
-void PresentSwapchain(Swapchain *swapchain, VkCommandBuffer cmdbuf, Image color_target) {
+internal void PresentHeadless(Swapchain *swapchain, VkCommandBuffer cmdbuf) {
     Swapchain *sc = swapchain;
     VkDevice ldev = vulkan_state.ldevice;
+    Image color_target = sc->copy_target;
+
+    if (sc->readback_requested) {
+        VkImageMemoryBarrier2 copy_barrier = CreateImageBarrier(color_target.handle, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+            VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_ATTACHMENT_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_ACCESS_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_ASPECT_COLOR_BIT);
+
+        PipelineImageBarriers(cmdbuf, VK_DEPENDENCY_BY_REGION_BIT, &copy_barrier, 1);
+
+        VkBufferImageCopy copy_region = {};
+        copy_region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        copy_region.imageSubresource.layerCount = 1;
+        copy_region.imageExtent.width = sc->width;
+        copy_region.imageExtent.height = sc->height;
+        copy_region.imageExtent.depth = 1;
+
+        vkCmdCopyImageToBuffer(cmdbuf, color_target.handle, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, sc->readback.handle, 1, &copy_region);
+
+        VkBufferMemoryBarrier2 host_barrier = CreateBufferBarrier(sc->readback.handle, VK_WHOLE_SIZE, VK_PIPELINE_STAGE_2_TRANSFER_BIT,
+            VK_ACCESS_2_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_2_HOST_BIT, VK_ACCESS_2_HOST_READ_BIT);
+
+        PipelineBufferBarriers(cmdbuf, 0, &host_barrier, 1);
+
+        sc->readback_requested = 0;
+    }
+
+    vkCmdWriteTimestamp(cmdbuf, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, sc->query_pool, 1);
+
+    EndCommandBuffer(cmdbuf);
+
+    VkSubmitInfo submit_info = {};
+    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submit_info.commandBufferCount = 1;
+    submit_info.pCommandBuffers = &cmdbuf;
+
+    VK_CHECK(vkQueueSubmit(vulkan_state.graphics_queue, 1, &submit_info, sc->frame_fence));
+
+    VK_CHECK(vkWaitForFences(ldev, 1, &sc->frame_fence, VK_TRUE, UINT64_MAX));
+    VK_CHECK(vkResetFences(ldev, 1, &sc->frame_fence));
+}
+
+// Fallback for surfaces that can't be rendered to.
+internal void CopyToSwapchain(Swapchain *swapchain, VkCommandBuffer cmdbuf) {
+    Swapchain *sc = swapchain;
+    Image color_target = sc->copy_target;
 
     VkImage current_image = sc->images[sc->current_image];
 
@@ -522,12 +734,38 @@ void PresentSwapchain(Swapchain *swapchain, VkCommandBuffer cmdbuf, Image color_
         VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, VK_IMAGE_ASPECT_COLOR_BIT);
 
     PipelineImageBarriers(cmdbuf, VK_DEPENDENCY_BY_REGION_BIT, &present_barrier, 1);
+}
+
+void PresentSwapchain(Swapchain *swapchain, VkCommandBuffer cmdbuf) {
+    Swapchain *sc = swapchain;
+    VkDevice ldev = vulkan_state.ldevice;
+
+    if (sc->headless) {
+        PresentHeadless(sc, cmdbuf);
+        return;
+    }
+
+    VkPipelineStageFlags wait_stage_mask;
+    if (sc->direct) {
+        VkImageMemoryBarrier2 present_barrier = CreateImageBarrier(sc->images[sc->current_image], VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+            VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_ATTACHMENT_OPTIMAL, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 0,
+            VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, VK_IMAGE_ASPECT_COLOR_BIT);
+
+        PipelineImageBarriers(cmdbuf, VK_DEPENDENCY_BY_REGION_BIT, &present_barrier, 1);
+
+        wait_stage_mask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    } else {
+        CopyToSwapchain(sc, cmdbuf);
+
+        // the copy target is written before the image is, so the whole frame
+        // can run ahead of the acquire
+        wait_stage_mask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+    }
 
     vkCmdWriteTimestamp(cmdbuf, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, sc->query_pool, 1);
 
     EndCommandBuffer(cmdbuf);
 
-    VkPipelineStageFlags wait_stage_mask = VK_PIPELINE_STAGE_TRANSFER_BIT;
     VkSubmitInfo submit_info = {};
     submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
     submit_info.waitSemaphoreCount = 1;
@@ -554,25 +792,33 @@ void PresentSwapchain(Swapchain *swapchain, VkCommandBuffer cmdbuf, Image color_
     VK_CHECK(vkResetFences(ldev, 1, &sc->frame_fence));
 }
 
-Image CreateImage(u32 width, u32 height, VkFormat format, u32 mip_levels, VkImageAspectFlags aspect_mask, VkImageUsageFlags usage) {
+internal VkImageCreateInfo GetImageInfo(u32 width, u32 height, u32 layers, VkFormat format, u32 mip_levels, VkImageUsageFlags usage) {
+    VkImageCreateInfo result = {};
+
+    result.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    result.imageType = VK_IMAGE_TYPE_2D;
+    result.format = format;
+    result.extent.width = width;
+    result.extent.height = height;
+    result.extent.depth = 1;
+    result.mipLevels = mip_levels;
+    result.arrayLayers = layers;
+    result.samples = VK_SAMPLE_COUNT_1_BIT;
+    result.tiling = VK_IMAGE_TILING_OPTIMAL;
+    result.usage = usage;
+    result.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    result.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+    return result;
+}
+
+internal Image CreateImage(u32 width, u32 height, u32 layers, VkFormat format, u32 mip_levels, VkImageAspectFlags aspect_mask,
+    VkImageUsageFlags usage, VkImageViewType view_type) {
     Image result = {};
 
     result.format = format;
 
-    VkImageCreateInfo info = {};
-    info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
-    info.imageType = VK_IMAGE_TYPE_2D;
-    info.format = format;
-    info.extent.width = width;
-    info.extent.height = height;
-    info.extent.depth = 1;
-    info.mipLevels = mip_levels;
-    info.arrayLayers = 1;
-    info.samples = VK_SAMPLE_COUNT_1_BIT;
-    info.tiling = VK_IMAGE_TILING_OPTIMAL;
-    info.usage = usage;
-    info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-    info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    VkImageCreateInfo info = GetImageInfo(width, height, layers, format, mip_levels, usage);
 
     VmaAllocationCreateInfo alloc_info = {};
     alloc_info.usage = VMA_MEMORY_USAGE_AUTO;
@@ -582,19 +828,61 @@ Image CreateImage(u32 width, u32 height, VkFormat format, u32 mip_levels, VkImag
     VkImageViewCreateInfo view_info = {};
     view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
     view_info.image = result.handle;
-    view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    view_info.viewType = view_type;
     view_info.format = format;
     view_info.subresourceRange.aspectMask = aspect_mask;
     view_info.subresourceRange.baseMipLevel = 0;
     view_info.subresourceRange.levelCount = mip_levels;
     view_info.subresourceRange.baseArrayLayer = 0;
-    view_info.subresourceRange.layerCount = 1;
+    view_info.subresourceRange.layerCount = layers;
 
     VK_CHECK(vkCreateImageView(vulkan_state.ldevice, &view_info, 0, &result.view));
 
     return result;
 }
 
+Image CreateImage(u32 width, u32 height, VkFormat format, u32 mip_levels, VkImageAspectFlags aspect_mask, VkImageUsageFlags usage) {
+    return CreateImage(width, height, 1, format, mip_levels, aspect_mask, usage, VK_IMAGE_VIEW_TYPE_2D);
+}
+
+Image CreateImageArray(u32 width, u32 height, u32 layers, VkFormat format, u32 mip_levels, VkImageAspectFlags aspect_mask,
+    VkImageUsageFlags usage) {
+    return CreateImage(width, height, layers, format, mip_levels, aspect_mask, usage, VK_IMAGE_VIEW_TYPE_2D_ARRAY);
+}
+
+Image CreateUnboundImage(u32 width, u32 height, VkFormat format, VkImageUsageFlags usage, VkMemoryRequirements *requirements) {
+    Image result = {};
+
+    result.format = format;
+
+    VkImageCreateInfo info = GetImageInfo(width, height, 1, format, 1, usage);
+    VK_CHECK(vkCreateImage(vulkan_state.ldevice, &info, 0, &result.handle));
+
+    vkGetImageMemoryRequirements(vulkan_state.ldevice, result.handle, requirements);
+
+    return result;
+}
+
+VmaAllocation AllocateImageMemory(VkMemoryRequirements requirements) {
+    VmaAllocationCreateInfo alloc_info = {};
+    alloc_info.preferredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+
+    VmaAllocation result;
+    VK_CHECK(vmaAllocateMemory(vulkan_state.allocator, &requirements, &alloc_info, &result, 0));
+
+    return result;
+}
+
+void FreeImageMemory(VmaAllocation allocation) {
+    vmaFreeMemory(vulkan_state.allocator, allocation);
+}
+
+void BindImageMemory(Image *image, VmaAllocation allocation, VkImageAspectFlags aspect_mask) {
+    VK_CHECK(vmaBindImageMemory(vulkan_state.allocator, allocation, image->handle));
+
+    image->view = CreateImageLayerView(*image, 0, aspect_mask);
+}
+
 Image CreateDepthImage(Swapchain *swapchain, VkCommandPool cmdpool) {
     Swapchain *sc = swapchain;
 
@@ -627,10 +915,55 @@ void DestroyImage(Image image) {
     vmaDestroyImage(vulkan_state.allocator, image.handle, image.allocation);
 }
 
+VkImageView CreateImageLayerView(Image image, u32 layer, VkImageAspectFlags aspect_mask) {
+    VkImageViewCreateInfo view_info = {};
+    view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    view_info.image = image.handle;
+    view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    view_info.format = image.format;
+    view_info.subresourceRange.aspectMask = aspect_mask;
+    view_info.subresourceRange.baseMipLevel = 0;
+    view_info.subresourceRange.levelCount = 1;
+    view_info.subresourceRange.baseArrayLayer = layer;
+    view_info.subresourceRange.layerCount = 1;
+
+    VkImageView result;
+    VK_CHECK(vkCreateImageView(vulkan_state.ldevice, &view_info, 0, &result));
+
+    return result;
+}
+
+VkImageView CreateImageMipView(Image image, u32 mip_level, VkImageAspectFlags aspect_mask) {
+    VkImageViewCreateInfo view_info = {};
+    view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    view_info.image = image.handle;
+    view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    view_info.format = image.format;
+    view_info.subresourceRange.aspectMask = aspect_mask;
+    view_info.subresourceRange.baseMipLevel = mip_level;
+    view_info.subresourceRange.levelCount = 1;
+    view_info.subresourceRange.baseArrayLayer = 0;
+    view_info.subresourceRange.layerCount = 1;
+
+    VkImageView result;
+    VK_CHECK(vkCreateImageView(vulkan_state.ldevice, &view_info, 0, &result));
+
+    return result;
+}
+
+void DestroyImageView(VkImageView view) {
+    vkDestroyImageView(vulkan_state.ldevice, view, 0);
+}
+
 Texture CreateTexture(u32 width, u32 height, VkFormat format, VkImageAspectFlags aspect_mask, VkImageUsageFlags usage, VkSamplerCreateInfo sampler_info) {
+    return CreateMipmappedTexture(width, height, 1, format, aspect_mask, usage, sampler_info);
+}
+
+Texture CreateMipmappedTexture(u32 width, u32 height, u32 mip_levels, VkFormat format, VkImageAspectFlags aspect_mask,
+    VkImageUsageFlags usage, VkSamplerCreateInfo sampler_info) {
     Texture result = {};
 
-    result.image = CreateImage(width, height, format, 1, aspect_mask, usage);
+    result.image = CreateImage(width, height, format, mip_levels, aspect_mask, usage);
 
     vkCreateSampler(vulkan_state.ldevice, &sampler_info, 0, &result.descriptor.sampler);
 
@@ -646,27 +979,114 @@ Texture CreateTexture(u32 width, u32 height, VkFormat format, VkImageAspectFlags
     return CreateTexture(width, height, format, aspect_mask, usage, sampler_info);
 }
 
+Texture CreateTextureArray(u32 width, u32 height, u32 layers, VkFormat format, VkImageAspectFlags aspect_mask, VkImageUsageFlags usage,
+    VkSamplerCreateInfo sampler_info) {
+    Texture result = {};
+
+    result.image = CreateImageArray(width, height, layers, format, 1, aspect_mask, usage);
+
+    vkCreateSampler(vulkan_state.ldevice, &sampler_info, 0, &result.descriptor.sampler);
+
+    result.descriptor.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    result.descriptor.imageView = result.image.view;
+    return result;
+}
+
 internal u32 GetMipLevels(u32 width, u32 height) {
     return u32(floorf(log2f(float(Max(width, height))))) + 1;
 }
 
+// blits down the chain need linear filtering on both ends, without it
+// images keep their single level
+internal b32 CanGenerateMipmaps(VkFormat format) {
+    return IsFormatSupported(format, VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT |
+        VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT);
+}
+
+// Every level has to be in TRANSFER_DST with level 0 filled, all of them end
+// up in SHADER_READ_ONLY.
+internal void GenerateMipmaps(VkCommandBuffer cmdbuf, Image image, u32 width, u32 height, u32 layers, u32 mip_levels) {
+    s32 mip_width = s32(width);
+    s32 mip_height = s32(height);
+
+    for (u32 level = 1; level < mip_levels; ++level) {
+        VkImageMemoryBarrier2 src_barrier = CreateImageBarrier(image.handle, VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT,
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_READ_BIT,
+            VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_ASPECT_COLOR_BIT);
+        src_barrier.subresourceRange.baseMipLevel = level - 1;
+        src_barrier.subresourceRange.levelCount = 1;
+
+        PipelineImageBarriers(cmdbuf, 0, &src_barrier, 1);
+
+        s32 next_width = Max(mip_width / 2, 1);
+        s32 next_height = Max(mip_height / 2, 1);
+
+        VkImageBlit2 blit = {};
+        blit.sType = VK_STRUCTURE_TYPE_IMAGE_BLIT_2;
+        blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        blit.srcSubresource.mipLevel = level - 1;
+        blit.srcSubresource.layerCount = layers;
+        blit.srcOffsets[1] = {mip_width, mip_height, 1};
+        blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        blit.dstSubresource.mipLevel = level;
+        blit.dstSubresource.layerCount = layers;
+        blit.dstOffsets[1] = {next_width, next_height, 1};
+
+        VkBlitImageInfo2 blit_info = {};
+        blit_info.sType = VK_STRUCTURE_TYPE_BLIT_IMAGE_INFO_2;
+        blit_info.srcImage = image.handle;
+        blit_info.srcImageLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        blit_info.dstImage = image.handle;
+        blit_info.dstImageLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        blit_info.regionCount = 1;
+        blit_info.pRegions = &blit;
+        blit_info.filter = VK_FILTER_LINEAR;
+
+        vkCmdBlitImage2(cmdbuf, &blit_info);
+
+        mip_width = next_width;
+        mip_height = next_height;
+    }
+
+    // the levels that were read from and the last one, which was only written
+    VkImageMemoryBarrier2 read_barriers[2];
+    u32 read_barriers_count = 0;
+
+    if (mip_levels > 1) {
+        VkImageMemoryBarrier2 *barrier = &read_barriers[read_barriers_count++];
+        *barrier = CreateImageBarrier(image.handle, VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_READ_BIT,
+            VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT,
+            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_ASPECT_COLOR_BIT);
+        barrier->subresourceRange.levelCount = mip_levels - 1;
+    }
+
+    VkImageMemoryBarrier2 *barrier = &read_barriers[read_barriers_count++];
+    *barrier = CreateImageBarrier(image.handle, VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT,
+        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT,
+        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_ASPECT_COLOR_BIT);
+    barrier->subresourceRange.baseMipLevel = mip_levels - 1;
+    barrier->subresourceRange.levelCount = 1;
+
+    PipelineImageBarriers(cmdbuf, 0, read_barriers, read_barriers_count);
+}
+
 Texture CreateTextureFromPixels(u32 width, u32 height, u32 channels, VkFormat format, u8 *pixels,
     VkSamplerCreateInfo sampler_info, VkCommandPool cmdpool) {
     Texture result = {};
 
-    //Image img = CreateImage(state, width, height, format, GetMipLevels(width, height), VK_IMAGE_ASPECT_COLOR_BIT,
-    Image img = CreateImage(width, height, format, 1, VK_IMAGE_ASPECT_COLOR_BIT,
-        VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
+    u32 mip_levels = CanGenerateMipmaps(format) ? GetMipLevels(width, height) : 1;
+    Image img = CreateImage(width, height, format, mip_levels, VK_IMAGE_ASPECT_COLOR_BIT,
+        VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
 
     VkDeviceSize size = width * height * channels;
     StagingBuffer sbuf = CreateStagingBuffer(size, pixels);
 
     VkCommandBuffer cmdbuf = BeginTempCommandBuffer(cmdpool);
 
-    VkImageMemoryBarrier2 before_barrier = CreateImageBarrier(img.handle, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, VK_IMAGE_LAYOUT_UNDEFINED,
-        VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_ASPECT_COLOR_BIT);
+    VkImageMemoryBarrier2 before_barrier = CreateImageBarrier(img.handle, VK_PIPELINE_STAGE_2_NONE, 0, VK_IMAGE_LAYOUT_UNDEFINED,
+        VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_ASPECT_COLOR_BIT);
 
-    PipelineImageBarriers(cmdbuf, VK_DEPENDENCY_BY_REGION_BIT, &before_barrier, 1);
+    PipelineImageBarriers(cmdbuf, 0, &before_barrier, 1);
 
     VkBufferImageCopy2 region = {};
     region.sType = VK_STRUCTURE_TYPE_BUFFER_IMAGE_COPY_2;
@@ -686,10 +1106,7 @@ Texture CreateTextureFromPixels(u32 width, u32 height, u32 channels, VkFormat fo
 
     vkCmdCopyBufferToImage2(cmdbuf, &copy_info);
 
-    VkImageMemoryBarrier2 after_barrier = CreateImageBarrier(img.handle, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-        VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_ASPECT_COLOR_BIT);
-
-    PipelineImageBarriers(cmdbuf, VK_DEPENDENCY_BY_REGION_BIT, &after_barrier, 1);
+    GenerateMipmaps(cmdbuf, img, width, height, 1, mip_levels);
 
     EndTempCommandBuffer(cmdpool, cmdbuf);
 
@@ -704,85 +1121,290 @@ Texture CreateTextureFromPixels(u32 width, u32 height, u32 channels, VkFormat fo
     return result;
 }
 
-Texture LoadTextureFromFile(const char *path, VkCommandPool cmdpool) {
-    Texture result = {};
-
-	int w, h, channels;
-	u8 *pixels = stbi_load(path, &w, &h, &channels, STBI_rgb);
-	if (!pixels) {
-		Print("Failed to load texture '%s'!\n", path);
-		Exit(1);
-	}
+// Pixels either point into the asset pack, with every mip level baked, or
+// were decoded from the file with just the first one.
+struct TextureDecode {
+    const char **paths;
+    u8 **pixels;
+    int *widths;
+    int *heights;
+    u32 *mip_levels;
+    b8 *packed;
+};
 
-	VkSamplerCreateInfo sampler_info = {};
-	sampler_info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
-	sampler_info.minFilter = VK_FILTER_NEAREST;
-	sampler_info.magFilter = VK_FILTER_NEAREST;
-	sampler_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
-	sampler_info.maxLod = 1.0f;
-
-	if (channels == 3) {
-		u8 *rgba_pixels = (u8 *)HeapAlloc(w * h * 4);
-		for (u32 i = 0; i < w * h; ++i) {
-			u32 pixel_idx = i * 3;
-			u32 rgba_idx = i * 4;
-
-			rgba_pixels[rgba_idx] = pixels[pixel_idx];
-			rgba_pixels[rgba_idx + 1] = pixels[pixel_idx + 1];
-			rgba_pixels[rgba_idx + 2] = pixels[pixel_idx + 2];
-			rgba_pixels[rgba_idx + 3] = 255;
-		}
+internal void DecodeTextureJob(void *data, u32 begin, u32 end) {
+    TextureDecode *decode = (TextureDecode *) data;
+
+    for (u32 i = begin; i < end; ++i) {
+        AssetEntry *entry = FindAsset(decode->paths[i]);
+        if (entry && entry->kind == ASSET_TEXTURE) {
+            decode->pixels[i] = GetAssetData(entry);
+            decode->widths[i] = int(entry->width);
+            decode->heights[i] = int(entry->height);
+            decode->mip_levels[i] = entry->mip_levels;
+            decode->packed[i] = 1;
+            continue;
+        }
 
-		result = CreateTextureFromPixels(w, h, 4, VK_FORMAT_R8G8B8A8_UNORM, rgba_pixels, sampler_info, cmdpool);
+        // stb expands RGB to RGBA while it decodes
+        int channels;
+        decode->pixels[i] = stbi_load(decode->paths[i], &decode->widths[i], &decode->heights[i], &channels, STBI_rgb_alpha);
+        decode->mip_levels[i] = 1;
+        decode->packed[i] = 0;
+    }
+}
 
-		HeapFree(rgba_pixels);
-	} else {
-		result = CreateTextureFromPixels(w, h, channels, VK_FORMAT_R8G8B8A8_UNORM, pixels, sampler_info, cmdpool);
-	}
-	
-	free(pixels);
+// RGBA8 pixels of every path, decoded on the job workers
+internal TextureDecode DecodeTextures(const char **paths, u32 count) {
+    TextureDecode result = {};
+    result.paths = paths;
+    result.pixels = (u8 **) HeapAlloc(count * sizeof(u8 *));
+    result.widths = (int *) HeapAlloc(count * sizeof(int));
+    result.heights = (int *) HeapAlloc(count * sizeof(int));
+    result.mip_levels = (u32 *) HeapAlloc(count * sizeof(u32));
+    result.packed = (b8 *) HeapAlloc(count * sizeof(b8));
+
+    ParallelFor(count, 1, DecodeTextureJob, &result);
+
+    for (u32 i = 0; i < count; ++i) {
+        if (!result.pixels[i]) {
+            Print("Failed to load texture '%s'!\n", paths[i]);
+            Exit(1);
+        }
+    }
 
     return result;
 }
 
-void DestroyTexture(Texture tex) {
-    vkDestroySampler(vulkan_state.ldevice, tex.descriptor.sampler, 0);
-    DestroyImage(tex.image);
+internal void FreeTextureDecode(TextureDecode *decode, u32 count) {
+    for (u32 i = 0; i < count; ++i) {
+        if (!decode->packed[i]) {
+            stbi_image_free(decode->pixels[i]);
+        }
+    }
+
+    HeapFree(decode->packed);
+    HeapFree(decode->mip_levels);
+    HeapFree(decode->heights);
+    HeapFree(decode->widths);
+    HeapFree(decode->pixels);
 }
 
-TextureArray CreateTextureArray(uint count) {
-    TextureArray result = {};
+void LoadTexturesFromFiles(const char **paths, Texture *textures, u32 count, VkCommandPool cmdpool) {
+    PROFILE_FUNCTION();
 
-    result.images = PushArray(&vulkan_state.arena, Image, count);
-    result.descriptors = PushArray(&vulkan_state.arena, VkDescriptorImageInfo, count);
+    TextureDecode decode = DecodeTextures(paths, count);
 
-    result.capacity = count;
-    result.count = 0;
-    
-    return result;
-}
+    // every texture goes into one staging buffer, offsets stay texel and
+    // optimalBufferCopyOffsetAlignment friendly
+    VkDeviceSize *offsets = (VkDeviceSize *) HeapAlloc(count * sizeof(VkDeviceSize));
+    VkDeviceSize staging_size = 0;
+    for (u32 i = 0; i < count; ++i) {
+        offsets[i] = staging_size;
+        staging_size += VkDeviceSize(decode.widths[i]) * decode.heights[i] * 4;
+        staging_size = (staging_size + 15) & ~VkDeviceSize(15);
+    }
+
+    StagingBuffer sbuf = CreateStagingBuffer(staging_size, 0);
+    u8 *staging = (u8 *) sbuf.allocation_info.pMappedData;
+
+    VkImageMemoryBarrier2 *barriers = (VkImageMemoryBarrier2 *) HeapAlloc(count * sizeof(VkImageMemoryBarrier2));
+    for (u32 i = 0; i < count; ++i) {
+        u32 width = u32(decode.widths[i]);
+        u32 height = u32(decode.heights[i]);
+
+        textures[i] = {};
+        textures[i].image = CreateImage(width, height, VK_FORMAT_R8G8B8A8_UNORM, 1, VK_IMAGE_ASPECT_COLOR_BIT,
+            VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
 
-void AddTexture(TextureArray *ta, Texture tex) {
-    Assert(ta->count < ta->capacity);
+        CopyMemory(staging + offsets[i], decode.pixels[i], u64(width) * height * 4);
 
-    ta->images[ta->count] = tex.image;
-    ta->descriptors[ta->count] = tex.descriptor;
-    ta->count++;
+        barriers[i] = CreateImageBarrier(textures[i].image.handle, VK_PIPELINE_STAGE_2_NONE, 0, VK_IMAGE_LAYOUT_UNDEFINED,
+            VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_ASPECT_COLOR_BIT);
+    }
+
+    VkCommandBuffer cmdbuf = BeginTempCommandBuffer(cmdpool);
+
+    PipelineImageBarriers(cmdbuf, 0, barriers, count);
+
+    for (u32 i = 0; i < count; ++i) {
+        VkBufferImageCopy2 region = {};
+        region.sType = VK_STRUCTURE_TYPE_BUFFER_IMAGE_COPY_2;
+        region.bufferOffset = offsets[i];
+        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.imageSubresource.layerCount = 1;
+        region.imageExtent.width = u32(decode.widths[i]);
+        region.imageExtent.height = u32(decode.heights[i]);
+        region.imageExtent.depth = 1;
+
+        VkCopyBufferToImageInfo2 copy_info = {};
+        copy_info.sType = VK_STRUCTURE_TYPE_COPY_BUFFER_TO_IMAGE_INFO_2;
+        copy_info.srcBuffer = sbuf.handle;
+        copy_info.dstImage = textures[i].image.handle;
+        copy_info.dstImageLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        copy_info.regionCount = 1;
+        copy_info.pRegions = &region;
+
+        vkCmdCopyBufferToImage2(cmdbuf, &copy_info);
+    }
+
+    for (u32 i = 0; i < count; ++i) {
+        barriers[i] = CreateImageBarrier(textures[i].image.handle, VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT,
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT,
+            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_ASPECT_COLOR_BIT);
+    }
+
+    PipelineImageBarriers(cmdbuf, 0, barriers, count);
+
+    // the only submission (and wait) of the whole batch
+    EndTempCommandBuffer(cmdpool, cmdbuf);
+
+    DestroyStagingBuffer(sbuf);
+
+    VkSamplerCreateInfo sampler_info = {};
+    sampler_info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    sampler_info.minFilter = VK_FILTER_NEAREST;
+    sampler_info.magFilter = VK_FILTER_NEAREST;
+    sampler_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    sampler_info.maxLod = 1.0f;
+
+    for (u32 i = 0; i < count; ++i) {
+        vkCreateSampler(vulkan_state.ldevice, &sampler_info, 0, &textures[i].descriptor.sampler);
+        textures[i].descriptor.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        textures[i].descriptor.imageView = textures[i].image.view;
+    }
+
+    HeapFree(barriers);
+    HeapFree(offsets);
+    FreeTextureDecode(&decode, count);
 }
 
-void LoadTextureAtSlot(TextureArray *ta, uint slot, const char *path, VkCommandPool cmdpool) {
-    Texture tex = LoadTextureFromFile(path, cmdpool);
+Texture LoadTextureFromFile(const char *path, VkCommandPool cmdpool) {
+    Texture result = {};
 
-    ta->images[slot] = tex.image;
-    ta->descriptors[slot] = tex.descriptor;
-    ta->count++;
+    LoadTexturesFromFiles(&path, &result, 1, cmdpool);
+
+    return result;
 }
 
-void DestroyTextureArray(TextureArray *ta) {
-    for (int i = 0; i < ta->count; ++i) {
-        vkDestroySampler(vulkan_state.ldevice, ta->descriptors[i].sampler, 0);
-        DestroyImage(ta->images[i]);
+Texture LoadTextureArrayFromFiles(const char **paths, u32 count, VkCommandPool cmdpool) {
+    PROFILE_FUNCTION();
+
+    Texture result = {};
+
+    TextureDecode decode = DecodeTextures(paths, count);
+
+    u32 width = u32(decode.widths[0]);
+    u32 height = u32(decode.heights[0]);
+    for (u32 i = 1; i < count; ++i) {
+        if (u32(decode.widths[i]) != width || u32(decode.heights[i]) != height) {
+            Print("Texture '%s' is %dx%d, the rest of its array is %ux%u!\n", paths[i], decode.widths[i], decode.heights[i],
+                width, height);
+            Exit(1);
+        }
+    }
+
+    VkFormat format = VK_FORMAT_R8G8B8A8_UNORM;
+    u32 mip_levels = GetMipLevels(width, height);
+
+    // the pack has every level already, anything decoded here only the first
+    b32 baked = 1;
+    for (u32 i = 0; i < count; ++i) {
+        baked = baked && decode.mip_levels[i] == mip_levels;
+    }
+
+    u32 uploaded_levels = baked ? mip_levels : 1;
+    if (!baked && !CanGenerateMipmaps(format)) {
+        mip_levels = 1;
+    }
+
+    // level by level, each with its layers back to back, which is how one
+    // copy region with layerCount reads them
+    VkDeviceSize layer_size = GetMipChainSize(width, height, uploaded_levels);
+    StagingBuffer sbuf = CreateStagingBuffer(layer_size * count, 0);
+    u8 *staging = (u8 *) sbuf.allocation_info.pMappedData;
+
+    VkBufferImageCopy2 regions[32] = {};
+    Assert(uploaded_levels <= ArrayCount(regions));
+    VkDeviceSize level_offset = 0;
+    for (u32 level = 0; level < uploaded_levels; ++level) {
+        u32 level_width = Max(width >> level, 1u);
+        u32 level_height = Max(height >> level, 1u);
+        VkDeviceSize level_size = VkDeviceSize(level_width) * level_height * 4;
+        VkDeviceSize src_offset = GetMipChainSize(width, height, level);
+
+        for (u32 i = 0; i < count; ++i) {
+            CopyMemory(staging + level_offset + level_size * i, decode.pixels[i] + src_offset, level_size);
+        }
+
+        VkBufferImageCopy2 *region = &regions[level];
+        region->sType = VK_STRUCTURE_TYPE_BUFFER_IMAGE_COPY_2;
+        region->bufferOffset = level_offset;
+        region->imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region->imageSubresource.mipLevel = level;
+        region->imageSubresource.layerCount = count;
+        region->imageExtent.width = level_width;
+        region->imageExtent.height = level_height;
+        region->imageExtent.depth = 1;
+
+        level_offset += level_size * count;
+    }
+
+    FreeTextureDecode(&decode, count);
+
+    result.image = CreateImageArray(width, height, count, format, mip_levels, VK_IMAGE_ASPECT_COLOR_BIT,
+        VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
+
+    VkCommandBuffer cmdbuf = BeginTempCommandBuffer(cmdpool);
+
+    VkImageMemoryBarrier2 before_barrier = CreateImageBarrier(result.image.handle, VK_PIPELINE_STAGE_2_NONE, 0, VK_IMAGE_LAYOUT_UNDEFINED,
+        VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_ASPECT_COLOR_BIT);
+
+    PipelineImageBarriers(cmdbuf, 0, &before_barrier, 1);
+
+    VkCopyBufferToImageInfo2 copy_info = {};
+    copy_info.sType = VK_STRUCTURE_TYPE_COPY_BUFFER_TO_IMAGE_INFO_2;
+    copy_info.srcBuffer = sbuf.handle;
+    copy_info.dstImage = result.image.handle;
+    copy_info.dstImageLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    copy_info.regionCount = uploaded_levels;
+    copy_info.pRegions = regions;
+
+    vkCmdCopyBufferToImage2(cmdbuf, &copy_info);
+
+    if (baked) {
+        VkImageMemoryBarrier2 read_barrier = CreateImageBarrier(result.image.handle, VK_PIPELINE_STAGE_2_TRANSFER_BIT,
+            VK_ACCESS_2_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT,
+            VK_ACCESS_2_SHADER_SAMPLED_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_ASPECT_COLOR_BIT);
+
+        PipelineImageBarriers(cmdbuf, 0, &read_barrier, 1);
+    } else {
+        GenerateMipmaps(cmdbuf, result.image, width, height, count, mip_levels);
     }
+
+    EndTempCommandBuffer(cmdpool, cmdbuf);
+
+    DestroyStagingBuffer(sbuf);
+
+    // texels stay sharp up close, distant faces blend between filtered levels
+    // instead of shimmering
+    VkSamplerCreateInfo sampler_info = {};
+    sampler_info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    sampler_info.magFilter = VK_FILTER_NEAREST;
+    sampler_info.minFilter = VK_FILTER_LINEAR;
+    sampler_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+    sampler_info.maxLod = float(mip_levels);
+
+    vkCreateSampler(vulkan_state.ldevice, &sampler_info, 0, &result.descriptor.sampler);
+    result.descriptor.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    result.descriptor.imageView = result.image.view;
+
+    return result;
+}
+
+void DestroyTexture(Texture tex) {
+    vkDestroySampler(vulkan_state.ldevice, tex.descriptor.sampler, 0);
+    DestroyImage(tex.image);
 }
 
 VkImageMemoryBarrier2 CreateImageBarrier(VkImage image, VkPipelineStageFlags2 src_stage, VkAccessFlags2 src_access, VkImageLayout old_layout,
@@ -842,6 +1464,19 @@ void PipelineBufferBarriers(VkCommandBuffer cmdbuf, VkDependencyFlags flags, VkB
     vkCmdPipelineBarrier2(cmdbuf, &info);
 }
 
+void PipelineBarriers(VkCommandBuffer cmdbuf, VkDependencyFlags flags, VkImageMemoryBarrier2 *image_barriers, u32 image_barriers_count,
+    VkBufferMemoryBarrier2 *buffer_barriers, u32 buffer_barriers_count) {
+    VkDependencyInfo info = {};
+    info.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+    info.dependencyFlags = flags;
+    info.imageMemoryBarrierCount = image_barriers_count;
+    info.pImageMemoryBarriers = image_barriers;
+    info.bufferMemoryBarrierCount = buffer_barriers_count;
+    info.pBufferMemoryBarriers = buffer_barriers;
+
+    vkCmdPipelineBarrier2(cmdbuf, &info);
+}
+
 VkDescriptorSetLayout CreateDescriptorSetLayout(VkDescriptorSetLayoutBinding *bindings, u32 bindings_count) {
     VkDescriptorSetLayoutCreateInfo layout_info = {};
     layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
@@ -947,24 +1582,35 @@ void BindTexture(DescriptorSet *desc_set, u32 binding, Texture texture) {
 	vkUpdateDescriptorSets(vulkan_state.ldevice, 1, &desc_write, 0, 0);
 }
 
-void BindTextureArray(DescriptorSet *desc_set, u32 binding, TextureArray *textures) {
-	VkWriteDescriptorSet desc_write = { VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET };
-	desc_write.dstSet = desc_set->handle;
-	desc_write.dstBinding = binding;
-	desc_write.descriptorCount = textures->count;
-	desc_write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-	desc_write.pImageInfo = textures->descriptors;
+void BindStorageImage(DescriptorSet *desc_set, u32 binding, Image image) {
+    VkDescriptorImageInfo image_info = {};
+    image_info.imageView = image.view;
+    image_info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
 
-	vkUpdateDescriptorSets(vulkan_state.ldevice, 1, &desc_write, 0, 0);
+    VkWriteDescriptorSet desc_write = { VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET };
+    desc_write.dstSet = desc_set->handle;
+    desc_write.dstBinding = binding;
+    desc_write.descriptorCount = 1;
+    desc_write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    desc_write.pImageInfo = &image_info;
+
+    vkUpdateDescriptorSets(vulkan_state.ldevice, 1, &desc_write, 0, 0);
 }
 
 VkPipelineShaderStageCreateInfo LoadShader(Shader shader) {
 	VkPipelineShaderStageCreateInfo result = {};
 
-	String code = ReadFile(shader.path);
-	if (!code.ptr) {
-		Print("Failed to read shader '%s'!\n", shader.path);
-		Exit(1);
+	// straight out of the mapped pack when there is one
+	String code;
+	AssetEntry *entry = FindAsset(shader.path);
+	if (entry) {
+		code = String(GetAssetData(entry), entry->size);
+	} else {
+		code = ReadFile(shader.path);
+		if (!code.ptr) {
+			Print("Failed to read shader '%s'!\n", shader.path);
+			Exit(1);
+		}
 	}
 
 	VkShaderModuleCreateInfo module_info = {};
@@ -975,6 +1621,10 @@ VkPipelineShaderStageCreateInfo LoadShader(Shader shader) {
 	VkShaderModule module;
 	VK_CHECK(vkCreateShaderModule(vulkan_state.ldevice, &module_info, 0, &module));
 
+	if (!entry) {
+		HeapFree(code.ptr);
+	}
+
 	result.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
 	result.stage = shader.stage;
 	result.module = module;
@@ -1019,7 +1669,7 @@ Pipeline CreateGraphicsPipeline(GraphicsPipelineOptions *options, VkDescriptorSe
     depth_stencil_state.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
     depth_stencil_state.depthTestEnable = options->depth_read;
     depth_stencil_state.depthWriteEnable = options->depth_write;
-    depth_stencil_state.depthCompareOp = VK_COMPARE_OP_LESS;
+    depth_stencil_state.depthCompareOp = options->depth_equal ? VK_COMPARE_OP_EQUAL : VK_COMPARE_OP_LESS;
 
     VkPipelineViewportStateCreateInfo viewport_stage = {};
     viewport_stage.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
@@ -1097,6 +1747,11 @@ Pipeline CreateGraphicsPipeline(GraphicsPipelineOptions *options, VkDescriptorSe
 }
 
 Pipeline CreateComputePipeline(Shader shader, VkDescriptorSetLayout desc_layout) {
+    return CreateComputePipeline(shader, desc_layout, 0, 0);
+}
+
+Pipeline CreateComputePipeline(Shader shader, VkDescriptorSetLayout desc_layout, VkPushConstantRange *push_constants,
+    u32 push_constants_count) {
     Pipeline result = CreatePipeline(VK_PIPELINE_BIND_POINT_COMPUTE);
 
     VkPipelineShaderStageCreateInfo stage_info = LoadShader(shader);
@@ -1105,6 +1760,8 @@ Pipeline CreateComputePipeline(Shader shader, VkDescriptorSetLayout desc_layout)
     layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
     layout_info.setLayoutCount = 1;
     layout_info.pSetLayouts = &desc_layout;
+    layout_info.pushConstantRangeCount = push_constants_count;
+    layout_info.pPushConstantRanges = push_constants;
 
     VK_CHECK(vkCreatePipelineLayout(vulkan_state.ldevice, &layout_info, 0, &result.layout));
 
@@ -1196,10 +1853,6 @@ void DestroyStagingBuffer(StagingBuffer buffer) {
 
 void UpdateRendererBuffer(Buffer buffer, VkDeviceSize size, void *data, VkCommandBuffer cmdbuf) {
     vkCmdUpdateBuffer(cmdbuf, buffer.handle, 0, size, data);
-
-    VkBufferMemoryBarrier2 after = CreateBufferBarrier(buffer.handle, size,
-        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
-    PipelineBufferBarriers(cmdbuf, VK_DEPENDENCY_DEVICE_GROUP_BIT, &after, 1);
 }
 
 VkQueryPool CreateQueryPool(uint32_t count, VkQueryType type) {
@@ -1227,6 +1880,13 @@ void WaitForDeviceIdle() {
 	VK_CHECK(vkDeviceWaitIdle(vulkan_state.ldevice));
 }
 
+b32 IsFormatSupported(VkFormat format, VkFormatFeatureFlags features) {
+    VkFormatProperties props;
+    vkGetPhysicalDeviceFormatProperties(vulkan_state.pdevice, format, &props);
+
+    return (props.optimalTilingFeatures & features) == features;
+}
+
 VkPhysicalDevice GetPhysicalDevice() {
     return vulkan_state.pdevice;
 }
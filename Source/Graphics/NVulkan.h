@@ -19,6 +19,25 @@
         }                                                                                          \
     } while(0)
 
+struct StagingBuffer {
+    VkBuffer handle;
+    VmaAllocation allocation;
+    VmaAllocationInfo allocation_info;
+};
+
+
+struct Image {
+    VkImage handle;
+    VkImageView view;
+    VmaAllocation allocation;
+    VkFormat format;
+};
+
+struct Texture {
+    Image image;
+    VkDescriptorImageInfo descriptor;
+};
+
 #define SWAPCHAIN_IMAGE_COUNT 2
 struct Swapchain {
     VkSwapchainKHR handle;
@@ -34,25 +53,18 @@ struct Swapchain {
     VkSemaphore release_semaphore;
     VkFence frame_fence;
     VkImage images[SWAPCHAIN_IMAGE_COUNT];
-};
-
-struct Image {
-    VkImage handle;
-    VkImageView view;
-    VmaAllocation allocation;
-    VkFormat format;
-};
-
-struct Texture {
-    Image image;
-    VkDescriptorImageInfo descriptor;
-};
-
-struct TextureArray {
-    Image *images;
-    VkDescriptorImageInfo *descriptors;
-    uint capacity;
-    uint count;
+    VkImageView views[SWAPCHAIN_IMAGE_COUNT];
+
+    // direct: the frame is drawn straight into the acquired image, otherwise
+    // into copy_target, which is copied over at present
+    b8 direct;
+    Image copy_target;
+
+    // headless: no surface, frames end in copy_target and can be
+    // copied into readback instead of being presented
+    b8 headless;
+    b8 readback_requested;
+    StagingBuffer readback;
 };
 
 struct Shader {
@@ -69,6 +81,8 @@ struct GraphicsPipelineOptions {
     VkFrontFace front_face;
     VkBool32 depth_read;
     VkBool32 depth_write;
+    // EQUAL instead of LESS, for passes drawn over their own depth prepass
+    b8 depth_equal;
     VkBool32 blend;
     Shader *shaders;
     u32 shaders_count;
@@ -93,12 +107,7 @@ struct Buffer {
     VmaAllocation allocation;
 };
 
-struct StagingBuffer {
-    VkBuffer handle;
-    VmaAllocation allocation;
-    VmaAllocationInfo allocation_info;
-};
-
+// window 0 runs without a surface, for CreateHeadlessSwapchain
 void InitVulkan(Window *window);
 void ReleaseVulkan();
 
@@ -118,25 +127,58 @@ void EndTempCommandBuffer(VkCommandPool cmdpool, VkCommandBuffer cmdbuf);
 void CreateSwapchain(Swapchain *swapchain, VkCommandPool cmdpool);
 void DestroySwapchain(Swapchain *swapchain);
 void UpdateSwapchain(Swapchain *swapchain, VkCommandPool cmdpool, b8 vsync);
-b32 AcquireSwapchain(Swapchain *swapchain, VkCommandPool cmdpool, VkCommandBuffer cmdbuf, Image color_target, Image depth_target);
-void PresentSwapchain(Swapchain *swapchain, VkCommandBuffer cmdbuf, Image color_target);
+b32 AcquireSwapchain(Swapchain *swapchain, VkCommandPool cmdpool, VkCommandBuffer cmdbuf);
+// What the frame ends in between AcquireSwapchain and PresentSwapchain. It
+// starts out undefined and has to be in VK_IMAGE_LAYOUT_ATTACHMENT_OPTIMAL
+// after color attachment writes by the time it's presented, the acquire is
+// waited on at color attachment output.
+Image GetSwapchainTarget(Swapchain *swapchain);
+void PresentSwapchain(Swapchain *swapchain, VkCommandBuffer cmdbuf);
+
+void CreateHeadlessSwapchain(Swapchain *swapchain, u32 width, u32 height);
+// The next PresentSwapchain copies the frame into the readback buffer, the
+// pixels (RGBA8, width * height) are valid until the one after that.
+void RequestSwapchainReadback(Swapchain *swapchain);
+u8 *GetSwapchainReadback(Swapchain *swapchain);
 
 Image CreateImage(u32 width, u32 height, VkFormat format, u32 mip_levels, VkImageAspectFlags aspect_mask, VkImageUsageFlags usage);
+// Viewed as VK_IMAGE_VIEW_TYPE_2D_ARRAY over all layers.
+Image CreateImageArray(u32 width, u32 height, u32 layers, VkFormat format, u32 mip_levels, VkImageAspectFlags aspect_mask,
+    VkImageUsageFlags usage);
 Image CreateDepthImage(Swapchain *swapchain, VkCommandPool cmdpool);
+// An image without memory and without a view, for placing several of them
+// in one allocation. DestroyImage leaves the memory alone.
+Image CreateUnboundImage(u32 width, u32 height, VkFormat format, VkImageUsageFlags usage, VkMemoryRequirements *requirements);
+VmaAllocation AllocateImageMemory(VkMemoryRequirements requirements);
+void FreeImageMemory(VmaAllocation allocation);
+// Binds it at the start of the allocation and creates its view.
+void BindImageMemory(Image *image, VmaAllocation allocation, VkImageAspectFlags aspect_mask);
 void DestroyImage(Image image);
+// A 2D view of a single layer of an array image, to render into it.
+VkImageView CreateImageLayerView(Image image, u32 layer, VkImageAspectFlags aspect_mask);
+// A 2D view of a single mip level, to write it from a compute shader.
+VkImageView CreateImageMipView(Image image, u32 mip_level, VkImageAspectFlags aspect_mask);
+void DestroyImageView(VkImageView view);
 
 Texture CreateTexture(u32 width, u32 height, VkFormat format, VkImageAspectFlags aspect_mask, VkImageUsageFlags usage, VkSamplerCreateInfo sampler_info);
 Texture CreateTexture(u32 width, u32 height, VkFormat format, VkImageAspectFlags aspect_mask, VkImageUsageFlags usage);
+// Levels left empty, for chains the renderer fills itself.
+Texture CreateMipmappedTexture(u32 width, u32 height, u32 mip_levels, VkFormat format, VkImageAspectFlags aspect_mask,
+    VkImageUsageFlags usage, VkSamplerCreateInfo sampler_info);
+Texture CreateTextureArray(u32 width, u32 height, u32 layers, VkFormat format, VkImageAspectFlags aspect_mask, VkImageUsageFlags usage,
+    VkSamplerCreateInfo sampler_info);
+// Blits the full mip chain when the format allows it.
 Texture CreateTextureFromPixels(u32 width, u32 height, u32 channels, VkFormat format, u8 *pixels,
     VkSamplerCreateInfo sampler_info, VkCommandPool cmdpool);
+// Decodes all of them on the job workers, then uploads them from one staging
+// buffer with a single submission.
+void LoadTexturesFromFiles(const char **paths, Texture *textures, u32 count, VkCommandPool cmdpool);
 Texture LoadTextureFromFile(const char *path, VkCommandPool cmdpool);
+// One layer per path, all of the same size, with a blitted mip chain and a
+// single trilinear sampler.
+Texture LoadTextureArrayFromFiles(const char **paths, u32 count, VkCommandPool cmdpool);
 void DestroyTexture(Texture tex);
 
-TextureArray CreateTextureArray(uint count);
-void AddTexture(TextureArray *ta, Texture tex);
-void LoadTextureAtSlot(TextureArray *ta, uint slot, const char *path, VkCommandPool cmdpool);
-void DestroyTextureArray(TextureArray *ta);
-
 VkImageMemoryBarrier2 CreateImageBarrier(VkImage image, VkPipelineStageFlags2 src_stage, VkAccessFlags2 src_access, VkImageLayout old_layout,
     VkPipelineStageFlags2 dst_stage, VkAccessFlags2 dst_access, VkImageLayout new_layout, VkImageAspectFlags aspect_mask);
 void PipelineImageBarriers(VkCommandBuffer cmdbuf, VkDependencyFlags flags, VkImageMemoryBarrier2 *barriers, u32 barriers_count);
@@ -144,6 +186,9 @@ void PipelineImageBarriers(VkCommandBuffer cmdbuf, VkDependencyFlags flags, VkIm
 VkBufferMemoryBarrier2 CreateBufferBarrier(VkBuffer buffer, VkDeviceSize size, VkPipelineStageFlags2 src_stage, VkAccessFlags2 src_access,
     VkPipelineStageFlags2 dst_stage, VkAccessFlags2 dst_access);
 void PipelineBufferBarriers(VkCommandBuffer cmdbuf, VkDependencyFlags flags, VkBufferMemoryBarrier2 *barriers, u32 barriers_count);
+// Both kinds in one vkCmdPipelineBarrier2.
+void PipelineBarriers(VkCommandBuffer cmdbuf, VkDependencyFlags flags, VkImageMemoryBarrier2 *image_barriers, u32 image_barriers_count,
+    VkBufferMemoryBarrier2 *buffer_barriers, u32 buffer_barriers_count);
 
 VkDescriptorSetLayout CreateDescriptorSetLayout(VkDescriptorSetLayoutBinding *bindings, u32 bindings_count);
 DescriptorSet CreateDescriptorSet(VkDescriptorSetLayoutBinding *bindings, u32 bindings_count);
@@ -152,10 +197,13 @@ void DestroyDescriptorSet(DescriptorSet *desc_set);
 void BindDescriptorSet(DescriptorSet *desc_set, Pipeline *p, VkCommandBuffer cmdbuf);
 void BindBuffer(DescriptorSet *desc_set, u32 binding, Buffer *buffer, VkDeviceSize size, VkDescriptorType type);
 void BindTexture(DescriptorSet *desc_set, u32 binding, Texture texture);
-void BindTextureArray(DescriptorSet *desc_set, u32 binding, TextureArray *textures);
+// The image has to be in VK_IMAGE_LAYOUT_GENERAL whenever it's used through it.
+void BindStorageImage(DescriptorSet *desc_set, u32 binding, Image image);
 
 Pipeline CreateGraphicsPipeline(GraphicsPipelineOptions *options, VkDescriptorSetLayout desc_layout);
 Pipeline CreateComputePipeline(Shader shader, VkDescriptorSetLayout desc_layout);
+Pipeline CreateComputePipeline(Shader shader, VkDescriptorSetLayout desc_layout, VkPushConstantRange *push_constants,
+    u32 push_constants_count);
 void DestroyPipeline(Pipeline pipeline);
 
 void BindPipeline(Pipeline *p, VkCommandBuffer cmdbuf);
@@ -165,6 +213,8 @@ Buffer CreateBuffer(VkCommandPool cmdpool, VkBufferUsageFlags usage, VkDeviceSiz
 StagingBuffer CreateStagingBuffer(VkDeviceSize size, void *data);
 void DestroyBuffer(Buffer buffer);
 void DestroyStagingBuffer(StagingBuffer buffer);
+// A transfer write of up to 64KB, whoever reads the buffer afterwards waits
+// for it.
 void UpdateRendererBuffer(Buffer buffer, VkDeviceSize size, void *data, VkCommandBuffer cmdbuf);
 
 VkQueryPool CreateQueryPool(uint32_t count, VkQueryType type);
@@ -172,5 +222,8 @@ void DestroyQueryPool(VkQueryPool pool);
 
 void WaitForDeviceIdle();
 
+// Whether optimally tiled images of the format have all of the features.
+b32 IsFormatSupported(VkFormat format, VkFormatFeatureFlags features);
+
 VkPhysicalDevice GetPhysicalDevice();
 VkDevice GetLogicalDevice();
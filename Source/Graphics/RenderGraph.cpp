@@ -0,0 +1,368 @@
+#include "RenderGraph.h"
+
+#include "GpuProfiler.h"
+
+void BeginRenderGraph(RenderGraph *graph) {
+    graph->resource_count = 0;
+    graph->pass_count = 0;
+    graph->access_count = 0;
+}
+
+internal void ReleaseTransients(RenderGraph *graph) {
+    for (u32 i = 0; i < graph->transient_count; ++i) {
+        DestroyImage(graph->transients[i].image);
+    }
+
+    for (u32 i = 0; i < graph->slot_count; ++i) {
+        FreeImageMemory(graph->slots[i].allocation);
+    }
+
+    graph->transient_count = 0;
+    graph->slot_count = 0;
+}
+
+void DestroyRenderGraph(RenderGraph *graph) {
+    ReleaseTransients(graph);
+}
+
+internal RenderGraphResource *AddResource(RenderGraph *graph, const char *name, RenderResource *index) {
+    Assert(graph->resource_count < RENDER_GRAPH_MAX_RESOURCES);
+
+    *index = graph->resource_count++;
+
+    RenderGraphResource *result = &graph->resources[*index];
+    *result = {};
+    result->name = name;
+    result->first_pass = max_u32;
+
+    return result;
+}
+
+RenderResource ImportImage(RenderGraph *graph, const char *name, Image image, VkImageAspectFlags aspect_mask, VkImageLayout layout,
+    VkPipelineStageFlags2 stage, VkAccessFlags2 access) {
+    RenderResource result;
+    RenderGraphResource *r = AddResource(graph, name, &result);
+
+    r->image = image;
+    r->aspect_mask = aspect_mask;
+    r->state.layout = layout;
+    r->state.write_stage = stage;
+    r->state.write_access = access;
+
+    return result;
+}
+
+RenderResource ImportBuffer(RenderGraph *graph, const char *name, VkBuffer buffer, VkPipelineStageFlags2 stage, VkAccessFlags2 access) {
+    RenderResource result;
+    RenderGraphResource *r = AddResource(graph, name, &result);
+
+    r->is_buffer = 1;
+    r->buffer = buffer;
+    r->state.write_stage = stage;
+    r->state.write_access = access;
+
+    return result;
+}
+
+RenderResource CreateTransientImage(RenderGraph *graph, const char *name, u32 width, u32 height, VkFormat format,
+    VkImageUsageFlags usage, VkImageAspectFlags aspect_mask) {
+    RenderResource result;
+    RenderGraphResource *r = AddResource(graph, name, &result);
+
+    r->transient = 1;
+    r->aspect_mask = aspect_mask;
+    r->info.width = width;
+    r->info.height = height;
+    r->info.format = format;
+    r->info.usage = usage;
+    r->info.aspect_mask = aspect_mask;
+    r->state.layout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+    return result;
+}
+
+u32 AddRenderPass(RenderGraph *graph, const char *name, RenderPassExecute *execute, void *data) {
+    Assert(graph->pass_count < RENDER_GRAPH_MAX_PASSES);
+
+    u32 result = graph->pass_count++;
+
+    RenderGraphPass *pass = &graph->passes[result];
+    pass->name = name;
+    pass->execute = execute;
+    pass->data = data;
+
+    return result;
+}
+
+// Only for the pass added last, the barriers rely on the accesses being in
+// the order the passes run.
+internal void AddAccess(RenderGraph *graph, u32 pass, RenderResource resource, VkPipelineStageFlags2 stage, VkAccessFlags2 access,
+    VkImageLayout layout, b32 write) {
+    Assert(pass + 1 == graph->pass_count);
+    Assert(resource < graph->resource_count);
+    Assert(graph->access_count < RENDER_GRAPH_MAX_ACCESSES);
+
+    RenderAccess *a = &graph->accesses[graph->access_count++];
+    a->resource = resource;
+    a->pass = pass;
+    a->stage = stage;
+    a->access = access;
+    a->layout = layout;
+    a->write = b8(write);
+
+    RenderGraphResource *r = &graph->resources[resource];
+    r->first_pass = Min(r->first_pass, pass);
+    r->last_pass = Max(r->last_pass, pass);
+}
+
+void ReadImage(RenderGraph *graph, u32 pass, RenderResource resource, VkPipelineStageFlags2 stage, VkAccessFlags2 access,
+    VkImageLayout layout) {
+    AddAccess(graph, pass, resource, stage, access, layout, 0);
+}
+
+void WriteImage(RenderGraph *graph, u32 pass, RenderResource resource, VkPipelineStageFlags2 stage, VkAccessFlags2 access,
+    VkImageLayout layout) {
+    AddAccess(graph, pass, resource, stage, access, layout, 1);
+}
+
+void ReadBuffer(RenderGraph *graph, u32 pass, RenderResource resource, VkPipelineStageFlags2 stage, VkAccessFlags2 access) {
+    AddAccess(graph, pass, resource, stage, access, VK_IMAGE_LAYOUT_UNDEFINED, 0);
+}
+
+void WriteBuffer(RenderGraph *graph, u32 pass, RenderResource resource, VkPipelineStageFlags2 stage, VkAccessFlags2 access) {
+    AddAccess(graph, pass, resource, stage, access, VK_IMAGE_LAYOUT_UNDEFINED, 1);
+}
+
+internal b32 TransientsMatch(RenderGraph *graph) {
+    u32 count = 0;
+
+    for (u32 i = 0; i < graph->resource_count; ++i) {
+        RenderGraphResource *r = &graph->resources[i];
+        if (!r->transient) {
+            continue;
+        }
+
+        if (count == graph->transient_count) {
+            return 0;
+        }
+
+        TransientImage *t = &graph->transients[count++];
+        b32 same = t->info.width == r->info.width && t->info.height == r->info.height && t->info.format == r->info.format &&
+            t->info.usage == r->info.usage && t->info.aspect_mask == r->info.aspect_mask &&
+            t->first_pass == r->first_pass && t->last_pass == r->last_pass;
+        if (!same) {
+            return 0;
+        }
+    }
+
+    return count == graph->transient_count;
+}
+
+// The first slot whose transients are all done before this one starts or
+// begin after it ends, and whose memory it can live in.
+internal u32 FindTransientSlot(RenderGraph *graph, u32 index, VkMemoryRequirements requirements) {
+    TransientImage *t = &graph->transients[index];
+
+    for (u32 slot = 0; slot < graph->slot_count; ++slot) {
+        TransientSlot *s = &graph->slots[slot];
+        if (!(s->requirements.memoryTypeBits & requirements.memoryTypeBits)) {
+            continue;
+        }
+
+        b32 overlaps = 0;
+        for (u32 i = 0; i < index; ++i) {
+            TransientImage *other = &graph->transients[i];
+            if (other->slot == slot && other->first_pass <= t->last_pass && t->first_pass <= other->last_pass) {
+                overlaps = 1;
+            }
+        }
+
+        if (overlaps) {
+            continue;
+        }
+
+        s->requirements.size = Max(s->requirements.size, requirements.size);
+        s->requirements.alignment = Max(s->requirements.alignment, requirements.alignment);
+        s->requirements.memoryTypeBits &= requirements.memoryTypeBits;
+
+        return slot;
+    }
+
+    TransientSlot *s = &graph->slots[graph->slot_count];
+    s->requirements = requirements;
+
+    return graph->slot_count++;
+}
+
+// Only when the transients or their lifetimes changed, on a resize mostly.
+// Nothing from earlier frames is in flight anymore, so the old ones can go.
+internal void PlaceTransients(RenderGraph *graph) {
+    ReleaseTransients(graph);
+
+    for (u32 i = 0; i < graph->resource_count; ++i) {
+        RenderGraphResource *r = &graph->resources[i];
+        if (!r->transient) {
+            continue;
+        }
+
+        u32 index = graph->transient_count++;
+
+        TransientImage *t = &graph->transients[index];
+        t->info = r->info;
+        t->first_pass = r->first_pass;
+        t->last_pass = r->last_pass;
+
+        VkMemoryRequirements requirements;
+        t->image = CreateUnboundImage(r->info.width, r->info.height, r->info.format, r->info.usage, &requirements);
+        t->slot = FindTransientSlot(graph, index, requirements);
+    }
+
+    for (u32 i = 0; i < graph->slot_count; ++i) {
+        graph->slots[i].allocation = AllocateImageMemory(graph->slots[i].requirements);
+    }
+
+    for (u32 i = 0; i < graph->transient_count; ++i) {
+        TransientImage *t = &graph->transients[i];
+        BindImageMemory(&t->image, graph->slots[t->slot].allocation, t->info.aspect_mask);
+    }
+}
+
+// What the transients that had the memory before this one did last.
+internal void GetAliasedState(RenderGraph *graph, RenderGraphResource *r, VkPipelineStageFlags2 *stage, VkAccessFlags2 *access) {
+    u32 slot = graph->transients[r->transient_index].slot;
+
+    for (u32 i = 0; i < graph->resource_count; ++i) {
+        RenderGraphResource *other = &graph->resources[i];
+        if (!other->transient || graph->transients[other->transient_index].slot != slot) {
+            continue;
+        }
+
+        if (other->last_pass < r->first_pass) {
+            *stage |= other->state.write_stage | other->state.read_stages;
+            *access |= other->state.write_access;
+        }
+    }
+}
+
+// One barrier for everything the pass touches. Reads in the same layout by
+// the passes right after are folded into it, so a target read by two passes
+// is transitioned and waited for once.
+internal void BarrierPass(RenderGraph *graph, u32 pass, VkCommandBuffer cmdbuf) {
+    VkImageMemoryBarrier2 image_barriers[RENDER_GRAPH_MAX_RESOURCES];
+    VkBufferMemoryBarrier2 buffer_barriers[RENDER_GRAPH_MAX_RESOURCES];
+    u32 image_barrier_count = 0;
+    u32 buffer_barrier_count = 0;
+
+    for (u32 i = 0; i < graph->access_count; ++i) {
+        RenderAccess *a = &graph->accesses[i];
+        if (a->pass != pass) {
+            continue;
+        }
+
+        RenderGraphResource *r = &graph->resources[a->resource];
+        RenderResourceState *state = &r->state;
+
+        b32 transition = !r->is_buffer && a->layout != state->layout;
+        b32 needed = 0;
+        VkPipelineStageFlags2 src_stage = 0;
+        VkAccessFlags2 src_access = 0;
+        VkPipelineStageFlags2 dst_stage = a->stage;
+        VkAccessFlags2 dst_access = a->access;
+
+        if (a->write || transition) {
+            src_stage = state->write_stage | state->read_stages;
+            src_access = state->write_access;
+            if (r->transient && state->layout == VK_IMAGE_LAYOUT_UNDEFINED) {
+                GetAliasedState(graph, r, &src_stage, &src_access);
+            }
+            needed = transition || src_stage;
+        } else if (state->write_stage) {
+            // already waited for the write at these stages
+            needed = (a->stage & ~state->read_stages) || (a->access & ~state->read_access);
+            src_stage = state->write_stage;
+            src_access = state->write_access;
+        }
+
+        if (needed && !a->write) {
+            for (u32 j = i + 1; j < graph->access_count; ++j) {
+                RenderAccess *next = &graph->accesses[j];
+                if (next->resource != a->resource) {
+                    continue;
+                }
+                if (next->write || next->layout != a->layout) {
+                    break;
+                }
+
+                dst_stage |= next->stage;
+                dst_access |= next->access;
+            }
+        }
+
+        if (needed && r->is_buffer) {
+            Assert(buffer_barrier_count < ArrayCount(buffer_barriers));
+            buffer_barriers[buffer_barrier_count++] = CreateBufferBarrier(r->buffer, VK_WHOLE_SIZE, src_stage, src_access,
+                dst_stage, dst_access);
+        } else if (needed) {
+            Assert(image_barrier_count < ArrayCount(image_barriers));
+            image_barriers[image_barrier_count++] = CreateImageBarrier(r->image.handle, src_stage, src_access, state->layout,
+                dst_stage, dst_access, a->layout, r->aspect_mask);
+        }
+
+        if (a->write) {
+            state->write_stage = a->stage;
+            state->write_access = a->access;
+            state->read_stages = 0;
+            state->read_access = 0;
+        } else if (transition) {
+            // the transition is a write of its own, whatever comes later
+            // waits for it through the stages it finished before
+            state->write_stage = dst_stage;
+            state->write_access = 0;
+            state->read_stages = dst_stage;
+            state->read_access = dst_access;
+        } else if (needed) {
+            state->read_stages |= dst_stage;
+            state->read_access |= dst_access;
+        } else {
+            state->read_stages |= a->stage;
+            state->read_access |= a->access;
+        }
+
+        if (!r->is_buffer) {
+            state->layout = a->layout;
+        }
+    }
+
+    if (image_barrier_count || buffer_barrier_count) {
+        PipelineBarriers(cmdbuf, 0, image_barriers, image_barrier_count, buffer_barriers, buffer_barrier_count);
+    }
+}
+
+void ExecuteRenderGraph(RenderGraph *graph, VkCommandBuffer cmdbuf) {
+    if (!TransientsMatch(graph)) {
+        PlaceTransients(graph);
+    }
+
+    u32 transient_count = 0;
+    for (u32 i = 0; i < graph->resource_count; ++i) {
+        RenderGraphResource *r = &graph->resources[i];
+        if (r->transient) {
+            r->transient_index = transient_count++;
+            r->image = graph->transients[r->transient_index].image;
+        }
+    }
+
+    for (u32 i = 0; i < graph->pass_count; ++i) {
+        RenderGraphPass *pass = &graph->passes[i];
+
+        u32 zone = BeginGpuZone(cmdbuf, pass->name);
+        BarrierPass(graph, i, cmdbuf);
+        pass->execute(cmdbuf, pass->data);
+        EndGpuZone(cmdbuf, zone);
+    }
+}
+
+Image GetRenderGraphImage(RenderGraph *graph, RenderResource resource) {
+    Assert(resource < graph->resource_count && !graph->resources[resource].is_buffer);
+    return graph->resources[resource].image;
+}
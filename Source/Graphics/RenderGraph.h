@@ -0,0 +1,132 @@
+#pragma once
+
+#include "../General.h"
+#include "NVulkan.h"
+
+enum {
+    RENDER_GRAPH_MAX_RESOURCES = 32,
+    RENDER_GRAPH_MAX_PASSES = 16,
+    // reads and writes of all passes together
+    RENDER_GRAPH_MAX_ACCESSES = 96,
+};
+
+// Index into the graph's resources, only valid for the frame it was
+// declared in.
+typedef u32 RenderResource;
+
+typedef void RenderPassExecute(VkCommandBuffer cmdbuf, void *data);
+
+struct RenderAccess {
+    RenderResource resource;
+    u32 pass;
+    VkPipelineStageFlags2 stage;
+    VkAccessFlags2 access;
+    // images only
+    VkImageLayout layout;
+    b8 write;
+};
+
+// Where a resource was left by what touched it so far. A write stays
+// pending until every later stage that reads it has waited for it once.
+struct RenderResourceState {
+    VkImageLayout layout;
+    VkPipelineStageFlags2 write_stage;
+    VkAccessFlags2 write_access;
+    // since the last write, a later write has to wait for them
+    VkPipelineStageFlags2 read_stages;
+    VkAccessFlags2 read_access;
+};
+
+struct TransientImageInfo {
+    u32 width;
+    u32 height;
+    VkFormat format;
+    VkImageUsageFlags usage;
+    VkImageAspectFlags aspect_mask;
+};
+
+struct RenderGraphResource {
+    const char *name;
+    b8 is_buffer;
+    // transient: created and placed by the graph, undefined at its first use
+    b8 transient;
+    u32 transient_index;
+    Image image;
+    VkImageAspectFlags aspect_mask;
+    VkBuffer buffer;
+    TransientImageInfo info;
+    RenderResourceState state;
+    // first and last pass that use it, the lifetime aliasing goes by
+    u32 first_pass;
+    u32 last_pass;
+};
+
+struct RenderGraphPass {
+    const char *name;
+    RenderPassExecute *execute;
+    void *data;
+};
+
+// A transient image as placed by the last build, kept as long as the frames
+// declare the same ones with the same lifetimes.
+struct TransientImage {
+    TransientImageInfo info;
+    u32 first_pass;
+    u32 last_pass;
+    u32 slot;
+    Image image;
+};
+
+// One allocation, shared by transients whose lifetimes don't overlap.
+struct TransientSlot {
+    VmaAllocation allocation;
+    VkMemoryRequirements requirements;
+};
+
+// Rebuilt every frame: import what lives outside of it, declare the
+// transients, add the passes with their reads and writes in the order they
+// run, then execute. Each pass gets a single barrier in front of it with
+// just what it needs, and a gpu zone under its name.
+//
+// Everything before the frame's command buffer has finished by the time it
+// runs, so imports only name what the command buffer itself did to them
+// ahead of the graph.
+struct RenderGraph {
+    RenderGraphResource resources[RENDER_GRAPH_MAX_RESOURCES];
+    u32 resource_count;
+    RenderGraphPass passes[RENDER_GRAPH_MAX_PASSES];
+    u32 pass_count;
+    RenderAccess accesses[RENDER_GRAPH_MAX_ACCESSES];
+    u32 access_count;
+
+    // kept between frames
+    TransientImage transients[RENDER_GRAPH_MAX_RESOURCES];
+    u32 transient_count;
+    TransientSlot slots[RENDER_GRAPH_MAX_RESOURCES];
+    u32 slot_count;
+};
+
+void BeginRenderGraph(RenderGraph *graph);
+// Frees the transients, after WaitForDeviceIdle.
+void DestroyRenderGraph(RenderGraph *graph);
+
+// stage and access of the last use in this command buffer, 0 for none
+RenderResource ImportImage(RenderGraph *graph, const char *name, Image image, VkImageAspectFlags aspect_mask, VkImageLayout layout,
+    VkPipelineStageFlags2 stage, VkAccessFlags2 access);
+RenderResource ImportBuffer(RenderGraph *graph, const char *name, VkBuffer buffer, VkPipelineStageFlags2 stage, VkAccessFlags2 access);
+RenderResource CreateTransientImage(RenderGraph *graph, const char *name, u32 width, u32 height, VkFormat format,
+    VkImageUsageFlags usage, VkImageAspectFlags aspect_mask);
+
+// name has to outlive the gpu profiler, data the execution
+u32 AddRenderPass(RenderGraph *graph, const char *name, RenderPassExecute *execute, void *data);
+void ReadImage(RenderGraph *graph, u32 pass, RenderResource resource, VkPipelineStageFlags2 stage, VkAccessFlags2 access,
+    VkImageLayout layout);
+void WriteImage(RenderGraph *graph, u32 pass, RenderResource resource, VkPipelineStageFlags2 stage, VkAccessFlags2 access,
+    VkImageLayout layout);
+void ReadBuffer(RenderGraph *graph, u32 pass, RenderResource resource, VkPipelineStageFlags2 stage, VkAccessFlags2 access);
+void WriteBuffer(RenderGraph *graph, u32 pass, RenderResource resource, VkPipelineStageFlags2 stage, VkAccessFlags2 access);
+
+// Transients are only backed by memory once this runs, the passes look them
+// up from their execute callbacks.
+void ExecuteRenderGraph(RenderGraph *graph, VkCommandBuffer cmdbuf);
+Image GetRenderGraphImage(RenderGraph *graph, RenderResource resource);
@@ -3,6 +3,7 @@
 #include "General.h"
 #include "Window/Window.h"
 #include "Graphics/NVulkan.h"
+#include "Graphics/GpuProfiler.h"
 #include "Math/Vec.h"
 #include "Math/Mat.h"
 #include "Math/Quat.h"
@@ -12,72 +13,177 @@
 #include "MapGen.h"
 #include "Renderer.h"
 #include "Player.h"
+#include "Simulation.h"
+#include "ChunkPipeline.h"
+#include "Options.h"
+#include "Replay.h"
+#include "FrameStats.h"
+#include "AssetPack.h"
+#include "Platform/Jobs.h"
+#include "Platform/Profiler.h"
+
+#include "ThirdParty/stb_image_write.h"
+
+internal void WriteFramePng(Swapchain *swapchain, String path, u32 frame_index) {
+	char filename[512];
+	snprintf(filename, sizeof(filename), "%.*s_%05u.png", int(path.len), (char *) path.ptr, frame_index);
+
+	u8 *pixels = GetSwapchainReadback(swapchain);
+	if (!stbi_write_png(filename, int(swapchain->width), int(swapchain->height), 4, pixels, int(swapchain->width * 4))) {
+		Print("Failed to write %s\n", filename);
+	}
+}
+
+// The 3D passes write and read these every frame, the smaller the better as
+// long as it can be rendered to (and the color one filtered by the post pass).
+internal VkFormat ChooseHdrFormat(u32 hdr_format) {
+	VkFormatFeatureFlags needed = VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BIT | VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BLEND_BIT |
+		VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+	b32 packed = IsFormatSupported(VK_FORMAT_B10G11R11_UFLOAT_PACK32, needed);
+
+	if (hdr_format == HDR_FORMAT_B10G11R11 && !packed) {
+		Print("B10G11R11 can't be rendered to, using RGBA16F\n");
+	}
+
+	if (packed && hdr_format != HDR_FORMAT_RGBA16F) {
+		return VK_FORMAT_B10G11R11_UFLOAT_PACK32;
+	}
+
+	return VK_FORMAT_R16G16B16A16_SFLOAT;
+}
+
+internal VkFormat ChooseDepthFormat(u32 depth_format) {
+	VkFormat format = VK_FORMAT_D32_SFLOAT;
+	if (depth_format == DEPTH_FORMAT_D24) {
+		format = VK_FORMAT_X8_D24_UNORM_PACK32;
+	} else if (depth_format == DEPTH_FORMAT_D16) {
+		format = VK_FORMAT_D16_UNORM;
+	}
+
+	if (!IsFormatSupported(format, VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT)) {
+		Print("Depth format can't be rendered to, using D32\n");
+		format = VK_FORMAT_D32_SFLOAT;
+	}
+
+	return format;
+}
 
 void NKMain() {
+	Options options = ParseOptions();
+
+	PROFILE_THREAD("main");
+	InitJobs(0);
+
 	Window window = {};
 	window.title = "nmc";
 	window.size.x = 1280;
 	window.size.y = 720;
 	
-	if (!InitWindow(&window)) {
-		Print("Failed to initialize window!\n");
-		Exit(1);
+	if (options.headless) {
+		window.running = 1;
+		InitVulkan(0);
+	} else {
+		if (!InitWindow(&window)) {
+			Print("Failed to initialize window!\n");
+			Exit(1);
+		}
+
+		InitVulkan(&window);
 	}
 
-	InitVulkan(&window);
 	VkCommandPool cmdpool = CreateCommandPool();
 	Swapchain swapchain = {};
-	CreateSwapchain(&swapchain, cmdpool);
+	if (options.headless) {
+		CreateHeadlessSwapchain(&swapchain, options.width, options.height);
+	} else {
+		CreateSwapchain(&swapchain, cmdpool);
+	}
 	VkCommandBuffer cmdbuf;
 	AllocateCommandBuffers(cmdpool, &cmdbuf, 1);
-	Image swapchain_target = CreateImage(swapchain.width, swapchain.height, swapchain.format.format, 1,
-		VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT);
-	Texture render_target = CreateTexture(swapchain.width, swapchain.height, VK_FORMAT_R16G16B16A16_SFLOAT, 
-		VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
-	Image depth_target = CreateImage(swapchain.width, swapchain.height, VK_FORMAT_D32_SFLOAT, 1,
-		VK_IMAGE_ASPECT_DEPTH_BIT, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT);
+	VkFormat hdr_format = ChooseHdrFormat(options.hdr_format);
+	VkFormat depth_format = ChooseDepthFormat(options.depth_format);
 
 	VkQueryPool pipeline_queries = CreateQueryPool(1, VK_QUERY_TYPE_PIPELINE_STATISTICS);
+	InitGpuProfiler();
+
+	// shaders and textures come from the pack when the build made one, loose
+	// files otherwise
+	if (!OpenAssetPack("Assets.pack")) {
+		Print("No asset pack, loading shaders and textures from their files\n");
+	}
 
 	VkCommandBuffer init_cmdbuf = BeginTempCommandBuffer(cmdpool);
-	InitRenderer(cmdpool, init_cmdbuf, render_target.image.format, depth_target.format);
+	InitRenderer(cmdpool, init_cmdbuf, hdr_format, depth_format, swapchain.format.format);
+	SetShadowMode(options.evsm_shadows ? SHADOW_MODE_EVSM : SHADOW_MODE_PCF);
+	SetDepthPrepass(!options.no_depth_prepass);
+	SetRenderScale(float(options.render_scale) / 100.0f);
+	ResizePostprocess(swapchain.width, swapchain.height, init_cmdbuf);
 
 	Player player = CreatePlayer();
 	ResizePlayerCamera(&player.camera, float(swapchain.width), float(swapchain.height));
-	UploadTransformations(&player, init_cmdbuf);
 
-	VkImageMemoryBarrier2 render_target_barrier_initial = CreateImageBarrier(render_target.image.handle, VK_PIPELINE_STAGE_ALL_GRAPHICS_BIT,
-		VK_ACCESS_2_NONE, VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_ALL_GRAPHICS_BIT,
-		VK_ACCESS_2_NONE, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_ASPECT_COLOR_BIT);
-	PipelineImageBarriers(init_cmdbuf, 0, &render_target_barrier_initial, 1);
+	// replays bring their own start pose, world and tick rate
+	b32 replaying = options.replay_path.len > 0;
+	u32 world_seed = options.seed;
+	double time_step = 0.01;
+	if (replaying && !LoadReplay(options.replay_path, &player, &world_seed, &time_step)) {
+		Exit(1);
+	}
+	SetWorldSeed(world_seed);
+
+	UploadTransformations(&player, init_cmdbuf);
 	EndTempCommandBuffer(cmdpool, init_cmdbuf);
 
 	VkPhysicalDeviceProperties pdev_props;
 	vkGetPhysicalDeviceProperties(GetPhysicalDevice(), &pdev_props);
 	Assert(pdev_props.limits.timestampComputeAndGraphics);
 
-	GenerateMap();
+	// the world streams in around the player through the chunk pipeline,
+	// headless runs and recordings wait for all of it so every frame renders
+	// and collides with the same world
+	InitChunkPipeline();
+	b32 flush_world = options.headless || replaying || options.record_path.len;
+	b32 meshes_flushed = flush_world ? FlushChunkPipeline(player.position) : 0;
 	// GenerateMapImage();
 
+	double entity_time_avg = 0.0;
+
 	double cpu_time_avg = 0.0;
 	double gpu_time_avg = 0.0;
 	u64 triangles = 0.0;
 	double triangles_per_sec = 0.0;
 
-	b32 cursor_locked = 1;
-	SetCursorToNone(&window);
+	double cpu_time_total = 0.0;
+	double gpu_time_total = 0.0;
+	double render_scale_total = 0.0;
+	u32 frame_index = 0;
+
+	b32 cursor_locked = !options.headless && !replaying;
+	if (cursor_locked) {
+		SetCursorToNone(&window);
+	}
 
 	BlockInstanceCounts prev_instance_counts = {};
+	u32 prev_chunks_uploaded = 0;
+	u32 prev_block_edits = 0;
 
-	u64 last_frame_time = GetTimeNowUs();
-	double time = 0.0;
-	const double time_step = 0.01;
-	double accumulator = 0.0;
+	InitFrameStats(float(options.hitch_ms));
+
+	if (options.record_path.len && !BeginReplayRecording(options.record_path, &player, world_seed, float(time_step))) {
+		Print("Failed to create %.*s\n", int(options.record_path.len), options.record_path.ptr);
+		Exit(1);
+	}
+
+	StartSimulation(&player, time_step, replaying);
 
 	while (window.running) {
+		PROFILE_ZONE("frame");
+
 		u64 cpu_time_begin = GetTimeNowUs();
 
-		UpdateWindow(&window);
+		if (!options.headless) {
+			UpdateWindow(&window);
+		}
 
 		if (IsKeyDown(KEY_ESCAPE)) {
 			cursor_locked ^= 1;
@@ -92,70 +198,93 @@ void NKMain() {
 			window.running = false;
 		}
 
-		UpdatePlayer(&player);
+		if (WasKeyPressed(KEY_P)) {
+			PrintGpuProfile();
+		}
+
+		if (WasKeyPressed(KEY_T)) {
+			String path = options.cpu_trace_path.len ? options.cpu_trace_path : String("nmc_cpu_trace.json");
+			if (WriteCpuTrace(path)) {
+				Print("Wrote %.*s\n", int(path.len), path.ptr);
+			}
+		}
+
+		if (WasKeyPressed(KEY_V)) {
+			u32 mode = (GetShadowMode() + 1) % SHADOW_MODE_COUNT;
+			SetShadowMode(mode);
+			Print("shadows: %s\n", GetShadowModeName(mode));
+		}
 
-		u64 now_time = GetTimeNowUs();
-		u64 frame_time = now_time - last_frame_time;
-		last_frame_time = now_time;
-		accumulator += double(frame_time) / 1000000;
+		if (replaying) {
+			PlayerInput input;
+			u32 block_edits;
+			if (!NextReplayInput(&input, &block_edits)) {
+				window.running = 0;
+				break;
+			}
 
-		while (accumulator >= time_step) {
-			UpdatePlayerPhysics(&player, time_step);
-			accumulator -= time_step;
-			time += time_step;
+			player.camera.front = input.front;
+			SubmitPlayerInput(input);
+			StepSimulation(block_edits);
+		} else {
+			UpdatePlayerLook(&player);
+			SubmitPlayerInput(GatherPlayerInput(&player));
 		}
 
+		// the simulation runs on its own thread, render between its last two ticks
+		SimFrame sim_frame = GetSimulationFrame();
+		player.position = InterpolatePlayerPosition(&sim_frame);
+		double time = (double(sim_frame.prev.tick) + sim_frame.alpha) * time_step;
+
+		if (replaying) {
+			CheckReplayPosition(sim_frame.curr.player_position);
+		}
+
+		entity_time_avg = entity_time_avg * 0.95 + sim_frame.curr.entity_update_ms * 0.05;
+
 		if (window.resized) {
 			UpdateSwapchain(&swapchain, cmdpool, 1);
 
-			DestroyImage(swapchain_target);
-			DestroyTexture(render_target);
-			DestroyImage(depth_target);
-			swapchain_target = CreateImage(swapchain.width, swapchain.height, swapchain.format.format, 1,
-				VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT);
-			render_target = CreateTexture(swapchain.width, swapchain.height, VK_FORMAT_R16G16B16A16_SFLOAT,
-				VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT);
-			depth_target = CreateImage(swapchain.width, swapchain.height, VK_FORMAT_D32_SFLOAT, 1,
-				VK_IMAGE_ASPECT_DEPTH_BIT, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT);
-
+			// the render graph recreates the frame's targets on its own
 			VkCommandBuffer temp_cmdbuf = BeginTempCommandBuffer(cmdpool);
 			ResizePlayerCamera(&player.camera, float(swapchain.width), float(swapchain.height));
-
+			ResizePostprocess(swapchain.width, swapchain.height, temp_cmdbuf);
 			EndTempCommandBuffer(cmdpool, temp_cmdbuf);
 		}
 
-		if (!AcquireSwapchain(&swapchain, cmdpool, cmdbuf, swapchain_target, depth_target)) {
+		if (!AcquireSwapchain(&swapchain, cmdpool, cmdbuf)) {
 			continue;
 		}
 
+		BeginGpuProfilerFrame(cmdbuf);
+
+		u32 upload_zone = BeginGpuZone(cmdbuf, "upload");
 		UploadTransformations(&player, cmdbuf);
 
-		BlockInstanceCounts instance_counts = UpdateBlockInstances(cmdbuf, prev_instance_counts);
+		b32 meshes_changed = UpdateChunkPipeline(player.position) || meshes_flushed;
+		meshes_flushed = 0;
+		BlockInstanceCounts instance_counts = UpdateBlockInstances(cmdbuf, prev_instance_counts, meshes_changed);
 		prev_instance_counts = instance_counts;
-
-		Cull(&player, instance_counts, cmdbuf);
+		EndGpuZone(cmdbuf, upload_zone);
 
 		vkCmdResetQueryPool(cmdbuf, pipeline_queries, 0, 1);
 		vkCmdBeginQuery(cmdbuf, pipeline_queries, 0, 0);
 
-		VkImageMemoryBarrier2 render_target_barrier_before = CreateImageBarrier(render_target.image.handle, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
-			VK_ACCESS_2_SHADER_SAMPLED_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
-			VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_ASPECT_COLOR_BIT);
-		PipelineImageBarriers(cmdbuf, 0, &render_target_barrier_before, 1);
+		RenderFrame(&swapchain, &player, instance_counts, float(time), cmdbuf);
 
-		RenderShadow(cmdbuf, instance_counts);
-		Render(&swapchain, render_target.image.view, depth_target.view, cmdbuf, instance_counts, time);
+		vkCmdEndQuery(cmdbuf, pipeline_queries, 0);
 
-		VkImageMemoryBarrier2 render_target_barrier_after = CreateImageBarrier(render_target.image.handle, VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
-			VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
-			VK_ACCESS_2_SHADER_SAMPLED_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_ASPECT_COLOR_BIT);
-		PipelineImageBarriers(cmdbuf, 0, &render_target_barrier_after, 1);
+		b32 write_png = options.headless && options.png_path.len &&
+			(frame_index + 1 == options.frames || (options.png_every && frame_index % options.png_every == 0));
+		if (write_png) {
+			RequestSwapchainReadback(&swapchain);
+		}
 
-		DoPostprocessing(&swapchain, render_target, swapchain_target, cmdbuf);
+		PresentSwapchain(&swapchain, cmdbuf);
 
-		vkCmdEndQuery(cmdbuf, pipeline_queries, 0);
-
-		PresentSwapchain(&swapchain, cmdbuf, swapchain_target);
+		if (write_png) {
+			WriteFramePng(&swapchain, options.png_path, frame_index);
+		}
 
 		uint64_t gpu_timestamps[2] = {};
 		VK_CHECK(vkGetQueryPoolResults(GetLogicalDevice(), swapchain.query_pool, 0, 2, sizeof(gpu_timestamps),
@@ -169,34 +298,127 @@ void NKMain() {
 		double gpu_time_end = double(gpu_timestamps[1]) * pdev_props.limits.timestampPeriod * 1e-6;
 
 		gpu_time_avg = gpu_time_avg * 0.95 + (gpu_time_end - gpu_time_begin) * 0.05;
+		gpu_time_total += gpu_time_end - gpu_time_begin;
 
 		u64 cpu_time_end = GetTimeNowUs();
 		double cpu_time_delta_ms = double(cpu_time_end - cpu_time_begin) / 1000.0;
 
 		cpu_time_avg = cpu_time_avg * 0.95 + cpu_time_delta_ms * 0.05;
+		cpu_time_total += cpu_time_delta_ms;
+
+		if (replaying) {
+			RecordReplayFrame(cpu_time_delta_ms, gpu_time_end - gpu_time_begin);
+		}
 
 		triangles = pipeline_stats[0];
 		triangles_per_sec = double(triangles) / double(gpu_time_avg * 1e-3);
 
-		char perf_title[128];
-		snprintf(perf_title, sizeof(perf_title), "cpu: %.2fms, gpu: %.2fms, tri: %llu, tri/sec: %.2fM", cpu_time_avg, gpu_time_avg, triangles, triangles_per_sec * 1e-6);
-		SetWindowTitle(&window, perf_title);
+		u32 entity_count = sim_frame.curr.entity_count;
+		double entities_per_ms = entity_time_avg > 0.0 ? double(entity_count) / entity_time_avg : 0.0;
+
+		ChunkPipelineStats chunk_stats = GetChunkPipelineStats();
+
+		// what the frame did, kept with it if it turns out to be a hitch
+		FrameTags frame_tags = {};
+		frame_tags.chunks_uploaded = chunk_stats.stages[CHUNK_STAGE_UPLOAD].completed - prev_chunks_uploaded;
+		for (u32 i = 0; i < CHUNK_STAGE_COUNT; ++i) {
+			frame_tags.chunks_pending += chunk_stats.stages[i].waiting + chunk_stats.stages[i].in_flight;
+		}
+		frame_tags.block_edits = sim_frame.curr.block_edits - prev_block_edits;
+		frame_tags.render_scale = GetRenderScale();
+		if (meshes_changed) {
+			frame_tags.upload_bytes = u64(instance_counts.solid + instance_counts.water) * sizeof(InstanceData);
+		}
+		prev_chunks_uploaded = chunk_stats.stages[CHUNK_STAGE_UPLOAD].completed;
+		prev_block_edits = sim_frame.curr.block_edits;
+
+		RecordFrameStats(cpu_time_delta_ms, gpu_time_end - gpu_time_begin, frame_tags);
+		FrameStatsSummary frame_summary = GetRollingFrameStats();
+
+		// the next frame renders at whatever this one's gpu time calls for
+		render_scale_total += frame_tags.render_scale;
+		if (options.gpu_budget_ms > 0.0f) {
+			UpdateRenderScale(float(gpu_time_end - gpu_time_begin), options.gpu_budget_ms);
+		}
+
+		// queued+running per stage and average latency, gen/dec/mesh/upload
+		char chunk_title[128];
+		int chunk_title_length = 0;
+		for (u32 i = 0; i < CHUNK_STAGE_COUNT; ++i) {
+			ChunkStageStats *stage = &chunk_stats.stages[i];
+			chunk_title_length += snprintf(chunk_title + chunk_title_length, sizeof(chunk_title) - chunk_title_length,
+				"%s%s %u+%u %.0fms", i ? ", " : "", GetChunkStageName(i), stage->waiting, stage->in_flight, stage->latency_avg);
+		}
+
+		char perf_title[384];
+		snprintf(perf_title, sizeof(perf_title), "cpu: %.2fms (p99 %.2f), gpu: %.2fms (p99 %.2f), scale: %.0f%%, hitches: %u, tri: %llu, tri/sec: %.2fM, mobs: %u (%.0f/ms), chunks: %u [%s]",
+			cpu_time_avg, frame_summary.cpu.p99, gpu_time_avg, frame_summary.gpu.p99, frame_tags.render_scale * 100.0f, frame_summary.hitches,
+			triangles, triangles_per_sec * 1e-6, entity_count, entities_per_ms, chunk_stats.uploaded_chunks, chunk_title);
+		if (!options.headless) {
+			SetWindowTitle(&window, perf_title);
+		}
+
+		frame_index++;
+		if (options.frames && frame_index >= options.frames) {
+			window.running = 0;
+		}
+	}
+
+	if ((options.headless || replaying) && frame_index) {
+		Print("%u frames at %ux%u, cpu: %.3fms, gpu: %.3fms, render scale: %.0f%%\n", frame_index, swapchain.width, swapchain.height,
+			cpu_time_total / frame_index, gpu_time_total / frame_index, render_scale_total / frame_index * 100.0);
+
+		FrameStatsSummary total = GetTotalFrameStats();
+		Print("cpu p50/p95/p99/max: %.2f/%.2f/%.2f/%.2fms, gpu p50/p95/p99/max: %.2f/%.2f/%.2f/%.2fms, hitches: %u\n",
+			total.cpu.p50, total.cpu.p95, total.cpu.p99, total.cpu.max,
+			total.gpu.p50, total.gpu.p95, total.gpu.p99, total.gpu.max, total.hitches);
+	}
+
+	StopSimulation();
+
+	if (options.record_path.len) {
+		EndReplayRecording();
+	}
+	if (replaying) {
+		EndReplay(options.timings_path);
 	}
 
 	WaitForDeviceIdle();
 
+	ResolveGpuProfiler();
+	if (options.headless) {
+		PrintGpuProfile();
+	}
+	if (options.gpu_trace_path.len && !WriteGpuTrace(options.gpu_trace_path)) {
+		Print("Failed to write %.*s\n", int(options.gpu_trace_path.len), options.gpu_trace_path.ptr);
+	}
+	if (options.gpu_csv_path.len && !WriteGpuProfileCsv(options.gpu_csv_path)) {
+		Print("Failed to write %.*s\n", int(options.gpu_csv_path.len), options.gpu_csv_path.ptr);
+	}
+	if (options.cpu_trace_path.len && !WriteCpuTrace(options.cpu_trace_path)) {
+		Print("Failed to write %.*s (needs a BUILD_PROFILE build)\n", int(options.cpu_trace_path.len), options.cpu_trace_path.ptr);
+	}
+	if (options.frame_stats_path.len && !WriteFrameStatsCsv(options.frame_stats_path)) {
+		Print("Failed to write %.*s\n", int(options.frame_stats_path.len), options.frame_stats_path.ptr);
+	}
+
+	DestroyFrameStats();
+
+	DestroyGpuProfiler();
 	DestroyQueryPool(pipeline_queries);
 
 	DestroyRenderer();
+	CloseAssetPack();
 
-	DestroyImage(depth_target);
-	DestroyImage(swapchain_target);
-	DestroyTexture(render_target);
 	FreeCommandBuffers(cmdpool, &cmdbuf, 1);
 	DestroySwapchain(&swapchain);
 	DestroyCommandPool(cmdpool);
 
 	ReleaseVulkan();
 
-	DestroyWindow(&window);
+	if (!options.headless) {
+		DestroyWindow(&window);
+	}
+
+	ShutdownJobs();
 }
\ No newline at end of file
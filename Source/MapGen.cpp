@@ -1,8 +1,9 @@
 #include "MapGen.h"
-#include "World.h"
 
 #include "Math/NMath.h"
 #include "Platform/Platform.h"
+#include "Platform/Jobs.h"
+#include "Platform/Profiler.h"
 
 #include "ThirdParty/stb_image_write.h"
 #include "ThirdParty/stb_perlin.h"
@@ -15,78 +16,140 @@ enum {
 	WATER_LEVEL = 15,
 };
 
-void GenerateMap() {
+struct MapGenState {
+	u32 seed;
+	float noise_offset_x;
+	float noise_offset_z;
+};
+
+global MapGenState mapgen;
+
+// stb_perlin has no seed for fbm noise, other seeds sample the heightmap from
+// a different part of the (256 periodic) noise instead. Seed 0 is the
+// original world.
+void SetWorldSeed(u32 seed) {
+	u32 h = seed * 0x9E3779B9u;
+	h ^= h >> 15;
+	h *= 0x85EBCA6Bu;
+	h ^= h >> 13;
+
+	mapgen.seed = seed;
+	mapgen.noise_offset_x = seed ? float(h & 0xFFFF) / 256.0f : 0.0f;
+	mapgen.noise_offset_z = seed ? float(h >> 16) / 256.0f : 0.0f;
+}
+
+u32 GetWorldSeed() {
+	return mapgen.seed;
+}
+
+// Fills a whole column of chunks with terrain from one heightmap lookup per
+// block column. Surfaces are left as dirt, DecorateChunk turns them into grass.
+void GenerateChunkColumn(int cx, int cz) {
+	PROFILE_FUNCTION();
+
 	int width = CHUNK_X * WORLD_CHUNK_COUNT_X;
 	int height = CHUNK_Z * WORLD_CHUNK_COUNT_Z;
 
-	u8 *heightmap = (u8 *) HeapAlloc(width * height);
-
 	float sx = 1.0f / width;
 	float sz = 1.0f / height;
 
-	for (int z = 0; z < height; ++z) {
-		for (int x = 0; x < width; ++x) {
-			float height = stb_perlin_fbm_noise3(x * sx, 0.0f, z * sz, 2, 0.5f, 6);
-			height = (height + 1.0f) * 0.5f;
-			heightmap[z * width + x] = u8(height * 50);
+	u8 heightmap[CHUNK_X][CHUNK_Z];
+	for (int bx = 0; bx < CHUNK_X; ++bx) {
+		int wx = cx * CHUNK_X + bx;
+
+		for (int bz = 0; bz < CHUNK_Z; ++bz) {
+			int wz = cz * CHUNK_Z + bz;
+
+			float h = stb_perlin_fbm_noise3(wx * sx + mapgen.noise_offset_x, 0.0f, wz * sz + mapgen.noise_offset_z, 2, 0.5f, 6);
+			h = (h + 1.0f) * 0.5f;
+			heightmap[bx][bz] = u8(h * 50);
 		}
 	}
 
-	for (int cx = 0; cx < WORLD_CHUNK_COUNT_X; ++cx) {
-		for (int cz = 0; cz < WORLD_CHUNK_COUNT_Z; ++cz) {
-			for (int cy = 0; cy < WORLD_CHUNK_COUNT_Y; ++cy) {
-				Chunk *c = GetChunk(cx, cy, cz);
-				c->world_pos = vec3(cx * CHUNK_X, cy * CHUNK_Y, cz * CHUNK_Z);
+	for (int cy = 0; cy < WORLD_CHUNK_COUNT_Y; ++cy) {
+		Chunk *c = GetChunk(cx, cy, cz);
+		c->world_pos = vec3(cx * CHUNK_X, cy * CHUNK_Y, cz * CHUNK_Z);
+
+		for (int bx = 0; bx < CHUNK_X; ++bx) {
+			for (int bz = 0; bz < CHUNK_Z; ++bz) {
+				int height = heightmap[bx][bz];
+				int ydiff = height - c->world_pos.y;
+				int water_height = WATER_LEVEL - height;
+
+				if (ydiff > 0) {
+					for (int i = 0; i < Min(ydiff, CHUNK_Y); ++i) {
+						int wy = c->world_pos.y + i;
+
+						Block block;
+						int yd = height - wy;
+						if (yd > 4) {
+							block = BLOCK_STONE;
+						} else {
+							block = BLOCK_DIRT;
+						}
+
+						c->blocks[bx][bz][i] = block;
+					}
+				}
+				if (water_height > 0 && c->world_pos.y < WATER_LEVEL) {
+					for (int i = Max(ydiff, 0); i < Min(ydiff + water_height, CHUNK_Y); ++i) {
+						c->blocks[bx][bz][i] = BLOCK_WATER;
+					}
+				}
 			}
 		}
+
+		MarkChunkDirty(c);
 	}
+}
 
-	for (int cx = 0; cx < WORLD_CHUNK_COUNT_X; ++cx) {
-		for (int cz = 0; cz < WORLD_CHUNK_COUNT_Z; ++cz) {
-			for (int cy = 0; cy < WORLD_CHUNK_COUNT_Y; ++cy) {
-				Chunk *c = GetChunk(cx, cy, cz);
-				for (int bx = 0; bx < CHUNK_X; ++bx) {
-					int wx = c->world_pos.x + bx;
-
-					for (int bz = 0; bz < CHUNK_Z; ++bz) {
-						int wz = c->world_pos.z + bz;
-
-						int height = heightmap[wz * width + wx];
-						int ydiff = height - c->world_pos.y;
-						int water_height = WATER_LEVEL - height;
-
-						if (ydiff > 0) {
-							for (int i = 0; i < Min(ydiff, CHUNK_Y); ++i) {
-								int wy = c->world_pos.y + i;
-
-								Block block;
-								int yd = height - wy;
-								if (yd == 1 && water_height <= 0) {
-									block = BLOCK_GRASS;
-								} else if (yd > 4) {
-									block = BLOCK_STONE;
-								} else {
-									block = BLOCK_DIRT;
-								}
-
-								PlaceBlock(c, bx, i, bz, block);
-							}
-						}
-						if (water_height > 0 && c->world_pos.y < WATER_LEVEL) {
-							for (int i = ydiff; i < Min(ydiff + water_height, CHUNK_Y); ++i) {
-								int wy = c->world_pos.y + i;
+// Needs the chunk above to be generated, dirt with air on top becomes grass.
+void DecorateChunk(Chunk *c) {
+	PROFILE_FUNCTION();
 
-								Block block = BLOCK_WATER;
-								PlaceBlock(c, bx, i, bz, block);
-							}
-						}
-					}
+	for (int bx = 0; bx < CHUNK_X; ++bx) {
+		int wx = c->world_pos.x + bx;
+
+		for (int bz = 0; bz < CHUNK_Z; ++bz) {
+			int wz = c->world_pos.z + bz;
+
+			for (int by = 0; by < CHUNK_Y; ++by) {
+				if (c->blocks[bx][bz][by] != BLOCK_DIRT) continue;
+
+				Block above = by + 1 < CHUNK_Y ? c->blocks[bx][bz][by + 1] : GetBlock(wx, int(c->world_pos.y) + by + 1, wz);
+				if (above == BLOCK_AIR) {
+					c->blocks[bx][bz][by] = BLOCK_GRASS;
 				}
 			}
 		}
 	}
 
-	HeapFree(heightmap);
+	MarkChunkDirty(c);
+	MarkChunkDecorated(c);
+}
+
+internal void GenerateColumns(void *data, u32 begin, u32 end) {
+	for (u32 column = begin; column < end; ++column) {
+		GenerateChunkColumn(int(column) / WORLD_CHUNK_COUNT_Z, int(column) % WORLD_CHUNK_COUNT_Z);
+	}
+}
+
+internal void DecorateChunks(void *data, u32 begin, u32 end) {
+	for (u32 i = begin; i < end; ++i) {
+		int cx = int(i) / (WORLD_CHUNK_COUNT_Z * WORLD_CHUNK_COUNT_Y);
+		int cz = (int(i) / WORLD_CHUNK_COUNT_Y) % WORLD_CHUNK_COUNT_Z;
+		int cy = int(i) % WORLD_CHUNK_COUNT_Y;
+		DecorateChunk(GetChunk(cx, cy, cz));
+	}
+}
+
+// Generates the whole world up front. The game streams it in through the
+// chunk pipeline instead, this is for tools and benchmarks.
+void GenerateMap() {
+	PROFILE_FUNCTION();
+
+	ParallelFor(WORLD_CHUNK_COUNT_X * WORLD_CHUNK_COUNT_Z, 1, GenerateColumns, 0);
+	ParallelFor(WORLD_CHUNK_COUNT_X * WORLD_CHUNK_COUNT_Y * WORLD_CHUNK_COUNT_Z, 16, DecorateChunks, 0);
 }
 
 /*
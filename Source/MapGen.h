@@ -1,4 +1,13 @@
 #pragma once
 
+#include "World.h"
+
+// Has to be set before any chunk is generated.
+void SetWorldSeed(u32 seed);
+u32 GetWorldSeed();
+
+void GenerateChunkColumn(int cx, int cz);
+void DecorateChunk(Chunk *c);
+
 void GenerateMap();
 void GenerateMapImage();
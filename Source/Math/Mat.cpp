@@ -217,15 +217,22 @@ mat4 Inverse(mat4 mat) {
     return result;
 }
 
+// scaled by the normal only so dot() gives a distance in view space units,
+// normalizing w as well breaks that for orthographic projections
+internal vec4 NormalizePlane(vec4 plane) {
+    float len = Length(vec3(plane.x, plane.y, plane.z));
+    return plane / vec4(len);
+}
+
 void ExtractFrustumPlanes(mat4 proj, vec4 dest[6]) {
     mat4 t = Transpose(proj);
 
-	dest[0] = Normalize(t[3] + t[0]); // left
-	dest[1] = Normalize(t[3] - t[0]); // right
-	dest[2] = Normalize(t[3] + t[1]); // top
-	dest[3] = Normalize(t[3] - t[1]); // bottom
-	dest[4] = Normalize(t[3] + t[2]); // near
-	dest[5] = Normalize(t[3] - t[2]); // far
+	dest[0] = NormalizePlane(t[3] + t[0]); // left
+	dest[1] = NormalizePlane(t[3] - t[0]); // right
+	dest[2] = NormalizePlane(t[3] + t[1]); // top
+	dest[3] = NormalizePlane(t[3] - t[1]); // bottom
+	dest[4] = NormalizePlane(t[3] + t[2]); // near
+	dest[5] = NormalizePlane(t[3] - t[2]); // far
 }
 
 void PrintMat(mat4 m) {
@@ -1,5 +1,10 @@
 #include "Quat.h"
 
+// vec3 has constructors, so GCC won't let it live in the union next to w
+internal vec3 GetVector(quat q) {
+    return vec3(q.x, q.y, q.z);
+}
+
 quat Invert(quat q) {
     quat result = {};
 
@@ -14,14 +19,22 @@ quat Invert(quat q) {
 quat operator*(quat q, quat p) {
     quat result = {};
 
-    result.w = q.w * p.w - Dot(p.v, q.v);
-    result.v = q.w * p.v + p.w * q.v + Cross(q.v, p.v);
+    vec3 qv = GetVector(q);
+    vec3 pv = GetVector(p);
+
+    result.w = q.w * p.w - Dot(pv, qv);
+
+    vec3 v = q.w * pv + p.w * qv + Cross(qv, pv);
+    result.x = v.x;
+    result.y = v.y;
+    result.z = v.z;
 
     return result;
 }
 
 vec3 operator*(quat q, vec3 v) {
-    vec3 qvXv = Cross(q.v, v);
+    vec3 qv = GetVector(q);
+    vec3 qvXv = Cross(qv, v);
 
-    return v + qvXv * (q.w * 2.0f) + Cross(q.v, qvXv) * 2.0f;
+    return v + qvXv * (q.w * 2.0f) + Cross(qv, qvXv) * 2.0f;
 }
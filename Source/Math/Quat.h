@@ -10,10 +10,6 @@ union quat {
         float y;
         float z;
     };
-    struct {
-        float _unusued;
-        vec3 v;
-    };
 
     quat() {
         w = .0f;
@@ -0,0 +1,142 @@
+#include "Mesher.h"
+
+#include "Platform/Platform.h"
+#include "Platform/Profiler.h"
+
+global u32 block_textures_map[BLOCK_COUNT][6] = {
+	{0, 0, 0, 0, 0, 0},
+	{0, 0, 0, 0, 0, 0},
+	{TEXTURE_DIRT, TEXTURE_DIRT, TEXTURE_DIRT, TEXTURE_DIRT, TEXTURE_DIRT, TEXTURE_DIRT},
+	{TEXTURE_GRASS_TOP, TEXTURE_DIRT, TEXTURE_GRASS_SIDE, TEXTURE_GRASS_SIDE, TEXTURE_GRASS_SIDE, TEXTURE_GRASS_SIDE},
+	{TEXTURE_OAK_LOG_TOP, TEXTURE_OAK_LOG_TOP, TEXTURE_OAK_LOG_SIDE, TEXTURE_OAK_LOG_SIDE, TEXTURE_OAK_LOG_SIDE, TEXTURE_OAK_LOG_SIDE},
+	{TEXTURE_STONE, TEXTURE_STONE, TEXTURE_STONE, TEXTURE_STONE, TEXTURE_STONE, TEXTURE_STONE},
+	{TEXTURE_COBBLE_STONE, TEXTURE_COBBLE_STONE, TEXTURE_COBBLE_STONE, TEXTURE_COBBLE_STONE, TEXTURE_COBBLE_STONE, TEXTURE_COBBLE_STONE},
+	{TEXTURE_STONE_BRICKS, TEXTURE_STONE_BRICKS, TEXTURE_STONE_BRICKS, TEXTURE_STONE_BRICKS, TEXTURE_STONE_BRICKS, TEXTURE_STONE_BRICKS},
+};
+
+perthread InstanceData *mesh_scratch;
+
+void MeshChunk(Chunk *c) {
+	PROFILE_FUNCTION();
+
+	// Single pass into a worst-case sized scratch buffer, solid faces grow up
+	// from the front and water faces down from the back. Blocks can change
+	// underneath us (edits), so nothing here may depend on a previous count.
+	if (!mesh_scratch) {
+		mesh_scratch = (InstanceData *) HeapAlloc(MAX_CHUNK_FACES * sizeof(InstanceData));
+	}
+
+	InstanceData *faces = mesh_scratch;
+	u32 idx = 0;
+	u32 water_idx = MAX_CHUNK_FACES;
+
+	for (int x = 0; x < CHUNK_X; ++x) {
+		int wx = c->world_pos.x + x;
+		for (int z = 0; z < CHUNK_Z; ++z) {
+			int wz = c->world_pos.z + z;
+			for (int y = 0; y < CHUNK_Y; ++y) {
+				int wy = c->world_pos.y + y;
+				Block b = c->blocks[x][z][y];
+
+				if (b == BLOCK_AIR) continue;
+
+				vec3 pos = vec3(wx, wy, wz);
+				u32 *tex = block_textures_map[b];
+
+				if (b != BLOCK_WATER) {
+					if (GetBlock(wx, wy + 1, wz) <= BLOCK_WATER) {
+						faces[idx++] = { pos, SIDE_TOP, tex[SIDE_TOP] };
+					}
+					if (GetBlock(wx, wy - 1, wz) <= BLOCK_WATER) {
+						faces[idx++] = { pos, SIDE_BOT, tex[SIDE_BOT] };
+					}
+					if (GetBlock(wx - 1, wy, wz) <= BLOCK_WATER) {
+						faces[idx++] = { pos, SIDE_WEST, tex[SIDE_WEST] };
+					}
+					if (GetBlock(wx + 1, wy, wz) <= BLOCK_WATER) {
+						faces[idx++] = { pos, SIDE_EAST, tex[SIDE_EAST] };
+					}
+					if (GetBlock(wx, wy, wz + 1) <= BLOCK_WATER) {
+						faces[idx++] = { pos, SIDE_NORTH, tex[SIDE_NORTH] };
+					}
+					if (GetBlock(wx, wy, wz - 1) <= BLOCK_WATER) {
+						faces[idx++] = { pos, SIDE_SOUTH, tex[SIDE_SOUTH] };
+					}
+				} else {
+					if (GetBlock(wx, wy + 1, wz) != BLOCK_WATER) {
+						faces[--water_idx] = { pos, SIDE_TOP, tex[SIDE_TOP] };
+					}
+					if (GetBlock(wx, wy - 1, wz) != BLOCK_WATER) {
+						faces[--water_idx] = { pos, SIDE_BOT, tex[SIDE_BOT] };
+					}
+					if (GetBlock(wx - 1, wy, wz) != BLOCK_WATER) {
+						faces[--water_idx] = { pos, SIDE_WEST, tex[SIDE_WEST] };
+					}
+					if (GetBlock(wx + 1, wy, wz) != BLOCK_WATER) {
+						faces[--water_idx] = { pos, SIDE_EAST, tex[SIDE_EAST] };
+					}
+					if (GetBlock(wx, wy, wz + 1) != BLOCK_WATER) {
+						faces[--water_idx] = { pos, SIDE_NORTH, tex[SIDE_NORTH] };
+					}
+					if (GetBlock(wx, wy, wz - 1) != BLOCK_WATER) {
+						faces[--water_idx] = { pos, SIDE_SOUTH, tex[SIDE_SOUTH] };
+					}
+				}
+			}
+		}
+	}
+
+	u32 water_count = MAX_CHUNK_FACES - water_idx;
+	u32 total = idx + water_count;
+
+	InstanceData *mesh = 0;
+	if (total > 0) {
+		mesh = (InstanceData *) HeapAlloc(total * sizeof(InstanceData));
+		CopyMemory(mesh, faces, idx * sizeof(InstanceData));
+		CopyMemory(mesh + idx, faces + water_idx, water_count * sizeof(InstanceData));
+	}
+
+	c->pending_instance_data = mesh;
+	c->pending_instance_count = idx;
+	c->pending_water_instance_count = water_count;
+}
+
+void CommitChunkMesh(Chunk *c) {
+	if (c->cached_instance_data) {
+		HeapFree(c->cached_instance_data);
+	}
+
+	c->cached_instance_data = c->pending_instance_data;
+	c->instance_count = c->pending_instance_count;
+	c->water_instance_count = c->pending_water_instance_count;
+
+	c->pending_instance_data = 0;
+	c->pending_instance_count = 0;
+	c->pending_water_instance_count = 0;
+}
+
+BlockInstanceCounts GatherChunkInstances(InstanceData *solid, InstanceData *water) {
+	BlockInstanceCounts result = {};
+
+	for (int cx = 0; cx < WORLD_CHUNK_COUNT_X; ++cx) {
+		for (int cz = 0; cz < WORLD_CHUNK_COUNT_Z; ++cz) {
+			for (int cy = 0; cy < WORLD_CHUNK_COUNT_Y; ++cy) {
+				Chunk *c = GetChunk(cx, cy, cz);
+				if (c->cached_instance_data) {
+					if (c->instance_count > 0) {
+						CopyMemory(solid + result.solid,
+							c->cached_instance_data, c->instance_count * sizeof(InstanceData));
+						result.solid += c->instance_count;
+					}
+					if (c->water_instance_count > 0) {
+						CopyMemory(water + result.water,
+							c->cached_instance_data + c->instance_count, c->water_instance_count * sizeof(InstanceData));
+						result.water += c->water_instance_count;
+					}
+				}
+			}
+		}
+	}
+
+	return result;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "General.h"
+#include "World.h"
+
+enum {
+	// every block emits at most one face per side
+	MAX_CHUNK_FACES = CHUNK_X * CHUNK_Y * CHUNK_Z * 6,
+};
+
+// Builds the face instances of c into c->pending_instance_data, solid faces
+// first and water faces after them. Safe to run on any thread as long as
+// nothing else meshes the same chunk.
+void MeshChunk(Chunk *c);
+
+// Moves the pending mesh into cached_instance_data. Only the thread that reads
+// the cached instances (the renderer) may call this.
+void CommitChunkMesh(Chunk *c);
+
+struct BlockInstanceCounts {
+	u32 solid;
+	u32 water;
+};
+
+// Copies the cached instances of every chunk into solid and water, each has
+// to have room for all of them.
+BlockInstanceCounts GatherChunkInstances(InstanceData *solid, InstanceData *water);
@@ -0,0 +1,188 @@
+#include "Options.h"
+
+#include "Platform/Platform.h"
+
+// "16.6", digits with an optional fraction
+internal b32 ParseFloat(String str, float *value) {
+	if (str.len == 0) {
+		return 0;
+	}
+
+	float result = 0.0f;
+	float scale = 0.0f;
+	for (u64 i = 0; i < str.len; ++i) {
+		if (str.ptr[i] == '.' && scale == 0.0f) {
+			scale = 1.0f;
+			continue;
+		}
+		if (!IsDigit(char(str.ptr[i]))) {
+			return 0;
+		}
+
+		if (scale == 0.0f) {
+			result = result * 10.0f + float(str.ptr[i] - '0');
+		} else {
+			scale *= 0.1f;
+			result += scale * float(str.ptr[i] - '0');
+		}
+	}
+
+	*value = result;
+	return 1;
+}
+
+// "1280x720"
+internal b32 ParseSize(String str, u32 *width, u32 *height) {
+	for (u64 i = 0; i < str.len; ++i) {
+		if (str.ptr[i] == 'x') {
+			return ParseU32(String(str.ptr, i), width) &&
+				ParseU32(String(str.ptr + i + 1, str.len - i - 1), height) &&
+				*width > 0 && *height > 0;
+		}
+	}
+
+	return 0;
+}
+
+internal void PrintUsage() {
+	PrintLiteral(
+		"usage: nmc [options]\n"
+		"  --headless         render offscreen, no window or swapchain\n"
+		"  --frames N         quit after N frames (--headless default: 300)\n"
+		"  --size WxH         framebuffer size for --headless (default 1280x720)\n"
+		"  --png PATH         --headless: write the last frame to PATH_<frame>.png\n"
+		"  --png-every N      --headless: also write every Nth frame\n"
+		"  --seed N           world seed (default 0)\n"
+		"  --record PATH      record player input and pose per tick to PATH\n"
+		"  --replay PATH      play back a recording, one tick per frame\n"
+		"  --timings PATH     --replay: write per frame cpu/gpu times as csv\n"
+		"  --gpu-trace PATH   write per pass gpu timings as chrome trace json on exit\n"
+		"  --gpu-csv PATH     write per pass gpu timings as csv on exit\n"
+		"  --cpu-trace PATH   write cpu zones as chrome trace json on exit (and on T)\n"
+		"  --hitch-ms N       frames above N ms are hitches (default: from the rolling median)\n"
+		"  --frame-stats PATH write frame time percentiles and hitches as csv on exit\n"
+		"  --shadows MODE     pcf or evsm shadow filtering (default pcf, V switches)\n"
+		"  --no-prepass       shade the solid pass without a depth prepass\n"
+		"  --render-scale PCT render the 3D passes at PCT percent of the output size, 50-100 (default 100)\n"
+		"  --gpu-budget MS    lower the render scale to keep gpu frames under MS ms, e.g. 16.6\n"
+		"  --hdr-format F     rgba16f or b10g11r11 color target (default: b10g11r11 if supported)\n"
+		"  --depth-format F   d32, d24 or d16 depth target (default d32)\n");
+}
+
+Options ParseOptions() {
+	Options result = {};
+	result.width = 1280;
+	result.height = 720;
+	result.render_scale = 100;
+
+	u32 count = GetCommandLineArgCount();
+	for (u32 i = 1; i < count; ++i) {
+		String arg = GetCommandLineArg(i);
+		String value = i + 1 < count ? GetCommandLineArg(i + 1) : String();
+
+		b32 ok = 1;
+		if (arg == "--headless") {
+			result.headless = 1;
+		} else if (arg == "--frames") {
+			ok = ParseU32(value, &result.frames);
+			i++;
+		} else if (arg == "--size") {
+			ok = ParseSize(value, &result.width, &result.height);
+			i++;
+		} else if (arg == "--png") {
+			ok = value.len > 0;
+			result.png_path = value;
+			i++;
+		} else if (arg == "--png-every") {
+			ok = ParseU32(value, &result.png_every);
+			i++;
+		} else if (arg == "--seed") {
+			ok = ParseU32(value, &result.seed);
+			i++;
+		} else if (arg == "--record") {
+			ok = value.len > 0;
+			result.record_path = value;
+			i++;
+		} else if (arg == "--replay") {
+			ok = value.len > 0;
+			result.replay_path = value;
+			i++;
+		} else if (arg == "--timings") {
+			ok = value.len > 0;
+			result.timings_path = value;
+			i++;
+		} else if (arg == "--gpu-trace") {
+			ok = value.len > 0;
+			result.gpu_trace_path = value;
+			i++;
+		} else if (arg == "--gpu-csv") {
+			ok = value.len > 0;
+			result.gpu_csv_path = value;
+			i++;
+		} else if (arg == "--cpu-trace") {
+			ok = value.len > 0;
+			result.cpu_trace_path = value;
+			i++;
+		} else if (arg == "--hitch-ms") {
+			ok = ParseU32(value, &result.hitch_ms);
+			i++;
+		} else if (arg == "--frame-stats") {
+			ok = value.len > 0;
+			result.frame_stats_path = value;
+			i++;
+		} else if (arg == "--no-prepass") {
+			result.no_depth_prepass = 1;
+		} else if (arg == "--render-scale") {
+			ok = ParseU32(value, &result.render_scale) && result.render_scale >= 50 && result.render_scale <= 100;
+			i++;
+		} else if (arg == "--gpu-budget") {
+			ok = ParseFloat(value, &result.gpu_budget_ms) && result.gpu_budget_ms > 0.0f;
+			i++;
+		} else if (arg == "--hdr-format") {
+			if (value == "rgba16f") {
+				result.hdr_format = HDR_FORMAT_RGBA16F;
+			} else if (value == "b10g11r11") {
+				result.hdr_format = HDR_FORMAT_B10G11R11;
+			} else {
+				ok = 0;
+			}
+			i++;
+		} else if (arg == "--depth-format") {
+			if (value == "d32") {
+				result.depth_format = DEPTH_FORMAT_D32;
+			} else if (value == "d24") {
+				result.depth_format = DEPTH_FORMAT_D24;
+			} else if (value == "d16") {
+				result.depth_format = DEPTH_FORMAT_D16;
+			} else {
+				ok = 0;
+			}
+			i++;
+		} else if (arg == "--shadows") {
+			ok = value == "pcf" || value == "evsm";
+			result.evsm_shadows = value == "evsm";
+			i++;
+		} else {
+			ok = 0;
+		}
+
+		if (!ok) {
+			Print("Invalid argument: %.*s\n", int(arg.len), arg.ptr);
+			PrintUsage();
+			Exit(1);
+		}
+	}
+
+	if (result.record_path.len && result.replay_path.len) {
+		PrintLiteral("--record and --replay can't be combined\n");
+		PrintUsage();
+		Exit(1);
+	}
+
+	// a replay ends with its recording
+	if (result.headless && !result.frames && !result.replay_path.len) {
+		result.frames = 300;
+	}
+
+	return result;
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "General.h"
+#include "DataStructures/String.h"
+
+enum HdrFormat {
+	// the packed one when the gpu can render to and filter it
+	HDR_FORMAT_AUTO,
+	HDR_FORMAT_RGBA16F,
+	HDR_FORMAT_B10G11R11,
+};
+
+enum DepthFormat {
+	DEPTH_FORMAT_D32,
+	DEPTH_FORMAT_D24,
+	// z-fights in the distance with the camera's 0.1 to 1000 range
+	DEPTH_FORMAT_D16,
+};
+
+struct Options {
+	// render into an offscreen image instead of a window and swapchain
+	b8 headless;
+	u32 width;
+	u32 height;
+
+	// stop after this many frames, 0 runs until the window is closed
+	u32 frames;
+
+	// headless only: the last frame, and every png_every-th one if set, is
+	// written to <png_path>_<frame>.png
+	String png_path;
+	u32 png_every;
+
+	// world seed for a new world, replays use the one they were recorded with
+	u32 seed;
+
+	// record the player's input and pose every simulation tick, or play a
+	// recording back one tick per frame and write the frame timings
+	String record_path;
+	String replay_path;
+	String timings_path;
+
+	// per pass gpu timings written on exit
+	String gpu_trace_path;
+	String gpu_csv_path;
+
+	// cpu zones of every thread, BUILD_PROFILE builds only
+	String cpu_trace_path;
+
+	// frames slower than this count as hitches, 0 picks a threshold from the
+	// rolling median; percentiles and hitches are written as csv on exit
+	u32 hitch_ms;
+	String frame_stats_path;
+
+	// start with exponential variance shadow maps instead of PCF, V toggles
+	b8 evsm_shadows;
+	// draw the solid pass without laying down its depth first
+	b8 no_depth_prepass;
+
+	// percent of the output size the 3D passes start out at; with a gpu
+	// budget in ms the scale then follows the gpu frame time, 0 keeps it
+	u32 render_scale;
+	float gpu_budget_ms;
+
+	// formats of the targets the 3D passes render into, HDR_FORMAT_* and
+	// DEPTH_FORMAT_*; unsupported ones fall back to RGBA16F and D32
+	u32 hdr_format;
+	u32 depth_format;
+};
+
+// Exits with a usage message on anything it doesn't understand.
+Options ParseOptions();
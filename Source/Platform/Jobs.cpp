@@ -0,0 +1,262 @@
+#include "Jobs.h"
+
+#include "Platform.h"
+#include "Profiler.h"
+
+// Chase-Lev work-stealing deque. The owning worker pushes and pops at the
+// bottom, other workers steal from the top. top and bottom live on separate
+// cache lines so thieves hammering top don't slow down the owner.
+struct alignby(64) WorkerDeque {
+    volatile u32 top;
+    u8 pad0[60];
+    volatile u32 bottom;
+    u8 pad1[60];
+
+    Job jobs[JOB_DEQUE_SIZE];
+};
+
+struct JobSystem {
+    u32 worker_count;
+    WorkerDeque *deques;
+    u64 deques_size;
+
+    OS_Handle threads[JOB_MAX_WORKERS];
+    OS_Handle wake_semaphore;
+
+    volatile u32 running;
+    volatile u32 sleeping;
+};
+
+global JobSystem job_system;
+
+// worker index + 1, 0 for threads that are not workers
+perthread u32 worker_slot;
+perthread u32 steal_seed;
+
+internal b32 PushJob(WorkerDeque *deque, Job job) {
+    u32 b = deque->bottom;
+    u32 t = AtomicLoad(&deque->top);
+
+    if (b - t >= JOB_DEQUE_SIZE) {
+        return 0;
+    }
+
+    deque->jobs[b % JOB_DEQUE_SIZE] = job;
+
+    // publishes the job before thieves can see the new bottom
+    AtomicStore(&deque->bottom, b + 1);
+
+    return 1;
+}
+
+internal b32 PopJob(WorkerDeque *deque, Job *job) {
+    u32 b = deque->bottom - 1;
+
+    // the store has to be visible before top is read, otherwise the owner and a
+    // thief can both take the last job
+    AtomicStore(&deque->bottom, b);
+    u32 t = AtomicLoad(&deque->top);
+
+    if (s32(b - t) < 0) {
+        AtomicStore(&deque->bottom, t);
+        return 0;
+    }
+
+    *job = deque->jobs[b % JOB_DEQUE_SIZE];
+
+    if (b != t) {
+        return 1;
+    }
+
+    // last job, race the thieves for it
+    b32 won = AtomicCompareExchange(&deque->top, t + 1, t) == t;
+    AtomicStore(&deque->bottom, t + 1);
+
+    return won;
+}
+
+internal b32 StealJob(WorkerDeque *deque, Job *job) {
+    u32 t = AtomicLoad(&deque->top);
+    u32 b = AtomicLoad(&deque->bottom);
+
+    if (s32(b - t) <= 0) {
+        return 0;
+    }
+
+    *job = deque->jobs[t % JOB_DEQUE_SIZE];
+
+    return AtomicCompareExchange(&deque->top, t + 1, t) == t;
+}
+
+internal b32 FindJob(Job *job) {
+    if (!worker_slot) {
+        return 0;
+    }
+
+    u32 self = worker_slot - 1;
+    if (PopJob(&job_system.deques[self], job)) {
+        return 1;
+    }
+
+    u32 count = job_system.worker_count;
+    if (count < 2) {
+        return 0;
+    }
+
+    // xorshift, start at a random victim so thieves spread out
+    steal_seed ^= steal_seed << 13;
+    steal_seed ^= steal_seed >> 17;
+    steal_seed ^= steal_seed << 5;
+
+    u32 start = steal_seed % count;
+    for (u32 i = 0; i < count; ++i) {
+        u32 victim = (start + i) % count;
+        if (victim != self && StealJob(&job_system.deques[victim], job)) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+internal void ExecuteJob(Job *job) {
+    PROFILE_ZONE("job");
+
+    job->function(job->data, job->begin, job->end);
+
+    if (job->counter) {
+        AtomicDecrement(&job->counter->value);
+    }
+}
+
+internal u32 WorkerThread(void *args) {
+    worker_slot = u32(u64(args)) + 1;
+    PROFILE_THREAD("worker");
+    steal_seed = worker_slot * 2654435761u;
+
+    while (AtomicLoad(&job_system.running)) {
+        Job job;
+
+        b32 found = 0;
+        for (u32 spin = 0; spin < 64 && !found; ++spin) {
+            found = FindJob(&job);
+            if (!found) {
+                SpinPause();
+            }
+        }
+
+        if (!found) {
+            // Announce we are going to sleep, then look once more. A pusher either
+            // sees sleeping != 0 and wakes us or its job is found by this check.
+            AtomicIncrement(&job_system.sleeping);
+            found = FindJob(&job);
+            if (!found && AtomicLoad(&job_system.running)) {
+                TakeSemaphore(job_system.wake_semaphore);
+            }
+            AtomicDecrement(&job_system.sleeping);
+        }
+
+        if (found) {
+            ExecuteJob(&job);
+        }
+    }
+
+    return 0;
+}
+
+void InitJobs(u32 worker_count) {
+    if (worker_count == 0) {
+        worker_count = GetProcessorCount();
+    }
+    worker_count = Clamp(worker_count, 1u, u32(JOB_MAX_WORKERS));
+
+    job_system.worker_count = worker_count;
+    job_system.deques_size = sizeof(WorkerDeque) * worker_count;
+    job_system.deques = (WorkerDeque *) ReserveMemory(job_system.deques_size);
+    CommitMemory(job_system.deques, job_system.deques_size);
+    SetMemory(job_system.deques, 0, job_system.deques_size);
+
+    job_system.wake_semaphore = CreateSemaphore(0, 1 << 30);
+    job_system.running = 1;
+    job_system.sleeping = 0;
+
+    worker_slot = 1;
+    steal_seed = 2654435761u;
+
+    for (u32 i = 1; i < worker_count; ++i) {
+        job_system.threads[i] = StartThread(WorkerThread, (void *) u64(i));
+    }
+}
+
+void ShutdownJobs() {
+    AtomicStore(&job_system.running, 0);
+
+    for (u32 i = 1; i < job_system.worker_count; ++i) {
+        DropSemaphore(job_system.wake_semaphore);
+    }
+    for (u32 i = 1; i < job_system.worker_count; ++i) {
+        JoinThread(job_system.threads[i]);
+    }
+
+    DestroySemaphore(job_system.wake_semaphore);
+    ReleaseMemory(job_system.deques, job_system.deques_size);
+
+    job_system = {};
+    worker_slot = 0;
+}
+
+u32 GetJobWorkerCount() {
+    return Max(job_system.worker_count, 1u);
+}
+
+void RunJobRange(JobFunc function, void *data, u32 begin, u32 end, JobCounter *counter) {
+    Job job = {};
+    job.function = function;
+    job.data = data;
+    job.begin = begin;
+    job.end = end;
+    job.counter = counter;
+
+    if (counter) {
+        AtomicIncrement(&counter->value);
+    }
+
+    // not a worker, nobody to steal it or our deque is full: do it right here
+    // instead of dropping it
+    if (!worker_slot || job_system.worker_count < 2 || !PushJob(&job_system.deques[worker_slot - 1], job)) {
+        ExecuteJob(&job);
+        return;
+    }
+
+    if (AtomicLoad(&job_system.sleeping)) {
+        DropSemaphore(job_system.wake_semaphore);
+    }
+}
+
+void RunJob(JobFunc function, void *data, JobCounter *counter) {
+    RunJobRange(function, data, 0, 0, counter);
+}
+
+void WaitForCounter(JobCounter *counter) {
+    while (AtomicLoad(&counter->value)) {
+        Job job;
+        if (FindJob(&job)) {
+            ExecuteJob(&job);
+        } else {
+            SpinPause();
+        }
+    }
+}
+
+void ParallelFor(u32 count, u32 batch_size, JobFunc function, void *data) {
+    JobCounter counter = {};
+
+    batch_size = Max(batch_size, 1u);
+
+    for (u32 begin = 0; begin < count; begin += batch_size) {
+        u32 end = Min(begin + batch_size, count);
+        RunJobRange(function, data, begin, end, &counter);
+    }
+
+    WaitForCounter(&counter);
+}
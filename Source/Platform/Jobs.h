@@ -0,0 +1,40 @@
+#pragma once
+
+#include "../General.h"
+
+enum {
+    JOB_DEQUE_SIZE = 4096,
+    JOB_MAX_WORKERS = 64,
+};
+
+// begin/end are the index range for ParallelFor jobs and 0 for single jobs.
+typedef void (*JobFunc)(void *data, u32 begin, u32 end);
+
+// Counts jobs that have not finished yet. Padded to a cache line so counters
+// of unrelated batches never share one.
+struct alignby(64) JobCounter {
+    volatile u32 value;
+};
+
+struct Job {
+    JobFunc function;
+    void *data;
+    u32 begin;
+    u32 end;
+    JobCounter *counter;
+};
+
+// Starts worker_count threads, the calling thread becomes worker 0 and helps
+// out whenever it waits. worker_count 0 picks one per logical processor.
+void InitJobs(u32 worker_count);
+void ShutdownJobs();
+u32 GetJobWorkerCount();
+
+// Threads that are not workers (e.g. the simulation thread) run jobs inline,
+// and so does everyone when there is only one worker.
+void RunJob(JobFunc function, void *data, JobCounter *counter);
+void RunJobRange(JobFunc function, void *data, u32 begin, u32 end, JobCounter *counter);
+void WaitForCounter(JobCounter *counter);
+
+// Splits [0, count) into batches of batch_size and blocks until all are done.
+void ParallelFor(u32 count, u32 batch_size, JobFunc function, void *data);
@@ -1,5 +1,11 @@
 #include "Platform.h"
 
+#include "../ThirdParty/stb_sprintf.h"
+
+// Windows builds don't link the CRT, so the compiler's implicit memcpy/memset
+// calls need these. Everywhere else libc provides tuned versions.
+#if OS_WINDOWS
+
 #if ARCH_X64 && COMPILER_CLANG
 
 #pragma function(memcpy)
@@ -126,6 +132,16 @@ int _CompareMemory(u8 *a, u8 *b, u64 size) {
 
 #endif
 
+#else
+
+#include <string.h>
+
+int _CompareMemory(u8 *a, u8 *b, u64 size) {
+    return memcmp(a, b, size) == 0;
+}
+
+#endif
+
 void _CopyMemory(u8 *dst, u8 *src, u64 size) {
     memcpy(dst, src, size);
 }
@@ -153,51 +169,51 @@ String ReadFile(String path) {
     return contents;
 }
 
-internal u32 RunTaskQueue(void *args) {
-    TaskQueue *queue = (TaskQueue *) args;
+internal void FlushFileWriter(FileWriter *writer) {
+    if (writer->used && WriteHandle(writer->file, writer->buffer, writer->used) != writer->used) {
+        writer->failed = 1;
+    }
 
-    while (!queue->canceled) {
-        u32 cur_idx = queue->dequeue_index;
-        u32 nxt_idx = (queue->dequeue_index + 1) % ArrayCount(queue->tasks);
-        if (cur_idx != queue->enqueue_index) {
-            u32 idx = AtomicCompareExchange(&queue->dequeue_index, nxt_idx, cur_idx);
+    writer->used = 0;
+}
 
-            if (idx == cur_idx) {
-                Task to_execute = queue->tasks[idx];
-                to_execute.function(queue, to_execute.ptr);
-            }
-        } else {
-            TakeSemaphore(queue->semaphore);
-        }
-    }
+b32 OpenFileWriter(FileWriter *writer, String path) {
+    writer->file = OpenFile(path, OS_WRITE | OS_CREATE);
+    writer->used = 0;
+    writer->failed = 0;
 
-    return 0;
+    return IsValidFile(writer->file);
 }
 
-void CreateTaskQueue(TaskQueue *queue, u32 thread_count) {
-    queue->semaphore = CreateSemaphore(0, thread_count);
-    queue->enqueue_index = 0;
-    queue->dequeue_index = 0;
-    queue->canceled = false;
+void WriteFormat(FileWriter *writer, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int needed = stbsp_vsnprintf(0, 0, fmt, args);
+    va_end(args);
 
-    for (u32 i = 0; i < thread_count; ++i) {
-        StartThread(RunTaskQueue, queue);
+    if (needed <= 0) {
+        return;
     }
-}
 
-void EnqueueTask(TaskQueue *queue, TaskFunc function, void *ptr) {
-    u32 idx = (queue->enqueue_index + 1) % ArrayCount(queue->tasks);
+    if (writer->used + u32(needed) + 1 > sizeof(writer->buffer)) {
+        FlushFileWriter(writer);
+    }
 
-    Task *_new = queue->tasks + idx;
-    _new->function = function;
-    _new->ptr = ptr;
+    if (u32(needed) + 1 > sizeof(writer->buffer)) {
+        writer->failed = 1;
+        return;
+    }
 
-    // TODO: Write barrier
-    queue->enqueue_index = idx;
+    va_start(args, fmt);
+    stbsp_vsnprintf(writer->buffer + writer->used, needed + 1, fmt, args);
+    va_end(args);
 
-    DropSemaphore(queue->semaphore);
+    writer->used += u32(needed);
 }
 
-void CancelTaskQueue(TaskQueue *queue) {
-    queue->canceled = true;
+b32 CloseFileWriter(FileWriter *writer) {
+    FlushFileWriter(writer);
+    CloseFile(writer->file);
+
+    return !writer->failed;
 }
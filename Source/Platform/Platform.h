@@ -5,6 +5,7 @@
 #include "../General.h"
 #include "../DataStructures/String.h"
 
+#if OS_WINDOWS
 // TODO: try to not include windows in header 
 #define NOMINMAX
 #define WIN32_LEAN_AND_MEAN
@@ -15,6 +16,7 @@
 #undef ZeroMemory
 #undef near
 #undef far
+#endif
 
 typedef u64 OS_Handle;
 typedef u32 OS_Flags;
@@ -31,23 +33,6 @@ struct OS_FileInfo {
 
 typedef u32 (*ThreadFunc)(void *args);
 
-struct TaskQueue;
-typedef void (*TaskFunc)(TaskQueue *queue, void *ptr);
-
-struct Task {
-    TaskFunc function;
-    void *ptr;
-};
-
-struct TaskQueue {
-    OS_Handle semaphore;
-    volatile u32 enqueue_index;
-    volatile u32 dequeue_index;
-    volatile b32 canceled;
-
-    Task tasks[256];
-};
-
 // Memory
 b32 EnableLargePages();
 u64 GetPageSize();
@@ -71,6 +56,10 @@ void PrintLiteral(const char *literal);
 // Exit
 void Exit(int code);
 
+// Command line, argument 0 is the program itself
+u32 GetCommandLineArgCount();
+String GetCommandLineArg(u32 index);
+
 // File Management
 OS_Handle OpenFile(String path, OS_Flags flags);
 void CloseFile(OS_Handle file);
@@ -79,6 +68,13 @@ OS_FileInfo GetFileInfo(OS_Handle file);
 b32 IsValidFile(OS_Handle file);
 
 String ReadHandle(OS_Handle file, u64 size, void *memory);
+// Writes at the current file position, returns the bytes actually written
+u64 WriteHandle(OS_Handle file, void *data, u64 size);
+
+// Read-only view of the first size bytes, stays valid after the file is
+// closed. Returns 0 on failure.
+void *MapFile(OS_Handle file, u64 size);
+void UnmapFile(void *ptr, u64 size);
 
 // Time
 u64 GetTimeNowUs();
@@ -87,11 +83,15 @@ void SleepMs(u32 ms);
 // Threading
 OS_Handle StartThread(ThreadFunc function, void *args);
 void JoinThread(OS_Handle thread);
+u32 GetProcessorCount();
+void SpinPause();
 
 // Mutex
 OS_Handle CreateMutex();
 void DestroyMutex(OS_Handle mutex);
 void AcquireMutex(OS_Handle mutex);
+// Returns whether it got the mutex, never waits.
+b32 TryAcquireMutex(OS_Handle mutex);
 void ReleaseMutex(OS_Handle mutex);
 
 // Semaphores
@@ -100,9 +100,13 @@ void DestroySemaphore(OS_Handle semaphore);
 b32 TakeSemaphore(OS_Handle semaphore);
 void DropSemaphore(OS_Handle semaphore);
 
-// Atomic Operations
+// Atomic Operations - all of these are full barriers
 u32 AtomicIncrement(volatile u32 *value);
+u32 AtomicDecrement(volatile u32 *value);
+u32 AtomicAdd(volatile u32 *value, u32 addend);
 u32 AtomicCompareExchange(volatile u32 *dst, u32 value, u32 comperand);
+u32 AtomicLoad(volatile u32 *value);
+void AtomicStore(volatile u32 *dst, u32 value);
 
 // Defined in Platform.cpp - not OS specific
 void _CopyMemory(u8 *dst, u8 *src, u64 size);
@@ -118,6 +122,15 @@ int _CompareMemory(u8 *a, u8 *b, u64 size);
 
 String ReadFile(String path);
 
-void CreateTaskQueue(TaskQueue *queue, u32 thread_count);
-void EnqueueTask(TaskQueue *queue, TaskFunc function, void *ptr);
-void CancelTaskQueue(TaskQueue *queue);
+// Buffered text output for dumps (csv, traces), formats with stb_sprintf
+struct FileWriter {
+    OS_Handle file;
+    u32 used;
+    b32 failed;
+    char buffer[KiloBytes(16)];
+};
+
+b32 OpenFileWriter(FileWriter *writer, String path);
+void WriteFormat(FileWriter *writer, const char *fmt, ...);
+// Returns 0 if anything failed to write
+b32 CloseFileWriter(FileWriter *writer);
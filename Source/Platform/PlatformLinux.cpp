@@ -0,0 +1,551 @@
+#include "Platform.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include "../ThirdParty/stb_sprintf.h"
+
+struct LinuxState {
+    u64 page_size;
+    u64 large_page_size;
+    b8 large_pages_enabled;
+
+    int argc;
+    char **argv;
+};
+
+global LinuxState platform_state;
+
+// 0 unlocked, 1 locked, 2 locked with waiters
+struct LinuxMutex {
+    volatile u32 state;
+};
+
+struct LinuxSemaphore {
+    volatile u32 value;
+    volatile u32 waiters;
+    // drops past it are lost, like ReleaseSemaphore failing on Windows
+    u32 max;
+};
+
+struct LinuxThread {
+    pthread_t handle;
+    ThreadFunc function;
+    void *args;
+};
+
+internal u64 ReadLargePageSize() {
+    u64 result = MegaBytes(2);
+
+    char buffer[4096];
+    int fd = open("/proc/meminfo", O_RDONLY);
+    if (fd < 0) {
+        return result;
+    }
+
+    ssize_t len = read(fd, buffer, sizeof(buffer) - 1);
+    close(fd);
+
+    if (len <= 0) {
+        return result;
+    }
+    buffer[len] = 0;
+
+    String meminfo = String((u8 *) buffer, u64(len));
+    String key = String("Hugepagesize:");
+    for (u64 i = 0; i + key.len <= meminfo.len; ++i) {
+        if (CompareMemory(meminfo.ptr + i, key.ptr, key.len)) {
+            u64 kb = 0;
+            for (u64 j = i + key.len; j < meminfo.len; ++j) {
+                char ch = char(meminfo.ptr[j]);
+                if (IsDigit(ch)) {
+                    kb = kb * 10 + u64(ch - '0');
+                } else if (kb) {
+                    break;
+                }
+            }
+
+            if (kb) {
+                result = KiloBytes(kb);
+            }
+            break;
+        }
+    }
+
+    return result;
+}
+
+internal void InitPlatform() {
+    platform_state.page_size = u64(sysconf(_SC_PAGESIZE));
+    platform_state.large_page_size = ReadLargePageSize();
+    platform_state.large_pages_enabled = b8(EnableLargePages());
+}
+
+internal long Futex(volatile u32 *address, int op, u32 value) {
+    return syscall(SYS_futex, address, op, value, 0, 0, 0);
+}
+
+// hugetlbfs pages have to be reserved by the admin (vm.nr_hugepages), so the
+// only reliable check is to try mapping one
+b32 EnableLargePages() {
+    u64 size = GetLargePageSize();
+    void *probe = mmap(0, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+
+    if (probe == MAP_FAILED) {
+        return 0;
+    }
+
+    munmap(probe, size);
+    return 1;
+}
+
+u64 GetPageSize() {
+    return platform_state.page_size;
+}
+
+u64 GetLargePageSize() {
+    return platform_state.large_page_size;
+}
+
+void *ReserveMemory(u64 size) {
+    void *result = mmap(0, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+
+    if (result == MAP_FAILED) {
+        return 0;
+    }
+
+    return result;
+}
+
+b32 CommitMemory(void *ptr, u64 size) {
+    // pages are only backed on first touch, this just makes them accessible
+    return mprotect(ptr, size, PROT_READ | PROT_WRITE) == 0;
+}
+
+void *ReserveMemoryLarge(u64 size) {
+    size = AlignPow2(size, GetLargePageSize());
+
+    void *result = mmap(0, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+
+    if (result == MAP_FAILED) {
+        return 0;
+    }
+
+    return result;
+}
+
+void *ReserveMemoryLargeIfPossible(u64 size) {
+    void *result = 0;
+
+    if (platform_state.large_pages_enabled) {
+        result = ReserveMemoryLarge(size);
+    }
+
+    if (!result) {
+        result = ReserveMemory(size);
+        if (!result) {
+            return 0;
+        }
+        CommitMemory(result, size);
+
+        // transparent huge pages, a no-op when THP is disabled
+        madvise(result, size, MADV_HUGEPAGE);
+    }
+
+    return result;
+}
+
+void DecommitMemory(void *ptr, u64 size) {
+    madvise(ptr, size, MADV_DONTNEED);
+    mprotect(ptr, size, PROT_NONE);
+}
+
+void ReleaseMemory(void *ptr, u64 size) {
+    // hugetlb mappings were rounded up to the large page size
+    if (munmap(ptr, size) != 0) {
+        munmap(ptr, AlignPow2(size, GetLargePageSize()));
+    }
+}
+
+void *HeapAlloc(u64 size) {
+    return malloc(size);
+}
+
+void *HeapRealloc(void *ptr, u64 size) {
+    return realloc(ptr, size);
+}
+
+void HeapFree(void *ptr) {
+    return free(ptr);
+}
+
+internal void WriteStdOut(const char *buffer, u64 size) {
+    while (size > 0) {
+        ssize_t written = write(STDOUT_FILENO, buffer, size);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+
+        buffer += written;
+        size -= u64(written);
+    }
+}
+
+void Print(const char *fmt, ...) {
+    if (fmt) {
+        va_list args;
+        va_start(args, fmt);
+        int needed = stbsp_vsnprintf(0, 0, fmt, args);
+        va_end(args);
+
+        if (needed <= 0) {
+            return;
+        }
+
+        char *buffer = (char *) HeapAlloc(needed + 1);
+
+        va_start(args, fmt);
+        stbsp_vsnprintf(buffer, needed + 1, fmt, args);
+        va_end(args);
+
+        WriteStdOut(buffer, u64(needed));
+
+        HeapFree(buffer);
+    }
+}
+
+void PrintLiteral(const char *literal) {
+    if (literal) {
+        WriteStdOut(literal, CStringLength(literal));
+    }
+}
+
+void Exit(int code) {
+    exit(code);
+}
+
+u32 GetCommandLineArgCount() {
+    return u32(platform_state.argc);
+}
+
+String GetCommandLineArg(u32 index) {
+    if (index >= u32(platform_state.argc)) {
+        return String();
+    }
+
+    return String(platform_state.argv[index]);
+}
+
+OS_Handle OpenFile(String path, OS_Flags flags) {
+    char *cpath = (char *) HeapAlloc(path.len + 1);
+    CopyMemory(cpath, path.ptr, path.len);
+    cpath[path.len] = 0;
+
+    int oflags = O_RDONLY;
+    if ((flags & OS_READ) && (flags & OS_WRITE)) {
+        oflags = O_RDWR;
+    } else if (flags & OS_WRITE) {
+        oflags = O_WRONLY;
+    }
+
+    if (flags & OS_CREATE) {
+        oflags |= O_CREAT | O_TRUNC;
+    }
+
+    int fd = open(cpath, oflags | O_CLOEXEC, 0644);
+
+    HeapFree(cpath);
+
+    return (OS_Handle) s64(fd);
+}
+
+void CloseFile(OS_Handle file) {
+    close(int(file));
+}
+
+OS_FileInfo GetFileInfo(OS_Handle file) {
+    OS_FileInfo result = {};
+
+    struct stat st;
+    if (fstat(int(file), &st) == 0) {
+        result.size = u64(st.st_size);
+    }
+
+    return result;
+}
+
+b32 IsValidFile(OS_Handle file) {
+    return s64(file) >= 0;
+}
+
+String ReadHandle(OS_Handle file, u64 size, void *memory) {
+    String result = {};
+
+    result.ptr = (u8 *) memory;
+
+    u8 *ptr = result.ptr;
+    u8 *end = ptr + size;
+
+    while (ptr < end) {
+        ssize_t read = pread(int(file), ptr, u64(end - ptr), off_t(result.len));
+        if (read < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (read == 0) {
+            break;
+        }
+
+        ptr += read;
+        result.len += u64(read);
+    }
+
+    *end = 0;
+
+    return result;
+}
+
+u64 WriteHandle(OS_Handle file, void *data, u64 size) {
+    u64 result = 0;
+
+    u8 *ptr = (u8 *) data;
+    u8 *end = ptr + size;
+
+    while (ptr < end) {
+        ssize_t written = write(int(file), ptr, u64(end - ptr));
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (written == 0) {
+            break;
+        }
+
+        ptr += written;
+        result += u64(written);
+    }
+
+    return result;
+}
+
+void *MapFile(OS_Handle file, u64 size) {
+    void *result = mmap(0, size, PROT_READ, MAP_PRIVATE, int(file), 0);
+
+    if (result == MAP_FAILED) {
+        return 0;
+    }
+
+    // start reading everything now, it's all going to be touched in order
+    madvise(result, size, MADV_WILLNEED);
+
+    return result;
+}
+
+void UnmapFile(void *ptr, u64 size) {
+    munmap(ptr, size);
+}
+
+u64 GetTimeNowUs() {
+    struct timespec ts;
+
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0) {
+        return u64(ts.tv_sec) * 1000000 + u64(ts.tv_nsec) / 1000;
+    }
+
+    return 0;
+}
+
+void SleepMs(u32 ms) {
+    struct timespec ts;
+    ts.tv_sec = ms / 1000;
+    ts.tv_nsec = long(ms % 1000) * 1000000;
+
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR) {
+    }
+}
+
+internal void *ThreadProc(void *args) {
+    LinuxThread *thread = (LinuxThread *) args;
+
+    thread->function(thread->args);
+
+    return 0;
+}
+
+OS_Handle StartThread(ThreadFunc function, void *args) {
+    LinuxThread *thread = (LinuxThread *) HeapAlloc(sizeof(LinuxThread));
+    thread->function = function;
+    thread->args = args;
+
+    if (pthread_create(&thread->handle, 0, ThreadProc, thread) != 0) {
+        HeapFree(thread);
+        return 0;
+    }
+
+    return (OS_Handle) thread;
+}
+
+void JoinThread(OS_Handle thread) {
+    LinuxThread *handle = (LinuxThread *) thread;
+
+    pthread_join(handle->handle, 0);
+    HeapFree(handle);
+}
+
+u32 GetProcessorCount() {
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+
+    return count > 0 ? u32(count) : 1;
+}
+
+void SpinPause() {
+#if ARCH_X64 || ARCH_X86
+    __builtin_ia32_pause();
+#elif ARCH_ARM64 || ARCH_ARM32
+    __asm__ volatile ("yield");
+#endif
+}
+
+OS_Handle CreateMutex() {
+    LinuxMutex *mutex = (LinuxMutex *) HeapAlloc(sizeof(LinuxMutex));
+    mutex->state = 0;
+
+    return (OS_Handle) mutex;
+}
+
+void DestroyMutex(OS_Handle mutex) {
+    HeapFree((LinuxMutex *) mutex);
+}
+
+void AcquireMutex(OS_Handle mutex) {
+    LinuxMutex *m = (LinuxMutex *) mutex;
+
+    u32 state = AtomicCompareExchange(&m->state, 1, 0);
+    if (state == 0) {
+        return;
+    }
+
+    // mark it contended so the owner knows to wake somebody on release
+    if (state != 2) {
+        state = __atomic_exchange_n(&m->state, 2, __ATOMIC_SEQ_CST);
+    }
+    while (state != 0) {
+        Futex(&m->state, FUTEX_WAIT_PRIVATE, 2);
+        state = __atomic_exchange_n(&m->state, 2, __ATOMIC_SEQ_CST);
+    }
+}
+
+b32 TryAcquireMutex(OS_Handle mutex) {
+    LinuxMutex *m = (LinuxMutex *) mutex;
+
+    return AtomicCompareExchange(&m->state, 1, 0) == 0;
+}
+
+void ReleaseMutex(OS_Handle mutex) {
+    LinuxMutex *m = (LinuxMutex *) mutex;
+
+    if (__atomic_exchange_n(&m->state, 0, __ATOMIC_SEQ_CST) == 2) {
+        Futex(&m->state, FUTEX_WAKE_PRIVATE, 1);
+    }
+}
+
+OS_Handle CreateSemaphore(s32 value, s32 max) {
+    LinuxSemaphore *semaphore = (LinuxSemaphore *) HeapAlloc(sizeof(LinuxSemaphore));
+    semaphore->value = u32(value);
+    semaphore->waiters = 0;
+    semaphore->max = u32(max);
+
+    return (OS_Handle) semaphore;
+}
+
+void DestroySemaphore(OS_Handle semaphore) {
+    HeapFree((LinuxSemaphore *) semaphore);
+}
+
+b32 TakeSemaphore(OS_Handle semaphore) {
+    LinuxSemaphore *s = (LinuxSemaphore *) semaphore;
+
+    for (;;) {
+        u32 value = AtomicLoad(&s->value);
+
+        if (value > 0) {
+            if (AtomicCompareExchange(&s->value, value - 1, value) == value) {
+                return 1;
+            }
+            continue;
+        }
+
+        // returns right away if a drop bumped value after the load above
+        AtomicIncrement(&s->waiters);
+        Futex(&s->value, FUTEX_WAIT_PRIVATE, 0);
+        AtomicDecrement(&s->waiters);
+    }
+}
+
+void DropSemaphore(OS_Handle semaphore) {
+    LinuxSemaphore *s = (LinuxSemaphore *) semaphore;
+
+    for (;;) {
+        u32 value = AtomicLoad(&s->value);
+
+        if (value >= s->max) {
+            return;
+        }
+        if (AtomicCompareExchange(&s->value, value + 1, value) == value) {
+            break;
+        }
+    }
+
+    if (AtomicLoad(&s->waiters)) {
+        Futex(&s->value, FUTEX_WAKE_PRIVATE, 1);
+    }
+}
+
+u32 AtomicIncrement(volatile u32 *value) {
+    return __atomic_add_fetch(value, 1, __ATOMIC_SEQ_CST);
+}
+
+u32 AtomicDecrement(volatile u32 *value) {
+    return __atomic_sub_fetch(value, 1, __ATOMIC_SEQ_CST);
+}
+
+u32 AtomicAdd(volatile u32 *value, u32 addend) {
+    return __atomic_add_fetch(value, addend, __ATOMIC_SEQ_CST);
+}
+
+u32 AtomicCompareExchange(volatile u32 *dst, u32 value, u32 comperand) {
+    __atomic_compare_exchange_n(dst, &comperand, value, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+
+    // holds the value that was in dst either way
+    return comperand;
+}
+
+u32 AtomicLoad(volatile u32 *value) {
+    return __atomic_load_n(value, __ATOMIC_SEQ_CST);
+}
+
+void AtomicStore(volatile u32 *dst, u32 value) {
+    __atomic_store_n(dst, value, __ATOMIC_SEQ_CST);
+}
+
+extern void NKMain();
+
+int main(int argc, char **argv) {
+    platform_state.argc = argc;
+    platform_state.argv = argv;
+
+    InitPlatform();
+
+    NKMain();
+    return 0;
+}
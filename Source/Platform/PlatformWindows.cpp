@@ -8,10 +8,40 @@
 struct WindowsState {
     u64 us_resolution;
     b8 large_pages_enabled;
+
+    String *args;
+    u32 args_count;
 };
 
 global WindowsState platform_state;
 
+// The no-CRT entry points don't get argv, split GetCommandLineA ourselves.
+// Arguments are separated by spaces, double quotes group.
+internal void ParseCommandLine() {
+    char *cmdline = GetCommandLineA();
+    u64 len = CStringLength(cmdline);
+
+    // at most one argument per two characters
+    platform_state.args = (String *) HeapAlloc((len / 2 + 1) * sizeof(String));
+    platform_state.args_count = 0;
+
+    u64 i = 0;
+    while (i < len) {
+        while (i < len && (cmdline[i] == ' ' || cmdline[i] == '\t')) i++;
+        if (i >= len) break;
+
+        b32 quoted = cmdline[i] == '"';
+        if (quoted) i++;
+
+        u64 start = i;
+        while (i < len && (quoted ? cmdline[i] != '"' : (cmdline[i] != ' ' && cmdline[i] != '\t'))) i++;
+
+        platform_state.args[platform_state.args_count++] = String((u8 *) cmdline + start, i - start);
+
+        if (quoted && i < len) i++;
+    }
+}
+
 internal void InitPlatform() {
     LARGE_INTEGER li = {};
 
@@ -22,6 +52,8 @@ internal void InitPlatform() {
 
     platform_state.us_resolution = li.QuadPart;
     platform_state.large_pages_enabled = b8(EnableLargePages());
+
+    ParseCommandLine();
 }
 
 b32 EnableLargePages() {
@@ -79,6 +111,9 @@ void *ReserveMemoryLargeIfPossible(u64 size) {
         Result = ReserveMemoryLarge(Size);
     } else {*/
         result = ReserveMemory(size);
+        if (!result) {
+            return 0;
+        }
         CommitMemory(result, size);
     // }
 
@@ -156,6 +191,18 @@ void Exit(int code) {
     ExitProcess(u32(code));
 }
 
+u32 GetCommandLineArgCount() {
+    return platform_state.args_count;
+}
+
+String GetCommandLineArg(u32 index) {
+    if (index >= platform_state.args_count) {
+        return String();
+    }
+
+    return platform_state.args[index];
+}
+
 OS_Handle OpenFile(String path, OS_Flags flags) {
     char *cpath = (char *) HeapAlloc(path.len + 1);
     CopyMemory(cpath, path.ptr, path.len);
@@ -173,9 +220,9 @@ OS_Handle OpenFile(String path, OS_Flags flags) {
 
     SECURITY_ATTRIBUTES security_attributes = {sizeof(SECURITY_ATTRIBUTES), 0, 0};
 
-    DWORD creation_disposition = 0;
-    if (!(flags & OS_CREATE)) {
-        creation_disposition = OPEN_EXISTING;
+    DWORD creation_disposition = OPEN_EXISTING;
+    if (flags & OS_CREATE) {
+        creation_disposition = CREATE_ALWAYS;
     }
 
     DWORD flags_and_attributes = 0;
@@ -246,6 +293,45 @@ String ReadHandle(OS_Handle file, u64 size, void *memory) {
     return result;
 }
 
+u64 WriteHandle(OS_Handle file, void *data, u64 size) {
+    u64 result = 0;
+
+    u8 *ptr = (u8 *) data;
+    u8 *end = ptr + size;
+
+    while (ptr < end) {
+        u64 unwritten = (u64) (end - ptr);
+        DWORD towrite = (DWORD) ClampTop(unwritten, max_u32);
+        DWORD written = 0;
+        if (!WriteFile((HANDLE) file, ptr, towrite, &written, 0) || written == 0) {
+            break;
+        }
+
+        ptr += written;
+        result += written;
+    }
+
+    return result;
+}
+
+void *MapFile(OS_Handle file, u64 size) {
+    HANDLE mapping = CreateFileMappingA((HANDLE) file, 0, PAGE_READONLY, DWORD(size >> 32), DWORD(size), 0);
+    if (!mapping) {
+        return 0;
+    }
+
+    void *result = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, size);
+
+    // the view keeps the mapping alive
+    CloseHandle(mapping);
+
+    return result;
+}
+
+void UnmapFile(void *ptr, u64 size) {
+    UnmapViewOfFile(ptr);
+}
+
 u64 GetTimeNowUs() {
     LARGE_INTEGER li = {};
 
@@ -274,6 +360,17 @@ void JoinThread(OS_Handle thread) {
     CloseHandle(handle);
 }
 
+u32 GetProcessorCount() {
+    SYSTEM_INFO system_info;
+    GetSystemInfo(&system_info);
+
+    return u32(system_info.dwNumberOfProcessors);
+}
+
+void SpinPause() {
+    YieldProcessor();
+}
+
 OS_Handle CreateMutex() {
     return (OS_Handle) CreateMutex(0, FALSE, 0);
 }
@@ -286,6 +383,10 @@ void AcquireMutex(OS_Handle mutex) {
     WaitForSingleObject((HANDLE) mutex, INFINITE);
 }
 
+b32 TryAcquireMutex(OS_Handle mutex) {
+    return WaitForSingleObject((HANDLE) mutex, 0) == WAIT_OBJECT_0;
+}
+
 void ReleaseMutex(OS_Handle mutex) {
     ReleaseMutex((HANDLE) mutex);
 }
@@ -310,10 +411,26 @@ u32 AtomicIncrement(volatile u32 *value) {
     return InterlockedIncrement(value);
 }
 
+u32 AtomicDecrement(volatile u32 *value) {
+    return InterlockedDecrement(value);
+}
+
+u32 AtomicAdd(volatile u32 *value, u32 addend) {
+    return InterlockedExchangeAdd(value, addend) + addend;
+}
+
 u32 AtomicCompareExchange(volatile u32 *dst, u32 value, u32 comperand) {
     return InterlockedCompareExchange(dst, value, comperand);
 }
 
+u32 AtomicLoad(volatile u32 *value) {
+    return InterlockedCompareExchange(value, 0, 0);
+}
+
+void AtomicStore(volatile u32 *dst, u32 value) {
+    InterlockedExchange(dst, value);
+}
+
 extern void NKMain();
 
 void WinMainCRTStartup() {
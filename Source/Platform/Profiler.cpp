@@ -0,0 +1,132 @@
+#include "Profiler.h"
+
+#include "Platform.h"
+
+#if BUILD_PROFILE
+
+struct Profiler {
+    volatile u32 thread_count;
+    ProfileRing *rings[PROFILER_MAX_THREADS];
+
+    // cycle counter and clock when the first thread registered, the dump
+    // converts cycles to us with the rate measured since then
+    u64 origin_tsc;
+    u64 origin_us;
+};
+
+global Profiler profiler;
+global ProfileRing overflow_ring;
+
+perthread ProfileRing *profile_ring;
+
+ProfileRing *RegisterProfileThread() {
+    u32 index = AtomicIncrement(&profiler.thread_count) - 1;
+
+    // past the limit threads share one ring nobody dumps
+    ProfileRing *ring = &overflow_ring;
+    if (index < PROFILER_MAX_THREADS) {
+        ring = (ProfileRing *) HeapAlloc(sizeof(ProfileRing));
+        ring->write = 0;
+        ring->thread_index = index;
+        ring->thread_name[0] = 0;
+
+        if (index == 0) {
+            profiler.origin_us = GetTimeNowUs();
+            profiler.origin_tsc = ReadCycleCounter();
+        }
+
+        profiler.rings[index] = ring;
+    }
+
+    profile_ring = ring;
+
+    return ring;
+}
+
+void SetProfilerThreadName(const char *name) {
+    ProfileRing *ring = profile_ring;
+    if (!ring) {
+        ring = RegisterProfileThread();
+    }
+
+    u64 length = Min(CStringLength(name), u64(sizeof(ring->thread_name) - 1));
+    CopyMemory(ring->thread_name, name, length);
+    ring->thread_name[length] = 0;
+}
+
+b32 WriteCpuTrace(String path) {
+    FileWriter *writer = (FileWriter *) HeapAlloc(sizeof(FileWriter));
+    if (!OpenFileWriter(writer, path)) {
+        HeapFree(writer);
+        return 0;
+    }
+
+    u64 now_us = GetTimeNowUs();
+    u64 now_tsc = ReadCycleCounter();
+    double tsc_per_us = 1.0;
+    if (now_us > profiler.origin_us) {
+        tsc_per_us = double(now_tsc - profiler.origin_tsc) / double(now_us - profiler.origin_us);
+    }
+
+    ProfileEvent *events = (ProfileEvent *) HeapAlloc(sizeof(ProfileEvent) * PROFILER_RING_SIZE);
+
+    WriteFormat(writer, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    WriteFormat(writer, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":0,\"args\":{\"name\":\"nmc\"}}");
+
+    u32 thread_count = Min(AtomicLoad(&profiler.thread_count), u32(PROFILER_MAX_THREADS));
+    for (u32 t = 0; t < thread_count; ++t) {
+        ProfileRing *ring = profiler.rings[t];
+        if (!ring) {
+            // registered but not published yet
+            continue;
+        }
+
+        if (ring->thread_name[0]) {
+            WriteFormat(writer, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+                t, ring->thread_name);
+        }
+
+        u32 write = AtomicLoad(&ring->write);
+        u32 copied = write > PROFILER_RING_SIZE ? write - PROFILER_RING_SIZE : 0;
+        for (u32 i = copied; i != write; ++i) {
+            events[i - copied] = ring->events[i & (PROFILER_RING_SIZE - 1)];
+        }
+
+        // anything the thread wrote over while we copied is garbage
+        u32 after = AtomicLoad(&ring->write);
+        u32 valid = after > PROFILER_RING_SIZE ? after - PROFILER_RING_SIZE : 0;
+        u32 first = Max(copied, Min(valid, write));
+
+        u32 depth = 0;
+        for (u32 i = first; i != write; ++i) {
+            ProfileEvent *event = &events[i - copied];
+            double ts = double(s64(event->tsc - profiler.origin_tsc)) / tsc_per_us;
+
+            if (event->name) {
+                WriteFormat(writer, ",\n{\"name\":\"%s\",\"ph\":\"B\",\"pid\":0,\"tid\":%u,\"ts\":%.3f}", event->name, t, ts);
+                depth++;
+            } else if (depth) {
+                // ends whose begin already fell out of the ring are skipped
+                WriteFormat(writer, ",\n{\"ph\":\"E\",\"pid\":0,\"tid\":%u,\"ts\":%.3f}", t, ts);
+                depth--;
+            }
+        }
+    }
+
+    WriteFormat(writer, "\n]}\n");
+
+    HeapFree(events);
+
+    b32 result = CloseFileWriter(writer);
+    HeapFree(writer);
+
+    return result;
+}
+
+#else
+
+b32 WriteCpuTrace(String path) {
+    return 0;
+}
+
+#endif
@@ -0,0 +1,106 @@
+#pragma once
+
+#include "../General.h"
+#include "../DataStructures/String.h"
+
+// CPU zones for Chrome trace dumps. Only BUILD_PROFILE builds record them,
+// everywhere else the macros expand to nothing.
+#ifndef BUILD_PROFILE
+#define BUILD_PROFILE 0
+#endif
+
+#if BUILD_PROFILE
+
+#include "Platform.h"
+
+#if ARCH_X64 || ARCH_X86
+#if COMPILER_MSVC
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#endif
+
+enum {
+    PROFILER_MAX_THREADS = 128,
+    // events per thread, every zone takes two
+    PROFILER_RING_SIZE = 1 << 16,
+};
+
+// name 0 ends the innermost open zone
+struct ProfileEvent {
+    const char *name;
+    u64 tsc;
+};
+
+// Written only by its thread, WriteCpuTrace reads it while that keeps going
+// and drops whatever got overwritten in the meantime.
+struct ProfileRing {
+    volatile u32 write;
+    u32 thread_index;
+    char thread_name[32];
+    ProfileEvent events[PROFILER_RING_SIZE];
+};
+
+extern perthread ProfileRing *profile_ring;
+ProfileRing *RegisterProfileThread();
+
+inline u64 ReadCycleCounter() {
+#if ARCH_X64 || ARCH_X86
+    return __rdtsc();
+#elif ARCH_ARM64 && !COMPILER_MSVC
+    u64 result;
+    __asm__ volatile("mrs %0, cntvct_el0" : "=r"(result));
+    return result;
+#else
+    return GetTimeNowUs();
+#endif
+}
+
+inline void PushProfileEvent(const char *name) {
+    ProfileRing *ring = profile_ring;
+    if_unlikely(!ring) {
+        ring = RegisterProfileThread();
+    }
+
+    u32 write = ring->write;
+    ProfileEvent *event = &ring->events[write & (PROFILER_RING_SIZE - 1)];
+    event->name = name;
+    event->tsc = ReadCycleCounter();
+
+#if COMPILER_MSVC
+    // volatile stores are releases with MSVC
+    ring->write = write + 1;
+#else
+    __atomic_store_n(&ring->write, write + 1, __ATOMIC_RELEASE);
+#endif
+}
+
+struct ProfileZoneScope {
+    ProfileZoneScope(const char *name) {
+        PushProfileEvent(name);
+    }
+
+    ~ProfileZoneScope() {
+        PushProfileEvent(0);
+    }
+};
+
+void SetProfilerThreadName(const char *name);
+
+// name has to outlive the profiler (string literals, __FUNCTION__)
+#define PROFILE_ZONE(name) ProfileZoneScope NK_LINENUMBER(profile_zone_)(name)
+#define PROFILE_FUNCTION() PROFILE_ZONE(__FUNCTION__)
+#define PROFILE_THREAD(name) SetProfilerThreadName(name)
+
+#else
+
+#define PROFILE_ZONE(name)
+#define PROFILE_FUNCTION()
+#define PROFILE_THREAD(name)
+
+#endif
+
+// Chrome trace json of every thread's ring, opens in chrome://tracing and
+// ui.perfetto.dev. Fails when profiling is compiled out.
+b32 WriteCpuTrace(String path);
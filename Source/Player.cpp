@@ -2,9 +2,14 @@
 
 #include "Math/NMath.h"
 
-#include "Renderer.h"
+#include "Collision.h"
+#include "World.h"
+#include "Window/Window.h"
+#include "Platform/Profiler.h"
 
 global const float eye_height = 1.6f;
+global const float player_width = 0.6f;
+global const float player_height = 1.8f;
 
 Player CreatePlayer() {
 	Player result = {};
@@ -29,39 +34,10 @@ void ResizePlayerCamera(Camera *c, float w, float h) {
 }
 
 RayIntersection CastRay(Player *p) {
-	RayIntersection result = {};
-
-	const float RAY_MAX_DISTANCE = 6;
-	const float RAY_STEP = 0.5f;
-
-	vec3 origin = p->position + vec3(0, eye_height, 0);
-	vec3 dir = p->camera.front;
-	float dist = RAY_STEP;
-
-	result.pos = origin;
-	result.prev_pos = origin;
-
-	while (dist < RAY_MAX_DISTANCE) {
-		vec3 cp = origin + dir * dist;
-
-		result.prev_pos = result.pos;
-		result.pos = cp;
-
-		BlockRef ref = GetBlockRef(cp);
-		if (ref.c) {
-			Block b = GetBlock(ref);
-			if (b != BLOCK_AIR) {
-				break;
-			}
-		}
-
-		dist += RAY_STEP;
-	}
-
-	return result;
+	return CastRay(GetEyePos(p), p->camera.front);
 }
 
-void UpdatePlayer(Player *p) {
+void UpdatePlayerLook(Player *p) {
     Int2 mouse_delta = GetMouseDeltaPosition();
 
 	if (mouse_delta.x != 0 || mouse_delta.y != 0) {
@@ -81,66 +57,90 @@ void UpdatePlayer(Player *p) {
 
 		p->camera.front = front;
 	}
+}
+
+PlayerInput GatherPlayerInput(Player *p) {
+	PlayerInput result = {};
 
-	if (WasButtonPressed(MOUSE_BUTTON_LEFT)) {
+	result.front = p->camera.front;
+
+	if (IsKeyDown(KEY_W)) result.held |= PLAYER_INPUT_FORWARD;
+	if (IsKeyDown(KEY_S)) result.held |= PLAYER_INPUT_BACK;
+	if (IsKeyDown(KEY_A)) result.held |= PLAYER_INPUT_LEFT;
+	if (IsKeyDown(KEY_D)) result.held |= PLAYER_INPUT_RIGHT;
+	if (IsKeyDown(KEY_SPACE)) result.held |= PLAYER_INPUT_UP;
+	if (IsKeyDown(KEY_SHIFT)) result.held |= PLAYER_INPUT_DOWN;
+
+	if (WasKeyPressed(KEY_F)) result.actions |= PLAYER_ACTION_TOGGLE_FLYING;
+	if (WasKeyPressed(KEY_N)) result.actions |= PLAYER_ACTION_SPAWN_MOBS;
+	if (WasButtonPressed(MOUSE_BUTTON_LEFT)) result.actions |= PLAYER_ACTION_BREAK;
+	if (WasButtonPressed(MOUSE_BUTTON_RIGHT)) result.actions |= PLAYER_ACTION_PLACE;
+
+	return result;
+}
+
+void TickPlayer(Player *p, PlayerInput *input, float df) {
+	PROFILE_FUNCTION();
+
+	p->camera.front = input->front;
+
+	if (input->actions & PLAYER_ACTION_BREAK) {
 		RayIntersection intersect = CastRay(p);
 		BlockRef br = GetBlockRef(intersect.pos);
-		if (br.c) {
-			PlaceBlock(br, BLOCK_AIR);
+		if (br.c && IsChunkDecorated(br.c)) {
+			QueueBlockEdit(br, BLOCK_AIR);
 		}
 	}
 
-	if (WasButtonPressed(MOUSE_BUTTON_RIGHT)) {
+	if (input->actions & PLAYER_ACTION_PLACE) {
 		RayIntersection intersect = CastRay(p);
 		BlockRef hit = GetBlockRef(intersect.pos);
 		BlockRef place = GetBlockRef(intersect.prev_pos);
-		if (hit.c && place.c) {
+		if (hit.c && place.c && IsChunkDecorated(hit.c) && IsChunkDecorated(place.c)) {
 			if (GetBlock(hit) != BLOCK_AIR && GetBlock(place) == BLOCK_AIR) {
-				PlaceBlock(place, BLOCK_OAK_LOG);
+				QueueBlockEdit(place, BLOCK_OAK_LOG);
 			}
 		}
 	}
-}
 
-void UpdatePlayerPhysics(Player *p, float df) {
 	p->acceleration = vec3(0);
 
-	vec3 front = p->camera.front;
+	vec3 front = input->front;
 	float speed = df;
 	if (p->flying) {
 		speed *= 5;
 	}
 
-	if (IsKeyDown(KEY_W)) {
+	if (input->held & PLAYER_INPUT_FORWARD) {
 		p->acceleration += front * speed;
 	}
-	if (IsKeyDown(KEY_S)) {
+	if (input->held & PLAYER_INPUT_BACK) {
 		p->acceleration -= front * speed;
 	}
-	if (IsKeyDown(KEY_A)) {
+	if (input->held & PLAYER_INPUT_LEFT) {
 		vec3 right = Cross(front, vec3(0, 1, 0));
 		p->acceleration -= right * speed;
 	}
-	if (IsKeyDown(KEY_D)) {
+	if (input->held & PLAYER_INPUT_RIGHT) {
 		vec3 right = Cross(front, vec3(0, 1, 0));
 		p->acceleration += right * speed;
 	}
 
-	if (WasKeyPressed(KEY_F)) {
+	if (input->actions & PLAYER_ACTION_TOGGLE_FLYING) {
 		p->flying = !p->flying;
 	}
 
 	if (p->flying) {
-		if (IsKeyDown(KEY_SPACE)) {
+		if (input->held & PLAYER_INPUT_UP) {
 			p->velocity.y = 0.25f;
 		}
-		if (IsKeyDown(KEY_SHIFT)) {
+		if (input->held & PLAYER_INPUT_DOWN) {
 			p->velocity.y = -0.25f;
 		}
 		p->on_ground = 0;
 	} else {
 		p->acceleration.y = -0.01f;
-		if (IsKeyDown(KEY_SPACE) && p->on_ground) {
+		if ((input->held & PLAYER_INPUT_UP) && p->on_ground) {
 			p->velocity.y = 0.25f;
 			p->on_ground = 0;
 		}
@@ -148,15 +148,24 @@ void UpdatePlayerPhysics(Player *p, float df) {
 
 	p->velocity += p->acceleration;
 	p->velocity *= 0.9;
-	p->position += p->velocity;
 
-	if (!p->flying) {
-		float ground_y = GetGroundLevel(p->position);
-		if (p->position.y <= ground_y) {
-			p->position.y = ground_y;
-			p->velocity.y = 0;
+	AABB box = CreateEntityAABB(p->position, player_width, player_height);
+	CollisionResult collision = MoveAndCollide(box, p->velocity);
+	p->position += collision.delta;
+
+	if (collision.hit_y) {
+		if (!p->flying && p->velocity.y < 0) {
 			p->on_ground = 1;
 		}
+		p->velocity.y = 0;
+	} else if (p->velocity.y != 0) {
+		p->on_ground = 0;
+	}
+	if (collision.hit_x) {
+		p->velocity.x = 0;
+	}
+	if (collision.hit_z) {
+		p->velocity.z = 0;
 	}
 }
 vec3 GetEyePos(Player *p) {
@@ -2,6 +2,7 @@
 
 #include "General.h"
 #include "Math/Mat.h"
+#include "Collision.h"
 
 struct Camera {
 	mat4 proj_matrix;
@@ -27,14 +28,34 @@ struct Player {
 	Camera camera;
 };
 
-struct RayIntersection {
-	vec3 pos;
-	vec3 prev_pos;
+enum {
+	PLAYER_INPUT_FORWARD = 1 << 0,
+	PLAYER_INPUT_BACK = 1 << 1,
+	PLAYER_INPUT_LEFT = 1 << 2,
+	PLAYER_INPUT_RIGHT = 1 << 3,
+	PLAYER_INPUT_UP = 1 << 4,
+	PLAYER_INPUT_DOWN = 1 << 5,
+};
+
+enum {
+	PLAYER_ACTION_TOGGLE_FLYING = 1 << 0,
+	PLAYER_ACTION_BREAK = 1 << 1,
+	PLAYER_ACTION_PLACE = 1 << 2,
+	PLAYER_ACTION_SPAWN_MOBS = 1 << 3,
+};
+
+// What the render thread hands the simulation each frame: keys held right now
+// and one-shot actions that happened since the last input.
+struct PlayerInput {
+	vec3 front;
+	u32 held;
+	u32 actions;
 };
 
 Player CreatePlayer();
 void ResizePlayerCamera(Camera *c, float w, float h);
 RayIntersection CastRay(Player *p);
-void UpdatePlayer(Player *p);
-void UpdatePlayerPhysics(Player *p, float df);
+void UpdatePlayerLook(Player *p);
+PlayerInput GatherPlayerInput(Player *p);
+void TickPlayer(Player *p, PlayerInput *input, float df);
 vec3 GetEyePos(Player *p);
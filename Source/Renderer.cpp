@@ -1,27 +1,55 @@
 #include "Renderer.h"
 
-global u32 block_textures_map[BLOCK_COUNT][6] = {
-	{0, 0, 0, 0, 0, 0},
-	{0, 0, 0, 0, 0, 0},
-	{TEXTURE_DIRT, TEXTURE_DIRT, TEXTURE_DIRT, TEXTURE_DIRT, TEXTURE_DIRT, TEXTURE_DIRT},
-	{TEXTURE_GRASS_TOP, TEXTURE_DIRT, TEXTURE_GRASS_SIDE, TEXTURE_GRASS_SIDE, TEXTURE_GRASS_SIDE, TEXTURE_GRASS_SIDE},
-	{TEXTURE_OAK_LOG_TOP, TEXTURE_OAK_LOG_TOP, TEXTURE_OAK_LOG_SIDE, TEXTURE_OAK_LOG_SIDE, TEXTURE_OAK_LOG_SIDE, TEXTURE_OAK_LOG_SIDE},
-	{TEXTURE_STONE, TEXTURE_STONE, TEXTURE_STONE, TEXTURE_STONE, TEXTURE_STONE, TEXTURE_STONE},
-	{TEXTURE_COBBLE_STONE, TEXTURE_COBBLE_STONE, TEXTURE_COBBLE_STONE, TEXTURE_COBBLE_STONE, TEXTURE_COBBLE_STONE, TEXTURE_COBBLE_STONE},
-	{TEXTURE_STONE_BRICKS, TEXTURE_STONE_BRICKS, TEXTURE_STONE_BRICKS, TEXTURE_STONE_BRICKS, TEXTURE_STONE_BRICKS, TEXTURE_STONE_BRICKS},
-};
+#include "ChunkPipeline.h"
+#include "Graphics/GpuProfiler.h"
+#include "Math/NMath.h"
+#include "Platform/Profiler.h"
 
 global Renderer renderer;
 
-internal void LoadTextures(TextureArray *textures, VkCommandPool cmdpool) {
-	LoadTextureAtSlot(textures, TEXTURE_DIRT, "Assets/Textures/dirt.png", cmdpool);
-	LoadTextureAtSlot(textures, TEXTURE_GRASS_SIDE, "Assets/Textures/grass_side.png", cmdpool);
-	LoadTextureAtSlot(textures, TEXTURE_GRASS_TOP, "Assets/Textures/grass_top.png", cmdpool);
-	LoadTextureAtSlot(textures, TEXTURE_OAK_LOG_SIDE, "Assets/Textures/log_oak.png", cmdpool);
-	LoadTextureAtSlot(textures, TEXTURE_OAK_LOG_TOP, "Assets/Textures/log_oak_top.png", cmdpool);
-	LoadTextureAtSlot(textures, TEXTURE_STONE, "Assets/Textures/stone.png", cmdpool);
-	LoadTextureAtSlot(textures, TEXTURE_COBBLE_STONE, "Assets/Textures/cobblestone.png", cmdpool);
-	LoadTextureAtSlot(textures, TEXTURE_STONE_BRICKS, "Assets/Textures/stone_bricks.png", cmdpool);
+// view distance shadows reach, split between the cascades
+global const float shadow_distance = 256.0f;
+// 0 splits evenly, 1 logarithmically
+global const float cascade_split_lambda = 0.75f;
+// far cascades are redrawn when frame_index % interval == phase
+global const u32 cascade_update_interval[SHADOW_CASCADE_COUNT] = { 1, 2, 4, 4 };
+global const u32 cascade_update_phase[SHADOW_CASCADE_COUNT] = { 0, 1, 0, 2 };
+global const char *cascade_zone_names[SHADOW_CASCADE_COUNT] = { "cascade 0", "cascade 1", "cascade 2", "cascade 3" };
+global const char *shadow_mode_names[SHADOW_MODE_COUNT] = { "pcf", "evsm" };
+// dynamic resolution aims this far below the budget and holds the scale
+// while the frame stays between the two
+global const float render_scale_target = 0.9f;
+global const float render_scale_hold = 0.8f;
+// drops quickly when over budget, grows back slowly so it doesn't oscillate
+global const float render_scale_step_down = 0.05f;
+global const float render_scale_step_up = 0.01f;
+
+internal void LoadTextures(VkCommandPool cmdpool) {
+	// layers in TEXTURE_* order
+	const char *block_paths[TEXTURE_COUNT] = {};
+	block_paths[TEXTURE_DIRT] = "Assets/Textures/dirt.png";
+	block_paths[TEXTURE_GRASS_SIDE] = "Assets/Textures/grass_side.png";
+	block_paths[TEXTURE_GRASS_TOP] = "Assets/Textures/grass_top.png";
+	block_paths[TEXTURE_OAK_LOG_SIDE] = "Assets/Textures/log_oak.png";
+	block_paths[TEXTURE_OAK_LOG_TOP] = "Assets/Textures/log_oak_top.png";
+	block_paths[TEXTURE_STONE] = "Assets/Textures/stone.png";
+	block_paths[TEXTURE_COBBLE_STONE] = "Assets/Textures/cobblestone.png";
+	block_paths[TEXTURE_STONE_BRICKS] = "Assets/Textures/stone_bricks.png";
+
+	renderer.block_textures = LoadTextureArrayFromFiles(block_paths, TEXTURE_COUNT, cmdpool);
+
+	const char *paths[] = {
+		"Assets/Textures/noise.png",
+		"Assets/Textures/water1.png",
+		"Assets/Textures/water2.png",
+	};
+
+	Texture textures[ArrayCount(paths)];
+	LoadTexturesFromFiles(paths, textures, ArrayCount(paths), cmdpool);
+
+	renderer.noise_texture = textures[0];
+	renderer.water_texture1 = textures[1];
+	renderer.water_texture2 = textures[2];
 }
 
 void CreateSkyRenderPass(VkFormat color_format, VkFormat depth_format, VkCommandPool cmdpool, RenderPass *pass) {
@@ -61,9 +89,10 @@ void CreateSolidRenderPass(VkFormat color_format, VkFormat depth_format, VkComma
 	VkDescriptorSetLayoutBinding bindings[] = {
 		{0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0 },
 		{1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT, 0},
-		{2, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, TEXTURE_COUNT, VK_SHADER_STAGE_FRAGMENT_BIT, 0},
+		{2, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, 0},
 		{3, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, 0},
-		{4, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, 0}
+		{4, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, 0},
+		{5, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, 0}
 	};
 
 	Shader shaders[] = {
@@ -96,6 +125,48 @@ void CreateSolidRenderPass(VkFormat color_format, VkFormat depth_format, VkComma
 		VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, sizeof(VkDrawIndirectCommand), &indirect_cmd);
 }
 
+// Shares the solid pass's descriptor set, the solid pass binds it.
+void CreateDepthPrepass(VkFormat color_format, VkFormat depth_format, RenderPass *solid_pass, DepthPrepass *prepass) {
+	Shader prepass_shaders[] = {
+		{"Assets/Shaders/Core.vert.spv", VK_SHADER_STAGE_VERTEX_BIT},
+	};
+
+	GraphicsPipelineOptions options = {};
+	options.color_formats = 0;
+	options.color_formats_count = 0;
+	options.depth_format = depth_format;
+	options.polygon_mode = VK_POLYGON_MODE_FILL;
+	options.cull_mode = VK_CULL_MODE_BACK_BIT;
+	options.front_face = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+	options.depth_read = VK_TRUE;
+	options.depth_write = VK_TRUE;
+	options.blend = VK_FALSE;
+	options.shaders = prepass_shaders;
+	options.shaders_count = ArrayCount(prepass_shaders);
+
+	prepass->pipeline = CreateGraphicsPipeline(&options, solid_pass->desc_set.layout);
+
+	Shader solid_shaders[] = {
+		{"Assets/Shaders/Core.vert.spv", VK_SHADER_STAGE_VERTEX_BIT},
+		{"Assets/Shaders/Core.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT},
+	};
+
+	options.color_formats = &color_format;
+	options.color_formats_count = 1;
+	options.depth_write = VK_FALSE;
+	options.depth_equal = 1;
+	options.shaders = solid_shaders;
+	options.shaders_count = ArrayCount(solid_shaders);
+
+	prepass->solid_pipeline = CreateGraphicsPipeline(&options, solid_pass->desc_set.layout);
+	prepass->enabled = 1;
+}
+
+void DestroyDepthPrepass(DepthPrepass *prepass) {
+	DestroyPipeline(prepass->pipeline);
+	DestroyPipeline(prepass->solid_pipeline);
+}
+
 void CreateWaterRenderPass(VkFormat color_format, VkFormat depth_format, VkCommandPool cmdpool, RenderPass *pass) {
 	VkDescriptorSetLayoutBinding bindings[] = {
 		{0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0 },
@@ -104,6 +175,7 @@ void CreateWaterRenderPass(VkFormat color_format, VkFormat depth_format, VkComma
 		{3, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, 0},
 		{4, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, 0},
 		{5, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, 0},
+		{6, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, 0},
 	};
 
 	Shader shaders[] = {
@@ -153,8 +225,7 @@ void DestroyRenderPass(RenderPass *pass) {
 
 void CreateShadowRenderPass(VkCommandBuffer cmdbuf, VkCommandPool cmdpool, ShadowPass *pass) {
 	VkDescriptorSetLayoutBinding bindings[] = {
-		{0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT, 0 },
-		{1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT, 0},
+		{0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT, 0},
 	};
 
 	Shader shaders[] = {
@@ -162,6 +233,12 @@ void CreateShadowRenderPass(VkCommandBuffer cmdbuf, VkCommandPool cmdpool, Shado
 		{"Assets/Shaders/Shadow.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT},
 	};
 
+	// the cascade's light space matrix
+	VkPushConstantRange light_space_pc = {};
+	light_space_pc.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+	light_space_pc.offset = 0;
+	light_space_pc.size = sizeof(mat4);
+
 	GraphicsPipelineOptions options = {};
 	options.color_formats = 0;
 	options.color_formats_count = 0;
@@ -174,6 +251,8 @@ void CreateShadowRenderPass(VkCommandBuffer cmdbuf, VkCommandPool cmdpool, Shado
 	options.blend = VK_FALSE;
 	options.shaders = shaders;
 	options.shaders_count = ArrayCount(shaders);
+	options.push_contants = &light_space_pc;
+	options.push_constants_count = 1;
 
 	VkDescriptorSetLayout layout = CreateDescriptorSetLayout(bindings, ArrayCount(bindings));
 	pass->pipeline = CreateGraphicsPipeline(&options, layout);
@@ -181,10 +260,10 @@ void CreateShadowRenderPass(VkCommandBuffer cmdbuf, VkCommandPool cmdpool, Shado
 
 	VkSamplerCreateInfo shadow_sampler = {};
 	shadow_sampler.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
-	shadow_sampler.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER;
-	shadow_sampler.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER;
-	shadow_sampler.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
-	pass->shadow_map = CreateTexture(SHADOW_MAP_WIDTH, SHADOW_MAP_HEIGHT, VK_FORMAT_D32_SFLOAT,
+	// the windows wrap around their layers
+	shadow_sampler.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+	shadow_sampler.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+	pass->shadow_map = CreateTextureArray(SHADOW_MAP_WIDTH, SHADOW_MAP_HEIGHT, SHADOW_CASCADE_COUNT, VK_FORMAT_D32_SFLOAT,
 		VK_IMAGE_ASPECT_DEPTH_BIT, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, shadow_sampler
 	);
 
@@ -192,14 +271,106 @@ void CreateShadowRenderPass(VkCommandBuffer cmdbuf, VkCommandPool cmdpool, Shado
 		VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
 		VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_ASPECT_DEPTH_BIT);
 	PipelineImageBarriers(cmdbuf, 0, &shadow_map_barrier, 1);
-	pass->light_space_buffer = CreateBuffer(cmdpool, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, sizeof(mat4), 0);
+
+	VkDescriptorSetLayoutBinding blur_bindings[] = {
+		{0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT, 0},
+		{1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT, 0},
+		{2, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT, 0},
+	};
+
+	// 32 bit floats where they filter and store, the squares of the positive
+	// exponent get close to the float max. Half floats always do both, with
+	// exponents low enough that the squares stay under their max of 65504.
+	VkFormat moments_format = VK_FORMAT_R32G32B32A32_SFLOAT;
+	pass->evsm_exponents = vec2(40.0f, 5.0f);
+	Shader blur_shader = {
+		"Assets/Shaders/ShadowBlur.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT
+	};
+	if (!IsFormatSupported(moments_format, VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT | VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT)) {
+		moments_format = VK_FORMAT_R16G16B16A16_SFLOAT;
+		pass->evsm_exponents = vec2(5.5f, 5.0f);
+		blur_shader.path = "Assets/Shaders/ShadowBlurHalf.comp.spv";
+	}
+
+	VkPushConstantRange blur_pc = {};
+	blur_pc.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	blur_pc.offset = 0;
+	blur_pc.size = sizeof(ShadowBlurConstants);
+
+	VkDescriptorSetLayout blur_layout = CreateDescriptorSetLayout(blur_bindings, ArrayCount(blur_bindings));
+	pass->blur_pipeline = CreateComputePipeline(blur_shader, blur_layout, &blur_pc, 1);
+	pass->blur_desc_set = CreateDescriptorSet(blur_bindings, ArrayCount(blur_bindings), blur_layout);
+
+	VkSamplerCreateInfo moments_sampler = {};
+	moments_sampler.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	moments_sampler.magFilter = VK_FILTER_LINEAR;
+	moments_sampler.minFilter = VK_FILTER_LINEAR;
+	moments_sampler.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+	moments_sampler.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+	pass->moments = CreateTextureArray(SHADOW_MOMENTS_WIDTH, SHADOW_MOMENTS_HEIGHT, SHADOW_CASCADE_COUNT, moments_format,
+		VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, moments_sampler);
+	pass->moments.descriptor.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+	pass->moments_blur = CreateImage(SHADOW_MOMENTS_WIDTH, SHADOW_MOMENTS_HEIGHT, moments_format, 1,
+		VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_USAGE_STORAGE_BIT);
+
+	BindTexture(&pass->blur_desc_set, 0, pass->shadow_map);
+	BindStorageImage(&pass->blur_desc_set, 1, pass->moments_blur);
+	BindStorageImage(&pass->blur_desc_set, 2, pass->moments.image);
+
+	VkImageMemoryBarrier2 moments_barriers[] = {
+		CreateImageBarrier(pass->moments.image.handle, VK_PIPELINE_STAGE_2_TOP_OF_PIPE_BIT, 0, VK_IMAGE_LAYOUT_UNDEFINED,
+			VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_ASPECT_COLOR_BIT),
+		CreateImageBarrier(pass->moments_blur.handle, VK_PIPELINE_STAGE_2_TOP_OF_PIPE_BIT, 0, VK_IMAGE_LAYOUT_UNDEFINED,
+			VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_ASPECT_COLOR_BIT),
+	};
+	PipelineImageBarriers(cmdbuf, 0, moments_barriers, ArrayCount(moments_barriers));
+
+	VkDrawIndirectCommand indirect_cmd = {6, 0, 0, 0};
+	pass->culled_instance_buffer = CreateBuffer(cmdpool, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, sizeof(InstanceData) * MAX_INSTANCE_COUNT, 0);
+
+	for (u32 i = 0; i < SHADOW_CASCADE_COUNT; ++i) {
+		ShadowCascade *cascade = &pass->cascades[i];
+		cascade->layer_view = CreateImageLayerView(pass->shadow_map.image, i, VK_IMAGE_ASPECT_DEPTH_BIT);
+		for (u32 j = 0; j < SHADOW_CULL_RECT_COUNT; ++j) {
+			cascade->indirect_buffers[j] = CreateBuffer(cmdpool, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+				VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, sizeof(VkDrawIndirectCommand), &indirect_cmd);
+		}
+		cascade->moments_stale = 1;
+	}
+
+	// tiles stay valid while the camera moves, so neither the light's origin
+	// nor its depth range may follow it
+	vec3 light_dir = Normalize(vec3(-1.0f, -1.0f, -1.0f));
+	pass->light_view = LookAt(vec3(0, 0, 0), light_dir, vec3(0, 1, 0));
+
+	vec3 world_size = vec3(WORLD_CHUNK_COUNT_X * CHUNK_X, WORLD_CHUNK_COUNT_Y * CHUNK_Y, WORLD_CHUNK_COUNT_Z * CHUNK_Z);
+	pass->light_near = 0.0f;
+	pass->light_far = 0.0f;
+	for (u32 i = 0; i < 8; ++i) {
+		vec3 corner = vec3((i & 1) ? world_size.x : 0.0f, (i & 2) ? world_size.y : 0.0f, (i & 4) ? world_size.z : 0.0f);
+		float d = Dot(corner, light_dir);
+		pass->light_near = Min(pass->light_near, d);
+		pass->light_far = Max(pass->light_far, d);
+	}
+	pass->light_near -= 1.0f;
+	pass->light_far += 1.0f;
 }
 
 void DestroyShadowPass(ShadowPass *pass) {
+	for (u32 i = 0; i < SHADOW_CASCADE_COUNT; ++i) {
+		DestroyImageView(pass->cascades[i].layer_view);
+		for (u32 j = 0; j < SHADOW_CULL_RECT_COUNT; ++j) {
+			DestroyBuffer(pass->cascades[i].indirect_buffers[j]);
+		}
+	}
 	DestroyDescriptorSet(&pass->desc_set);
 	DestroyPipeline(pass->pipeline);
 	DestroyTexture(pass->shadow_map);
-	DestroyBuffer(pass->light_space_buffer);
+	DestroyBuffer(pass->culled_instance_buffer);
+	DestroyDescriptorSet(&pass->blur_desc_set);
+	DestroyPipeline(pass->blur_pipeline);
+	DestroyTexture(pass->moments);
+	DestroyImage(pass->moments_blur);
 }
 
 void CreateCullPass(VkCommandPool cmdpool, CullPass *pass) {
@@ -216,22 +387,24 @@ void CreateCullPass(VkCommandPool cmdpool, CullPass *pass) {
 
 	VkDescriptorSetLayout layout = CreateDescriptorSetLayout(bindings, ArrayCount(bindings));
 	pass->pipeline = CreateComputePipeline(culling_shader, layout);
-	pass->desc_sets[0] = CreateDescriptorSet(bindings, ArrayCount(bindings), layout);
-	pass->desc_sets[1] = CreateDescriptorSet(bindings, ArrayCount(bindings), layout);
-
-	pass->frustum_info_buffer = CreateBuffer(cmdpool, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, sizeof(FrustumInfo), 0);
+	for (u32 i = 0; i < CULL_CALL_COUNT; ++i) {
+		pass->desc_sets[i] = CreateDescriptorSet(bindings, ArrayCount(bindings), layout);
+		pass->frustum_info_buffers[i] = CreateBuffer(cmdpool, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, sizeof(FrustumInfo), 0);
+	}
 }
 
 void DestroyCullPass(CullPass *pass) {
-	DestroyDescriptorSet(&pass->desc_sets[0]);
-	DestroyDescriptorSet(&pass->desc_sets[1]);
+	for (u32 i = 0; i < CULL_CALL_COUNT; ++i) {
+		DestroyDescriptorSet(&pass->desc_sets[i]);
+		DestroyBuffer(pass->frustum_info_buffers[i]);
+	}
 	DestroyPipeline(pass->pipeline);
-	DestroyBuffer(pass->frustum_info_buffer);
 }
 
-void CreatePostprocess(VkCommandPool cmdpool, Postprocess *post) {
+void CreatePostprocess(VkFormat present_format, VkCommandPool cmdpool, Postprocess *post) {
 	VkDescriptorSetLayoutBinding bindings[] = {
-		{0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, 0}
+		{0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, 0},
+		{1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, 0}
 	};
 
 	Shader shaders[] = {
@@ -239,10 +412,15 @@ void CreatePostprocess(VkCommandPool cmdpool, Postprocess *post) {
 		{"Assets/Shaders/Post.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT},
 	};
 
-	VkFormat format = VK_FORMAT_R8G8B8A8_SRGB;
+	VkFormat ldr_format = VK_FORMAT_R8G8B8A8_UNORM;
+
+	VkPushConstantRange scale_pc = {};
+	scale_pc.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+	scale_pc.offset = 0;
+	scale_pc.size = sizeof(RenderScaleConstants);
 
 	GraphicsPipelineOptions options = {};
-	options.color_formats = &format;
+	options.color_formats = &ldr_format;
 	options.color_formats_count = 1;
 	options.depth_format = VK_FORMAT_UNDEFINED;
 	options.polygon_mode = VK_POLYGON_MODE_FILL;
@@ -253,26 +431,151 @@ void CreatePostprocess(VkCommandPool cmdpool, Postprocess *post) {
 	options.blend = VK_FALSE;
 	options.shaders = shaders;
 	options.shaders_count = ArrayCount(shaders);
+	options.push_contants = &scale_pc;
+	options.push_constants_count = 1;
 
 	VkDescriptorSetLayout layout = CreateDescriptorSetLayout(bindings, ArrayCount(bindings));
 	post->desc_set = CreateDescriptorSet(bindings, ArrayCount(bindings), layout);
 	post->pipeline = CreateGraphicsPipeline(&options, layout);
+
+	VkDescriptorSetLayoutBinding fxaa_bindings[] = {
+		{0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, 0}
+	};
+
+	Shader fxaa_shaders[] = {
+		{"Assets/Shaders/Post.vert.spv", VK_SHADER_STAGE_VERTEX_BIT},
+		{"Assets/Shaders/Fxaa.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT},
+	};
+
+	// straight into the swapchain image, which is always an sRGB format
+	options.color_formats = &present_format;
+	options.shaders = fxaa_shaders;
+	options.shaders_count = ArrayCount(fxaa_shaders);
+	options.push_contants = 0;
+	options.push_constants_count = 0;
+
+	VkDescriptorSetLayout fxaa_layout = CreateDescriptorSetLayout(fxaa_bindings, ArrayCount(fxaa_bindings));
+	post->fxaa_desc_set = CreateDescriptorSet(fxaa_bindings, ArrayCount(fxaa_bindings), fxaa_layout);
+	post->fxaa_pipeline = CreateGraphicsPipeline(&options, fxaa_layout);
+
+	VkDescriptorSetLayoutBinding bloom_bindings[] = {
+		{0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT, 0},
+		{1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT, 0},
+	};
+
+	Shader bloom_shader = {
+		"Assets/Shaders/Bloom.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT
+	};
+
+	VkPushConstantRange bloom_pc = {};
+	bloom_pc.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	bloom_pc.offset = 0;
+	bloom_pc.size = sizeof(BloomConstants);
+
+	VkDescriptorSetLayout bloom_layout = CreateDescriptorSetLayout(bloom_bindings, ArrayCount(bloom_bindings));
+	post->bloom_pipeline = CreateComputePipeline(bloom_shader, bloom_layout, &bloom_pc, 1);
+	for (u32 i = 0; i < BLOOM_DISPATCH_COUNT; ++i) {
+		post->bloom_desc_sets[i] = CreateDescriptorSet(bloom_bindings, ArrayCount(bloom_bindings), bloom_layout);
+	}
+}
+
+internal void DestroyPostprocessTargets(Postprocess *post) {
+	if (!post->width) {
+		return;
+	}
+
+	for (u32 i = 0; i < BLOOM_MIP_COUNT; ++i) {
+		DestroyImageView(post->bloom_mip_views[i]);
+	}
+	DestroyTexture(post->bloom);
+	post->width = 0;
+	post->height = 0;
 }
 
 void DestroyPostprocess(Postprocess *post) {
+	DestroyPostprocessTargets(post);
 	DestroyPipeline(post->pipeline);
 	DestroyDescriptorSet(&post->desc_set);
+	DestroyPipeline(post->fxaa_pipeline);
+	DestroyDescriptorSet(&post->fxaa_desc_set);
+	DestroyPipeline(post->bloom_pipeline);
+	for (u32 i = 0; i < BLOOM_DISPATCH_COUNT; ++i) {
+		DestroyDescriptorSet(&post->bloom_desc_sets[i]);
+	}
+}
+
+internal u32 GetBloomMipSize(u32 size, u32 mip) {
+	return Max((size / 2) >> mip, 1u);
+}
+
+// bloom_desc_sets[dispatch] reads source and writes mip
+internal void BindBloomDispatch(Postprocess *post, u32 dispatch, Texture source, u32 mip) {
+	Image target = post->bloom.image;
+	target.view = post->bloom_mip_views[mip];
+
+	BindTexture(&post->bloom_desc_sets[dispatch], 0, source);
+	BindStorageImage(&post->bloom_desc_sets[dispatch], 1, target);
+}
+
+void ResizePostprocess(u32 width, u32 height, VkCommandBuffer cmdbuf) {
+	Postprocess *post = &renderer.post_process;
+	DestroyPostprocessTargets(post);
+
+	post->width = width;
+	post->height = height;
+
+	VkSamplerCreateInfo linear_sampler = {};
+	linear_sampler.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	linear_sampler.magFilter = VK_FILTER_LINEAR;
+	linear_sampler.minFilter = VK_FILTER_LINEAR;
+	linear_sampler.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	linear_sampler.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+
+	post->bloom = CreateMipmappedTexture(GetBloomMipSize(width, 0), GetBloomMipSize(height, 0), BLOOM_MIP_COUNT,
+		VK_FORMAT_R16G16B16A16_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+		linear_sampler);
+	post->bloom.descriptor.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+	for (u32 i = 0; i < BLOOM_MIP_COUNT; ++i) {
+		post->bloom_mip_views[i] = CreateImageMipView(post->bloom.image, i, VK_IMAGE_ASPECT_COLOR_BIT);
+	}
+
+	// the first dispatch reads the frame's render target, bound by the bloom
+	// pass
+	for (u32 mip = 1; mip < BLOOM_MIP_COUNT; ++mip) {
+		Texture source = post->bloom;
+		source.descriptor.imageView = post->bloom_mip_views[mip - 1];
+		BindBloomDispatch(post, mip, source, mip);
+	}
+
+	for (u32 mip = BLOOM_MIP_COUNT - 1; mip > 0; --mip) {
+		Texture source = post->bloom;
+		source.descriptor.imageView = post->bloom_mip_views[mip];
+		BindBloomDispatch(post, BLOOM_MIP_COUNT + (BLOOM_MIP_COUNT - 1 - mip), source, mip - 1);
+	}
+
+	Texture bloom_top = post->bloom;
+	bloom_top.descriptor.imageView = post->bloom_mip_views[0];
+	BindTexture(&post->desc_set, 1, bloom_top);
+
+	VkImageMemoryBarrier2 bloom_barrier = CreateImageBarrier(post->bloom.image.handle, VK_PIPELINE_STAGE_2_TOP_OF_PIPE_BIT, 0,
+		VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL,
+		VK_IMAGE_ASPECT_COLOR_BIT);
+	PipelineImageBarriers(cmdbuf, 0, &bloom_barrier, 1);
 }
 
 void InitRenderer(VkCommandPool cmdpool, VkCommandBuffer cmdbuf,
-	VkFormat color_format, VkFormat depth_format) {
+	VkFormat color_format, VkFormat depth_format, VkFormat present_format) {
 
 	CreateSkyRenderPass(color_format, depth_format, cmdpool, &renderer.sky_pass);
 	CreateSolidRenderPass(color_format, depth_format, cmdpool, &renderer.solid_pass);
 	CreateWaterRenderPass(color_format, depth_format, cmdpool, &renderer.water_pass);
+	CreateDepthPrepass(color_format, depth_format, &renderer.solid_pass, &renderer.depth_prepass);
 	CreateShadowRenderPass(cmdbuf, cmdpool, &renderer.shadow_pass);
 	CreateCullPass(cmdpool, &renderer.cull_pass);
-	CreatePostprocess(cmdpool, &renderer.post_process);
+	CreatePostprocess(present_format, cmdpool, &renderer.post_process);
+	renderer.color_format = color_format;
+	renderer.depth_format = depth_format;
+	renderer.render_scale = 1.0f;
 
 	Globals globals = {};
 	renderer.globals_buffer = CreateBuffer(cmdpool, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, sizeof(globals), &globals);
@@ -280,39 +583,49 @@ void InitRenderer(VkCommandPool cmdpool, VkCommandBuffer cmdbuf,
 	SkyUniform sky_uniform = {};
 	renderer.sky_buffer = CreateBuffer(cmdpool, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, sizeof(sky_uniform), &sky_uniform);
 
-	renderer.textures = CreateTextureArray(TEXTURE_COUNT);
-	LoadTextures(&renderer.textures, cmdpool);
-
-	renderer.noise_texture = LoadTextureFromFile("Assets/Textures/noise.png", cmdpool);
-	renderer.water_texture1 = LoadTextureFromFile("Assets/Textures/water1.png", cmdpool);
-	renderer.water_texture2 = LoadTextureFromFile("Assets/Textures/water2.png", cmdpool);
+	LoadTextures(cmdpool);
 }
 
 void DestroyRenderer() {
 	DestroyRenderPass(&renderer.sky_pass);
 	DestroyRenderPass(&renderer.solid_pass);
 	DestroyRenderPass(&renderer.water_pass);
+	DestroyDepthPrepass(&renderer.depth_prepass);
 	DestroyShadowPass(&renderer.shadow_pass);
 	DestroyCullPass(&renderer.cull_pass);
+	DestroyPostprocess(&renderer.post_process);
+	DestroyRenderGraph(&renderer.graph);
 	DestroyBuffer(renderer.globals_buffer);
 	DestroyBuffer(renderer.sky_buffer);
-	DestroyTextureArray(&renderer.textures);
+	DestroyTexture(renderer.block_textures);
 	DestroyTexture(renderer.noise_texture);
 	DestroyTexture(renderer.water_texture1);
 	DestroyTexture(renderer.water_texture2);
 }
 
-internal void Cull(CullCall *cull, VkCommandBuffer cmdbuf) {
+// Writes the barriers the dispatch has to wait on into barriers[0..1].
+internal void UploadCullCall(CullCall *cull, VkBufferMemoryBarrier2 *barriers, VkCommandBuffer cmdbuf) {
 	FrustumInfo frustum_info = {};
 	frustum_info.view_matrix = cull->view_matrix;
 	ExtractFrustumPlanes(cull->proj_matrix, frustum_info.planes);
 	frustum_info.instance_count = cull->instance_count;
 
-	UpdateRendererBuffer(renderer.cull_pass.frustum_info_buffer, sizeof(frustum_info), &frustum_info, cmdbuf);
+	Buffer *frustum_info_buffer = &renderer.cull_pass.frustum_info_buffers[cull->desc_set_index];
+	UpdateRendererBuffer(*frustum_info_buffer, sizeof(frustum_info), &frustum_info, cmdbuf);
 
 	VkDrawIndirectCommand indirect_cmd = {6, 0, 0, 0};
 	UpdateRendererBuffer(cull->indirect_buffer, sizeof(indirect_cmd), &indirect_cmd, cmdbuf);
 
+	barriers[0] = CreateBufferBarrier(frustum_info_buffer->handle, sizeof(frustum_info), VK_PIPELINE_STAGE_2_TRANSFER_BIT,
+		VK_ACCESS_2_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_UNIFORM_READ_BIT);
+	barriers[1] = CreateBufferBarrier(cull->indirect_buffer.handle, sizeof(indirect_cmd), VK_PIPELINE_STAGE_2_TRANSFER_BIT,
+		VK_ACCESS_2_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+		VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT);
+}
+
+internal void DispatchCullCall(CullCall *cull, VkCommandBuffer cmdbuf) {
+	Buffer *frustum_info_buffer = &renderer.cull_pass.frustum_info_buffers[cull->desc_set_index];
+
 	Pipeline *pipeline = &renderer.cull_pass.pipeline;
 	DescriptorSet *desc_set = &renderer.cull_pass.desc_sets[cull->desc_set_index];
 	BindPipeline(pipeline, cmdbuf);
@@ -322,95 +635,469 @@ internal void Cull(CullCall *cull, VkCommandBuffer cmdbuf) {
 	BindBuffer(desc_set, 0, &cull->instance_buffer, buffer_size, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
 	BindBuffer(desc_set, 1, &cull->culled_instance_buffer, buffer_size, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
 	BindBuffer(desc_set, 2, &cull->indirect_buffer, VK_WHOLE_SIZE, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
-	BindBuffer(desc_set, 3, &renderer.cull_pass.frustum_info_buffer, VK_WHOLE_SIZE, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
+	BindBuffer(desc_set, 3, frustum_info_buffer, VK_WHOLE_SIZE, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
 
 	u32 group_count = (cull->instance_count + 63) / 64;
 	vkCmdDispatch(cmdbuf, group_count, 1, 1);
+}
 
-	VkBufferMemoryBarrier2 cull_barriers[] = { CreateBufferBarrier(
-		cull->indirect_buffer.handle, VK_WHOLE_SIZE, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
-		VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT),
-		CreateBufferBarrier(
-		cull->culled_instance_buffer.handle, cull->instance_count * sizeof(InstanceData), VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
-		VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT) };
-    PipelineBufferBarriers(cmdbuf, VK_DEPENDENCY_DEVICE_GROUP_BIT, cull_barriers, 2);
-}
-
-void Cull(Player *p, BlockInstanceCounts instance_counts, VkCommandBuffer cmdbuf) {
-	CullCall solid_cull_call = {};
-	solid_cull_call.instance_buffer = renderer.solid_pass.instance_buffer;
-	solid_cull_call.culled_instance_buffer = renderer.solid_pass.culled_instance_buffer;
-	solid_cull_call.indirect_buffer = renderer.solid_pass.indirect_buffer;
-	solid_cull_call.proj_matrix = p->camera.proj_matrix;
-	solid_cull_call.view_matrix = p->camera.view_matrix;
-	solid_cull_call.desc_set_index = 0;
-	solid_cull_call.instance_count = instance_counts.solid;
-	Cull(&solid_cull_call, cmdbuf);
-
-	CullCall water_cull_call = {};
-	water_cull_call.instance_buffer = renderer.water_pass.instance_buffer;
-	water_cull_call.culled_instance_buffer = renderer.water_pass.culled_instance_buffer;
-	water_cull_call.indirect_buffer = renderer.water_pass.indirect_buffer;
-	water_cull_call.proj_matrix = p->camera.proj_matrix;
-	water_cull_call.view_matrix = p->camera.view_matrix;
-	water_cull_call.desc_set_index = 1;
-	water_cull_call.instance_count = instance_counts.water;
-	Cull(&water_cull_call, cmdbuf);
-}
-
-void RenderShadow(VkCommandBuffer cmdbuf, BlockInstanceCounts instance_counts) {
-	if (instance_counts.solid == 0) {
-		return;
+// Both uploads behind one barrier, what reads the results is up to the
+// render graph.
+internal void ExecuteCull(VkCommandBuffer cmdbuf, void *data) {
+	FramePasses *frame = (FramePasses *) data;
+	Player *p = frame->player;
+
+	CullCall cull_calls[2] = {};
+
+	CullCall *solid_cull_call = &cull_calls[0];
+	solid_cull_call->instance_buffer = renderer.solid_pass.instance_buffer;
+	solid_cull_call->culled_instance_buffer = renderer.solid_pass.culled_instance_buffer;
+	solid_cull_call->indirect_buffer = renderer.solid_pass.indirect_buffer;
+	solid_cull_call->proj_matrix = p->camera.proj_matrix;
+	solid_cull_call->view_matrix = p->camera.view_matrix;
+	solid_cull_call->desc_set_index = CULL_SOLID;
+	solid_cull_call->instance_count = frame->instance_counts.solid;
+
+	CullCall *water_cull_call = &cull_calls[1];
+	water_cull_call->instance_buffer = renderer.water_pass.instance_buffer;
+	water_cull_call->culled_instance_buffer = renderer.water_pass.culled_instance_buffer;
+	water_cull_call->indirect_buffer = renderer.water_pass.indirect_buffer;
+	water_cull_call->proj_matrix = p->camera.proj_matrix;
+	water_cull_call->view_matrix = p->camera.view_matrix;
+	water_cull_call->desc_set_index = CULL_WATER;
+	water_cull_call->instance_count = frame->instance_counts.water;
+
+	VkBufferMemoryBarrier2 upload_barriers[2 * ArrayCount(cull_calls)];
+	for (u32 i = 0; i < ArrayCount(cull_calls); ++i) {
+		UploadCullCall(&cull_calls[i], &upload_barriers[2 * i], cmdbuf);
 	}
+	PipelineBufferBarriers(cmdbuf, 0, upload_barriers, ArrayCount(upload_barriers));
 
-	VkClearDepthStencilValue depth_clear = { 1.0f, 0 };
+	for (u32 i = 0; i < ArrayCount(cull_calls); ++i) {
+		DispatchCullCall(&cull_calls[i], cmdbuf);
+	}
+}
 
-	VkRenderingAttachmentInfo depth_attachment = {};
-	depth_attachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
-	depth_attachment.imageView = renderer.shadow_pass.shadow_map.image.view;
-	depth_attachment.imageLayout = VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL;
-	depth_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-	depth_attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-	depth_attachment.clearValue.depthStencil = depth_clear;
+internal s32 WrapShadowTile(s32 tile) {
+	return ((tile % SHADOW_TILE_COUNT) + SHADOW_TILE_COUNT) % SHADOW_TILE_COUNT;
+}
 
-	VkRenderingInfo rendering_info = {};
-	rendering_info.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
-	rendering_info.renderArea.extent.width = SHADOW_MAP_WIDTH;
-	rendering_info.renderArea.extent.height = SHADOW_MAP_HEIGHT;
-	rendering_info.layerCount = 1;
-	rendering_info.colorAttachmentCount = 0;
-	rendering_info.pColorAttachments = 0;
-	rendering_info.pDepthAttachment = &depth_attachment;
-	vkCmdBeginRendering(cmdbuf, &rendering_info);
+internal u64 GetShadowSlotBit(s32 tile_x, s32 tile_y) {
+	return u64(1) << (WrapShadowTile(-tile_y - 1) * SHADOW_TILE_COUNT + WrapShadowTile(tile_x));
+}
 
-	VkViewport viewport = {};
-	viewport.width = SHADOW_MAP_WIDTH;
-	viewport.height = SHADOW_MAP_HEIGHT;
-	viewport.maxDepth = 1;
+internal vec2 GetLightSpaceXY(vec3 p) {
+	mat4 *view = &renderer.shadow_pass.light_view;
+	vec3 right = vec3((*view)[0][0], (*view)[1][0], (*view)[2][0]);
+	vec3 up = vec3((*view)[0][1], (*view)[1][1], (*view)[2][1]);
+	return vec2(Dot(p, right), Dot(p, up));
+}
 
-	VkRect2D scissor = {};
-	scissor.extent.width = SHADOW_MAP_WIDTH;
-	scissor.extent.height = SHADOW_MAP_HEIGHT;
+// tiles [x0, x1] x [y0, y1] that are inside the window
+internal void MarkShadowTiles(ShadowCascade *cascade, s32 x0, s32 y0, s32 x1, s32 y1) {
+	x0 = Max(x0, cascade->window_x);
+	y0 = Max(y0, cascade->window_y);
+	x1 = Min(x1, cascade->window_x + SHADOW_TILE_COUNT - 1);
+	y1 = Min(y1, cascade->window_y + SHADOW_TILE_COUNT - 1);
 
-	vkCmdSetViewport(cmdbuf, 0, 1, &viewport);
-	vkCmdSetScissor(cmdbuf, 0, 1, &scissor);
+	for (s32 y = y0; y <= y1; ++y) {
+		for (s32 x = x0; x <= x1; ++x) {
+			cascade->dirty_slots |= GetShadowSlotBit(x, y);
+		}
+	}
+}
+
+internal void MarkChunkShadowTiles(ShadowCascade *cascade, vec3 chunk_pos) {
+	vec2 min = vec2(FLT_MAX, FLT_MAX);
+	vec2 max = vec2(-FLT_MAX, -FLT_MAX);
+	for (u32 i = 0; i < 8; ++i) {
+		vec3 corner = chunk_pos + vec3((i & 1) ? CHUNK_X : 0, (i & 2) ? CHUNK_Y : 0, (i & 4) ? CHUNK_Z : 0);
+		vec2 p = GetLightSpaceXY(corner);
+		min = vec2(Min(min.x, p.x), Min(min.y, p.y));
+		max = vec2(Max(max.x, p.x), Max(max.y, p.y));
+	}
+
+	MarkShadowTiles(cascade, IFloor(min.x / cascade->tile_size), IFloor(min.y / cascade->tile_size),
+		IFloor(max.x / cascade->tile_size), IFloor(max.y / cascade->tile_size));
+}
+
+// in tiles, relative to the window
+struct ShadowTileRect {
+	s32 x;
+	s32 y;
+	s32 width;
+	s32 height;
+};
+
+// The dirty tiles merged into rects that are in one piece in the layer as
+// well, so none of them crosses the row or column where the window wraps.
+internal u32 GatherShadowTileRects(ShadowCascade *cascade, ShadowTileRect *rects) {
+	u32 result = 0;
+
+	// rect that ended in the previous row at each column, -1 for none
+	s32 open[SHADOW_TILE_COUNT];
+	for (s32 x = 0; x < SHADOW_TILE_COUNT; ++x) {
+		open[x] = -1;
+	}
+
+	for (s32 y = 0; y < SHADOW_TILE_COUNT; ++y) {
+		s32 tile_y = cascade->window_y + y;
+		b32 wraps = WrapShadowTile(tile_y) == 0;
+
+		s32 next_open[SHADOW_TILE_COUNT];
+		for (s32 x = 0; x < SHADOW_TILE_COUNT; ++x) {
+			next_open[x] = -1;
+		}
+
+		s32 x = 0;
+		while (x < SHADOW_TILE_COUNT) {
+			if (!(cascade->dirty_slots & GetShadowSlotBit(cascade->window_x + x, tile_y))) {
+				x++;
+				continue;
+			}
 
+			s32 start = x;
+			do {
+				x++;
+			} while (x < SHADOW_TILE_COUNT && WrapShadowTile(cascade->window_x + x) != 0 &&
+				(cascade->dirty_slots & GetShadowSlotBit(cascade->window_x + x, tile_y)));
+
+			s32 above = wraps ? -1 : open[start];
+			if (above >= 0 && rects[above].width == x - start) {
+				rects[above].height++;
+				next_open[start] = above;
+			} else {
+				ShadowTileRect *rect = &rects[result];
+				rect->x = start;
+				rect->y = y;
+				rect->width = x - start;
+				rect->height = 1;
+				next_open[start] = s32(result);
+				result++;
+			}
+		}
+
+		for (s32 i = 0; i < SHADOW_TILE_COUNT; ++i) {
+			open[i] = next_open[i];
+		}
+	}
+
+	return result;
+}
+
+internal mat4 GetShadowTileProjection(ShadowCascade *cascade, ShadowTileRect rect) {
 	ShadowPass *pass = &renderer.shadow_pass;
-	RenderPass *solid_pass = &renderer.solid_pass;
+
+	float left = float(cascade->window_x + rect.x) * cascade->tile_size;
+	float bottom = float(cascade->window_y + rect.y) * cascade->tile_size;
+	float right = left + float(rect.width) * cascade->tile_size;
+	float top = bottom + float(rect.height) * cascade->tile_size;
+
+	return Ortho(left, right, bottom, top, pass->light_near, pass->light_far);
+}
+
+internal void RenderShadowCascade(VkCommandBuffer cmdbuf, u32 index, BlockInstanceCounts instance_counts) {
+	ShadowPass *pass = &renderer.shadow_pass;
+	ShadowCascade *cascade = &pass->cascades[index];
+
+	ShadowTileRect rects[SHADOW_TILE_COUNT * SHADOW_TILE_COUNT];
+	u32 rect_count = GatherShadowTileRects(cascade, rects);
+
+	ShadowTileRect bounds = rects[0];
+	s32 area = rects[0].width * rects[0].height;
+	for (u32 i = 1; i < rect_count; ++i) {
+		s32 x1 = Max(bounds.x + bounds.width, rects[i].x + rects[i].width);
+		s32 y1 = Max(bounds.y + bounds.height, rects[i].y + rects[i].height);
+		bounds.x = Min(bounds.x, rects[i].x);
+		bounds.y = Min(bounds.y, rects[i].y);
+		bounds.width = x1 - bounds.x;
+		bounds.height = y1 - bounds.y;
+		area += rects[i].width * rects[i].height;
+	}
+
+	// Too many rects, or ones that leave little of their bounds clean, are
+	// drawn as the whole bounds instead. Split where the window wraps, that
+	// is at most four rects.
+	if (rect_count > 1 && (rect_count > SHADOW_CULL_RECT_COUNT || 4 * area >= 3 * bounds.width * bounds.height)) {
+		MarkShadowTiles(cascade, cascade->window_x + bounds.x, cascade->window_y + bounds.y,
+			cascade->window_x + bounds.x + bounds.width - 1, cascade->window_y + bounds.y + bounds.height - 1);
+		rect_count = GatherShadowTileRects(cascade, rects);
+		Assert(rect_count <= SHADOW_CULL_RECT_COUNT);
+	}
+
+	// culled against each rect on its own, so none of them draws what only
+	// the others cover
+	CullCall cull_calls[SHADOW_CULL_RECT_COUNT] = {};
+	VkBufferMemoryBarrier2 upload_barriers[2 * SHADOW_CULL_RECT_COUNT];
+	for (u32 i = 0; i < rect_count; ++i) {
+		CullCall *cull_call = &cull_calls[i];
+		cull_call->instance_buffer = renderer.solid_pass.instance_buffer;
+		cull_call->culled_instance_buffer = pass->culled_instance_buffer;
+		cull_call->indirect_buffer = cascade->indirect_buffers[i];
+		cull_call->proj_matrix = GetShadowTileProjection(cascade, rects[i]);
+		cull_call->view_matrix = pass->light_view;
+		cull_call->desc_set_index = CULL_SHADOW + index * SHADOW_CULL_RECT_COUNT + i;
+		cull_call->instance_count = instance_counts.solid;
+
+		UploadCullCall(cull_call, &upload_barriers[2 * i], cmdbuf);
+	}
+	PipelineBufferBarriers(cmdbuf, 0, upload_barriers, 2 * rect_count);
+
 	Pipeline *pipeline = &pass->pipeline;
 	DescriptorSet *desc_set = &pass->desc_set;
-	BindPipeline(pipeline, cmdbuf);
-	BindDescriptorSet(desc_set, pipeline, cmdbuf);
+	BindBuffer(desc_set, 0, &pass->culled_instance_buffer, instance_counts.solid * sizeof(InstanceData), VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+
+	// The rects share the culled buffer, each one is culled, then drawn
+	// before the next culls over it.
+	for (u32 i = 0; i < rect_count; ++i) {
+		ShadowTileRect rect = rects[i];
+		CullCall *cull_call = &cull_calls[i];
+
+		if (i > 0) {
+			VkBufferMemoryBarrier2 culled_barrier = CreateBufferBarrier(pass->culled_instance_buffer.handle,
+				instance_counts.solid * sizeof(InstanceData), VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,
+				VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT);
+			PipelineBufferBarriers(cmdbuf, 0, &culled_barrier, 1);
+		}
 
-	BindBuffer(desc_set, 0, &pass->light_space_buffer, VK_WHOLE_SIZE, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
-	BindBuffer(desc_set, 1, &solid_pass->culled_instance_buffer, instance_counts.solid * sizeof(InstanceData), VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+		DispatchCullCall(cull_call, cmdbuf);
+
+		VkBufferMemoryBarrier2 cull_barriers[] = {
+			CreateBufferBarrier(pass->culled_instance_buffer.handle, instance_counts.solid * sizeof(InstanceData),
+				VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT, VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT,
+				VK_ACCESS_2_SHADER_STORAGE_READ_BIT),
+			CreateBufferBarrier(cull_call->indirect_buffer.handle, sizeof(VkDrawIndirectCommand), VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+				VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT, VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT, VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT),
+		};
+
+		if (i == 0) {
+			// the clean tiles have to survive the transition
+			VkImageMemoryBarrier2 layer_barrier = CreateImageBarrier(pass->shadow_map.image.handle, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+				VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT |
+				VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT, VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+				VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL, VK_IMAGE_ASPECT_DEPTH_BIT);
+			layer_barrier.subresourceRange.baseArrayLayer = index;
+			layer_barrier.subresourceRange.layerCount = 1;
+			PipelineBarriers(cmdbuf, 0, &layer_barrier, 1, cull_barriers, ArrayCount(cull_barriers));
+		} else {
+			// the rects don't overlap, the layer needs no barrier between them
+			PipelineBufferBarriers(cmdbuf, 0, cull_barriers, ArrayCount(cull_barriers));
+		}
 
-	vkCmdDrawIndirect(cmdbuf, solid_pass->indirect_buffer.handle, 0, 1, sizeof(VkDrawIndirectCommand));
+		// the top row of the rect is the first one in the layer
+		VkRect2D scissor = {};
+		scissor.offset.x = WrapShadowTile(cascade->window_x + rect.x) * SHADOW_TILE_SIZE;
+		scissor.offset.y = WrapShadowTile(-(cascade->window_y + rect.y + rect.height - 1) - 1) * SHADOW_TILE_SIZE;
+		scissor.extent.width = u32(rect.width) * SHADOW_TILE_SIZE;
+		scissor.extent.height = u32(rect.height) * SHADOW_TILE_SIZE;
+
+		VkRenderingAttachmentInfo depth_attachment = {};
+		depth_attachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+		depth_attachment.imageView = cascade->layer_view;
+		depth_attachment.imageLayout = VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL;
+		depth_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+		depth_attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+
+		VkRenderingInfo rendering_info = {};
+		rendering_info.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
+		rendering_info.renderArea = scissor;
+		rendering_info.layerCount = 1;
+		rendering_info.colorAttachmentCount = 0;
+		rendering_info.pColorAttachments = 0;
+		rendering_info.pDepthAttachment = &depth_attachment;
+		vkCmdBeginRendering(cmdbuf, &rendering_info);
 
-	vkCmdEndRendering(cmdbuf);
+		BindPipeline(pipeline, cmdbuf);
+		BindDescriptorSet(desc_set, pipeline, cmdbuf);
+
+		VkViewport viewport = {};
+		viewport.x = float(scissor.offset.x);
+		viewport.y = float(scissor.offset.y);
+		viewport.width = float(scissor.extent.width);
+		viewport.height = float(scissor.extent.height);
+		viewport.maxDepth = 1;
+
+		vkCmdSetViewport(cmdbuf, 0, 1, &viewport);
+		vkCmdSetScissor(cmdbuf, 0, 1, &scissor);
+
+		VkClearAttachment clear = {};
+		clear.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+		clear.clearValue.depthStencil = { 1.0f, 0 };
+
+		VkClearRect clear_rect = {};
+		clear_rect.rect = scissor;
+		clear_rect.layerCount = 1;
+		vkCmdClearAttachments(cmdbuf, 1, &clear, 1, &clear_rect);
+
+		mat4 light_space_matrix = cull_call->proj_matrix * pass->light_view;
+		vkCmdPushConstants(cmdbuf, pipeline->layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(mat4), &light_space_matrix);
+
+		vkCmdDrawIndirect(cmdbuf, cull_call->indirect_buffer.handle, 0, 1, sizeof(VkDrawIndirectCommand));
+
+		vkCmdEndRendering(cmdbuf);
+	}
+
+	// read by the main passes, and by the moments filter right after
+	VkImageMemoryBarrier2 layer_barrier = CreateImageBarrier(pass->shadow_map.image.handle, VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+		VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT |
+		VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_ASPECT_DEPTH_BIT);
+	layer_barrier.subresourceRange.baseArrayLayer = index;
+	layer_barrier.subresourceRange.layerCount = 1;
+
+	// the next cascade culls into the same buffer this one just drew from
+	VkBufferMemoryBarrier2 culled_barrier = CreateBufferBarrier(pass->culled_instance_buffer.handle, instance_counts.solid * sizeof(InstanceData),
+		VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT);
+
+	PipelineImageBarriers(cmdbuf, 0, &layer_barrier, 1);
+	PipelineBufferBarriers(cmdbuf, 0, &culled_barrier, 1);
+
+	cascade->dirty_slots = 0;
+	cascade->rendered = 1;
+	cascade->moments_stale = 1;
+}
+
+// Whole layer at once, the blur reaches across tile borders and the window
+// wraps around just like the depth does.
+internal void FilterShadowMoments(VkCommandBuffer cmdbuf, u32 index) {
+	ShadowPass *pass = &renderer.shadow_pass;
+
+	BindPipeline(&pass->blur_pipeline, cmdbuf);
+	BindDescriptorSet(&pass->blur_desc_set, &pass->blur_pipeline, cmdbuf);
+
+	u32 group_count_x = SHADOW_MOMENTS_WIDTH / 8;
+	u32 group_count_y = SHADOW_MOMENTS_HEIGHT / 8;
+
+	// the previous cascade's vertical pass may still be reading it
+	VkImageMemoryBarrier2 blur_barrier = CreateImageBarrier(pass->moments_blur.handle, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+		VK_ACCESS_2_SHADER_READ_BIT, VK_IMAGE_LAYOUT_GENERAL, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_WRITE_BIT,
+		VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_ASPECT_COLOR_BIT);
+	PipelineImageBarriers(cmdbuf, 0, &blur_barrier, 1);
+
+	ShadowBlurConstants constants = { index, 0, pass->evsm_exponents };
+	vkCmdPushConstants(cmdbuf, pass->blur_pipeline.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+	vkCmdDispatch(cmdbuf, group_count_x, group_count_y, 1);
+
+	blur_barrier = CreateImageBarrier(pass->moments_blur.handle, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_WRITE_BIT,
+		VK_IMAGE_LAYOUT_GENERAL, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_READ_BIT, VK_IMAGE_LAYOUT_GENERAL,
+		VK_IMAGE_ASPECT_COLOR_BIT);
+	PipelineImageBarriers(cmdbuf, 0, &blur_barrier, 1);
+
+	constants.vertical = 1;
+	vkCmdPushConstants(cmdbuf, pass->blur_pipeline.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+	vkCmdDispatch(cmdbuf, group_count_x, group_count_y, 1);
+
+	VkImageMemoryBarrier2 layer_barrier = CreateImageBarrier(pass->moments.image.handle, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+		VK_ACCESS_2_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,
+		VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_ASPECT_COLOR_BIT);
+	layer_barrier.subresourceRange.baseArrayLayer = index;
+	layer_barrier.subresourceRange.layerCount = 1;
+	PipelineImageBarriers(cmdbuf, 0, &layer_barrier, 1);
+
+	pass->cascades[index].moments_stale = 0;
+}
+
+// Leaves every layer it touched readable by the fragment shader, the render
+// graph doesn't see the shadow map.
+internal void ExecuteShadow(VkCommandBuffer cmdbuf, void *data) {
+	FramePasses *frame = (FramePasses *) data;
+	BlockInstanceCounts instance_counts = frame->instance_counts;
+	ShadowPass *pass = &renderer.shadow_pass;
+
+	vec3 changed_chunks[CHANGED_CHUNKS_MAX];
+	u32 changed_count = TakeChangedChunks(changed_chunks, CHANGED_CHUNKS_MAX);
+
+	for (u32 i = 0; i < SHADOW_CASCADE_COUNT; ++i) {
+		ShadowCascade *cascade = &pass->cascades[i];
+		if (changed_count > CHANGED_CHUNKS_MAX) {
+			cascade->dirty_slots = max_u64;
+			continue;
+		}
+
+		for (u32 c = 0; c < changed_count; ++c) {
+			MarkChunkShadowTiles(cascade, changed_chunks[c]);
+		}
+	}
+
+	if (instance_counts.solid == 0) {
+		return;
+	}
+
+	for (u32 i = 0; i < SHADOW_CASCADE_COUNT; ++i) {
+		ShadowCascade *cascade = &pass->cascades[i];
+
+		// PCF leaves the moments alone, switching over catches them all up
+		// right away
+		b32 draw = cascade->due && cascade->dirty_slots;
+		b32 filter = pass->mode == SHADOW_MODE_EVSM && (draw || cascade->moments_stale);
+		if (!draw && !filter) {
+			continue;
+		}
+
+		GPU_ZONE(cmdbuf, cascade_zone_names[i]);
+		if (draw) {
+			RenderShadowCascade(cmdbuf, i, instance_counts);
+		}
+		if (filter) {
+			GPU_ZONE(cmdbuf, "evsm filter");
+			FilterShadowMoments(cmdbuf, i);
+		}
+	}
+}
+
+void SetDepthPrepass(b32 enabled) {
+	renderer.depth_prepass.enabled = b8(enabled);
+}
+
+void SetShadowMode(u32 mode) {
+	Assert(mode < SHADOW_MODE_COUNT);
+	renderer.shadow_pass.mode = mode;
+}
+
+u32 GetShadowMode() {
+	return renderer.shadow_pass.mode;
+}
+
+const char *GetShadowModeName(u32 mode) {
+	Assert(mode < SHADOW_MODE_COUNT);
+	return shadow_mode_names[mode];
+}
+
+void SetRenderScale(float scale) {
+	renderer.render_scale = Clamp(scale, RENDER_SCALE_MIN, 1.0f);
+}
+
+float GetRenderScale() {
+	return renderer.render_scale;
+}
+
+void UpdateRenderScale(float gpu_ms, float budget_ms) {
+	if (budget_ms <= 0.0f || gpu_ms <= 0.0f) {
+		return;
+	}
+
+	float load = gpu_ms / budget_ms;
+	if (load <= 1.0f && load >= render_scale_hold) {
+		return;
+	}
+
+	// most of the frame is paid per pixel, so it goes with the scale squared
+	float scale = renderer.render_scale;
+	float wanted = scale * SquareRoot(render_scale_target / load);
+	float step = Clamp(wanted - scale, -render_scale_step_down, render_scale_step_up);
+
+	SetRenderScale(scale + step);
 }
 
-void Render(Swapchain *swapchain, VkImageView color_view, VkImageView depth_view, VkCommandBuffer cmdbuf,
+internal VkExtent2D GetRenderExtent(u32 width, u32 height) {
+	VkExtent2D result = {};
+
+	result.width = Max(u32(float(width) * renderer.render_scale + 0.5f), 1u);
+	result.height = Max(u32(float(height) * renderer.render_scale + 0.5f), 1u);
+
+	return result;
+}
+
+internal void Render(Swapchain *swapchain, VkImageView color_view, VkImageView depth_view, VkCommandBuffer cmdbuf,
 	BlockInstanceCounts instance_counts, float time) {
 	VkClearColorValue clear_color = {};
 	VkClearDepthStencilValue depth_clear = { 1.0f, 0 };
@@ -431,10 +1118,11 @@ void Render(Swapchain *swapchain, VkImageView color_view, VkImageView depth_view
 	depth_attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
 	depth_attachment.clearValue.depthStencil = depth_clear;
 
+	VkExtent2D extent = GetRenderExtent(swapchain->width, swapchain->height);
+
 	VkRenderingInfo rendering_info = {};
 	rendering_info.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
-	rendering_info.renderArea.extent.width = swapchain->width;
-	rendering_info.renderArea.extent.height = swapchain->height;
+	rendering_info.renderArea.extent = extent;
 	rendering_info.layerCount = 1;
 	rendering_info.colorAttachmentCount = 1;
 	rendering_info.pColorAttachments = &color_attachment;
@@ -442,19 +1130,46 @@ void Render(Swapchain *swapchain, VkImageView color_view, VkImageView depth_view
 	vkCmdBeginRendering(cmdbuf, &rendering_info);
 
 	VkViewport viewport = {};
-	viewport.width = float(swapchain->width);
-	viewport.height = float(swapchain->height);
+	viewport.width = float(extent.width);
+	viewport.height = float(extent.height);
 	viewport.maxDepth = 1;
 
 	VkRect2D scissor = {};
-	scissor.extent.width = swapchain->width;
-	scissor.extent.height = swapchain->height;
+	scissor.extent = extent;
 
 	vkCmdSetViewport(cmdbuf, 0, 1, &viewport);
 	vkCmdSetScissor(cmdbuf, 0, 1, &scissor);
 
+	DepthPrepass *prepass = &renderer.depth_prepass;
+	b32 prepass_solid = prepass->enabled && instance_counts.solid > 0;
+
+	if (instance_counts.solid > 0) {
+		RenderPass *pass = &renderer.solid_pass;
+		DescriptorSet *desc_set = &pass->desc_set;
+
+		// written once up front, the prepass reads the same set
+		BindBuffer(desc_set, 0, &renderer.globals_buffer, VK_WHOLE_SIZE, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
+		BindBuffer(desc_set, 1, &pass->culled_instance_buffer, instance_counts.solid * sizeof(InstanceData), VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+		BindTexture(desc_set, 2, renderer.block_textures);
+		BindTexture(desc_set, 3, renderer.shadow_pass.shadow_map);
+		BindTexture(desc_set, 4, renderer.noise_texture);
+		BindTexture(desc_set, 5, renderer.shadow_pass.moments);
+	}
+
+	if (prepass_solid) {
+		GPU_ZONE(cmdbuf, "depth prepass");
+
+		RenderPass *pass = &renderer.solid_pass;
+		BindPipeline(&prepass->pipeline, cmdbuf);
+		BindDescriptorSet(&pass->desc_set, &prepass->pipeline, cmdbuf);
+
+		vkCmdDrawIndirect(cmdbuf, pass->indirect_buffer.handle, 0, 1, sizeof(VkDrawIndirectCommand));
+	}
+
 	// sky
 	{
+		GPU_ZONE(cmdbuf, "sky");
+
 		RenderPass *pass = &renderer.sky_pass;
 		Pipeline *pipeline = &pass->pipeline;
 		DescriptorSet *desc_set = &pass->desc_set;
@@ -467,22 +1182,20 @@ void Render(Swapchain *swapchain, VkImageView color_view, VkImageView depth_view
 	}
 
 	if (instance_counts.solid > 0) {
+		GPU_ZONE(cmdbuf, "solid");
+
+		// only the visible fragments pass the EQUAL compare after the prepass
 		RenderPass *pass = &renderer.solid_pass;
-		Pipeline *pipeline = &pass->pipeline;
-		DescriptorSet *desc_set = &pass->desc_set;
+		Pipeline *pipeline = prepass_solid ? &prepass->solid_pipeline : &pass->pipeline;
 		BindPipeline(pipeline, cmdbuf);
-		BindDescriptorSet(desc_set, pipeline, cmdbuf);
-
-		BindBuffer(desc_set, 0, &renderer.globals_buffer, VK_WHOLE_SIZE, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
-		BindBuffer(desc_set, 1, &pass->culled_instance_buffer, instance_counts.solid * sizeof(InstanceData), VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
-		BindTextureArray(desc_set, 2, &renderer.textures);
-		BindTexture(desc_set, 3, renderer.shadow_pass.shadow_map);
-		BindTexture(desc_set, 4, renderer.noise_texture);
+		BindDescriptorSet(&pass->desc_set, pipeline, cmdbuf);
 
 		vkCmdDrawIndirect(cmdbuf, pass->indirect_buffer.handle, 0, 1, sizeof(VkDrawIndirectCommand));
 	}
 
 	if (instance_counts.water > 0) {
+		GPU_ZONE(cmdbuf, "water");
+
 		RenderPass *pass = &renderer.water_pass;
 		Pipeline *pipeline = &pass->pipeline;
 		DescriptorSet *desc_set = &pass->desc_set;
@@ -495,6 +1208,7 @@ void Render(Swapchain *swapchain, VkImageView color_view, VkImageView depth_view
 		BindTexture(desc_set, 3, renderer.noise_texture);
 		BindTexture(desc_set, 4, renderer.water_texture1);
 		BindTexture(desc_set, 5, renderer.water_texture2);
+		BindTexture(desc_set, 6, renderer.shadow_pass.moments);
 
 		vkCmdPushConstants(cmdbuf, pipeline->layout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(float), &time);
 
@@ -504,25 +1218,18 @@ void Render(Swapchain *swapchain, VkImageView color_view, VkImageView depth_view
 	vkCmdEndRendering(cmdbuf);
 }
 
-void DoPostprocessing(Swapchain *swapchain, Texture render_target, Image swapchain_target, VkCommandBuffer cmdbuf) {
-	Postprocess *post = &renderer.post_process;
-	BindPipeline(&post->pipeline, cmdbuf);
-	BindDescriptorSet(&post->desc_set, &post->pipeline, cmdbuf);
-
-	VkClearColorValue clear_color = { 0.0f, 0.0f, 0.0f, 1.0f };
-
+internal void BeginFullscreenPass(VkCommandBuffer cmdbuf, VkImageView target, u32 width, u32 height) {
 	VkRenderingAttachmentInfo color_attachment = {};
 	color_attachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
-	color_attachment.imageView = swapchain_target.view;
+	color_attachment.imageView = target;
 	color_attachment.imageLayout = VK_IMAGE_LAYOUT_ATTACHMENT_OPTIMAL;
-	color_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+	color_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 	color_attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-	color_attachment.clearValue.color = clear_color;
 
 	VkRenderingInfo rendering_info = {};
 	rendering_info.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
-	rendering_info.renderArea.extent.width = swapchain->width;
-	rendering_info.renderArea.extent.height = swapchain->height;
+	rendering_info.renderArea.extent.width = width;
+	rendering_info.renderArea.extent.height = height;
 	rendering_info.layerCount = 1;
 	rendering_info.colorAttachmentCount = 1;
 	rendering_info.pColorAttachments = &color_attachment;
@@ -530,40 +1237,303 @@ void DoPostprocessing(Swapchain *swapchain, Texture render_target, Image swapcha
 	vkCmdBeginRendering(cmdbuf, &rendering_info);
 
 	VkViewport viewport = {};
-	viewport.width = float(swapchain->width);
-	viewport.height = float(swapchain->height);
+	viewport.width = float(width);
+	viewport.height = float(height);
 	viewport.maxDepth = 1;
 
 	VkRect2D scissor = {};
-	scissor.extent.width = swapchain->width;
-	scissor.extent.height = swapchain->height;
+	scissor.extent.width = width;
+	scissor.extent.height = height;
 
 	vkCmdSetViewport(cmdbuf, 0, 1, &viewport);
 	vkCmdSetScissor(cmdbuf, 0, 1, &scissor);
+}
+
+// Every dispatch waits for the one before, they all work on the one image.
+internal void RenderBloom(Postprocess *post, RenderScaleConstants scale, VkCommandBuffer cmdbuf) {
+	BindPipeline(&post->bloom_pipeline, cmdbuf);
+
+	VkImageMemoryBarrier2 chain_barrier = CreateImageBarrier(post->bloom.image.handle, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+		VK_ACCESS_2_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+		VK_ACCESS_2_SHADER_READ_BIT | VK_ACCESS_2_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_ASPECT_COLOR_BIT);
+
+	for (u32 dispatch = 0; dispatch < BLOOM_DISPATCH_COUNT; ++dispatch) {
+		u32 mode = BLOOM_MODE_DOWNSAMPLE;
+		u32 mip = dispatch;
+		if (dispatch == 0) {
+			mode = BLOOM_MODE_PREFILTER;
+		} else if (dispatch >= BLOOM_MIP_COUNT) {
+			mode = BLOOM_MODE_UPSAMPLE;
+			mip = BLOOM_DISPATCH_COUNT - 1 - dispatch;
+		}
+
+		if (dispatch > 0) {
+			PipelineImageBarriers(cmdbuf, 0, &chain_barrier, 1);
+		}
+
+		BloomConstants constants = {};
+		constants.scale = scale;
+		constants.mode = mode;
+
+		BindDescriptorSet(&post->bloom_desc_sets[dispatch], &post->bloom_pipeline, cmdbuf);
+		vkCmdPushConstants(cmdbuf, post->bloom_pipeline.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+
+		u32 width = GetBloomMipSize(post->width, mip);
+		u32 height = GetBloomMipSize(post->height, mip);
+		vkCmdDispatch(cmdbuf, (width + 7) / 8, (height + 7) / 8, 1);
+	}
+}
+
+// The frame's targets are read through the bloom's sampler, the upscale
+// needs them filtered.
+internal Texture GetTargetTexture(Image image) {
+	Texture result = {};
+
+	result.image = image;
+	result.descriptor.sampler = renderer.post_process.bloom.descriptor.sampler;
+	result.descriptor.imageView = image.view;
+	result.descriptor.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 
-	BindTexture(&post->desc_set, 0, render_target);
+	return result;
+}
+
+internal RenderScaleConstants GetRenderScaleConstants(u32 width, u32 height) {
+	RenderScaleConstants result = {};
+
+	VkExtent2D extent = GetRenderExtent(width, height);
+	result.uv_scale = vec2(float(extent.width) / float(width), float(extent.height) / float(height));
+	result.uv_max = vec2((float(extent.width) - 0.5f) / float(width), (float(extent.height) - 0.5f) / float(height));
+
+	return result;
+}
+
+internal void ExecuteMain(VkCommandBuffer cmdbuf, void *data) {
+	FramePasses *frame = (FramePasses *) data;
+
+	Image color_target = GetRenderGraphImage(&renderer.graph, frame->hdr_target);
+	Image depth_target = GetRenderGraphImage(&renderer.graph, frame->depth_target);
+	Render(frame->swapchain, color_target.view, depth_target.view, cmdbuf, frame->instance_counts, frame->time);
+}
+
+internal void ExecuteBloom(VkCommandBuffer cmdbuf, void *data) {
+	FramePasses *frame = (FramePasses *) data;
+	Postprocess *post = &renderer.post_process;
+
+	Texture hdr_source = GetTargetTexture(GetRenderGraphImage(&renderer.graph, frame->hdr_target));
+	BindBloomDispatch(post, 0, hdr_source, 0);
+
+	RenderBloom(post, frame->scale, cmdbuf);
+}
+
+internal void ExecuteTonemap(VkCommandBuffer cmdbuf, void *data) {
+	FramePasses *frame = (FramePasses *) data;
+	Postprocess *post = &renderer.post_process;
+
+	BindTexture(&post->desc_set, 0, GetTargetTexture(GetRenderGraphImage(&renderer.graph, frame->hdr_target)));
+
+	BeginFullscreenPass(cmdbuf, GetRenderGraphImage(&renderer.graph, frame->ldr_target).view, post->width, post->height);
+	BindPipeline(&post->pipeline, cmdbuf);
+	BindDescriptorSet(&post->desc_set, &post->pipeline, cmdbuf);
+	vkCmdPushConstants(cmdbuf, post->pipeline.layout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(frame->scale), &frame->scale);
 	vkCmdDraw(cmdbuf, 6, 1, 0, 0);
+	vkCmdEndRendering(cmdbuf);
+}
 
+internal void ExecuteFxaa(VkCommandBuffer cmdbuf, void *data) {
+	FramePasses *frame = (FramePasses *) data;
+	Postprocess *post = &renderer.post_process;
+
+	BindTexture(&post->fxaa_desc_set, 0, GetTargetTexture(GetRenderGraphImage(&renderer.graph, frame->ldr_target)));
+
+	BeginFullscreenPass(cmdbuf, GetRenderGraphImage(&renderer.graph, frame->present_target).view, post->width, post->height);
+	BindPipeline(&post->fxaa_pipeline, cmdbuf);
+	BindDescriptorSet(&post->fxaa_desc_set, &post->fxaa_pipeline, cmdbuf);
+	vkCmdDraw(cmdbuf, 6, 1, 0, 0);
 	vkCmdEndRendering(cmdbuf);
 }
 
-internal mat4 UploadLightSpaceTransform(Player *p, VkCommandBuffer cmdbuf) {
-	const float shadow_dist = 50.0f;
-	const float shadow_range = 120.0f;
+void RenderFrame(Swapchain *swapchain, Player *p, BlockInstanceCounts instance_counts, float time, VkCommandBuffer cmdbuf) {
+	RenderGraph *graph = &renderer.graph;
+	FramePasses *frame = &renderer.frame;
+	Postprocess *post = &renderer.post_process;
+	Assert(post->width == swapchain->width && post->height == swapchain->height);
+
+	frame->swapchain = swapchain;
+	frame->player = p;
+	frame->instance_counts = instance_counts;
+	frame->time = time;
+	frame->scale = GetRenderScaleConstants(post->width, post->height);
+
+	BeginRenderGraph(graph);
+
+	// the uploads wrote these ahead of the graph
+	RenderResource solid_instances = ImportBuffer(graph, "solid instances", renderer.solid_pass.instance_buffer.handle,
+		VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT);
+	RenderResource water_instances = ImportBuffer(graph, "water instances", renderer.water_pass.instance_buffer.handle,
+		VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT);
+	RenderResource globals = ImportBuffer(graph, "globals", renderer.globals_buffer.handle,
+		VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT);
+	RenderResource sky = ImportBuffer(graph, "sky", renderer.sky_buffer.handle, VK_PIPELINE_STAGE_2_TRANSFER_BIT,
+		VK_ACCESS_2_TRANSFER_WRITE_BIT);
+
+	RenderResource solid_culled = ImportBuffer(graph, "solid culled", renderer.solid_pass.culled_instance_buffer.handle, 0, 0);
+	RenderResource solid_indirect = ImportBuffer(graph, "solid indirect", renderer.solid_pass.indirect_buffer.handle, 0, 0);
+	RenderResource water_culled = ImportBuffer(graph, "water culled", renderer.water_pass.culled_instance_buffer.handle, 0, 0);
+	RenderResource water_indirect = ImportBuffer(graph, "water indirect", renderer.water_pass.indirect_buffer.handle, 0, 0);
+
+	RenderResource bloom = ImportImage(graph, "bloom", post->bloom.image, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_GENERAL, 0, 0);
+	frame->present_target = ImportImage(graph, "present", GetSwapchainTarget(swapchain), VK_IMAGE_ASPECT_COLOR_BIT,
+		VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, 0);
+
+	// the depth is done before the ldr target is needed, the two share memory
+	frame->hdr_target = CreateTransientImage(graph, "hdr", post->width, post->height, renderer.color_format,
+		VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_IMAGE_ASPECT_COLOR_BIT);
+	frame->depth_target = CreateTransientImage(graph, "depth", post->width, post->height, renderer.depth_format,
+		VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_IMAGE_ASPECT_DEPTH_BIT);
+	frame->ldr_target = CreateTransientImage(graph, "ldr", post->width, post->height, VK_FORMAT_R8G8B8A8_UNORM,
+		VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_IMAGE_ASPECT_COLOR_BIT);
+
+	u32 pass = AddRenderPass(graph, "cull", ExecuteCull, frame);
+	ReadBuffer(graph, pass, solid_instances, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT);
+	ReadBuffer(graph, pass, water_instances, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT);
+	WriteBuffer(graph, pass, solid_culled, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT);
+	WriteBuffer(graph, pass, water_culled, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT);
+	// reset by a transfer, then counted up by the shader
+	WriteBuffer(graph, pass, solid_indirect, VK_PIPELINE_STAGE_2_TRANSFER_BIT | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+		VK_ACCESS_2_TRANSFER_WRITE_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT);
+	WriteBuffer(graph, pass, water_indirect, VK_PIPELINE_STAGE_2_TRANSFER_BIT | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+		VK_ACCESS_2_TRANSFER_WRITE_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT);
+
+	pass = AddRenderPass(graph, "shadow", ExecuteShadow, frame);
+	ReadBuffer(graph, pass, solid_instances, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT);
+
+	pass = AddRenderPass(graph, "main", ExecuteMain, frame);
+	ReadBuffer(graph, pass, globals, VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT,
+		VK_ACCESS_2_UNIFORM_READ_BIT);
+	ReadBuffer(graph, pass, sky, VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT, VK_ACCESS_2_UNIFORM_READ_BIT);
+	ReadBuffer(graph, pass, solid_culled, VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT);
+	ReadBuffer(graph, pass, water_culled, VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT);
+	ReadBuffer(graph, pass, solid_indirect, VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT, VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT);
+	ReadBuffer(graph, pass, water_indirect, VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT, VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT);
+	WriteImage(graph, pass, frame->hdr_target, VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+		VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_ATTACHMENT_OPTIMAL);
+	WriteImage(graph, pass, frame->depth_target, VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+		VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_ATTACHMENT_OPTIMAL);
+
+	pass = AddRenderPass(graph, "bloom", ExecuteBloom, frame);
+	ReadImage(graph, pass, frame->hdr_target, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT,
+		VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+	WriteImage(graph, pass, bloom, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT |
+		VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL);
+
+	pass = AddRenderPass(graph, "tonemap", ExecuteTonemap, frame);
+	ReadImage(graph, pass, frame->hdr_target, VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT,
+		VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+	ReadImage(graph, pass, bloom, VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT, VK_IMAGE_LAYOUT_GENERAL);
+	WriteImage(graph, pass, frame->ldr_target, VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT,
+		VK_IMAGE_LAYOUT_ATTACHMENT_OPTIMAL);
+
+	pass = AddRenderPass(graph, "fxaa", ExecuteFxaa, frame);
+	ReadImage(graph, pass, frame->ldr_target, VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT,
+		VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+	WriteImage(graph, pass, frame->present_target, VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT,
+		VK_IMAGE_LAYOUT_ATTACHMENT_OPTIMAL);
+
+	ExecuteRenderGraph(graph, cmdbuf);
+}
 
-	vec3 player_eye = GetEyePos(p);
+// Bounding sphere of the camera frustum slice, so the cascade's size doesn't
+// change when the camera turns. The window is the run of tiles covering it,
+// and being on the tile grid keeps it on whole texels too.
+internal void FitShadowCascade(ShadowCascade *cascade, Camera *c, vec3 eye, float near, float far) {
+	vec3 up = vec3(0, 1, 0);
+	vec3 right = Normalize(Cross(c->front, up));
+	vec3 cam_up = Cross(right, c->front);
+
+	float tan_x = 1.0f / c->proj_matrix[0][0];
+	float tan_y = -1.0f / c->proj_matrix[1][1];
+
+	vec3 corners[8];
+	vec3 center = vec3(0, 0, 0);
+	for (u32 i = 0; i < 8; ++i) {
+		float d = (i & 4) ? far : near;
+		float sx = (i & 1) ? 1.0f : -1.0f;
+		float sy = (i & 2) ? 1.0f : -1.0f;
+
+		corners[i] = eye + c->front * d + right * (sx * d * tan_x) + cam_up * (sy * d * tan_y);
+		center += corners[i];
+	}
+	center = center / 8.0f;
 
-	vec3 light_dir = Normalize(vec3(-1.0f, -1.0f, -1.0f));
-	vec3 light_pos = player_eye - light_dir * shadow_dist;
-	mat4 light_view = LookAt(light_pos, player_eye, vec3(0, 1, 0));
-	mat4 light_proj = Ortho(-shadow_range, shadow_range, -shadow_range, shadow_range, 0.1f, 1000.0f);
-	mat4 light_vp = light_proj * light_view;
+	float radius = 0.0f;
+	for (u32 i = 0; i < 8; ++i) {
+		radius = Max(radius, Length(corners[i] - center));
+	}
+
+	// padding for the frames a far cascade goes without an update
+	radius = float(ICeil(radius)) + 4.0f;
+
+	// wherever the sphere sits in the grid SHADOW_TILE_COUNT tiles cover it
+	float tile_size = 2.0f * radius / float(SHADOW_TILE_COUNT - 1);
+	vec2 center_ls = GetLightSpaceXY(center);
+	s32 window_x = IFloor((center_ls.x - radius) / tile_size);
+	s32 window_y = IFloor((center_ls.y - radius) / tile_size);
+
+	if (tile_size != cascade->tile_size) {
+		cascade->dirty_slots = max_u64;
+	} else if (window_x != cascade->window_x || window_y != cascade->window_y) {
+		// tiles that scrolled in take the slots of the ones that scrolled out
+		for (s32 y = window_y; y < window_y + SHADOW_TILE_COUNT; ++y) {
+			for (s32 x = window_x; x < window_x + SHADOW_TILE_COUNT; ++x) {
+				b32 was_inside = x >= cascade->window_x && x < cascade->window_x + SHADOW_TILE_COUNT &&
+					y >= cascade->window_y && y < cascade->window_y + SHADOW_TILE_COUNT;
+				if (!was_inside) {
+					cascade->dirty_slots |= GetShadowSlotBit(x, y);
+				}
+			}
+		}
+	}
+
+	cascade->tile_size = tile_size;
+	cascade->window_x = window_x;
+	cascade->window_y = window_y;
 
-	UpdateRendererBuffer(renderer.shadow_pass.light_space_buffer, sizeof(mat4), &light_vp, cmdbuf);
-	return light_vp;
+	ShadowTileRect window = { 0, 0, SHADOW_TILE_COUNT, SHADOW_TILE_COUNT };
+	cascade->light_proj = GetShadowTileProjection(cascade, window);
 }
 
-internal void UploadPlayerCameraMatrices(Player *p, mat4 light_space_matrix, VkCommandBuffer cmdbuf) {
+internal void UpdateShadowCascades(Player *p) {
+	ShadowPass *pass = &renderer.shadow_pass;
+	Camera *c = &p->camera;
+
+	vec3 eye = GetEyePos(p);
+
+	// z of the projection is near * far / (near - far) over far / (near - far)
+	float near = c->proj_matrix[3][2] / c->proj_matrix[2][2];
+
+	float prev_split = near;
+	for (u32 i = 0; i < SHADOW_CASCADE_COUNT; ++i) {
+		ShadowCascade *cascade = &pass->cascades[i];
+
+		float t = float(i + 1) / float(SHADOW_CASCADE_COUNT);
+		float log_split = near * Power(shadow_distance / near, t);
+		float uniform_split = near + (shadow_distance - near) * t;
+		float split = Lerp(uniform_split, log_split, cascade_split_lambda);
+
+		u32 interval = cascade_update_interval[i];
+		cascade->due = !cascade->rendered || pass->frame_index % interval == cascade_update_phase[i];
+		if (cascade->due) {
+			FitShadowCascade(cascade, c, eye, prev_split, split);
+			cascade->split = split;
+		}
+
+		prev_split = split;
+	}
+
+	pass->frame_index++;
+}
+
+internal void UploadPlayerCameraMatrices(Player *p, VkCommandBuffer cmdbuf) {
 	Camera *c = &p->camera;
 
 	vec3 pos = GetEyePos(p);
@@ -571,7 +1541,19 @@ internal void UploadPlayerCameraMatrices(Player *p, mat4 light_space_matrix, VkC
 
 	c->view_matrix = view_matrix;
 
-	Globals globals = { c->proj_matrix, view_matrix, light_space_matrix, pos };
+	Globals globals = {};
+	globals.proj_matrix = c->proj_matrix;
+	globals.view_matrix = view_matrix;
+	for (u32 i = 0; i < SHADOW_CASCADE_COUNT; ++i) {
+		ShadowCascade *cascade = &renderer.shadow_pass.cascades[i];
+		globals.light_space_matrices[i] = cascade->light_proj * renderer.shadow_pass.light_view;
+		globals.cascade_splits[i] = cascade->split;
+		globals.shadow_window_offsets[i] = vec4(float(WrapShadowTile(cascade->window_x)) / SHADOW_TILE_COUNT,
+			float(WrapShadowTile(-cascade->window_y)) / SHADOW_TILE_COUNT, 0.0f, 0.0f);
+	}
+	globals.camera_pos = pos;
+	globals.shadow_mode = renderer.shadow_pass.mode;
+	globals.evsm_exponents = renderer.shadow_pass.evsm_exponents;
     UpdateRendererBuffer(renderer.globals_buffer, sizeof(globals), &globals, cmdbuf);
 
 	SkyUniform sky_uniform = { Inverse(c->proj_matrix), Inverse(view_matrix), pos };
@@ -579,168 +1561,34 @@ internal void UploadPlayerCameraMatrices(Player *p, mat4 light_space_matrix, VkC
 }
 
 void UploadTransformations(Player *p, VkCommandBuffer cmdbuf) {
-	mat4 light_vp = UploadLightSpaceTransform(p, cmdbuf);
-	UploadPlayerCameraMatrices(p, light_vp, cmdbuf);
+	UpdateShadowCascades(p);
+	UploadPlayerCameraMatrices(p, cmdbuf);
 }
 
-BlockInstanceCounts UpdateBlockInstances(VkCommandBuffer cmdbuf, BlockInstanceCounts prev_instance_counts) {
-	if (!AnyChunkDirty()) {
-		return prev_instance_counts;
-	}
-
-	ResetChunkDirtiness();
-
-	for (int cx = 0; cx < WORLD_CHUNK_COUNT_X; ++cx) {
-		for (int cz = 0; cz < WORLD_CHUNK_COUNT_Z; ++cz) {
-			for (int cy = 0; cy < WORLD_CHUNK_COUNT_Y; ++cy) {
-				Chunk *c = GetChunk(cx, cy, cz);
-				if (!c->dirty) continue;
-
-				// pass 1 - count instances
-				u32 chunk_instance_count = 0;
-				u32 chunk_water_instance_count = 0;
-				for (int x = 0; x < CHUNK_X; ++x) {
-					int wx = c->world_pos.x + x;
-					for (int z = 0; z < CHUNK_Z; ++z) {
-						int wz = c->world_pos.z + z;
-						for (int y = 0; y < CHUNK_Y; ++y) {
-							int wy = c->world_pos.y + y;
-							Block b = c->blocks[x][z][y];
-
-							if (b == BLOCK_AIR) continue;
-
-							if (b != BLOCK_WATER) {
-								if (GetBlock(wx, wy + 1, wz) <= BLOCK_WATER) chunk_instance_count++;
-								if (GetBlock(wx, wy - 1, wz) <= BLOCK_WATER) chunk_instance_count++;
-								if (GetBlock(wx - 1, wy, wz) <= BLOCK_WATER) chunk_instance_count++;
-								if (GetBlock(wx + 1, wy, wz) <= BLOCK_WATER) chunk_instance_count++;
-								if (GetBlock(wx, wy, wz + 1) <= BLOCK_WATER) chunk_instance_count++;
-								if (GetBlock(wx, wy, wz - 1) <= BLOCK_WATER) chunk_instance_count++;
-							} else {
-								if (GetBlock(wx, wy + 1, wz) != BLOCK_WATER) chunk_water_instance_count++;
-								if (GetBlock(wx, wy - 1, wz) != BLOCK_WATER) chunk_water_instance_count++;
-								if (GetBlock(wx - 1, wy, wz) != BLOCK_WATER) chunk_water_instance_count++;
-								if (GetBlock(wx + 1, wy, wz) != BLOCK_WATER) chunk_water_instance_count++;
-								if (GetBlock(wx, wy, wz + 1) != BLOCK_WATER) chunk_water_instance_count++;
-								if (GetBlock(wx, wy, wz - 1) != BLOCK_WATER) chunk_water_instance_count++;
-							}
-						}
-					}
-				}
+BlockInstanceCounts UpdateBlockInstances(VkCommandBuffer cmdbuf, BlockInstanceCounts prev_instance_counts, b32 meshes_changed) {
+	PROFILE_FUNCTION();
 
-				if (!c->cached_instance_data) {
-					c->cached_instance_data = (InstanceData *) HeapAlloc(
-						(chunk_instance_count + chunk_water_instance_count) * sizeof(InstanceData));
-				} else {
-					c->cached_instance_data =
-						(InstanceData *) HeapRealloc(c->cached_instance_data,
-							(chunk_instance_count + chunk_water_instance_count) * sizeof(InstanceData));
-				}
-				c->instance_count = chunk_instance_count;
-				c->water_instance_count = chunk_water_instance_count;
-
-				// pass 2 - fill instance data cache
-				u32 idx = 0;
-				u32 water_idx = chunk_instance_count;
-				for (int x = 0; x < CHUNK_X; ++x) {
-					int wx = c->world_pos.x + x;
-					for (int z = 0; z < CHUNK_Z; ++z) {
-						int wz = c->world_pos.z + z;
-						for (int y = 0; y < CHUNK_Y; ++y) {
-							int wy = c->world_pos.y + y;
-							Block b = c->blocks[x][z][y];
-
-							if (b == BLOCK_AIR) continue;
-
-							vec3 pos = vec3(wx, wy, wz);
-							u32 *tex = block_textures_map[b];
-
-							if (b != BLOCK_WATER) {
-								if (GetBlock(wx, wy + 1, wz) <= BLOCK_WATER) {
-									c->cached_instance_data[idx++] = { pos, SIDE_TOP, tex[SIDE_TOP] };
-								}
-								if (GetBlock(wx, wy - 1, wz) <= BLOCK_WATER) {
-									c->cached_instance_data[idx++] = { pos, SIDE_BOT, tex[SIDE_BOT] };
-								}
-								if (GetBlock(wx - 1, wy, wz) <= BLOCK_WATER) {
-									c->cached_instance_data[idx++] = { pos, SIDE_WEST, tex[SIDE_WEST] };
-								}
-								if (GetBlock(wx + 1, wy, wz) <= BLOCK_WATER) {
-									c->cached_instance_data[idx++] = { pos, SIDE_EAST, tex[SIDE_EAST] };
-								}
-								if (GetBlock(wx, wy, wz + 1) <= BLOCK_WATER) {
-									c->cached_instance_data[idx++] = { pos, SIDE_NORTH, tex[SIDE_NORTH] };
-								}
-								if (GetBlock(wx, wy, wz - 1) <= BLOCK_WATER) {
-									c->cached_instance_data[idx++] = { pos, SIDE_SOUTH, tex[SIDE_SOUTH] };
-								}
-							} else {
-								if (GetBlock(wx, wy + 1, wz) != BLOCK_WATER) {
-									c->cached_instance_data[water_idx++] = { pos, SIDE_TOP, tex[SIDE_TOP] };
-								}
-								if (GetBlock(wx, wy - 1, wz) != BLOCK_WATER) {
-									c->cached_instance_data[water_idx++] = { pos, SIDE_BOT, tex[SIDE_BOT] };
-								}
-								if (GetBlock(wx - 1, wy, wz) != BLOCK_WATER) {
-									c->cached_instance_data[water_idx++] = { pos, SIDE_WEST, tex[SIDE_WEST] };
-								}
-								if (GetBlock(wx + 1, wy, wz) != BLOCK_WATER) {
-									c->cached_instance_data[water_idx++] = { pos, SIDE_EAST, tex[SIDE_EAST] };
-								}
-								if (GetBlock(wx, wy, wz + 1) != BLOCK_WATER) {
-									c->cached_instance_data[water_idx++] = { pos, SIDE_NORTH, tex[SIDE_NORTH] };
-								}
-								if (GetBlock(wx, wy, wz - 1) != BLOCK_WATER) {
-									c->cached_instance_data[water_idx++] = { pos, SIDE_SOUTH, tex[SIDE_SOUTH] };
-								}
-							}
-						}
-					}
-				}
-
-				c->dirty = 0;
-			}
-		}
+	if (!meshes_changed) {
+		return prev_instance_counts;
 	}
 
 	RenderPass *solid_pass = &renderer.solid_pass;
 	RenderPass *water_pass = &renderer.water_pass;
 	InstanceData *instance_data = (InstanceData *) solid_pass->instance_staging_buffer.allocation_info.pMappedData;
 	InstanceData *water_instance_data = (InstanceData *) water_pass->instance_staging_buffer.allocation_info.pMappedData;
-	u32 instance_count = 0;
-	u32 water_instance_count = 0;
-
-	for (int cx = 0; cx < WORLD_CHUNK_COUNT_X; ++cx) {
-		for (int cz = 0; cz < WORLD_CHUNK_COUNT_Z; ++cz) {
-			for (int cy = 0; cy < WORLD_CHUNK_COUNT_Y; ++cy) {
-				Chunk *c = GetChunk(cx, cy, cz);
-				if (c->cached_instance_data) {
-					if (c->instance_count > 0) {
-						CopyMemory(instance_data + instance_count,
-							c->cached_instance_data, c->instance_count * sizeof(InstanceData));
-						instance_count += c->instance_count;
-					}
-					if (c->water_instance_count > 0) {
-						CopyMemory(water_instance_data + water_instance_count,
-							c->cached_instance_data + c->instance_count, c->water_instance_count * sizeof(InstanceData));
-						water_instance_count += c->water_instance_count;
-					}
-				}
-			}
-		}
-	}
+	BlockInstanceCounts counts = GatherChunkInstances(instance_data, water_instance_data);
 
     VkBufferCopy copy = {};
     copy.srcOffset = 0;
     copy.dstOffset = 0;
-    copy.size = instance_count * sizeof(InstanceData);
+    copy.size = counts.solid * sizeof(InstanceData);
     vkCmdCopyBuffer(cmdbuf, solid_pass->instance_staging_buffer.handle, solid_pass->instance_buffer.handle, 1, &copy);
 	
     copy = {};
     copy.srcOffset = 0;
     copy.dstOffset = 0;
-    copy.size = water_instance_count * sizeof(InstanceData);
+    copy.size = counts.water * sizeof(InstanceData);
     vkCmdCopyBuffer(cmdbuf, water_pass->instance_staging_buffer.handle, water_pass->instance_buffer.handle, 1, &copy);
 
-	return { instance_count, water_instance_count };
+	return counts;
 }
@@ -2,8 +2,10 @@
 
 #include "General.h"
 #include "Graphics/NVulkan.h"
+#include "Graphics/RenderGraph.h"
 #include "Math/Mat.h"
 #include "World.h"
+#include "Mesher.h"
 #include "Player.h"
 
 enum {
@@ -13,6 +15,45 @@ enum {
 enum {
 	SHADOW_MAP_WIDTH = 2048,
 	SHADOW_MAP_HEIGHT = 2048,
+	// has to match SHADOW_CASCADE_COUNT in Common.h
+	SHADOW_CASCADE_COUNT = 4,
+	// tiles per side of a cascade, redrawn one by one when they go stale
+	SHADOW_TILE_COUNT = 8,
+	SHADOW_TILE_SIZE = SHADOW_MAP_WIDTH / SHADOW_TILE_COUNT,
+	// rects of dirty tiles culled on their own, at least the four a rect
+	// splits into where the window wraps
+	SHADOW_CULL_RECT_COUNT = 4,
+	// EVSM moments are filtered down to half the depth's resolution
+	SHADOW_MOMENTS_WIDTH = SHADOW_MAP_WIDTH / 2,
+	SHADOW_MOMENTS_HEIGHT = SHADOW_MAP_HEIGHT / 2,
+};
+
+enum {
+	// the first one is half the render target's size
+	BLOOM_MIP_COUNT = 6,
+	// down the whole chain and back up to the first mip
+	BLOOM_DISPATCH_COUNT = 2 * BLOOM_MIP_COUNT - 1,
+};
+
+// has to match BLOOM_MODE_* in Bloom.comp.glsl
+enum {
+	// the render target into the first mip, bright parts only
+	BLOOM_MODE_PREFILTER,
+	BLOOM_MODE_DOWNSAMPLE,
+	// tent filtered onto the next larger mip
+	BLOOM_MODE_UPSAMPLE,
+};
+
+// the 3D passes never go below this fraction of the output size
+#define RENDER_SCALE_MIN 0.5f
+
+// has to match SHADOW_MODE_* in Common.h
+enum ShadowMode {
+	// 9 rotated depth compares per fragment
+	SHADOW_MODE_PCF,
+	// exponential variance shadow maps, one filtered fetch of blurred moments
+	SHADOW_MODE_EVSM,
+	SHADOW_MODE_COUNT
 };
 
 struct FrustumInfo {
@@ -21,6 +62,27 @@ struct FrustumInfo {
 	u32 instance_count;
 };
 
+// Which part of the render target the 3D passes drew into, for the post
+// passes reading it.
+struct RenderScaleConstants {
+	vec2 uv_scale;
+	// half a texel inside the drawn part, filtering stops there
+	vec2 uv_max;
+};
+
+struct BloomConstants {
+	RenderScaleConstants scale;
+	u32 mode;
+};
+
+struct ShadowBlurConstants {
+	u32 layer;
+	// 0 takes the depth down to moments and blurs them horizontally, 1 blurs
+	// vertically into the layer
+	u32 vertical;
+	vec2 evsm_exponents;
+};
+
 struct SkyUniform {
 	mat4 inv_proj;
 	mat4 inv_view;
@@ -37,17 +99,83 @@ struct RenderPass {
 	Buffer indirect_buffer;
 };
 
+enum {
+	CULL_SOLID,
+	CULL_WATER,
+	// SHADOW_CULL_RECT_COUNT per cascade
+	CULL_SHADOW,
+	CULL_CALL_COUNT = CULL_SHADOW + SHADOW_CASCADE_COUNT * SHADOW_CULL_RECT_COUNT
+};
+
+// The window of a cascade is SHADOW_TILE_COUNT^2 tiles on a grid fixed in
+// light space. Its layer holds them wrapped around, tile (x, y) always lives
+// in slot (x, -y - 1) mod SHADOW_TILE_COUNT, so when the window scrolls only
+// the tiles that came into it need drawing and the rest stay where they are.
+struct ShadowCascade {
+	// the window, the light view is shared
+	mat4 light_proj;
+	// view depth the cascade covers up to
+	float split;
+	// in world units, changes only with the camera's aspect ratio
+	float tile_size;
+	// first tile of the window
+	s32 window_x;
+	s32 window_y;
+	// one bit per slot, y * SHADOW_TILE_COUNT + x
+	u64 dirty_slots;
+
+	// the one layer of the shadow map it renders into
+	VkImageView layer_view;
+	// one per rect culled on its own
+	Buffer indirect_buffers[SHADOW_CULL_RECT_COUNT];
+
+	b8 due;
+	b8 rendered;
+	// the moments no longer match the depth, only kept up in SHADOW_MODE_EVSM
+	b8 moments_stale;
+};
+
+// Cascades fit to slices of the camera frustum, one layer of the shadow map
+// each. The sun never moves, so the layers are kept between frames and only
+// tiles that scrolled into a window or whose chunks were meshed again get
+// redrawn. Far cascades pick up their changes every few frames only,
+// staggered so at most two render in a frame.
 struct ShadowPass {
 	DescriptorSet desc_set;
 	Pipeline pipeline;
-	Buffer light_space_buffer;
 	Texture shadow_map;
+
+	// solid instances inside the light frustum, so casters behind the camera
+	// still land in the shadow map. Shared by the cascades and their rects,
+	// each rect is culled right before it's drawn.
+	Buffer culled_instance_buffer;
+
+	// fixed, the depth range covers the whole world
+	mat4 light_view;
+	float light_near;
+	float light_far;
+
+	ShadowCascade cascades[SHADOW_CASCADE_COUNT];
+	u32 frame_index;
+
+	// a layer per cascade, regenerated from the depth whenever the cascade
+	// draws something. The blur goes through moments_blur one direction at
+	// a time, both stay in VK_IMAGE_LAYOUT_GENERAL.
+	u32 mode;
+	// positive and negative, as high as the moments' format allows
+	vec2 evsm_exponents;
+	Texture moments;
+	Image moments_blur;
+	DescriptorSet blur_desc_set;
+	Pipeline blur_pipeline;
 };
 
+// One descriptor set and frustum buffer per call, the calls are recorded
+// back to back into the same command buffer.
 struct CullPass {
-	DescriptorSet desc_sets[2];
+	DescriptorSet desc_sets[CULL_CALL_COUNT];
 	Pipeline pipeline;
-	Buffer frustum_info_buffer;
+	Buffer frustum_info_buffers[CULL_CALL_COUNT];
 };
 
 struct CullCall {
@@ -60,48 +188,115 @@ struct CullCall {
 	u32 instance_count;
 };
 
+// Lays down the solid depth with the vertex shader alone, so the solid pass
+// can run with an EQUAL compare and shade every pixel once.
+struct DepthPrepass {
+	Pipeline pipeline;
+	// the solid pass's pipeline without depth writes and with the EQUAL compare
+	Pipeline solid_pipeline;
+	b8 enabled;
+};
+
+// Bloom as a compute chain down from half resolution and back up, then
+// tone mapping into the frame's ldr target and FXAA from there into the
+// swapchain target. The bloom chain is made by ResizePostprocess, the
+// targets it reads from are transients of the render graph.
 struct Postprocess {
 	DescriptorSet desc_set;
 	Pipeline pipeline;
+
+	DescriptorSet fxaa_desc_set;
+	Pipeline fxaa_pipeline;
+
+	// one set per dispatch, in the order they run
+	DescriptorSet bloom_desc_sets[BLOOM_DISPATCH_COUNT];
+	Pipeline bloom_pipeline;
+
+	u32 width;
+	u32 height;
+	// stays in VK_IMAGE_LAYOUT_GENERAL, the first mip ends up with the sum
+	// of all of them
+	Texture bloom;
+	VkImageView bloom_mip_views[BLOOM_MIP_COUNT];
+};
+
+// What the passes need from RenderFrame once the graph runs them.
+struct FramePasses {
+	Swapchain *swapchain;
+	Player *player;
+	BlockInstanceCounts instance_counts;
+	float time;
+	RenderScaleConstants scale;
+
+	RenderResource hdr_target;
+	RenderResource depth_target;
+	// tone mapped and gamma encoded, with the luma in alpha for FXAA
+	RenderResource ldr_target;
+	RenderResource present_target;
 };
 
 struct Renderer {
 	RenderPass sky_pass;
 	RenderPass solid_pass;
 	RenderPass water_pass;
+	DepthPrepass depth_prepass;
 	ShadowPass shadow_pass;
 	CullPass cull_pass;
 	Postprocess post_process;
 
-	TextureArray textures;
+	Texture block_textures;
 	Texture noise_texture;
 	Texture water_texture1;
 	Texture water_texture2;
 	Buffer globals_buffer;
 	Buffer sky_buffer;
-};
 
-struct BlockInstanceCounts {
-	u32 solid;
-	u32 water;
+	VkFormat color_format;
+	VkFormat depth_format;
+	RenderGraph graph;
+	FramePasses frame;
+
+	// fraction of the swapchain size the 3D passes render at, the render
+	// target stays full size and only its top left part is drawn
+	float render_scale;
 };
 
 struct Globals {
 	mat4 proj_matrix;
 	mat4 view_matrix;
-	mat4 light_space_matrix;
+	mat4 light_space_matrices[SHADOW_CASCADE_COUNT];
+	// split of every cascade, x first
+	vec4 cascade_splits;
+	// xy: where the window starts in its wrapped layer, in uv
+	vec4 shadow_window_offsets[SHADOW_CASCADE_COUNT];
 	vec3 camera_pos;
+	u32 shadow_mode;
+	vec2 evsm_exponents;
 };
 
 void InitRenderer(VkCommandPool cmdpool, VkCommandBuffer cmdbuf,
-	VkFormat color_format, VkFormat depth_format);
+	VkFormat color_format, VkFormat depth_format, VkFormat present_format);
 void DestroyRenderer();
 
-void Cull(Player *p, BlockInstanceCounts instance_counts, VkCommandBuffer cmdbuf);
-void RenderShadow(VkCommandBuffer cmdbuf, BlockInstanceCounts instance_counts);
-void Render(Swapchain *swapchain, VkImageView color_view, VkImageView depth_view, VkCommandBuffer cmdbuf,
-	BlockInstanceCounts instance_counts, float time);
-void DoPostprocessing(Swapchain *swapchain, Texture render_target, Image swapchain_target, VkCommandBuffer cmdbuf);
+// Culling, shadows, the 3D passes and post processing into the swapchain
+// target, after the uploads. Leaves it the way PresentSwapchain wants it.
+void RenderFrame(Swapchain *swapchain, Player *p, BlockInstanceCounts instance_counts, float time, VkCommandBuffer cmdbuf);
+void SetDepthPrepass(b32 enabled);
+
+// Clamped to RENDER_SCALE_MIN..1, takes effect with the next frame.
+void SetRenderScale(float scale);
+float GetRenderScale();
+// Steers the render scale towards keeping the gpu frame time under
+// budget_ms, call once per frame with the last frame's time.
+void UpdateRenderScale(float gpu_ms, float budget_ms);
+
+// SHADOW_MODE_*, takes effect with the next frame.
+void SetShadowMode(u32 mode);
+u32 GetShadowMode();
+const char *GetShadowModeName(u32 mode);
+
+// Has to be called again whenever the swapchain is resized.
+void ResizePostprocess(u32 width, u32 height, VkCommandBuffer cmdbuf);
 void UploadTransformations(Player *p, VkCommandBuffer cmdbuf);
 
-BlockInstanceCounts UpdateBlockInstances(VkCommandBuffer cmdbuf, BlockInstanceCounts prev_instance_counts);
+BlockInstanceCounts UpdateBlockInstances(VkCommandBuffer cmdbuf, BlockInstanceCounts prev_instance_counts, b32 meshes_changed);
@@ -0,0 +1,239 @@
+#include "Replay.h"
+
+#include "Math/Vec.h"
+#include "Platform/Platform.h"
+
+enum {
+	REPLAY_WRITE_BUFFER_TICKS = 1024,
+};
+
+// drift below this is float noise from a different build, not a desync
+global const float replay_drift_tolerance = 0.001f;
+
+struct ReplayRecorder {
+	b32 active;
+	OS_Handle file;
+
+	ReplayTick buffer[REPLAY_WRITE_BUFFER_TICKS];
+	u32 buffered;
+	u64 tick_count;
+};
+
+struct ReplayFrame {
+	u32 tick;
+	float cpu_ms;
+	float gpu_ms;
+};
+
+struct ReplayPlayback {
+	String data;
+	ReplayTick *ticks;
+	u32 tick_count;
+	u32 cursor;
+
+	float max_drift;
+	u32 drifted_ticks;
+
+	ReplayFrame *frames;
+	u32 frame_count;
+};
+
+global ReplayRecorder recorder;
+global ReplayPlayback playback;
+
+internal void StoreVec3(float *dst, vec3 v) {
+	dst[0] = v.x;
+	dst[1] = v.y;
+	dst[2] = v.z;
+}
+
+internal b32 FlushReplayTicks() {
+	u64 size = recorder.buffered * sizeof(ReplayTick);
+	u64 written = WriteHandle(recorder.file, recorder.buffer, size);
+
+	recorder.buffered = 0;
+
+	return written == size;
+}
+
+b32 BeginReplayRecording(String path, Player *player, u32 world_seed, float time_step) {
+	Assert(!recorder.active);
+
+	OS_Handle file = OpenFile(path, OS_WRITE | OS_CREATE);
+	if (!IsValidFile(file)) {
+		return 0;
+	}
+
+	ReplayHeader header = {};
+	header.magic = REPLAY_MAGIC;
+	header.version = REPLAY_VERSION;
+	header.world_seed = world_seed;
+	header.time_step = time_step;
+	StoreVec3(header.start_position, player->position);
+	header.start_yaw = player->yaw;
+	header.start_pitch = player->pitch;
+	header.start_flying = player->flying;
+
+	if (WriteHandle(file, &header, sizeof(header)) != sizeof(header)) {
+		CloseFile(file);
+		return 0;
+	}
+
+	recorder.file = file;
+	recorder.buffered = 0;
+	recorder.tick_count = 0;
+	recorder.active = 1;
+
+	return 1;
+}
+
+b32 IsRecordingReplay() {
+	return recorder.active;
+}
+
+void RecordReplayTick(PlayerInput *input, Player *player, u32 block_edits) {
+	ReplayTick *tick = &recorder.buffer[recorder.buffered++];
+
+	StoreVec3(tick->front, input->front);
+	StoreVec3(tick->position, player->position);
+	tick->held = u8(input->held);
+	tick->actions = u8(input->actions);
+	tick->block_edits = u16(block_edits);
+
+	recorder.tick_count++;
+
+	if (recorder.buffered == REPLAY_WRITE_BUFFER_TICKS) {
+		FlushReplayTicks();
+	}
+}
+
+void EndReplayRecording() {
+	if (!recorder.active) {
+		return;
+	}
+
+	if (!FlushReplayTicks()) {
+		Print("Failed to write replay ticks\n");
+	}
+
+	CloseFile(recorder.file);
+	recorder.active = 0;
+
+	Print("Recorded %llu ticks\n", recorder.tick_count);
+}
+
+b32 LoadReplay(String path, Player *player, u32 *world_seed, double *time_step) {
+	String data = ReadFile(path);
+	if (!data.ptr) {
+		Print("Failed to open replay %.*s\n", int(path.len), path.ptr);
+		return 0;
+	}
+
+	ReplayHeader *header = (ReplayHeader *) data.ptr;
+	if (data.len < sizeof(ReplayHeader) || header->magic != REPLAY_MAGIC || header->version != REPLAY_VERSION ||
+		(data.len - sizeof(ReplayHeader)) % sizeof(ReplayTick) != 0) {
+		Print("%.*s is not a replay\n", int(path.len), path.ptr);
+		HeapFree(data.ptr);
+		return 0;
+	}
+
+	player->position = vec3(header->start_position[0], header->start_position[1], header->start_position[2]);
+	player->velocity = vec3(0);
+	player->acceleration = vec3(0);
+	player->yaw = header->start_yaw;
+	player->pitch = header->start_pitch;
+	player->flying = header->start_flying;
+
+	*world_seed = header->world_seed;
+	*time_step = double(header->time_step);
+
+	playback = {};
+	playback.data = data;
+	playback.ticks = (ReplayTick *) (data.ptr + sizeof(ReplayHeader));
+	playback.tick_count = u32((data.len - sizeof(ReplayHeader)) / sizeof(ReplayTick));
+	playback.frames = (ReplayFrame *) HeapAlloc(Max(playback.tick_count, 1u) * sizeof(ReplayFrame));
+
+	return 1;
+}
+
+b32 NextReplayInput(PlayerInput *input, u32 *block_edits) {
+	if (playback.cursor >= playback.tick_count) {
+		return 0;
+	}
+
+	ReplayTick *tick = &playback.ticks[playback.cursor++];
+
+	*input = {};
+	input->front = vec3(tick->front[0], tick->front[1], tick->front[2]);
+	input->held = tick->held;
+	input->actions = tick->actions;
+	*block_edits = tick->block_edits;
+
+	return 1;
+}
+
+void CheckReplayPosition(vec3 position) {
+	if (!playback.cursor) {
+		return;
+	}
+
+	ReplayTick *tick = &playback.ticks[playback.cursor - 1];
+	vec3 recorded = vec3(tick->position[0], tick->position[1], tick->position[2]);
+
+	float drift = Length(position - recorded);
+	playback.max_drift = Max(playback.max_drift, drift);
+	if (drift > replay_drift_tolerance) {
+		playback.drifted_ticks++;
+	}
+}
+
+void RecordReplayFrame(double cpu_ms, double gpu_ms) {
+	if (playback.frame_count < Max(playback.tick_count, 1u)) {
+		ReplayFrame *frame = &playback.frames[playback.frame_count++];
+		frame->tick = playback.cursor;
+		frame->cpu_ms = float(cpu_ms);
+		frame->gpu_ms = float(gpu_ms);
+	}
+}
+
+void EndReplay(String timings_path) {
+	FileWriter *writer = 0;
+	if (timings_path.len) {
+		writer = (FileWriter *) HeapAlloc(sizeof(FileWriter));
+		if (!OpenFileWriter(writer, timings_path)) {
+			Print("Failed to open %.*s\n", int(timings_path.len), timings_path.ptr);
+			HeapFree(writer);
+			writer = 0;
+		}
+	}
+
+	if (writer) {
+		WriteFormat(writer, "frame,tick,cpu_ms,gpu_ms\n");
+	} else {
+		PrintLiteral("frame,tick,cpu_ms,gpu_ms\n");
+	}
+
+	for (u32 i = 0; i < playback.frame_count; ++i) {
+		ReplayFrame *frame = &playback.frames[i];
+
+		if (writer) {
+			WriteFormat(writer, "%u,%u,%.3f,%.3f\n", i, frame->tick, frame->cpu_ms, frame->gpu_ms);
+		} else {
+			Print("%u,%u,%.3f,%.3f\n", i, frame->tick, frame->cpu_ms, frame->gpu_ms);
+		}
+	}
+
+	if (writer) {
+		if (!CloseFileWriter(writer)) {
+			Print("Failed to write %.*s\n", int(timings_path.len), timings_path.ptr);
+		}
+		HeapFree(writer);
+	}
+
+	Print("Replayed %u of %u ticks, max drift %.4f, %u ticks off the recording\n",
+		playback.cursor, playback.tick_count, playback.max_drift, playback.drifted_ticks);
+
+	HeapFree(playback.frames);
+	HeapFree(playback.data.ptr);
+	playback = {};
+}
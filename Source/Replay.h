@@ -0,0 +1,52 @@
+#pragma once
+
+#include "General.h"
+#include "DataStructures/String.h"
+#include "Player.h"
+
+// A recording is a header followed by one ReplayTick per simulation tick,
+// the tick count follows from the file size.
+#define REPLAY_MAGIC 0x52434D4E // "NMCR"
+#define REPLAY_VERSION 2
+
+struct ReplayHeader {
+	u32 magic;
+	u32 version;
+	u32 world_seed;
+	float time_step;
+
+	float start_position[3];
+	float start_yaw;
+	float start_pitch;
+	u32 start_flying;
+};
+
+// The input TickPlayer got and the camera pose it ended up with. Edits can
+// wait on the chunk jobs, so how many were applied at the start of the tick
+// is recorded too.
+struct ReplayTick {
+	float front[3];
+	float position[3];
+	u8 held;
+	u8 actions;
+	u16 block_edits;
+};
+
+// Recording, the ticks are written from the simulation thread.
+b32 BeginReplayRecording(String path, Player *player, u32 world_seed, float time_step);
+b32 IsRecordingReplay();
+void RecordReplayTick(PlayerInput *input, Player *player, u32 block_edits);
+void EndReplayRecording();
+
+// Playback restores the start pose into player, the world seed and time step
+// the recording was made with. One tick is played back per frame.
+b32 LoadReplay(String path, Player *player, u32 *world_seed, double *time_step);
+b32 NextReplayInput(PlayerInput *input, u32 *block_edits);
+// Compares the simulated position against the recorded one of the last tick
+// handed out by NextReplayInput.
+void CheckReplayPosition(vec3 position);
+
+void RecordReplayFrame(double cpu_ms, double gpu_ms);
+// Writes frame,tick,cpu_ms,gpu_ms per played back frame to timings_path, or
+// prints it if the path is empty, then frees the recording.
+void EndReplay(String timings_path);
@@ -0,0 +1,231 @@
+#include "Simulation.h"
+
+#include "Entities.h"
+#include "Replay.h"
+#include "World.h"
+#include "Platform/Platform.h"
+#include "Platform/Profiler.h"
+
+struct InputQueue {
+	PlayerInput inputs[SIM_INPUT_QUEUE_SIZE];
+	volatile u32 read;
+	volatile u32 write;
+
+	// render thread only: actions that did not fit while the queue was full
+	u32 pending_actions;
+};
+
+struct Simulation {
+	OS_Handle thread;
+	volatile u32 running;
+	b32 stepped;
+	u32 tick;
+	u32 step_block_edits;
+
+	u64 step_us;
+	float time_step;
+
+	Player player;
+	PlayerInput last_input;
+
+	EntityStore entities;
+	SpatialHash entity_hash;
+	u32 spawn_seed;
+	u32 block_edits;
+
+	InputQueue input_queue;
+
+	SimSnapshot snapshots[SIM_SNAPSHOT_COUNT];
+	volatile u32 published;
+};
+
+global Simulation sim;
+
+internal SimSnapshot TakeSnapshot(u32 tick, float entity_update_ms) {
+	SimSnapshot result = {};
+
+	result.tick = tick;
+	result.time_us = GetTimeNowUs();
+	result.player_position = sim.player.position;
+	result.player_velocity = sim.player.velocity;
+	result.player_flying = sim.player.flying;
+	result.entity_count = sim.entities.count;
+	result.entity_update_ms = entity_update_ms;
+	result.block_edits = sim.block_edits;
+
+	return result;
+}
+
+// Folds everything queued since the last tick into one input: the latest held
+// keys and look direction, and every action that happened in between.
+internal PlayerInput DrainPlayerInput() {
+	InputQueue *q = &sim.input_queue;
+
+	PlayerInput result = sim.last_input;
+	result.actions = 0;
+
+	u32 read = q->read;
+	u32 write = AtomicLoad(&q->write);
+
+	for (; read != write; ++read) {
+		PlayerInput *input = &q->inputs[read % SIM_INPUT_QUEUE_SIZE];
+		result.front = input->front;
+		result.held = input->held;
+		result.actions |= input->actions;
+	}
+
+	AtomicStore(&q->read, read);
+
+	sim.last_input = result;
+
+	return result;
+}
+
+internal void SimulationTick(u32 tick) {
+	PROFILE_ZONE("simulation tick");
+
+	// last tick's edits, before anything collides
+	u32 edits = sim.stepped ? ApplyBlockEditsWaiting(sim.step_block_edits) : ApplyBlockEdits();
+	sim.block_edits += edits;
+
+	PlayerInput input = DrainPlayerInput();
+
+	TickPlayer(&sim.player, &input, sim.time_step);
+
+	if (IsRecordingReplay()) {
+		RecordReplayTick(&input, &sim.player, edits);
+	}
+
+	if (input.actions & PLAYER_ACTION_SPAWN_MOBS) {
+		SpawnEntitiesAround(&sim.entities, sim.player.position, 32.0f, 1024, sim.spawn_seed++);
+	}
+
+	u64 entity_time_begin = GetTimeNowUs();
+	UpdateEntities(&sim.entities, 1);
+	BuildSpatialHash(&sim.entity_hash, &sim.entities);
+	float entity_update_ms = float(GetTimeNowUs() - entity_time_begin) / 1000.0f;
+
+	sim.snapshots[tick % SIM_SNAPSHOT_COUNT] = TakeSnapshot(tick, entity_update_ms);
+	AtomicStore(&sim.published, tick);
+}
+
+internal u32 SimulationThread(void *args) {
+	PROFILE_THREAD("simulation");
+
+	u32 tick = AtomicLoad(&sim.published);
+	u64 next_tick_us = GetTimeNowUs() + sim.step_us;
+
+	while (AtomicLoad(&sim.running)) {
+		u64 now = GetTimeNowUs();
+
+		if (now < next_tick_us) {
+			// Sleep granularity can be a whole scheduler quantum, only sleep when
+			// there is plenty of time left and yield for the rest.
+			SleepMs(next_tick_us - now > 2000 ? 1 : 0);
+			continue;
+		}
+
+		// after a long stall (debugger, window drag) drop the backlog instead of
+		// running hundreds of ticks to catch up
+		if (now - next_tick_us > sim.step_us * 10) {
+			next_tick_us = now;
+		}
+
+		SimulationTick(++tick);
+		next_tick_us += sim.step_us;
+	}
+
+	return 0;
+}
+
+void StartSimulation(Player *player, double time_step, b32 stepped) {
+	sim.player = *player;
+	sim.last_input.front = player->camera.front;
+	sim.time_step = float(time_step);
+	sim.step_us = u64(time_step * 1000000.0);
+	sim.spawn_seed = 1;
+
+	sim.entities = CreateEntityStore(1 << 16);
+	sim.entity_hash = CreateSpatialHash(&sim.entities, 4.0f);
+
+	SimSnapshot initial = TakeSnapshot(0, 0.0f);
+	for (u32 i = 0; i < SIM_SNAPSHOT_COUNT; ++i) {
+		sim.snapshots[i] = initial;
+	}
+	sim.published = 0;
+	sim.tick = 0;
+
+	sim.stepped = stepped;
+	if (!stepped) {
+		sim.running = 1;
+		sim.thread = StartThread(SimulationThread, 0);
+	}
+}
+
+void StopSimulation() {
+	if (!sim.stepped) {
+		AtomicStore(&sim.running, 0);
+		JoinThread(sim.thread);
+	}
+
+	DestroyEntityStore(&sim.entities);
+}
+
+void SubmitPlayerInput(PlayerInput input) {
+	InputQueue *q = &sim.input_queue;
+
+	input.actions |= q->pending_actions;
+
+	u32 write = q->write;
+	u32 read = AtomicLoad(&q->read);
+
+	if (write - read >= SIM_INPUT_QUEUE_SIZE) {
+		q->pending_actions = input.actions;
+		return;
+	}
+
+	q->inputs[write % SIM_INPUT_QUEUE_SIZE] = input;
+	q->pending_actions = 0;
+	AtomicStore(&q->write, write + 1);
+}
+
+void StepSimulation(u32 block_edits) {
+	Assert(sim.stepped);
+
+	sim.step_block_edits = block_edits;
+	SimulationTick(++sim.tick);
+}
+
+SimFrame GetSimulationFrame() {
+	SimFrame result = {};
+
+	// The simulation only ever writes the slot after the published one, so
+	// prev/curr stay intact unless it got two ticks further while copying.
+	for (;;) {
+		u32 published = AtomicLoad(&sim.published);
+
+		result.curr = sim.snapshots[published % SIM_SNAPSHOT_COUNT];
+		result.prev = sim.snapshots[(published - 1) % SIM_SNAPSHOT_COUNT];
+
+		if (AtomicLoad(&sim.published) - published < SIM_SNAPSHOT_COUNT - 2) {
+			break;
+		}
+	}
+
+	if (sim.stepped) {
+		result.alpha = 1.0f;
+	} else {
+		u64 now = GetTimeNowUs();
+		u64 since = now > result.curr.time_us ? now - result.curr.time_us : 0;
+		result.alpha = Clamp(float(double(since) / double(sim.step_us)), 0.0f, 1.0f);
+	}
+
+	return result;
+}
+
+vec3 InterpolatePlayerPosition(SimFrame *frame) {
+	vec3 prev = frame->prev.player_position;
+	vec3 curr = frame->curr.player_position;
+
+	return prev + (curr - prev) * frame->alpha;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "General.h"
+#include "Math/Vec.h"
+#include "Player.h"
+
+enum {
+	SIM_SNAPSHOT_COUNT = 4,
+	SIM_INPUT_QUEUE_SIZE = 64,
+};
+
+// Everything the render thread needs from one simulation tick. Once published
+// a snapshot is never written again until the ring wraps around.
+struct SimSnapshot {
+	u32 tick;
+	u64 time_us;
+
+	vec3 player_position;
+	vec3 player_velocity;
+	b32 player_flying;
+
+	u32 entity_count;
+	float entity_update_ms;
+
+	// applied since the start
+	u32 block_edits;
+};
+
+struct SimFrame {
+	SimSnapshot prev;
+	SimSnapshot curr;
+
+	// how far the render time is between prev and curr, in [0, 1]
+	float alpha;
+};
+
+// A stepped simulation has no thread and only ticks on StepSimulation, which
+// makes it deterministic for replays. Frames of it render the latest tick.
+void StartSimulation(Player *player, double time_step, b32 stepped);
+void StopSimulation();
+// Applies exactly block_edits queued edits at the start of the tick, as many
+// as the recorded tick did, however busy the chunk jobs are right now.
+void StepSimulation(u32 block_edits);
+
+// Render thread side. Neither call blocks on the simulation thread.
+void SubmitPlayerInput(PlayerInput input);
+SimFrame GetSimulationFrame();
+
+vec3 InterpolatePlayerPosition(SimFrame *frame);
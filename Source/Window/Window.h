@@ -35,6 +35,12 @@ struct Window {
     HDC device_ctx;
     RECT rect;
     DWORD style;
+#elif OS_LINUX
+    // Display * and the xcb_connection_t * behind it, kept opaque so Xlib's
+    // own Window typedef never meets ours
+    void *display;
+    void *connection;
+    u32 handle;
 #endif
 };
 
@@ -0,0 +1,422 @@
+// Xlib calls its window id type Window, rename it for this file. The X
+// headers go first since XKB uses our internal keyword as a member name.
+#define Window XWindow
+#include <X11/Xlib.h>
+#include <X11/Xlib-xcb.h>
+#include <X11/Xutil.h>
+#include <X11/Xatom.h>
+#include <X11/XKBlib.h>
+#include <X11/keysym.h>
+#include <X11/cursorfont.h>
+#undef Window
+
+#include "Window.h"
+
+struct X11State {
+    Display *display;
+    XWindow handle;
+
+    Atom wm_delete_window;
+    Atom net_wm_state;
+    Atom net_wm_state_fullscreen;
+    Atom net_wm_state_maximized_vert;
+    Atom net_wm_state_maximized_horz;
+
+    Cursor cursor_handles[3]; // 0 - arrow, 1 - hand, 2 - hidden
+    b8 cursor_locked;
+
+    b8 key_states[WIN_MAX_KEYS];
+    Int2 last_mouse_pos;
+};
+
+global X11State x11;
+global InputState input;
+
+// maps to the virtual key codes in Keys.h
+internal u8 TranslateKeySym(KeySym sym) {
+    if (sym >= XK_a && sym <= XK_z) return u8(KEY_A + (sym - XK_a));
+    if (sym >= XK_A && sym <= XK_Z) return u8(KEY_A + (sym - XK_A));
+    if (sym >= XK_0 && sym <= XK_9) return u8(KEY_0 + (sym - XK_0));
+
+    switch (sym) {
+        case XK_BackSpace: return KEY_BACKSPACE;
+        case XK_Tab: return KEY_TAB;
+        case XK_Return: return KEY_ENTER;
+        case XK_Shift_L:
+        case XK_Shift_R: return KEY_SHIFT;
+        case XK_Control_L:
+        case XK_Control_R: return KEY_CONTROL;
+        case XK_Alt_L:
+        case XK_Alt_R: return KEY_MENU;
+        case XK_Escape: return KEY_ESCAPE;
+        case XK_space: return KEY_SPACE;
+        case XK_Left: return KEY_LEFT;
+        case XK_Up: return KEY_UP;
+        case XK_Right: return KEY_RIGHT;
+        case XK_Down: return KEY_DOWN;
+        case XK_Insert: return KEY_INSERT;
+        case XK_Delete: return KEY_DELETE;
+    }
+
+    return 0;
+}
+
+internal void SendWMState(b32 add, Atom first, Atom second) {
+    XEvent event = {};
+    event.xclient.type = ClientMessage;
+    event.xclient.window = x11.handle;
+    event.xclient.message_type = x11.net_wm_state;
+    event.xclient.format = 32;
+    event.xclient.data.l[0] = add ? 1 : 0;
+    event.xclient.data.l[1] = long(first);
+    event.xclient.data.l[2] = long(second);
+    event.xclient.data.l[3] = 1;
+
+    XSendEvent(x11.display, DefaultRootWindow(x11.display), False,
+               SubstructureNotifyMask | SubstructureRedirectMask, &event);
+    XFlush(x11.display);
+}
+
+internal void UpdateWindowRect(Window *win) {
+    XWindowAttributes attributes;
+    if (XGetWindowAttributes(x11.display, x11.handle, &attributes)) {
+        win->size.x = attributes.width;
+        win->size.y = attributes.height;
+    }
+
+    int x = 0;
+    int y = 0;
+    XWindow child;
+    XTranslateCoordinates(x11.display, x11.handle, DefaultRootWindow(x11.display), 0, 0, &x, &y, &child);
+
+    win->pos.x = x;
+    win->pos.y = y;
+}
+
+internal void ProcessEvent(Window *win, XEvent *event) {
+    switch (event->type) {
+        case ClientMessage: {
+            if (Atom(event->xclient.data.l[0]) == x11.wm_delete_window) {
+                win->running = 0;
+            }
+        } break;
+        case DestroyNotify: {
+            win->running = 0;
+        } break;
+        case ConfigureNotify: {
+            if (event->xconfigure.width != win->size.x || event->xconfigure.height != win->size.y) {
+                win->resized = 1;
+            }
+        } break;
+        case KeyPress: {
+            u8 key = TranslateKeySym(XLookupKeysym(&event->xkey, 0));
+            if (key) {
+                x11.key_states[key] = 1;
+
+                if (win->key_callback) {
+                    win->key_callback(key);
+                }
+            }
+
+            char asciichar;
+            KeySym sym;
+            int asciicharlen = XLookupString(&event->xkey, &asciichar, 1, &sym, 0);
+            if (asciicharlen == 1) {
+                if (input.text_len + 1 < sizeof(input.text) - 1) {
+                    input.text[input.text_len] = asciichar;
+                    input.text[input.text_len + 1] = 0;
+                    input.text_len++;
+                }
+
+                if (win->char_callback) {
+                    win->char_callback(asciichar);
+                }
+            }
+        } break;
+        case KeyRelease: {
+            u8 key = TranslateKeySym(XLookupKeysym(&event->xkey, 0));
+            if (key) {
+                x11.key_states[key] = 0;
+            }
+        } break;
+        case ButtonPress:
+        case ButtonRelease: {
+            b8 down = event->type == ButtonPress;
+            u32 button = event->xbutton.button;
+
+            if (button == Button1 || button == Button3) {
+                ButtonInput *state = &input.buttons[button == Button1 ? MOUSE_BUTTON_LEFT : MOUSE_BUTTON_RIGHT];
+                if (down) {
+                    state->pressed = 1;
+                } else {
+                    state->released = 1;
+                }
+                state->down = down;
+            } else if (down && (button == Button4 || button == Button5)) {
+                int steps = button == Button4 ? 1 : -1;
+                input.delta_scroll += steps;
+                input.scroll += steps;
+            }
+        } break;
+        case MotionNotify: {
+            input.mouse_delta_pos.x += event->xmotion.x - x11.last_mouse_pos.x;
+            input.mouse_delta_pos.y += event->xmotion.y - x11.last_mouse_pos.y;
+
+            x11.last_mouse_pos.x = event->xmotion.x;
+            x11.last_mouse_pos.y = event->xmotion.y;
+        } break;
+    }
+}
+
+b8 InitWindow(Window *win) {
+    if (!win->title) win->title = "Window";
+
+    int width = win->size.x;
+    if (!width) width = 1280;
+
+    int height = win->size.y;
+    if (!height) height = 720;
+
+    Display *display = XOpenDisplay(0);
+    if (!display) {
+        Print("XOpenDisplay failed.\n");
+        return 0;
+    }
+
+    int screen = DefaultScreen(display);
+
+    XSetWindowAttributes attributes = {};
+    attributes.event_mask = StructureNotifyMask | KeyPressMask | KeyReleaseMask |
+                            ButtonPressMask | ButtonReleaseMask | PointerMotionMask | FocusChangeMask;
+
+    XWindow handle = XCreateWindow(display,
+                                   RootWindow(display, screen),
+                                   win->pos.x,
+                                   win->pos.y,
+                                   u32(width),
+                                   u32(height),
+                                   0,
+                                   CopyFromParent,
+                                   InputOutput,
+                                   CopyFromParent,
+                                   CWEventMask,
+                                   &attributes);
+
+    if (!handle) {
+        Print("XCreateWindow failed.\n");
+        XCloseDisplay(display);
+        return 0;
+    }
+
+    x11.display = display;
+    x11.handle = handle;
+
+    x11.wm_delete_window = XInternAtom(display, "WM_DELETE_WINDOW", False);
+    x11.net_wm_state = XInternAtom(display, "_NET_WM_STATE", False);
+    x11.net_wm_state_fullscreen = XInternAtom(display, "_NET_WM_STATE_FULLSCREEN", False);
+    x11.net_wm_state_maximized_vert = XInternAtom(display, "_NET_WM_STATE_MAXIMIZED_VERT", False);
+    x11.net_wm_state_maximized_horz = XInternAtom(display, "_NET_WM_STATE_MAXIMIZED_HORZ", False);
+
+    XSetWMProtocols(display, handle, &x11.wm_delete_window, 1);
+    XStoreName(display, handle, win->title);
+
+    // otherwise held keys report a release before every repeat
+    XkbSetDetectableAutoRepeat(display, True, 0);
+
+    x11.cursor_handles[0] = XCreateFontCursor(display, XC_left_ptr);
+    x11.cursor_handles[1] = XCreateFontCursor(display, XC_hand2);
+
+    char blank_bits[1] = {};
+    Pixmap blank = XCreateBitmapFromData(display, handle, blank_bits, 1, 1);
+    XColor black = {};
+    x11.cursor_handles[2] = XCreatePixmapCursor(display, blank, blank, &black, &black, 0, 0);
+    XFreePixmap(display, blank);
+
+    // Show Window
+    XMapWindow(display, handle);
+    XFlush(display);
+
+    win->display = display;
+    win->connection = XGetXCBConnection(display);
+    win->handle = u32(handle);
+    win->running = 1;
+
+    UpdateWindowRect(win);
+
+    return 1;
+}
+
+void DestroyWindow(Window *win) {
+    for (u32 i = 0; i < ArrayCount(x11.cursor_handles); ++i) {
+        XFreeCursor(x11.display, x11.cursor_handles[i]);
+    }
+
+    XDestroyWindow(x11.display, x11.handle);
+    XCloseDisplay(x11.display);
+
+    x11 = {};
+}
+
+void UpdateWindow(Window *win) {
+    win->resized = 0;
+
+    input.text[0] = 0;
+    input.text_len = 0;
+
+    input.mouse_delta_pos.x = 0;
+    input.mouse_delta_pos.y = 0;
+    input.delta_scroll = 0;
+
+    for (int i = 0; i < WIN_MAX_BUTTONS; ++i) {
+        input.buttons[i].pressed = 0;
+        input.buttons[i].released = 0;
+    }
+
+    while (XPending(x11.display)) {
+        XEvent event;
+        XNextEvent(x11.display, &event);
+
+        ProcessEvent(win, &event);
+    }
+
+    // Window Info
+    UpdateWindowRect(win);
+
+    // Keyboard input
+    for (int i = 5; i < WIN_MAX_KEYS; ++i) {
+        ButtonInput *button = input.keys + i;
+
+        b8 down = x11.key_states[i];
+        b8 wasdown = button->down;
+
+        button->down = down;
+        button->pressed = !wasdown && down;
+        button->released = wasdown && !down;
+    }
+
+    // Mouse input
+    input.mouse_pos = x11.last_mouse_pos;
+
+    // X has no raw mouse deltas without XInput2, keep the pointer in the
+    // middle of the window so it never hits an edge while looking around
+    if (x11.cursor_locked) {
+        int cx = win->size.x / 2;
+        int cy = win->size.y / 2;
+
+        XWarpPointer(x11.display, 0, x11.handle, 0, 0, 0, 0, cx, cy);
+        XFlush(x11.display);
+
+        x11.last_mouse_pos.x = cx;
+        x11.last_mouse_pos.y = cy;
+    }
+}
+
+void ToggleFullscreen(Window *win) {
+    win->fullscreen = !win->fullscreen;
+
+    SendWMState(win->fullscreen, x11.net_wm_state_fullscreen, 0);
+}
+
+void MaximizeWindow(Window *win) {
+    SendWMState(1, x11.net_wm_state_maximized_vert, x11.net_wm_state_maximized_horz);
+
+    UpdateWindowRect(win);
+}
+
+b32 IsMaximized(Window *win) {
+    b32 result = 0;
+
+    Atom type;
+    int format;
+    unsigned long count;
+    unsigned long remaining;
+    u8 *data = 0;
+
+    if (XGetWindowProperty(x11.display, x11.handle, x11.net_wm_state, 0, 64, False, XA_ATOM,
+                           &type, &format, &count, &remaining, &data) == Success && data) {
+        Atom *atoms = (Atom *) data;
+
+        b32 vert = 0;
+        b32 horz = 0;
+        for (unsigned long i = 0; i < count; ++i) {
+            if (atoms[i] == x11.net_wm_state_maximized_vert) vert = 1;
+            if (atoms[i] == x11.net_wm_state_maximized_horz) horz = 1;
+        }
+
+        result = vert && horz;
+        XFree(data);
+    }
+
+    return result;
+}
+
+void SetWindowTitle(Window *win, const char *title) {
+    XStoreName(x11.display, x11.handle, title);
+}
+
+void SetCursorToArrow() {
+    XDefineCursor(x11.display, x11.handle, x11.cursor_handles[0]);
+    XUngrabPointer(x11.display, CurrentTime);
+
+    x11.cursor_locked = 0;
+}
+
+void SetCursorToPointer() {
+    XDefineCursor(x11.display, x11.handle, x11.cursor_handles[1]);
+    XUngrabPointer(x11.display, CurrentTime);
+
+    x11.cursor_locked = 0;
+}
+
+void SetCursorToNone(Window *win) {
+    XDefineCursor(x11.display, x11.handle, x11.cursor_handles[2]);
+    XGrabPointer(x11.display, x11.handle, True, ButtonPressMask | ButtonReleaseMask | PointerMotionMask,
+                 GrabModeAsync, GrabModeAsync, x11.handle, None, CurrentTime);
+
+    x11.cursor_locked = 1;
+}
+
+char *GetTextInput(int *len) {
+    *len = input.text_len;
+    return input.text;
+}
+
+b8 IsKeyDown(u8 key) {
+    return input.keys[key].down;
+}
+
+b8 WasKeyPressed(u8 key) {
+    return input.keys[key].pressed;
+}
+
+b8 WasKeyReleased(u8 key) {
+    return input.keys[key].released;
+}
+
+b8 IsButtonDown(u8 button) {
+    return input.buttons[button].down;
+}
+
+b8 WasButtonPressed(u8 button) {
+    return input.buttons[button].pressed;
+}
+
+b8 WasButtonReleased(u8 button) {
+    return input.buttons[button].released;
+}
+
+Int2 GetMousePosition() {
+    return input.mouse_pos;
+}
+
+Int2 GetMouseDeltaPosition() {
+    return input.mouse_delta_pos;
+}
+
+int GetMouseScroll() {
+    return input.scroll;
+}
+
+int GetMouseScrollDelta() {
+    return input.delta_scroll;
+}
@@ -1,7 +1,12 @@
 #include "World.h"
 
+#include "ChunkPipeline.h"
+#include "Platform/Platform.h"
+#include "Platform/Profiler.h"
+
 global World world;
-global u32 global_dirty;
+global volatile u32 global_dirty;
+global BlockEditQueue block_edits;
 
 BlockRef GetBlockRef(vec3 pos) {
 	BlockRef result = {};
@@ -53,48 +58,123 @@ Block GetBlock(BlockRef ref) {
 	return ref.c->blocks[ref.bx][ref.bz][ref.by];
 }
 
+b32 IsSolidBlock(Block b) {
+	return b != BLOCK_AIR && b != BLOCK_WATER;
+}
+
 void PlaceBlock(BlockRef ref, Block block) {
 	PlaceBlock(ref.c, ref.bx, ref.by, ref.bz, block);
 }
 
 void PlaceBlock(Chunk *c, int x, int y, int z, Block block) {
 	c->blocks[x][z][y] = block;
-	c->dirty = 1;
+	MarkChunkDirty(c);
+}
 
-	global_dirty++;
+void MarkChunkDecorated(Chunk *c) {
+	AtomicStore(&c->decorated, 1);
 }
 
-Chunk *GetChunk(int x, int y, int z) {
-	return &world.chunks[x][z][y];
+b32 IsChunkDecorated(Chunk *c) {
+	return AtomicLoad(&c->decorated);
 }
 
-b32 AnyChunkDirty() {
-	return global_dirty > 0;
+b32 IsBlockDecorated(int x, int y, int z) {
+	if_unlikely(x < 0 || y < 0 || z < 0) {
+		return 1;
+	}
+
+	int cx = x / CHUNK_X;
+	int cy = y / CHUNK_Y;
+	int cz = z / CHUNK_Z;
+
+	if_unlikely(cx >= WORLD_CHUNK_COUNT_X || cy >= WORLD_CHUNK_COUNT_Y || cz >= WORLD_CHUNK_COUNT_Z) {
+		return 1;
+	}
+
+	return IsChunkDecorated(&world.chunks[cx][cz][cy]);
 }
 
-void ResetChunkDirtiness() {
-	global_dirty = 0;
+void MarkChunkDirty(Chunk *c) {
+	AtomicStore(&c->dirty, 1);
+	AtomicIncrement(&global_dirty);
 }
 
-float GetGroundLevel(vec3 pos) {
-	int cx = int(pos.x) / CHUNK_X;
-	int cy = int(pos.y) / CHUNK_Y;
-	int cz = int(pos.z) / CHUNK_Z;
+b32 QueueBlockEdit(BlockRef ref, Block block) {
+	u32 write = block_edits.write;
+	u32 read = AtomicLoad(&block_edits.read);
 
-	int bx = int(pos.x) % CHUNK_X;
-	int by = int(pos.y) % CHUNK_Y;
-	int bz = int(pos.z) % CHUNK_Z;
+	if (write - read >= BLOCK_EDIT_QUEUE_SIZE) {
+		return 0;
+	}
+
+	block_edits.edits[write % BLOCK_EDIT_QUEUE_SIZE] = { ref, block };
+	AtomicStore(&block_edits.write, write + 1);
 
-	Chunk *cys = world.chunks[cx][cz];
-	for (int ccy = cy; ccy >= 0; --ccy) {
-		Chunk *c = &cys[ccy];
-		Block *bys = c->blocks[bx][bz];
-		for (int bby = by; bby >= 0; --bby) {
-			if (bys[bby] != BLOCK_AIR) {
-				return bby + 1;
+	return 1;
+}
+
+internal u32 ApplyQueuedBlockEdits(u32 max_count, b32 wait) {
+	PROFILE_FUNCTION();
+
+	u32 read = block_edits.read;
+	u32 write = AtomicLoad(&block_edits.write);
+	u32 start = read;
+	u32 end = read + Min(write - read, max_count);
+
+	if (read == end) {
+		return 0;
+	}
+
+	if (wait) {
+		LockChunkEdits();
+	} else if (!TryLockChunkEdits()) {
+		// the render thread is starting jobs, all of them wait for the next tick
+		return 0;
+	}
+
+	// an edit that has to wait holds back the ones behind it too, so edits
+	// of the same block keep their order
+	for (; read != end; ++read) {
+		BlockEdit *edit = &block_edits.edits[read % BLOCK_EDIT_QUEUE_SIZE];
+		if (!IsChunkEditable(edit->ref.c)) {
+			if (!wait) {
+				break;
+			}
+
+			// no job starts while the edits are locked, only the running ones
+			// have to finish
+			while (!IsChunkEditable(edit->ref.c)) {
+				SleepMs(0);
 			}
 		}
+
+		PlaceBlock(edit->ref, edit->block);
 	}
 
-	return 0;
+	UnlockChunkEdits();
+
+	AtomicStore(&block_edits.read, read);
+
+	return read - start;
+}
+
+u32 ApplyBlockEdits() {
+	return ApplyQueuedBlockEdits(BLOCK_EDIT_QUEUE_SIZE, 0);
+}
+
+u32 ApplyBlockEditsWaiting(u32 count) {
+	return ApplyQueuedBlockEdits(count, 1);
+}
+
+Chunk *GetChunk(int x, int y, int z) {
+	return &world.chunks[x][z][y];
+}
+
+b32 AnyChunkDirty() {
+	return AtomicLoad(&global_dirty) > 0;
+}
+
+void ResetChunkDirtiness() {
+	AtomicStore(&global_dirty, 0);
 }
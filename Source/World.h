@@ -65,7 +65,16 @@ struct Chunk {
 	InstanceData *cached_instance_data;
 	u32 instance_count;
 	u32 water_instance_count;
-	b8 dirty;
+	// set by whoever changes the blocks, cleared by the pipeline when it
+	// starts meshing the chunk
+	volatile u32 dirty;
+	// once set no job writes the blocks anymore, only edits change them
+	volatile u32 decorated;
+
+	// written by the mesh job, moved into cached_instance_data by the upload stage
+	InstanceData *pending_instance_data;
+	u32 pending_instance_count;
+	u32 pending_water_instance_count;
 };
 
 struct World {
@@ -79,15 +88,53 @@ struct BlockRef {
 	int bz;
 };
 
+enum {
+	BLOCK_EDIT_QUEUE_SIZE = 256
+};
+
+struct BlockEdit {
+	BlockRef ref;
+	Block block;
+};
+
+// Filled and drained by the simulation, edits wait in it while their chunk is
+// busy.
+struct BlockEditQueue {
+	BlockEdit edits[BLOCK_EDIT_QUEUE_SIZE];
+	volatile u32 read;
+	volatile u32 write;
+};
+
 BlockRef GetBlockRef(vec3 pos);
 Block GetBlock(int x, int y, int z);
 Block GetBlock(BlockRef ref);
+b32 IsSolidBlock(Block b);
 
 void PlaceBlock(BlockRef ref, Block block);
 void PlaceBlock(Chunk *c, int x, int y, int z, Block block);
+void MarkChunkDirty(Chunk *c);
+void MarkChunkDecorated(Chunk *c);
+// Blocks of chunks that aren't decorated yet are only read by the jobs
+// building them, everyone else checks first. Outside the world counts as
+// decorated.
+b32 IsChunkDecorated(Chunk *c);
+b32 IsBlockDecorated(int x, int y, int z);
+
+// Edits made by the simulation are queued and applied at the start of its next
+// tick, so it is the only thread that changes blocks after decoration and it
+// collides against them without racing anyone. An edit whose chunk a job is
+// still writing, meshing or reading from a neighbour stays queued for the next
+// tick, together with the edits behind it, and so do all of them if the render
+// thread is starting jobs right then.
+b32 QueueBlockEdit(BlockRef ref, Block block);
+// Returns the number of edits applied.
+u32 ApplyBlockEdits();
+// Applies the next count edits (or as many as are queued) and waits for the
+// jobs on their chunks instead of leaving them queued, so a replay applies
+// them on the tick the recording did. Only on the thread scheduling the chunk
+// jobs of a flushed world, anywhere else the chunks may not get there.
+u32 ApplyBlockEditsWaiting(u32 count);
 
 Chunk *GetChunk(int x, int y, int z);
 b32 AnyChunkDirty();
 void ResetChunkDirtiness();
-
-float GetGroundLevel(vec3 pos);